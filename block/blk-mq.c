@@ -33,6 +33,7 @@ static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
 
 static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx);
+static void blk_mq_kick_hw_queue(struct blk_mq_hw_ctx *hctx);
 
 /*
  * Check if any of the ctx's have pending work in this hardware queue
@@ -247,7 +248,7 @@ struct request *blk_mq_alloc_request(struct request_queue *q, int rw, gfp_t gfp,
 
 	rq = __blk_mq_alloc_request(&alloc_data, rw);
 	if (!rq && (gfp & __GFP_WAIT)) {
-		__blk_mq_run_hw_queue(hctx);
+		blk_mq_kick_hw_queue(hctx);
 		blk_mq_put_ctx(ctx);
 
 		ctx = blk_mq_get_ctx(q);
@@ -772,11 +773,19 @@ static int blk_mq_hctx_next_cpu(struct blk_mq_hw_ctx *hctx)
 	return cpu;
 }
 
+/*
+ * Callers may have preemption disabled, so a queue whose ->queue_rq() can
+ * sleep is always run from kblockd here.  Submitters run it directly, see
+ * blk_mq_run_submitted().
+ */
 void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
 {
 	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
 		return;
 
+	if (hctx->flags & BLK_MQ_F_BLOCKING)
+		async = true;
+
 	if (!async && cpumask_test_cpu(smp_processor_id(), hctx->cpumask))
 		__blk_mq_run_hw_queue(hctx);
 	else if (hctx->queue->nr_hw_queues == 1)
@@ -789,6 +798,42 @@ void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
 	}
 }
 
+/*
+ * Run @hctx while holding a software queue, e.g. to free up tags before
+ * waiting for one.
+ */
+static void blk_mq_kick_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	if (hctx->flags & BLK_MQ_F_BLOCKING)
+		blk_mq_run_hw_queue(hctx, true);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+
+/*
+ * Run @hctx for a request the submitter just queued on @ctx, and let go of
+ * @ctx.  A queue whose ->queue_rq() can sleep is run from the submitting
+ * task once @ctx is released, rather than bounced through kblockd.
+ */
+static void blk_mq_run_submitted(struct blk_mq_hw_ctx *hctx,
+				 struct blk_mq_ctx *ctx, bool async)
+{
+	if (async || !(hctx->flags & BLK_MQ_F_BLOCKING)) {
+		blk_mq_run_hw_queue(hctx, async);
+		blk_mq_put_ctx(ctx);
+		return;
+	}
+
+	blk_mq_put_ctx(ctx);
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (cpumask_test_cpu(raw_smp_processor_id(), hctx->cpumask))
+		__blk_mq_run_hw_queue(hctx);
+	else
+		blk_mq_run_hw_queue(hctx, true);
+}
+
 void blk_mq_run_queues(struct request_queue *q, bool async)
 {
 	struct blk_mq_hw_ctx *hctx;
@@ -1100,7 +1145,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 			hctx);
 	rq = __blk_mq_alloc_request(&alloc_data, rw);
 	if (unlikely(!rq)) {
-		__blk_mq_run_hw_queue(hctx);
+		blk_mq_kick_hw_queue(hctx);
 		blk_mq_put_ctx(ctx);
 		trace_block_sleeprq(q, bio, rw);
 
@@ -1148,7 +1193,11 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		goto run_queue;
 	}
 
-	if (is_sync) {
+	/*
+	 * Queues that may sleep in ->queue_rq() get their sync IO dispatched
+	 * once the software queue is released, see blk_mq_run_submitted().
+	 */
+	if (is_sync && !(data.hctx->flags & BLK_MQ_F_BLOCKING)) {
 		int ret;
 
 		blk_mq_bio_to_request(rq, bio);
@@ -1180,7 +1229,9 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		 * dispatching.
 		 */
 run_queue:
-		blk_mq_run_hw_queue(data.hctx, !is_sync || is_flush_fua);
+		blk_mq_run_submitted(data.hctx, data.ctx,
+				     !is_sync || is_flush_fua);
+		return;
 	}
 done:
 	blk_mq_put_ctx(data.ctx);
@@ -1255,7 +1306,9 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 		 * dispatching.
 		 */
 run_queue:
-		blk_mq_run_hw_queue(data.hctx, !is_sync || is_flush_fua);
+		blk_mq_run_submitted(data.hctx, data.ctx,
+				     !is_sync || is_flush_fua);
+		return;
 	}
 
 	blk_mq_put_ctx(data.ctx);
@@ -21,8 +21,10 @@
  */
 #include <linux/async_tx.h>
 #include <linux/gfp.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/random.h>
+#include <linux/slab.h>
 #include <linux/module.h>
 
 #undef pr
@@ -30,6 +32,11 @@
 
 #define NDISKS 64 /* Including P and Q */
 
+/* throughput run: this many independent stripes in flight per round */
+#define BENCH_DISKS 16
+#define BENCH_STRIPES 32
+#define BENCH_ROUNDS 64
+
 static struct page *dataptrs[NDISKS];
 static addr_conv_t addr_conv[NDISKS];
 static struct page *data[NDISKS+3];
@@ -192,6 +199,90 @@ static int test(int disks, int *tests)
 }
 
 
+static atomic_t bench_pending;
+static struct completion bench_done;
+
+static void bench_callback(void *param)
+{
+	if (atomic_dec_and_test(&bench_pending))
+		complete(&bench_done);
+}
+
+/* Time xor (raid5) or p+q (raid6) of BENCH_STRIPES stripes at a time. */
+static void bench_op(struct page *(*stripes)[BENCH_DISKS], bool pq)
+{
+	struct dma_async_tx_descriptor *tx;
+	struct async_submit_ctl submit;
+	bool async = false;
+	ktime_t start;
+	u64 bytes, ns;
+	int r, s;
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		atomic_set(&bench_pending, BENCH_STRIPES);
+		reinit_completion(&bench_done);
+
+		for (s = 0; s < BENCH_STRIPES; s++) {
+			if (pq) {
+				init_async_submit(&submit, ASYNC_TX_ACK, NULL,
+						  bench_callback, NULL,
+						  addr_conv);
+				tx = async_gen_syndrome(stripes[s], 0,
+							BENCH_DISKS, PAGE_SIZE,
+							&submit);
+			} else {
+				init_async_submit(&submit, ASYNC_TX_ACK |
+						  ASYNC_TX_XOR_ZERO_DST, NULL,
+						  bench_callback, NULL,
+						  addr_conv);
+				tx = async_xor(stripes[s][BENCH_DISKS-2],
+					       stripes[s], 0, BENCH_DISKS-2,
+					       PAGE_SIZE, &submit);
+			}
+			async |= tx != NULL;
+		}
+		async_tx_issue_pending_all();
+		wait_for_completion(&bench_done);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	bytes = (u64)BENCH_ROUNDS * BENCH_STRIPES * (BENCH_DISKS-2) * PAGE_SIZE;
+	pr("%s: %d disks, %d stripes in flight: %llu MB/s (%s)\n",
+	   pq ? "gen_syndrome" : "xor", BENCH_DISKS, BENCH_STRIPES,
+	   div64_u64((bytes * NSEC_PER_SEC) >> 20, ns ? ns : 1),
+	   async ? "async" : "sync");
+}
+
+static void raid6_bench(void)
+{
+	struct page *(*stripes)[BENCH_DISKS];
+	int i, j;
+
+	stripes = kcalloc(BENCH_STRIPES, sizeof(*stripes), GFP_KERNEL);
+	if (!stripes)
+		return;
+
+	for (i = 0; i < BENCH_STRIPES; i++)
+		for (j = 0; j < BENCH_DISKS; j++) {
+			stripes[i][j] = alloc_page(GFP_KERNEL);
+			if (!stripes[i][j])
+				goto out;
+			prandom_bytes(page_address(stripes[i][j]), PAGE_SIZE);
+		}
+
+	init_completion(&bench_done);
+	bench_op(stripes, false);
+	bench_op(stripes, true);
+
+out:
+	for (i = 0; i < BENCH_STRIPES; i++)
+		for (j = 0; j < BENCH_DISKS; j++)
+			if (stripes[i][j])
+				put_page(stripes[i][j]);
+	kfree(stripes);
+}
+
 static int raid6_test(void)
 {
 	int err = 0;
@@ -233,6 +324,8 @@ static int raid6_test(void)
 	pr("complete (%d tests, %d failure%s)\n",
 	   tests, err, err == 1 ? "" : "s");
 
+	raid6_bench();
+
 	for (i = 0; i < NDISKS+3; i++)
 		put_page(data[i]);
 
@@ -63,6 +63,10 @@ struct driver_private {
  *	binding of drivers which were unable to get all the resources needed by
  *	the device; typically because it depends on another driver getting
  *	probed first.
+ * @probe_time_ns - time spent in the driver's probe routine, summed over
+ *	every attempt including deferred ones.
+ * @probe_deferrals - number of times a probe of this device returned
+ *	-EPROBE_DEFER.
  * @device - pointer back to the struct class that this structure is
  * associated with.
  *
@@ -74,6 +78,8 @@ struct device_private {
 	struct klist_node knode_driver;
 	struct klist_node knode_bus;
 	struct list_head deferred_probe;
+	u64 probe_time_ns;
+	unsigned int probe_deferrals;
 	struct device *device;
 };
 #define to_device_private_parent(obj)	\
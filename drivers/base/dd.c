@@ -25,6 +25,9 @@
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
 #include <linux/pinctrl/devinfo.h>
+#include <linux/of.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -41,9 +44,13 @@
  *
  * Deferred probe maintains two lists of devices, a pending list and an active
  * list.  A driver returning -EPROBE_DEFER causes the device to be added to the
- * pending list.  A successful driver probe will trigger moving all devices
- * from the pending to the active list so that the workqueue will eventually
- * retry them.
+ * pending list.  A successful driver probe moves the pending devices that may
+ * depend on the newly bound device to the active list so that the workqueue
+ * will retry them; on a device tree system that is decided from the phandles
+ * a device's node refers to.  Because that can't see every dependency, a
+ * targeted trigger also schedules a full sweep of the pending list a short
+ * while later.  The workqueue retries the devices of the active list in
+ * parallel unless "deferred_probe_serial" is given on the command line.
  *
  * The deferred_probe_mutex must be held any time the deferred_probe_*_list
  * of the (struct device*)->p->deferred_probe pointers are manipulated
@@ -53,6 +60,27 @@ static LIST_HEAD(deferred_probe_pending_list);
 static LIST_HEAD(deferred_probe_active_list);
 static struct workqueue_struct *deferred_wq;
 static atomic_t deferred_trigger_count = ATOMIC_INIT(0);
+static ASYNC_DOMAIN_EXCLUSIVE(deferred_probe_domain);
+static bool deferred_probe_serial;
+
+/* Longest a pending device waits for a full sweep after a targeted trigger */
+#define DEFERRED_PROBE_SWEEP_DELAY	(HZ / 10)
+
+static int __init deferred_probe_serial_setup(char *arg)
+{
+	deferred_probe_serial = true;
+	return 0;
+}
+early_param("deferred_probe_serial", deferred_probe_serial_setup);
+
+static void deferred_probe_one(void *data, async_cookie_t cookie)
+{
+	struct device *dev = data;
+
+	dev_dbg(dev, "Retrying from deferred list\n");
+	bus_probe_device(dev);
+	put_device(dev);
+}
 
 /*
  * deferred_probe_work_func() - Retry probing devices in the active list.
@@ -63,9 +91,12 @@ static void deferred_probe_work_func(struct work_struct *work)
 	struct device_private *private;
 	/*
 	 * This block processes every device in the deferred 'active' list.
-	 * Each device is removed from the active list and passed to
-	 * bus_probe_device() to re-attempt the probe.  The loop continues
-	 * until every device in the active list is removed and retried.
+	 * Each device is removed from the active list and handed to
+	 * bus_probe_device() to re-attempt the probe, either directly or from
+	 * the async domain so that independent devices probe concurrently.
+	 * The loop continues until every device in the active list is removed;
+	 * the work then waits for the retries it started.  Devices activated
+	 * by those probes requeue the work and are picked up by the next run.
 	 *
 	 * Note: Once the device is removed from the list and the mutex is
 	 * released, it is possible for the device get freed by another thread
@@ -98,14 +129,17 @@ static void deferred_probe_work_func(struct work_struct *work)
 		device_pm_move_last(dev);
 		device_pm_unlock();
 
-		dev_dbg(dev, "Retrying from deferred list\n");
-		bus_probe_device(dev);
+		if (deferred_probe_serial)
+			deferred_probe_one(dev, 0);
+		else
+			async_schedule_domain(deferred_probe_one, dev,
+					      &deferred_probe_domain);
 
 		mutex_lock(&deferred_probe_mutex);
-
-		put_device(dev);
 	}
 	mutex_unlock(&deferred_probe_mutex);
+
+	async_synchronize_full_domain(&deferred_probe_domain);
 }
 static DECLARE_WORK(deferred_probe_work, deferred_probe_work_func);
 
@@ -129,13 +163,142 @@ void driver_deferred_probe_del(struct device *dev)
 	mutex_unlock(&deferred_probe_mutex);
 }
 
+#ifdef CONFIG_OF
+/* More phandles than this under a supplier's node retry every DT device */
+#define DEFERRED_SUPPLIER_PHANDLES	32
+/* How far below the supplier's node consumers may point, e.g. pin groups */
+#define DEFERRED_SUPPLIER_DEPTH		2
+
+struct deferred_supplier {
+	struct device_node *np;
+	phandle phandles[DEFERRED_SUPPLIER_PHANDLES];
+	unsigned int nr;
+	bool overflow;
+};
+
+static void deferred_supplier_collect(struct deferred_supplier *s,
+				      struct device_node *np, int depth)
+{
+	struct device_node *child;
+
+	if (np->phandle) {
+		if (s->nr == DEFERRED_SUPPLIER_PHANDLES) {
+			s->overflow = true;
+			return;
+		}
+		s->phandles[s->nr++] = np->phandle;
+	}
+
+	if (!depth)
+		return;
+
+	for_each_child_of_node(np, child) {
+		deferred_supplier_collect(s, child, depth - 1);
+		if (s->overflow) {
+			of_node_put(child);
+			return;
+		}
+	}
+}
+
+static void deferred_supplier_init(struct deferred_supplier *s,
+				   struct device *supplier)
+{
+	s->np = supplier ? supplier->of_node : NULL;
+	s->nr = 0;
+	s->overflow = false;
+	if (s->np)
+		deferred_supplier_collect(s, s->np, DEFERRED_SUPPLIER_DEPTH);
+}
+
+/*
+ * Look for any of the supplier's phandles in the cells of @np's properties.
+ * Plain numbers can collide with a phandle, which only costs a retry.
+ */
+static bool deferred_node_refers_to(struct device_node *np,
+				    const struct deferred_supplier *s)
+{
+	struct property *pp;
+	const __be32 *cell;
+	unsigned int i, n;
+	phandle ph;
+
+	for_each_property_of_node(np, pp) {
+		cell = pp->value;
+		for (n = pp->length / sizeof(*cell); n; n--) {
+			ph = be32_to_cpup(cell++);
+			for (i = 0; i < s->nr; i++)
+				if (ph == s->phandles[i])
+					return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * deferred_probe_may_depend() - Could @dev have been waiting for the supplier?
+ *
+ * Devices without a DT node can't be reasoned about and are always retried.
+ * A DT device is retried if its node or one of its direct children points at
+ * the supplier's node or a node below it, or if it sits below the supplier.
+ */
+static bool deferred_probe_may_depend(struct device *dev,
+				      const struct deferred_supplier *s)
+{
+	struct device_node *np = dev->of_node, *child, *parent;
+
+	if (!np)
+		return true;
+	if (!s->np)
+		return false;
+	if (s->overflow)
+		return true;
+
+	for (parent = np->parent; parent; parent = parent->parent)
+		if (parent == s->np)
+			return true;
+
+	if (deferred_node_refers_to(np, s))
+		return true;
+
+	for_each_child_of_node(np, child) {
+		if (deferred_node_refers_to(child, s)) {
+			of_node_put(child);
+			return true;
+		}
+	}
+	return false;
+}
+#else
+struct deferred_supplier { };
+
+static inline void deferred_supplier_init(struct deferred_supplier *s,
+					  struct device *supplier)
+{
+}
+
+static inline bool deferred_probe_may_depend(struct device *dev,
+					     const struct deferred_supplier *s)
+{
+	return true;
+}
+#endif
+
 static bool driver_deferred_probe_enable = false;
+static void deferred_probe_sweep_func(struct work_struct *work);
+static DECLARE_DELAYED_WORK(deferred_probe_sweep_work,
+			    deferred_probe_sweep_func);
+
 /**
  * driver_deferred_probe_trigger() - Kick off re-probing deferred devices
+ * @supplier: device that was just bound, or %NULL to retry every device
  *
- * This functions moves all devices from the pending list to the active
- * list and schedules the deferred probe workqueue to process them.  It
- * should be called anytime a driver is successfully bound to a device.
+ * This functions moves the pending devices that may depend on @supplier to
+ * the active list and schedules the deferred probe workqueue to process
+ * them.  It should be called anytime a driver is successfully bound to a
+ * device.  Since the dependency check is only a guess, it also arranges for
+ * a full sweep of the pending list within DEFERRED_PROBE_SWEEP_DELAY; a burst
+ * of binds thus costs one sweep rather than one per bind.
  *
  * Note, there is a race condition in multi-threaded probe. In the case where
  * more than one device is probing at the same time, it is possible for one
@@ -145,23 +308,34 @@ static bool driver_deferred_probe_enable = false;
  *
  * The atomic 'deferred_trigger_count' is used to determine if a successful
  * trigger has occurred in the midst of probing a driver. If the trigger count
- * changes in the midst of a probe, then deferred processing should be triggered
- * again.
+ * changes in the midst of a probe, then the device is retried straight away
+ * by driver_deferred_probe_retry().
  */
-static void driver_deferred_probe_trigger(void)
+static void driver_deferred_probe_trigger(struct device *supplier)
 {
+	struct device_private *private, *next;
+	struct deferred_supplier s;
+
 	if (!driver_deferred_probe_enable)
 		return;
 
-	/*
-	 * A successful probe means that all the devices in the pending list
-	 * should be triggered to be reprobed.  Move all the deferred devices
-	 * into the active list so they can be retried by the workqueue
-	 */
+	/* Walk the supplier's nodes before taking the mutex */
+	if (supplier)
+		deferred_supplier_init(&s, supplier);
+
 	mutex_lock(&deferred_probe_mutex);
 	atomic_inc(&deferred_trigger_count);
-	list_splice_tail_init(&deferred_probe_pending_list,
-			      &deferred_probe_active_list);
+	if (!supplier) {
+		list_splice_tail_init(&deferred_probe_pending_list,
+				      &deferred_probe_active_list);
+	} else {
+		list_for_each_entry_safe(private, next,
+					 &deferred_probe_pending_list,
+					 deferred_probe)
+			if (deferred_probe_may_depend(private->device, &s))
+				list_move_tail(&private->deferred_probe,
+					       &deferred_probe_active_list);
+	}
 	mutex_unlock(&deferred_probe_mutex);
 
 	/*
@@ -169,12 +343,38 @@ static void driver_deferred_probe_trigger(void)
 	 * safe to kick it again.
 	 */
 	queue_work(deferred_wq, &deferred_probe_work);
+	if (supplier)
+		queue_delayed_work(deferred_wq, &deferred_probe_sweep_work,
+				   DEFERRED_PROBE_SWEEP_DELAY);
+}
+
+static void deferred_probe_sweep_func(struct work_struct *work)
+{
+	driver_deferred_probe_trigger(NULL);
+}
+
+/*
+ * driver_deferred_probe_retry() - Retry @dev, which deferred while a trigger
+ * ran, without waiting for the next sweep.
+ */
+static void driver_deferred_probe_retry(struct device *dev)
+{
+	if (!driver_deferred_probe_enable)
+		return;
+
+	mutex_lock(&deferred_probe_mutex);
+	if (!list_empty(&dev->p->deferred_probe))
+		list_move_tail(&dev->p->deferred_probe,
+			       &deferred_probe_active_list);
+	mutex_unlock(&deferred_probe_mutex);
+
+	queue_work(deferred_wq, &deferred_probe_work);
 }
 
 static void enable_trigger_defer_cycle(void)
 {
 	driver_deferred_probe_enable = true;
-	driver_deferred_probe_trigger();
+	driver_deferred_probe_trigger(NULL);
 	/*
 	 * Sort as many dependencies as possible before the next initcall
 	 * level
@@ -215,6 +415,83 @@ static int deferred_probe_enable_fn(void)
 }
 late_initcall(deferred_probe_enable_fn);
 
+#define PROBE_REPORT_ENTRIES	10
+
+struct probe_report_entry {
+	char name[32];
+	u64 value;
+};
+
+/* Keep @top sorted by decreasing value, dropping the smallest entry. */
+static void probe_report_insert(struct probe_report_entry *top,
+				struct device *dev, u64 value)
+{
+	int i = PROBE_REPORT_ENTRIES - 1;
+
+	if (!value || value <= top[i].value)
+		return;
+
+	for (; i > 0 && top[i - 1].value < value; i--)
+		top[i] = top[i - 1];
+	strlcpy(top[i].name, dev_name(dev), sizeof(top[i].name));
+	top[i].value = value;
+}
+
+/*
+ * probe_report() - Summarise boot time probing once deferred probing settled.
+ *
+ * Prints the devices that spent the longest in their probe routines, the
+ * ones that deferred most often and those still waiting on the deferred list.
+ */
+static int probe_report(void)
+{
+	struct probe_report_entry *slow, *deferred;
+	struct device_private *private;
+	unsigned int devices = 0, deferrals = 0;
+	struct kobject *kobj;
+	struct device *dev;
+	u64 total_ns = 0;
+	int i;
+
+	slow = kcalloc(2 * PROBE_REPORT_ENTRIES, sizeof(*slow), GFP_KERNEL);
+	if (!slow)
+		return -ENOMEM;
+	deferred = slow + PROBE_REPORT_ENTRIES;
+
+	spin_lock(&devices_kset->list_lock);
+	list_for_each_entry(kobj, &devices_kset->list, entry) {
+		dev = container_of(kobj, struct device, kobj);
+		if (!dev->p || !dev->p->probe_time_ns)
+			continue;
+		devices++;
+		total_ns += dev->p->probe_time_ns;
+		deferrals += dev->p->probe_deferrals;
+		probe_report_insert(slow, dev, dev->p->probe_time_ns);
+		probe_report_insert(deferred, dev, dev->p->probe_deferrals);
+	}
+	spin_unlock(&devices_kset->list_lock);
+
+	pr_info("probe: %u devices probed in %llu ms, %u deferrals\n",
+		devices, div_u64(total_ns, NSEC_PER_MSEC), deferrals);
+	for (i = 0; i < PROBE_REPORT_ENTRIES && slow[i].value; i++)
+		pr_info("probe: %-32s %6llu us\n", slow[i].name,
+			div_u64(slow[i].value, NSEC_PER_USEC));
+	for (i = 0; i < PROBE_REPORT_ENTRIES && deferred[i].value; i++)
+		pr_info("probe: %-32s %6llu deferrals\n", deferred[i].name,
+			deferred[i].value);
+
+	mutex_lock(&deferred_probe_mutex);
+	list_for_each_entry(private, &deferred_probe_pending_list,
+			    deferred_probe)
+		pr_info("probe: %s still deferred\n",
+			dev_name(private->device));
+	mutex_unlock(&deferred_probe_mutex);
+
+	kfree(slow);
+	return 0;
+}
+late_initcall_sync(probe_report);
+
 static void driver_bound(struct device *dev)
 {
 	if (klist_node_attached(&dev->p->knode_driver)) {
@@ -230,10 +507,10 @@ static void driver_bound(struct device *dev)
 
 	/*
 	 * Make sure the device is no longer in one of the deferred lists and
-	 * kick off retrying all pending devices
+	 * kick off retrying the pending devices that may have waited for it
 	 */
 	driver_deferred_probe_del(dev);
-	driver_deferred_probe_trigger();
+	driver_deferred_probe_trigger(dev);
 
 	if (dev->bus)
 		blocking_notifier_call_chain(&dev->bus->p->bus_notifier,
@@ -302,6 +579,7 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 {
 	int ret = 0;
 	int local_trigger_count = atomic_read(&deferred_trigger_count);
+	ktime_t calltime;
 
 	atomic_inc(&probe_count);
 	pr_debug("bus: '%s': %s: probing driver %s with device %s\n",
@@ -321,15 +599,14 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 		goto probe_failed;
 	}
 
-	if (dev->bus->probe) {
+	calltime = ktime_get();
+	if (dev->bus->probe)
 		ret = dev->bus->probe(dev);
-		if (ret)
-			goto probe_failed;
-	} else if (drv->probe) {
+	else if (drv->probe)
 		ret = drv->probe(dev);
-		if (ret)
-			goto probe_failed;
-	}
+	dev->p->probe_time_ns += ktime_to_ns(ktime_sub(ktime_get(), calltime));
+	if (ret)
+		goto probe_failed;
 
 	driver_bound(dev);
 	ret = 1;
@@ -346,10 +623,11 @@ probe_failed:
 	if (ret == -EPROBE_DEFER) {
 		/* Driver requested deferred probing */
 		dev_dbg(dev, "Driver %s requests probe deferral\n", drv->name);
+		dev->p->probe_deferrals++;
 		driver_deferred_probe_add(dev);
-		/* Did a trigger occur while probing? Need to re-trigger if yes */
+		/* Did a trigger occur while probing? Need to retry if yes */
 		if (local_trigger_count != atomic_read(&deferred_trigger_count))
-			driver_deferred_probe_trigger();
+			driver_deferred_probe_retry(dev);
 	} else if (ret != -ENODEV && ret != -ENXIO) {
 		/* driver matched but the probe failed */
 		printk(KERN_WARNING
@@ -395,6 +673,8 @@ void wait_for_device_probe(void)
 	/* wait for the known devices to complete their probing */
 	wait_event(probe_waitqueue, atomic_read(&probe_count) == 0);
 	async_synchronize_full();
+	/* and for the deferred retries, which run in their own domain */
+	flush_work(&deferred_probe_work);
 }
 EXPORT_SYMBOL_GPL(wait_for_device_probe);
 
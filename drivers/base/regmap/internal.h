@@ -17,6 +17,8 @@
 #include <linux/fs.h>
 #include <linux/list.h>
 #include <linux/wait.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
 
 struct regmap;
 struct regcache_ops;
@@ -29,6 +31,16 @@ struct regmap_debugfs_off_cache {
 	unsigned int max_reg;
 };
 
+/* Per-CPU counters behind the debugfs "stats" file */
+struct regmap_stats {
+	unsigned long cache_hits;
+	unsigned long cache_lockless_hits;
+	unsigned long cache_misses;
+	unsigned long bus_reads;
+	unsigned long bus_writes;
+	unsigned long coalesced_writes;
+};
+
 struct regmap_format {
 	size_t buf_size;
 	size_t reg_bytes;
@@ -83,6 +95,8 @@ struct regmap {
 
 	struct list_head debugfs_off_cache;
 	struct mutex cache_lock;
+
+	struct regmap_stats __percpu *stats;
 #endif
 
 	unsigned int max_register;
@@ -153,6 +167,13 @@ struct regcache_ops {
 	void (*debugfs_init)(struct regmap *map);
 #endif
 	int (*read)(struct regmap *map, unsigned int reg, unsigned int *value);
+	/*
+	 * Optional: look a register up without map->lock held, called
+	 * under rcu_read_lock().  Any error makes the caller retry with
+	 * the lock held, so it may give up whenever a writer interferes.
+	 */
+	int (*read_lockless)(struct regmap *map, unsigned int reg,
+			     unsigned int *value);
 	int (*write)(struct regmap *map, unsigned int reg, unsigned int value);
 	int (*sync)(struct regmap *map, unsigned int min, unsigned int max);
 	int (*drop)(struct regmap *map, unsigned int min, unsigned int max);
@@ -193,6 +214,24 @@ struct regmap_field {
 	unsigned int id_offset;
 };
 
+#ifdef CONFIG_DEBUG_FS
+/* The counters may go away under us; regmap_debugfs_exit() waits for RCU */
+#define regmap_stat_add(map, field, n)				\
+	do {							\
+		struct regmap_stats __percpu *__st;		\
+								\
+		rcu_read_lock();				\
+		__st = rcu_dereference_raw((map)->stats);	\
+		if (__st)					\
+			this_cpu_add(__st->field, (n));		\
+		rcu_read_unlock();				\
+	} while (0)
+#define regmap_stat_inc(map, field) regmap_stat_add(map, field, 1)
+#else
+#define regmap_stat_inc(map, field) do { } while (0)
+#define regmap_stat_add(map, field, n) do { } while (0)
+#endif
+
 #ifdef CONFIG_DEBUG_FS
 extern void regmap_debugfs_initcall(void);
 extern void regmap_debugfs_init(struct regmap *map, const char *name);
@@ -208,6 +247,8 @@ int regcache_init(struct regmap *map, const struct regmap_config *config);
 void regcache_exit(struct regmap *map);
 int regcache_read(struct regmap *map,
 		       unsigned int reg, unsigned int *value);
+int regcache_read_lockless(struct regmap *map,
+			   unsigned int reg, unsigned int *value);
 int regcache_write(struct regmap *map,
 			unsigned int reg, unsigned int value);
 int regcache_sync(struct regmap *map);
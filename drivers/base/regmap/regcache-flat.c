@@ -52,6 +52,20 @@ static int regcache_flat_read(struct regmap *map,
 	return 0;
 }
 
+/* Every slot is a single word that is never moved, so no lock is needed. */
+static int regcache_flat_read_lockless(struct regmap *map,
+				       unsigned int reg, unsigned int *value)
+{
+	unsigned int *cache = map->cache;
+
+	if (reg > map->max_register)
+		return -ENOENT;
+
+	*value = ACCESS_ONCE(cache[reg]);
+
+	return 0;
+}
+
 static int regcache_flat_write(struct regmap *map, unsigned int reg,
 			       unsigned int value)
 {
@@ -68,5 +82,6 @@ struct regcache_ops regcache_flat_ops = {
 	.init = regcache_flat_init,
 	.exit = regcache_flat_exit,
 	.read = regcache_flat_read,
+	.read_lockless = regcache_flat_read_lockless,
 	.write = regcache_flat_write,
 };
@@ -14,6 +14,8 @@
 #include <linux/device.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/seq_file.h>
 
 #include "internal.h"
@@ -22,6 +24,14 @@ static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
 				 unsigned int value);
 static int regcache_rbtree_exit(struct regmap *map);
 
+/*
+ * Reads may walk the tree without map->lock, see
+ * regcache_rbtree_read_lockless().  To make that safe a node never
+ * changes its base register or length once it is in the tree: growing a
+ * block replaces the node, and the old one is freed after a grace
+ * period.  Every change to the tree or to a cached value happens inside
+ * the seqcount write section so that lockless readers can notice it.
+ */
 struct regcache_rbtree_node {
 	/* block of adjacent registers */
 	void *block;
@@ -33,13 +43,31 @@ struct regcache_rbtree_node {
 	unsigned int blklen;
 	/* the actual rbtree node holding this block */
 	struct rb_node node;
-} __attribute__ ((packed));
+	/* deferred free once the node has been replaced */
+	struct rcu_head rcu;
+};
+
+/*
+ * Size of a node before it gained @rcu and lost __packed.  A write that
+ * misses the cache extends a block up to this many bytes of registers
+ * away instead of allocating a node; keep the distance as it was.
+ */
+#define REGCACHE_RBTREE_NODE_COST \
+	(2 * sizeof(void *) + 2 * sizeof(unsigned int) + sizeof(struct rb_node))
 
 struct regcache_rbtree_ctx {
 	struct rb_root root;
 	struct regcache_rbtree_node *cached_rbnode;
+	seqcount_t seq;
 };
 
+/*
+ * An rbtree with 2^32 nodes is at most 64 levels deep, so a lockless walk
+ * that takes more steps than that has been sent in a circle by a
+ * concurrent rebalance.
+ */
+#define REGCACHE_RBTREE_MAX_DEPTH	64
+
 static inline void regcache_rbtree_get_base_top_reg(
 	struct regmap *map,
 	struct regcache_rbtree_node *rbnode,
@@ -127,7 +155,7 @@ static int regcache_rbtree_insert(struct regmap *map, struct rb_root *root,
 	}
 
 	/* insert the node into the rbtree */
-	rb_link_node(&rbnode->node, parent, new);
+	rb_link_node_rcu(&rbnode->node, parent, new);
 	rb_insert_color(&rbnode->node, root);
 
 	return 1;
@@ -209,6 +237,7 @@ static int regcache_rbtree_init(struct regmap *map)
 	rbtree_ctx = map->cache;
 	rbtree_ctx->root = RB_ROOT;
 	rbtree_ctx->cached_rbnode = NULL;
+	seqcount_init(&rbtree_ctx->seq);
 
 	for (i = 0; i < map->num_reg_defaults; i++) {
 		ret = regcache_rbtree_write(map,
@@ -273,60 +302,149 @@ static int regcache_rbtree_read(struct regmap *map,
 	return 0;
 }
 
+static bool regcache_rbtree_lockless_hit(struct regmap *map,
+					 struct regcache_rbtree_node *rbnode,
+					 unsigned int reg, unsigned int *value)
+{
+	unsigned int base_reg, top_reg, idx;
+
+	regcache_rbtree_get_base_top_reg(map, rbnode, &base_reg, &top_reg);
+	if (reg < base_reg || reg > top_reg)
+		return false;
+
+	idx = (reg - base_reg) / map->reg_stride;
+	if (!test_bit(idx, rbnode->cache_present))
+		return false;
+
+	*value = regcache_rbtree_get_register(map, rbnode, idx);
+	return true;
+}
+
+/*
+ * Look a register up without map->lock, under rcu_read_lock().  The
+ * walk never waits for a writer: if one is active, or has changed the
+ * tree by the time the value has been read, the caller falls back to the
+ * locked path.  Nodes are only freed after a grace period, so every
+ * pointer followed here stays valid even if it is stale.
+ */
+static int regcache_rbtree_read_lockless(struct regmap *map,
+					 unsigned int reg, unsigned int *value)
+{
+	struct regcache_rbtree_ctx *rbtree_ctx = map->cache;
+	struct regcache_rbtree_node *rbnode;
+	struct rb_node *node;
+	unsigned int base_reg, top_reg;
+	unsigned int seq;
+	bool found = false;
+	int depth;
+
+	seq = raw_read_seqcount(&rbtree_ctx->seq);
+	if (seq & 1)
+		return -EBUSY;
+
+	rbnode = rcu_dereference_raw(rbtree_ctx->cached_rbnode);
+	if (rbnode)
+		found = regcache_rbtree_lockless_hit(map, rbnode, reg, value);
+
+	node = rcu_dereference_raw(rbtree_ctx->root.rb_node);
+	for (depth = 0; !found && node; depth++) {
+		if (depth == REGCACHE_RBTREE_MAX_DEPTH)
+			return -EAGAIN;
+
+		rbnode = container_of(node, struct regcache_rbtree_node, node);
+		regcache_rbtree_get_base_top_reg(map, rbnode, &base_reg,
+						 &top_reg);
+		if (reg > top_reg)
+			node = rcu_dereference_raw(node->rb_right);
+		else if (reg < base_reg)
+			node = rcu_dereference_raw(node->rb_left);
+		else if (regcache_rbtree_lockless_hit(map, rbnode, reg, value))
+			found = true;
+		else
+			break;
+	}
+
+	if (read_seqcount_retry(&rbtree_ctx->seq, seq))
+		return -EAGAIN;
+
+	return found ? 0 : -ENOENT;
+}
 
-static int regcache_rbtree_insert_to_block(struct regmap *map,
-					   struct regcache_rbtree_node *rbnode,
-					   unsigned int base_reg,
-					   unsigned int top_reg,
-					   unsigned int reg,
-					   unsigned int value)
+static void regcache_rbtree_free_node(struct regcache_rbtree_node *rbnode)
 {
+	kfree(rbnode->cache_present);
+	kfree(rbnode->block);
+	kfree(rbnode);
+}
+
+static void regcache_rbtree_free_node_rcu(struct rcu_head *rcu)
+{
+	regcache_rbtree_free_node(container_of(rcu,
+					       struct regcache_rbtree_node,
+					       rcu));
+}
+
+/*
+ * Grow @rbnode to cover base_reg..top_reg and store @value for @reg in
+ * it.  The grown block is built in a new node that takes the place of
+ * @rbnode in the tree, since lockless readers may still be looking at
+ * the old one.  Returns the new node.
+ */
+static struct regcache_rbtree_node *
+regcache_rbtree_insert_to_block(struct regmap *map,
+				struct regcache_rbtree_node *rbnode,
+				unsigned int base_reg, unsigned int top_reg,
+				unsigned int reg, unsigned int value)
+{
+	struct regcache_rbtree_ctx *rbtree_ctx = map->cache;
+	struct regcache_rbtree_node *new;
 	unsigned int blklen;
 	unsigned int pos, offset;
-	unsigned long *present;
-	u8 *blk;
 
 	blklen = (top_reg - base_reg) / map->reg_stride + 1;
 	pos = (reg - base_reg) / map->reg_stride;
 	offset = (rbnode->base_reg - base_reg) / map->reg_stride;
 
-	blk = krealloc(rbnode->block,
-		       blklen * map->cache_word_size,
-		       GFP_KERNEL);
-	if (!blk)
-		return -ENOMEM;
+	new = kzalloc(sizeof(*new), map->alloc_flags);
+	if (!new)
+		return NULL;
 
-	if (BITS_TO_LONGS(blklen) > BITS_TO_LONGS(rbnode->blklen)) {
-		present = krealloc(rbnode->cache_present,
-				   BITS_TO_LONGS(blklen) * sizeof(*present),
-				   GFP_KERNEL);
-		if (!present) {
-			kfree(blk);
-			return -ENOMEM;
-		}
+	new->block = kmalloc(blklen * map->cache_word_size, map->alloc_flags);
+	if (!new->block)
+		goto err_free;
 
-		memset(present + BITS_TO_LONGS(rbnode->blklen), 0,
-		       (BITS_TO_LONGS(blklen) - BITS_TO_LONGS(rbnode->blklen))
-		       * sizeof(*present));
-	} else {
-		present = rbnode->cache_present;
-	}
+	new->cache_present = kzalloc(BITS_TO_LONGS(blklen) *
+				     sizeof(*new->cache_present),
+				     map->alloc_flags);
+	if (!new->cache_present)
+		goto err_free_block;
 
-	/* insert the register value in the correct place in the rbnode block */
-	if (pos == 0) {
-		memmove(blk + offset * map->cache_word_size,
-			blk, rbnode->blklen * map->cache_word_size);
-		bitmap_shift_left(present, present, offset, blklen);
-	}
+	/* copy the old block into its place in the new one */
+	memcpy(new->block + offset * map->cache_word_size, rbnode->block,
+	       rbnode->blklen * map->cache_word_size);
+	bitmap_copy(new->cache_present, rbnode->cache_present, rbnode->blklen);
+	if (offset)
+		bitmap_shift_left(new->cache_present, new->cache_present,
+				  offset, blklen);
 
-	/* update the rbnode block, its size and the base register */
-	rbnode->block = blk;
-	rbnode->blklen = blklen;
-	rbnode->base_reg = base_reg;
-	rbnode->cache_present = present;
+	new->blklen = blklen;
+	new->base_reg = base_reg;
+	regcache_rbtree_set_register(map, new, pos, value);
 
-	regcache_rbtree_set_register(map, rbnode, pos, value);
-	return 0;
+	/* make the new node visible only once it is complete */
+	smp_wmb();
+	rb_replace_node(&rbnode->node, &new->node, &rbtree_ctx->root);
+	if (rbtree_ctx->cached_rbnode == rbnode)
+		rbtree_ctx->cached_rbnode = new;
+	call_rcu(&rbnode->rcu, regcache_rbtree_free_node_rcu);
+
+	return new;
+
+err_free_block:
+	kfree(new->block);
+err_free:
+	kfree(new);
+	return NULL;
 }
 
 static struct regcache_rbtree_node *
@@ -380,14 +498,13 @@ err_free:
 	return NULL;
 }
 
-static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
-				 unsigned int value)
+static int __regcache_rbtree_write(struct regmap *map, unsigned int reg,
+				   unsigned int value)
 {
 	struct regcache_rbtree_ctx *rbtree_ctx;
 	struct regcache_rbtree_node *rbnode, *rbnode_tmp;
 	struct rb_node *node;
 	unsigned int reg_tmp;
-	int ret;
 
 	rbtree_ctx = map->cache;
 
@@ -404,7 +521,7 @@ static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
 		unsigned int min, max;
 		unsigned int max_dist;
 
-		max_dist = map->reg_stride * sizeof(*rbnode_tmp) /
+		max_dist = map->reg_stride * REGCACHE_RBTREE_NODE_COST /
 			map->cache_word_size;
 		if (reg < max_dist)
 			min = 0;
@@ -428,13 +545,22 @@ static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
 				continue;
 			}
 
-			ret = regcache_rbtree_insert_to_block(map, rbnode_tmp,
-							      new_base_reg,
-							      new_top_reg, reg,
-							      value);
-			if (ret)
-				return ret;
-			rbtree_ctx->cached_rbnode = rbnode_tmp;
+			/*
+			 * Growing past the next block would make the two
+			 * overlap; let the next block grow down instead.
+			 */
+			if (reg > top_reg && rb_next(node) &&
+			    rb_entry(rb_next(node), struct regcache_rbtree_node,
+				     node)->base_reg < reg)
+				continue;
+
+			rbnode = regcache_rbtree_insert_to_block(map, rbnode_tmp,
+								 new_base_reg,
+								 new_top_reg,
+								 reg, value);
+			if (!rbnode)
+				return -ENOMEM;
+			rbtree_ctx->cached_rbnode = rbnode;
 			return 0;
 		}
 
@@ -453,6 +579,19 @@ static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
 	return 0;
 }
 
+static int regcache_rbtree_write(struct regmap *map, unsigned int reg,
+				 unsigned int value)
+{
+	struct regcache_rbtree_ctx *rbtree_ctx = map->cache;
+	int ret;
+
+	write_seqcount_begin(&rbtree_ctx->seq);
+	ret = __regcache_rbtree_write(map, reg, value);
+	write_seqcount_end(&rbtree_ctx->seq);
+
+	return ret;
+}
+
 static int regcache_rbtree_sync(struct regmap *map, unsigned int min,
 				unsigned int max)
 {
@@ -524,7 +663,9 @@ static int regcache_rbtree_drop(struct regmap *map, unsigned int min,
 		else
 			end = rbnode->blklen;
 
+		write_seqcount_begin(&rbtree_ctx->seq);
 		bitmap_clear(rbnode->cache_present, start, end - start);
+		write_seqcount_end(&rbtree_ctx->seq);
 	}
 
 	return 0;
@@ -539,6 +680,7 @@ struct regcache_ops regcache_rbtree_ops = {
 	.debugfs_init = rbtree_debugfs_init,
 #endif
 	.read = regcache_rbtree_read,
+	.read_lockless = regcache_rbtree_read_lockless,
 	.write = regcache_rbtree_write,
 	.sync = regcache_rbtree_sync,
 	.drop = regcache_rbtree_drop,
@@ -16,6 +16,7 @@
 #include <trace/events/regmap.h>
 #include <linux/bsearch.h>
 #include <linux/sort.h>
+#include <linux/rcupdate.h>
 
 #include "internal.h"
 
@@ -221,6 +222,41 @@ int regcache_read(struct regmap *map,
 	return -EINVAL;
 }
 
+/**
+ * regcache_read_lockless: Fetch a cached register without map->lock.
+ *
+ * @map: map to configure.
+ * @reg: The register index.
+ * @value: The value to be returned.
+ *
+ * Only caches providing a read_lockless operation are looked at, and
+ * only while the cache is in use.  Return 0 on a hit, a negative value
+ * if the caller has to fall back to regcache_read() under the lock.
+ */
+int regcache_read_lockless(struct regmap *map,
+			   unsigned int reg, unsigned int *value)
+{
+	int ret;
+
+	if (!map->cache_ops || !map->cache_ops->read_lockless)
+		return -ENOSYS;
+
+	if (ACCESS_ONCE(map->cache_bypass) || regmap_volatile(map, reg))
+		return -EINVAL;
+
+	rcu_read_lock();
+	ret = map->cache_ops->read_lockless(map, reg, value);
+	rcu_read_unlock();
+
+	if (ret == 0) {
+		trace_regmap_reg_read_cache(map, reg, *value);
+		regmap_stat_inc(map, cache_hits);
+		regmap_stat_inc(map, cache_lockless_hits);
+	}
+
+	return ret;
+}
+
 /**
  * regcache_write: Set the value of a given register in the cache.
  *
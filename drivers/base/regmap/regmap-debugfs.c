@@ -16,6 +16,8 @@
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/list.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
 
 #include "internal.h"
 
@@ -467,12 +469,61 @@ static const struct file_operations regmap_access_fops = {
 	.llseek = default_llseek,
 };
 
+static int regmap_stats_show(struct seq_file *s, void *ignored)
+{
+	struct regmap *map = s->private;
+	struct regmap_stats sum = { };
+	struct regmap_stats *st;
+	unsigned long reads;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(map->stats, cpu);
+		sum.cache_hits += st->cache_hits;
+		sum.cache_lockless_hits += st->cache_lockless_hits;
+		sum.cache_misses += st->cache_misses;
+		sum.bus_reads += st->bus_reads;
+		sum.bus_writes += st->bus_writes;
+		sum.coalesced_writes += st->coalesced_writes;
+	}
+
+	reads = sum.cache_hits + sum.cache_misses;
+
+	seq_printf(s, "cache hits: %lu (%lu lockless)\n", sum.cache_hits,
+		   sum.cache_lockless_hits);
+	seq_printf(s, "cache misses: %lu\n", sum.cache_misses);
+	seq_printf(s, "cache hit rate: %lu%%\n",
+		   reads ? sum.cache_hits * 100 / reads : 0);
+	seq_printf(s, "bus reads: %lu\n", sum.bus_reads);
+	seq_printf(s, "bus writes: %lu\n", sum.bus_writes);
+	seq_printf(s, "coalesced writes: %lu\n", sum.coalesced_writes);
+
+	return 0;
+}
+
+static int regmap_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, regmap_stats_show, inode->i_private);
+}
+
+static const struct file_operations regmap_stats_fops = {
+	.open		= regmap_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void regmap_debugfs_init(struct regmap *map, const char *name)
 {
 	struct rb_node *next;
 	struct regmap_range_node *range_node;
 	const char *devname = "dummy";
 
+	/* Count from the start even if the directory comes later */
+	if (!map->stats)
+		rcu_assign_pointer(map->stats,
+				   alloc_percpu(struct regmap_stats));
+
 	/* If we don't have the debugfs root yet, postpone init */
 	if (!regmap_debugfs_root) {
 		struct regmap_debugfs_node *node;
@@ -513,6 +564,10 @@ void regmap_debugfs_init(struct regmap *map, const char *name)
 	debugfs_create_file("range", 0400, map->debugfs,
 			    map, &regmap_reg_ranges_fops);
 
+	if (map->stats)
+		debugfs_create_file("stats", 0400, map->debugfs,
+				    map, &regmap_stats_fops);
+
 	if (map->max_register || regmap_readable(map, 0)) {
 		umode_t registers_mode;
 
@@ -554,6 +609,8 @@ void regmap_debugfs_init(struct regmap *map, const char *name)
 
 void regmap_debugfs_exit(struct regmap *map)
 {
+	struct regmap_stats __percpu *stats;
+
 	if (map->debugfs) {
 		debugfs_remove_recursive(map->debugfs);
 		mutex_lock(&map->cache_lock);
@@ -573,6 +630,13 @@ void regmap_debugfs_exit(struct regmap *map)
 		}
 		mutex_unlock(&regmap_debugfs_early_lock);
 	}
+
+	stats = map->stats;
+	if (stats) {
+		RCU_INIT_POINTER(map->stats, NULL);
+		synchronize_rcu();
+		free_percpu(stats);
+	}
 }
 
 void regmap_debugfs_initcall(void)
@@ -1286,6 +1286,7 @@ int _regmap_raw_write(struct regmap *map, unsigned int reg,
 		struct regmap_async *async;
 
 		trace_regmap_async_write_start(map, reg, val_len);
+		regmap_stat_inc(map, bus_writes);
 
 		spin_lock_irqsave(&map->async_lock, flags);
 		async = list_first_entry_or_null(&map->async_free,
@@ -1344,6 +1345,7 @@ int _regmap_raw_write(struct regmap *map, unsigned int reg,
 	}
 
 	trace_regmap_hw_write_start(map, reg, val_len / map->format.val_bytes);
+	regmap_stat_inc(map, bus_writes);
 
 	/* If we're doing a single register write we can probably just
 	 * send the work_buf directly, otherwise try to do a gather
@@ -1412,6 +1414,7 @@ static int _regmap_bus_formatted_write(void *context, unsigned int reg,
 	map->format.format_write(map, reg, val);
 
 	trace_regmap_hw_write_start(map, reg, 1);
+	regmap_stat_inc(map, bus_writes);
 
 	ret = map->bus->write(map->bus_context, map->work_buf,
 			      map->format.buf_size);
@@ -1426,6 +1429,7 @@ static int _regmap_bus_reg_write(void *context, unsigned int reg,
 {
 	struct regmap *map = context;
 
+	regmap_stat_inc(map, bus_writes);
 	return map->bus->reg_write(map->bus_context, reg, val);
 }
 
@@ -1476,6 +1480,8 @@ int _regmap_write(struct regmap *map, unsigned int reg,
 
 	trace_regmap_reg_write(map, reg, val);
 
+	if (!map->bus)
+		regmap_stat_inc(map, bus_writes);
 	return map->reg_write(context, reg, val);
 }
 
@@ -1786,6 +1792,7 @@ int _regmap_raw_multi_reg_write(struct regmap *map,
 	u8 = buf;
 	*u8 |= map->write_flag_mask;
 
+	regmap_stat_inc(map, bus_writes);
 	ret = map->bus->write(map->bus_context, buf, len);
 
 	kfree(buf);
@@ -1849,16 +1856,84 @@ static int _regmap_range_multi_paged_reg_write(struct regmap *map,
 	return 0;
 }
 
+/*
+ * Count how many of the num_regs writes at regs can go out as one raw
+ * block write: a run of writeable registers at consecutive addresses on
+ * a bus that takes raw writes.  Paged registers are left alone since a
+ * run could cross a window.
+ */
+static size_t _regmap_coalesce_run(struct regmap *map,
+				   const struct reg_default *regs,
+				   size_t num_regs)
+{
+	size_t n;
+
+	if (!regmap_can_raw_write(map) || map->use_single_rw ||
+	    !map->format.parse_val || !RB_EMPTY_ROOT(&map->range_tree))
+		return 1;
+
+	for (n = 1; n < num_regs; n++) {
+		if (regs[n].reg != regs[n - 1].reg + map->reg_stride)
+			break;
+		if (!regmap_writeable(map, regs[n].reg))
+			break;
+	}
+
+	return n;
+}
+
+static int _regmap_coalesced_write(struct regmap *map,
+				   const struct reg_default *regs,
+				   size_t num_regs)
+{
+	size_t val_bytes = map->format.val_bytes;
+	void *buf;
+	int i;
+	int ret;
+
+	if (!regmap_writeable(map, regs[0].reg))
+		return -EIO;
+
+	buf = kmalloc(num_regs * val_bytes, map->alloc_flags);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < num_regs; i++) {
+		trace_regmap_reg_write(map, regs[i].reg, regs[i].def);
+		map->format.format_val(buf + i * val_bytes, regs[i].def, 0);
+	}
+
+	ret = _regmap_raw_write(map, regs[0].reg, buf, num_regs * val_bytes);
+	if (ret == 0)
+		regmap_stat_add(map, coalesced_writes, num_regs - 1);
+
+	kfree(buf);
+
+	return ret;
+}
+
 static int _regmap_multi_reg_write(struct regmap *map,
 				   const struct reg_default *regs,
 				   size_t num_regs)
 {
 	int i;
 	int ret;
+	size_t n;
 
 	if (!map->can_multi_write) {
-		for (i = 0; i < num_regs; i++) {
-			ret = _regmap_write(map, regs[i].reg, regs[i].def);
+		/*
+		 * Sequences written through here are mostly register
+		 * patches and init tables, so runs of consecutive
+		 * registers are common: send each run as a single bulk
+		 * transfer rather than one transfer per register.
+		 */
+		for (i = 0; i < num_regs; i += n) {
+			n = _regmap_coalesce_run(map, regs + i, num_regs - i);
+			if (n > 1)
+				ret = _regmap_coalesced_write(map, regs + i, n);
+			else
+				ret = _regmap_write(map, regs[i].reg,
+						    regs[i].def);
 			if (ret != 0)
 				return ret;
 		}
@@ -2064,6 +2139,7 @@ static int _regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
 	u8[0] |= map->read_flag_mask;
 
 	trace_regmap_hw_read_start(map, reg, val_len / map->format.val_bytes);
+	regmap_stat_inc(map, bus_reads);
 
 	ret = map->bus->read(map->bus_context, map->work_buf,
 			     map->format.reg_bytes + map->format.pad_bytes,
@@ -2079,6 +2155,7 @@ static int _regmap_bus_reg_read(void *context, unsigned int reg,
 {
 	struct regmap *map = context;
 
+	regmap_stat_inc(map, bus_reads);
 	return map->bus->reg_read(map->bus_context, reg, val);
 }
 
@@ -2108,8 +2185,11 @@ static int _regmap_read(struct regmap *map, unsigned int reg,
 
 	if (!map->cache_bypass) {
 		ret = regcache_read(map, reg, val);
-		if (ret == 0)
+		if (ret == 0) {
+			regmap_stat_inc(map, cache_hits);
 			return 0;
+		}
+		regmap_stat_inc(map, cache_misses);
 	}
 
 	if (map->cache_only)
@@ -2118,6 +2198,8 @@ static int _regmap_read(struct regmap *map, unsigned int reg,
 	if (!regmap_readable(map, reg))
 		return -EIO;
 
+	if (!map->bus)
+		regmap_stat_inc(map, bus_reads);
 	ret = map->reg_read(context, reg, val);
 	if (ret == 0) {
 #ifdef LOG_DEVICE
@@ -2151,6 +2233,10 @@ int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val)
 	if (reg % map->reg_stride)
 		return -EINVAL;
 
+	/* Cached, non-volatile registers can usually be had without the lock */
+	if (regcache_read_lockless(map, reg, val) == 0)
+		return 0;
+
 	map->lock(map->lock_arg);
 
 	ret = _regmap_read(map, reg, val);
@@ -0,0 +1,141 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/zstd.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+
+#include "zcomp_zstd.h"
+
+/*
+ * Pages are decompressed under the zram table bit spinlock, without a
+ * zcomp_strm, so the decompression workspace is per-cpu and shared by
+ * every zstd stream; it is allocated with the first stream and freed
+ * with the last one.
+ */
+static DEFINE_PER_CPU(void *, zstd_dwrkmem);
+static DEFINE_MUTEX(zstd_dwrkmem_lock);
+static int zstd_dwrkmem_users;
+
+static void *zstd_alloc(size_t size)
+{
+	void *ret;
+
+	ret = kzalloc(size, GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!ret)
+		ret = __vmalloc(size,
+				GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN |
+				__GFP_ZERO | __GFP_HIGHMEM,
+				PAGE_KERNEL);
+	return ret;
+}
+
+static void zstd_dwrkmem_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kvfree(per_cpu(zstd_dwrkmem, cpu));
+		per_cpu(zstd_dwrkmem, cpu) = NULL;
+	}
+}
+
+static int zstd_dwrkmem_get(void)
+{
+	size_t size = zstd_decompress_workspace_size(PAGE_SIZE);
+	int cpu, ret = 0;
+
+	mutex_lock(&zstd_dwrkmem_lock);
+	if (zstd_dwrkmem_users++)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(zstd_dwrkmem, cpu) = zstd_alloc(size);
+		if (!per_cpu(zstd_dwrkmem, cpu)) {
+			zstd_dwrkmem_free();
+			zstd_dwrkmem_users--;
+			ret = -ENOMEM;
+			break;
+		}
+	}
+out:
+	mutex_unlock(&zstd_dwrkmem_lock);
+	return ret;
+}
+
+static void zstd_dwrkmem_put(void)
+{
+	mutex_lock(&zstd_dwrkmem_lock);
+	if (!--zstd_dwrkmem_users)
+		zstd_dwrkmem_free();
+	mutex_unlock(&zstd_dwrkmem_lock);
+}
+
+static void *zcomp_zstd_create(void)
+{
+	void *ret;
+
+	/*
+	 * This function can be called in swapout/fs write path
+	 * so we can't use GFP_FS|IO. And it assumes we already
+	 * have at least one stream in zram initialization so we
+	 * don't do best effort to allocate more stream in here.
+	 * A default stream will work well without further multiple
+	 * streams. That's why we use NORETRY | NOWARN.
+	 */
+	ret = zstd_alloc(zstd_compress_workspace_size(ZSTD_DEFAULT_CLEVEL,
+						      PAGE_SIZE));
+	if (ret && zstd_dwrkmem_get()) {
+		kvfree(ret);
+		ret = NULL;
+	}
+	return ret;
+}
+
+static void zcomp_zstd_destroy(void *private)
+{
+	kvfree(private);
+	zstd_dwrkmem_put();
+}
+
+static int zcomp_zstd_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	/* zcomp_strm buffers are two pages, always enough for one page */
+	*dst_len = zstd_compress_bound(PAGE_SIZE);
+	/* return  : Success if return 0 */
+	return zstd_compress(src, PAGE_SIZE, dst, dst_len, private,
+			zstd_compress_workspace_size(ZSTD_DEFAULT_CLEVEL,
+						     PAGE_SIZE),
+			ZSTD_DEFAULT_CLEVEL);
+}
+
+static int zcomp_zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst)
+{
+	size_t dst_len = PAGE_SIZE;
+	int ret;
+
+	ret = zstd_decompress(src, src_len, dst, &dst_len,
+			get_cpu_var(zstd_dwrkmem),
+			zstd_decompress_workspace_size(PAGE_SIZE));
+	put_cpu_var(zstd_dwrkmem);
+	/* return  : Success if return 0 */
+	return ret;
+}
+
+struct zcomp_backend zcomp_zstd = {
+	.compress = zcomp_zstd_compress,
+	.decompress = zcomp_zstd_decompress,
+	.create = zcomp_zstd_create,
+	.destroy = zcomp_zstd_destroy,
+	.name = "zstd",
+};
@@ -43,6 +43,9 @@
 
 #define is_rproc_enabled IS_ENABLED(CONFIG_REMOTEPROC)
 
+/* Receive buffers allocated, or given back to the Host, per kick */
+#define INBUF_BATCH 16
+
 /*
  * This is a global struct for storing common data for all the devices
  * this driver handles.
@@ -116,6 +119,9 @@ struct port_buffer {
 	/* DMA address of buffer */
 	dma_addr_t dma;
 
+	/* The page *buf is in, for receive buffers that can be spliced */
+	struct page *page;
+
 	/* Device we got DMA memory from */
 	struct device *dev;
 
@@ -373,7 +379,9 @@ static void free_buf(struct port_buffer *buf, bool can_sleep)
 		put_page(page);
 	}
 
-	if (!buf->dev) {
+	if (buf->page) {
+		put_page(buf->page);
+	} else if (!buf->dev) {
 		kfree(buf->buf);
 	} else if (is_rproc_enabled) {
 		unsigned long flags;
@@ -434,6 +442,7 @@ static struct port_buffer *alloc_buf(struct virtqueue *vq, size_t buf_size,
 		goto fail;
 
 	buf->sgpages = pages;
+	buf->page = NULL;
 	if (pages > 0) {
 		buf->dev = NULL;
 		buf->buf = NULL;
@@ -476,6 +485,36 @@ fail:
 	return NULL;
 }
 
+/*
+ * Receive buffers are whole pages, so that splice_read can hand them to
+ * a pipe and put a fresh page in their place.  rproc-serial needs DMA
+ * memory instead; its buffers are copied out.
+ */
+static struct port_buffer *alloc_inbuf(struct virtqueue *vq)
+{
+	struct port_buffer *buf;
+
+	if (is_rproc_serial(vq->vdev))
+		return alloc_buf(vq, PAGE_SIZE, 0);
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return NULL;
+
+	buf->page = alloc_page(GFP_KERNEL);
+	if (!buf->page) {
+		kfree(buf);
+		return NULL;
+	}
+	buf->buf = page_address(buf->page);
+	buf->dev = NULL;
+	buf->sgpages = 0;
+	buf->len = 0;
+	buf->offset = 0;
+	buf->size = PAGE_SIZE;
+	return buf;
+}
+
 /* Callers should take appropriate locks */
 static struct port_buffer *get_inbuf(struct port *port)
 {
@@ -496,11 +535,11 @@ static struct port_buffer *get_inbuf(struct port *port)
 
 /*
  * Create a scatter-gather list representing our input buffer and put
- * it in the queue.
+ * it in the queue, without telling the Host.
  *
  * Callers should take appropriate locks.
  */
-static int add_inbuf(struct virtqueue *vq, struct port_buffer *buf)
+static int __add_inbuf(struct virtqueue *vq, struct port_buffer *buf)
 {
 	struct scatterlist sg[1];
 	int ret;
@@ -508,12 +547,58 @@ static int add_inbuf(struct virtqueue *vq, struct port_buffer *buf)
 	sg_init_one(sg, buf->buf, buf->size);
 
 	ret = virtqueue_add_inbuf(vq, sg, 1, buf, GFP_ATOMIC);
-	virtqueue_kick(vq);
 	if (!ret)
 		ret = vq->num_free;
 	return ret;
 }
 
+/* As __add_inbuf(), and kick the Host.  Callers should take locks. */
+static int add_inbuf(struct virtqueue *vq, struct port_buffer *buf)
+{
+	int ret;
+
+	ret = __add_inbuf(vq, buf);
+	virtqueue_kick(vq);
+	return ret;
+}
+
+/*
+ * Put port->inbuf, all of whose data has been consumed, back in the
+ * queue so that the Host can send us more data.  The Host is kicked once
+ * every INBUF_BATCH buffers; callers count the ones not yet kicked in
+ * *pending and finish with kick_inbufs().
+ */
+static void requeue_inbuf(struct port *port, unsigned int *pending)
+{
+	struct port_buffer *buf;
+	unsigned long flags;
+
+	spin_lock_irqsave(&port->inbuf_lock, flags);
+	buf = port->inbuf;
+	port->inbuf = NULL;
+
+	if (__add_inbuf(port->in_vq, buf) < 0)
+		dev_warn(port->dev, "failed add_buf\n");
+
+	if (++*pending == INBUF_BATCH) {
+		virtqueue_kick(port->in_vq);
+		*pending = 0;
+	}
+	spin_unlock_irqrestore(&port->inbuf_lock, flags);
+}
+
+static void kick_inbufs(struct port *port, unsigned int pending)
+{
+	unsigned long flags;
+
+	if (!pending)
+		return;
+
+	spin_lock_irqsave(&port->inbuf_lock, flags);
+	virtqueue_kick(port->in_vq);
+	spin_unlock_irqrestore(&port->inbuf_lock, flags);
+}
+
 /* Discard any unread data this port has. Callers lockers. */
 static void discard_port_data(struct port *port)
 {
@@ -529,13 +614,14 @@ static void discard_port_data(struct port *port)
 	err = 0;
 	while (buf) {
 		port->stats.bytes_discarded += buf->len - buf->offset;
-		if (add_inbuf(port->in_vq, buf) < 0) {
+		if (__add_inbuf(port->in_vq, buf) < 0) {
 			err++;
 			free_buf(buf, false);
 		}
 		port->inbuf = NULL;
 		buf = get_inbuf(port);
 	}
+	virtqueue_kick(port->in_vq);
 	if (err)
 		dev_warn(port->dev, "Errors adding %d buffers back to vq\n",
 			 err);
@@ -667,48 +753,42 @@ done:
 }
 
 /*
- * Give out the data that's requested from the buffer that we have
- * queued up.
+ * Give out the data that's requested from the buffers that we have
+ * queued up, going through as many of them as it takes.
  */
 static ssize_t fill_readbuf(struct port *port, char *out_buf, size_t out_count,
 			    bool to_user)
 {
 	struct port_buffer *buf;
-	unsigned long flags;
-
-	if (!out_count || !port_has_data(port))
-		return 0;
-
-	buf = port->inbuf;
-	out_count = min(out_count, buf->len - buf->offset);
+	unsigned int pending = 0;
+	size_t copied = 0, len;
+	ssize_t ret = 0;
+
+	while (copied < out_count && port_has_data(port)) {
+		buf = port->inbuf;
+		len = min(out_count - copied, buf->len - buf->offset);
+
+		if (to_user) {
+			if (copy_to_user(out_buf + copied,
+					 buf->buf + buf->offset, len)) {
+				ret = -EFAULT;
+				break;
+			}
+		} else {
+			memcpy(out_buf + copied, buf->buf + buf->offset, len);
+		}
 
-	if (to_user) {
-		ssize_t ret;
+		buf->offset += len;
+		copied += len;
 
-		ret = copy_to_user(out_buf, buf->buf + buf->offset, out_count);
-		if (ret)
-			return -EFAULT;
-	} else {
-		memcpy(out_buf, buf->buf + buf->offset, out_count);
+		/* We're done using all the data in this buffer. */
+		if (buf->offset == buf->len)
+			requeue_inbuf(port, &pending);
 	}
+	kick_inbufs(port, pending);
 
-	buf->offset += out_count;
-
-	if (buf->offset == buf->len) {
-		/*
-		 * We're done using all the data in this buffer.
-		 * Re-queue so that the Host can send us more data.
-		 */
-		spin_lock_irqsave(&port->inbuf_lock, flags);
-		port->inbuf = NULL;
-
-		if (add_inbuf(port->in_vq, buf) < 0)
-			dev_warn(port->dev, "failed add_buf\n");
-
-		spin_unlock_irqrestore(&port->inbuf_lock, flags);
-	}
 	/* Return the number of bytes actually copied */
-	return out_count;
+	return copied ? copied : ret;
 }
 
 /* The condition that must be true for polling to end */
@@ -744,13 +824,13 @@ static bool will_write_block(struct port *port)
 	return ret;
 }
 
-static ssize_t port_fops_read(struct file *filp, char __user *ubuf,
-			      size_t count, loff_t *offp)
+/*
+ * Wait for data to read.  Returns 1 if there is some, 0 if there is none
+ * and nothing's connected on the host, or a negative error.
+ */
+static int wait_port_readable(struct port *port, bool nonblock)
 {
-	struct port *port;
-	ssize_t ret;
-
-	port = filp->private_data;
+	int ret;
 
 	/* Port is hot-unplugged. */
 	if (!port->guest_connected)
@@ -764,7 +844,7 @@ static ssize_t port_fops_read(struct file *filp, char __user *ubuf,
 		 */
 		if (!port->host_connected)
 			return 0;
-		if (filp->f_flags & O_NONBLOCK)
+		if (nonblock)
 			return -EAGAIN;
 
 		ret = wait_event_freezable(port->waitqueue,
@@ -788,9 +868,130 @@ static ssize_t port_fops_read(struct file *filp, char __user *ubuf,
 	if (!port_has_data(port) && !port->host_connected)
 		return 0;
 
+	return 1;
+}
+
+static ssize_t port_fops_read(struct file *filp, char __user *ubuf,
+			      size_t count, loff_t *offp)
+{
+	struct port *port;
+	ssize_t ret;
+
+	port = filp->private_data;
+
+	ret = wait_port_readable(port, filp->f_flags & O_NONBLOCK);
+	if (ret <= 0)
+		return ret;
+
 	return fill_readbuf(port, ubuf, count, true);
 }
 
+static void port_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	put_page(spd->pages[i]);
+}
+
+/* The pages belong to the pipe alone, so they may be stolen */
+static const struct pipe_buf_operations port_pipe_buf_ops = {
+	.can_merge = 0,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Take up to len bytes of received data into spd.  A buffer whose data
+ * is taken up to its end hands its page over and gets a fresh one before
+ * going back to the Host; only data that stops short of that is copied.
+ */
+static ssize_t fill_splice_pages(struct port *port,
+				 struct splice_pipe_desc *spd, size_t len)
+{
+	struct port_buffer *buf;
+	struct page *page;
+	unsigned int pending = 0;
+	size_t taken = 0, n;
+	ssize_t ret = 0;
+
+	while (taken < len && spd->nr_pages < spd->nr_pages_max &&
+	       port_has_data(port)) {
+		buf = port->inbuf;
+		n = min(len - taken, buf->len - buf->offset);
+
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (buf->page && buf->offset + n == buf->len) {
+			spd->pages[spd->nr_pages] = buf->page;
+			spd->partial[spd->nr_pages].offset = buf->offset;
+			buf->page = page;
+			buf->buf = page_address(page);
+		} else {
+			memcpy(page_address(page), buf->buf + buf->offset, n);
+			spd->pages[spd->nr_pages] = page;
+			spd->partial[spd->nr_pages].offset = 0;
+		}
+		spd->partial[spd->nr_pages].len = n;
+		spd->nr_pages++;
+
+		buf->offset += n;
+		taken += n;
+
+		if (buf->offset == buf->len)
+			requeue_inbuf(port, &pending);
+	}
+	kick_inbufs(port, pending);
+
+	return taken ? taken : ret;
+}
+
+/* Zero-copy read by splicing the received pages */
+static ssize_t port_fops_splice_read(struct file *filp, loff_t *ppos,
+				     struct pipe_inode_info *pipe,
+				     size_t len, unsigned int flags)
+{
+	struct port *port = filp->private_data;
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.flags = flags,
+		.ops = &port_pipe_buf_ops,
+		.spd_release = port_spd_release,
+	};
+	ssize_t ret;
+
+	if (!len)
+		return 0;
+
+	ret = wait_port_readable(port, filp->f_flags & O_NONBLOCK);
+	if (ret <= 0)
+		return ret;
+
+	/*
+	 * Data can't go back to the port once taken, so when we may not
+	 * wait for room in the pipe only take what fits in it now.
+	 */
+	if (flags & SPLICE_F_NONBLOCK) {
+		spd.nr_pages_max = min_t(unsigned int, PIPE_DEF_BUFFERS,
+					 pipe->buffers - pipe->nrbufs);
+		if (!spd.nr_pages_max)
+			return -EAGAIN;
+	}
+
+	ret = fill_splice_pages(port, &spd, len);
+	if (ret <= 0)
+		return ret;
+
+	return splice_to_pipe(pipe, &spd);
+}
+
 static int wait_port_writable(struct port *port, bool nonblock)
 {
 	int ret;
@@ -1110,6 +1311,7 @@ static const struct file_operations port_fops = {
 	.open  = port_fops_open,
 	.read  = port_fops_read,
 	.write = port_fops_write,
+	.splice_read = port_fops_splice_read,
 	.splice_write = port_fops_splice_write,
 	.poll  = port_fops_poll,
 	.release = port_fops_release,
@@ -1362,28 +1564,37 @@ static void set_console_size(struct port *port, u16 rows, u16 cols)
 	port->cons.ws.ws_col = cols;
 }
 
+/* Fill the queue INBUF_BATCH buffers at a time, with one kick each */
 static unsigned int fill_queue(struct virtqueue *vq, spinlock_t *lock)
 {
-	struct port_buffer *buf;
-	unsigned int nr_added_bufs;
+	struct port_buffer *bufs[INBUF_BATCH];
+	unsigned int nr_added_bufs, i, n;
 	int ret;
 
 	nr_added_bufs = 0;
 	do {
-		buf = alloc_buf(vq, PAGE_SIZE, 0);
-		if (!buf)
+		for (n = 0; n < INBUF_BATCH; n++) {
+			bufs[n] = alloc_inbuf(vq);
+			if (!bufs[n])
+				break;
+		}
+		if (!n)
 			break;
 
+		ret = 1;
 		spin_lock_irq(lock);
-		ret = add_inbuf(vq, buf);
-		if (ret < 0) {
-			spin_unlock_irq(lock);
-			free_buf(buf, true);
-			break;
+		for (i = 0; i < n && ret > 0; i++) {
+			ret = __add_inbuf(vq, bufs[i]);
+			if (ret < 0)
+				break;
 		}
-		nr_added_bufs++;
+		virtqueue_kick(vq);
 		spin_unlock_irq(lock);
-	} while (ret > 0);
+
+		nr_added_bufs += i;
+		while (i < n)
+			free_buf(bufs[i++], true);
+	} while (ret > 0 && n == INBUF_BATCH);
 
 	return nr_added_bufs;
 }
@@ -0,0 +1,604 @@
+/*
+ * drivers/cpufreq/cpufreq_schedutil.c
+ *
+ * CPUFreq governor driven by scheduler-provided CPU utilization.
+ *
+ * The scheduler reports every change of a CPU's utilization through
+ * cpufreq_update_util(), from the tick and from task enqueue/dequeue, so
+ * the governor reacts to load as it appears instead of on the next timer
+ * sample.  Requests are rate limited by rate_limit_us and applied in place
+ * when the driver supports fast switching, or from a per-policy RT kthread
+ * otherwise.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/sched/rt.h>
+#include <linux/slab.h>
+#include <trace/events/power.h>
+
+/* Default rate limit, raised to ten transition latencies for slow drivers */
+#define DEFAULT_RATE_LIMIT_US	(2 * USEC_PER_MSEC)
+
+struct sugov_tunables {
+	int usage_count;
+	unsigned int rate_limit_us;
+};
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+	struct sugov_tunables *tunables;
+
+	raw_spinlock_t update_lock;	/* For shared policies */
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+
+	/* The next fields are only needed if fast switch cannot be used. */
+	struct irq_work irq_work;
+	struct kthread_work work;
+	struct mutex work_lock;
+	struct kthread_worker worker;
+	struct task_struct *thread;
+	bool work_in_progress;
+
+	bool need_freq_update;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	/* The fields below are only needed when sharing a policy. */
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+/* For cases where we have single governor instance for system */
+static struct sugov_tunables *global_tunables;
+static DEFINE_MUTEX(global_tunables_lock);
+
+/************************ Governor internals ***********************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress)
+		return false;
+
+	if (unlikely(sg_policy->need_freq_update)) {
+		sg_policy->need_freq_update = false;
+		/*
+		 * The limits have changed, so forget the last request, which
+		 * may have been clamped, to be sure to recompute the frequency.
+		 */
+		sg_policy->next_freq = UINT_MAX;
+		return true;
+	}
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)ACCESS_ONCE(sg_policy->tunables->rate_limit_us) *
+			   NSEC_PER_USEC;
+}
+
+static void sugov_update_commit(struct sugov_policy *sg_policy, u64 time,
+				unsigned int next_freq)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+
+	if (sg_policy->next_freq == next_freq)
+		return;
+
+	sg_policy->next_freq = next_freq;
+	sg_policy->last_freq_update_time = time;
+
+	if (policy->fast_switch_enabled) {
+		next_freq = cpufreq_driver_fast_switch(policy, next_freq);
+		if (!next_freq)
+			return;
+
+		policy->cur = next_freq;
+		trace_cpu_frequency(next_freq, smp_processor_id());
+	} else {
+		sg_policy->work_in_progress = true;
+		irq_work_queue(&sg_policy->irq_work);
+	}
+}
+
+/**
+ * get_next_freq - Compute a new frequency for a given cpufreq policy.
+ * @sg_policy: schedutil policy object to compute the new frequency for.
+ * @util: Current CPU utilization.
+ * @max: CPU capacity.
+ *
+ * The frequency is proportional to the utilization with a 25% margin, so
+ * that a CPU running at 80% of its capacity gets the next frequency up:
+ *
+ * next_freq = 1.25 * max_freq * util / max
+ *
+ * and is then mapped to the lowest table frequency at or above it within the
+ * policy limits, so that requests resolving to the current frequency don't
+ * reach the driver.
+ */
+static unsigned int get_next_freq(struct sugov_policy *sg_policy,
+				  unsigned long util, unsigned long max)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int freq = policy->cpuinfo.max_freq;
+	int index;
+
+	freq = mult_frac(freq + (freq >> 2), util, max);
+	freq = clamp_val(freq, policy->min, policy->max);
+
+	if (policy->freq_table &&
+	    !cpufreq_frequency_table_target(policy, policy->freq_table, freq,
+					    CPUFREQ_RELATION_L, &index))
+		freq = policy->freq_table[index].frequency;
+
+	return freq;
+}
+
+static void sugov_update_single(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int next_f;
+
+	if (!sugov_should_update_freq(sg_policy, time))
+		return;
+
+	next_f = util == ULONG_MAX ? policy->max :
+		 get_next_freq(sg_policy, util, max);
+	sugov_update_commit(sg_policy, time, next_f);
+}
+
+static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
+{
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0, max = 1;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+		unsigned long j_util, j_max;
+		s64 delta_ns;
+
+		/*
+		 * A CPU whose utilization hasn't been updated for more than a
+		 * tick is idle with its tick stopped, so its last value is
+		 * stale and must not hold the frequency up.
+		 */
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > TICK_NSEC)
+			continue;
+
+		j_util = j_sg_cpu->util;
+		if (j_util == ULONG_MAX)
+			return policy->max;
+
+		j_max = j_sg_cpu->max;
+		if (j_util * max > j_max * util) {
+			util = j_util;
+			max = j_max;
+		}
+	}
+
+	return get_next_freq(sg_policy, util, max);
+}
+
+static void sugov_update_shared(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned int next_f;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+
+	if (sugov_should_update_freq(sg_policy, time)) {
+		next_f = sugov_next_freq_shared(sg_cpu, time);
+		sugov_update_commit(sg_policy, time, next_f);
+	}
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct kthread_work *work)
+{
+	struct sugov_policy *sg_policy = container_of(work, struct sugov_policy,
+						      work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy = container_of(irq_work,
+						      struct sugov_policy,
+						      irq_work);
+
+	queue_kthread_work(&sg_policy->worker, &sg_policy->work);
+}
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct sugov_tunables *tunables, char *buf)
+{
+	return sprintf(buf, "%u\n", tunables->rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct sugov_tunables *tunables,
+				   const char *buf, size_t count)
+{
+	unsigned int rate_limit_us;
+
+	if (kstrtouint(buf, 10, &rate_limit_us))
+		return -EINVAL;
+
+	tunables->rate_limit_us = rate_limit_us;
+	return count;
+}
+
+/*
+ * Create show/store routines
+ * - sys: One governor instance for complete SYSTEM
+ * - pol: One governor instance per struct cpufreq_policy
+ */
+static ssize_t show_rate_limit_us_gov_sys(struct kobject *kobj,
+					  struct attribute *attr, char *buf)
+{
+	return show_rate_limit_us(global_tunables, buf);
+}
+
+static ssize_t store_rate_limit_us_gov_sys(struct kobject *kobj,
+					   struct attribute *attr,
+					   const char *buf, size_t count)
+{
+	return store_rate_limit_us(global_tunables, buf, count);
+}
+
+static ssize_t show_rate_limit_us_gov_pol(struct cpufreq_policy *policy,
+					  char *buf)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	return show_rate_limit_us(sg_policy->tunables, buf);
+}
+
+static ssize_t store_rate_limit_us_gov_pol(struct cpufreq_policy *policy,
+					   const char *buf, size_t count)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	return store_rate_limit_us(sg_policy->tunables, buf, count);
+}
+
+static struct global_attr rate_limit_us_gov_sys =
+	__ATTR(rate_limit_us, 0644, show_rate_limit_us_gov_sys,
+	       store_rate_limit_us_gov_sys);
+
+static struct freq_attr rate_limit_us_gov_pol =
+	__ATTR(rate_limit_us, 0644, show_rate_limit_us_gov_pol,
+	       store_rate_limit_us_gov_pol);
+
+static struct attribute *sugov_attributes_gov_sys[] = {
+	&rate_limit_us_gov_sys.attr,
+	NULL,
+};
+
+static struct attribute_group sugov_attr_group_gov_sys = {
+	.attrs = sugov_attributes_gov_sys,
+	.name = "schedutil",
+};
+
+static struct attribute *sugov_attributes_gov_pol[] = {
+	&rate_limit_us_gov_pol.attr,
+	NULL,
+};
+
+static struct attribute_group sugov_attr_group_gov_pol = {
+	.attrs = sugov_attributes_gov_pol,
+	.name = "schedutil",
+};
+
+static struct attribute_group *get_sysfs_attr(void)
+{
+	if (have_governor_per_policy())
+		return &sugov_attr_group_gov_pol;
+	else
+		return &sugov_attr_group_gov_sys;
+}
+
+/********************** cpufreq governor interface *********************/
+
+static unsigned int sugov_default_rate_limit(struct cpufreq_policy *policy)
+{
+	unsigned int latency = policy->cpuinfo.transition_latency;
+
+	if (latency == CPUFREQ_ETERNAL)
+		return DEFAULT_RATE_LIMIT_US;
+
+	return max_t(unsigned int, DEFAULT_RATE_LIMIT_US,
+		     10 * (latency / NSEC_PER_USEC));
+}
+
+static int sugov_kthread_create(struct sugov_policy *sg_policy)
+{
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+	struct cpufreq_policy *policy = sg_policy->policy;
+	struct task_struct *thread;
+	int ret;
+
+	/* kthread only required for slow path */
+	if (policy->fast_switch_enabled)
+		return 0;
+
+	init_kthread_work(&sg_policy->work, sugov_work);
+	init_kthread_worker(&sg_policy->worker);
+	thread = kthread_create(kthread_worker_fn, &sg_policy->worker,
+				"sugov:%d", cpumask_first(policy->related_cpus));
+	if (IS_ERR(thread)) {
+		pr_err("failed to create sugov thread: %ld\n", PTR_ERR(thread));
+		return PTR_ERR(thread);
+	}
+
+	ret = sched_setscheduler_nocheck(thread, SCHED_FIFO, &param);
+	if (ret) {
+		kthread_stop(thread);
+		pr_warn("%s: failed to set SCHED_FIFO\n", __func__);
+		return ret;
+	}
+
+	sg_policy->thread = thread;
+	set_cpus_allowed_ptr(thread, policy->related_cpus);
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	mutex_init(&sg_policy->work_lock);
+
+	wake_up_process(thread);
+
+	return 0;
+}
+
+static void sugov_kthread_stop(struct sugov_policy *sg_policy)
+{
+	/* kthread only required for slow path */
+	if (sg_policy->policy->fast_switch_enabled)
+		return;
+
+	flush_kthread_worker(&sg_policy->worker);
+	kthread_stop(sg_policy->thread);
+	mutex_destroy(&sg_policy->work_lock);
+}
+
+static int sugov_init(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	struct sugov_tunables *tunables;
+	int ret;
+
+	/* State should be equivalent to EXIT */
+	if (policy->governor_data)
+		return -EBUSY;
+
+	cpufreq_enable_fast_switch(policy);
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy) {
+		ret = -ENOMEM;
+		goto disable_fast_switch;
+	}
+
+	sg_policy->policy = policy;
+	raw_spin_lock_init(&sg_policy->update_lock);
+
+	ret = sugov_kthread_create(sg_policy);
+	if (ret)
+		goto free_sg_policy;
+
+	mutex_lock(&global_tunables_lock);
+
+	if (!have_governor_per_policy() && global_tunables) {
+		global_tunables->usage_count++;
+		sg_policy->tunables = global_tunables;
+		policy->governor_data = sg_policy;
+		goto out;
+	}
+
+	tunables = kzalloc(sizeof(*tunables), GFP_KERNEL);
+	if (!tunables) {
+		ret = -ENOMEM;
+		goto stop_kthread;
+	}
+
+	tunables->usage_count = 1;
+	tunables->rate_limit_us = sugov_default_rate_limit(policy);
+	sg_policy->tunables = tunables;
+	policy->governor_data = sg_policy;
+
+	if (!have_governor_per_policy()) {
+		WARN_ON(cpufreq_get_global_kobject());
+		global_tunables = tunables;
+	}
+
+	ret = sysfs_create_group(get_governor_parent_kobj(policy),
+				 get_sysfs_attr());
+	if (ret)
+		goto free_tunables;
+
+out:
+	mutex_unlock(&global_tunables_lock);
+	return 0;
+
+free_tunables:
+	if (!have_governor_per_policy()) {
+		global_tunables = NULL;
+		cpufreq_put_global_kobject();
+	}
+	policy->governor_data = NULL;
+	kfree(tunables);
+stop_kthread:
+	mutex_unlock(&global_tunables_lock);
+	sugov_kthread_stop(sg_policy);
+free_sg_policy:
+	kfree(sg_policy);
+disable_fast_switch:
+	cpufreq_disable_fast_switch(policy);
+	pr_err("initialization failed (error %d)\n", ret);
+	return ret;
+}
+
+static int sugov_exit(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	struct sugov_tunables *tunables = sg_policy->tunables;
+
+	mutex_lock(&global_tunables_lock);
+
+	policy->governor_data = NULL;
+	if (!--tunables->usage_count) {
+		sysfs_remove_group(get_governor_parent_kobj(policy),
+				   get_sysfs_attr());
+		if (!have_governor_per_policy()) {
+			global_tunables = NULL;
+			cpufreq_put_global_kobject();
+		}
+		kfree(tunables);
+	}
+
+	mutex_unlock(&global_tunables_lock);
+
+	sugov_kthread_stop(sg_policy);
+	kfree(sg_policy);
+	cpufreq_disable_fast_switch(policy);
+	return 0;
+}
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	sg_policy->last_freq_update_time = 0;
+	sg_policy->next_freq = UINT_MAX;
+	sg_policy->work_in_progress = false;
+	sg_policy->need_freq_update = false;
+
+	for_each_cpu(cpu, policy->cpus) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
+
+		memset(sg_cpu, 0, sizeof(*sg_cpu));
+		sg_cpu->sg_policy = sg_policy;
+		cpufreq_add_update_util_hook(cpu, &sg_cpu->update_util,
+					     policy_is_shared(policy) ?
+							sugov_update_shared :
+							sugov_update_single);
+	}
+	return 0;
+}
+
+static int sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, policy->cpus)
+		cpufreq_remove_update_util_hook(cpu);
+
+	synchronize_sched();
+
+	if (!policy->fast_switch_enabled) {
+		irq_work_sync(&sg_policy->irq_work);
+		flush_kthread_work(&sg_policy->work);
+	}
+	return 0;
+}
+
+static int sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	if (!policy->fast_switch_enabled) {
+		mutex_lock(&sg_policy->work_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy, policy->max,
+						CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy, policy->min,
+						CPUFREQ_RELATION_L);
+		mutex_unlock(&sg_policy->work_lock);
+	}
+
+	sg_policy->need_freq_update = true;
+	return 0;
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_POLICY_INIT:
+		return sugov_init(policy);
+	case CPUFREQ_GOV_POLICY_EXIT:
+		return sugov_exit(policy);
+	case CPUFREQ_GOV_START:
+		return sugov_start(policy);
+	case CPUFREQ_GOV_STOP:
+		return sugov_stop(policy);
+	case CPUFREQ_GOV_LIMITS:
+		return sugov_limits(policy);
+	}
+	return 0;
+}
+
+static struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name = "schedutil",
+	.governor = cpufreq_governor_schedutil,
+	.owner = THIS_MODULE,
+};
+
+static int __init sugov_register(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+
+module_init(sugov_register);
+
+static void __exit sugov_unregister(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_schedutil);
+}
+module_exit(sugov_unregister);
+
+MODULE_DESCRIPTION("'cpufreq_schedutil' - A cpufreq governor driven by "
+	"scheduler utilization");
+MODULE_LICENSE("GPL");
@@ -15,29 +15,41 @@
 #include <linux/cputime.h>
 #include <linux/hashtable.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/proc_fs.h>
-#include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/user_namespace.h>
+#include <linux/vmalloc.h>
+#include <uapi/linux/cpufreq_stats.h>
 
 #define UID_HASH_BITS 10
 
-DECLARE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
+static DEFINE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
 
 static spinlock_t cpufreq_stats_lock;
 
-static DEFINE_RT_MUTEX(uid_lock); /* uid_hash_table */
+/*
+ * Writers of uid_hash_table take uid_lock; readers, including the tick path
+ * charging time to a UID, only hold the RCU read lock.
+ */
+static DEFINE_SPINLOCK(uid_lock);
 
+/*
+ * CPU time of a UID, indexed by all_freq_table position.  Each CPU adds to
+ * its own copy of the array; readers fold the copies.
+ */
 struct uid_entry {
 	uid_t uid;
-	unsigned int dead_max_states;
-	unsigned int alive_max_states;
-	u64 *dead_time_in_state;
-	u64 *alive_time_in_state;
+	unsigned int max_states;
+	u64 __percpu *time_in_state;
+	u64 last_update;	/* jiffies_64 when last charged */
 	struct hlist_node hash;
+	struct rcu_head rcu;
 };
 
 struct cpufreq_stats {
@@ -84,122 +96,245 @@ struct cpufreq_stats_attribute {
 	ssize_t(*show) (struct cpufreq_stats *, char *);
 };
 
-/* Caller must hold uid lock */
+/* Caller must hold uid_lock or the RCU read lock */
 static struct uid_entry *find_uid_entry(uid_t uid)
 {
 	struct uid_entry *uid_entry;
 
-	hash_for_each_possible(uid_hash_table, uid_entry, hash, uid) {
+	hash_for_each_possible_rcu(uid_hash_table, uid_entry, hash, uid) {
 		if (uid_entry->uid == uid)
 			return uid_entry;
 	}
 	return NULL;
 }
 
-/* Caller must hold uid lock */
+static void free_uid_entry(struct rcu_head *rcu)
+{
+	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
+
+	free_percpu(uid_entry->time_in_state);
+	kfree(uid_entry);
+}
+
+/*
+ * Caller must hold the RCU read lock.  This runs from the tick, so the
+ * entry is allocated atomically; if that fails the tick is not accounted.
+ */
 static struct uid_entry *find_or_register_uid(uid_t uid)
 {
-	struct uid_entry *uid_entry;
+	struct uid_entry *uid_entry, *old;
+	unsigned int max_states = all_freq_table->table_size;
+	unsigned long flags;
 
 	uid_entry = find_uid_entry(uid);
 	if (uid_entry)
 		return uid_entry;
 
-	uid_entry = kzalloc(sizeof(struct uid_entry), GFP_ATOMIC);
+	uid_entry = kzalloc(sizeof(*uid_entry), GFP_ATOMIC);
 	if (!uid_entry)
 		return NULL;
 
+	uid_entry->time_in_state = __alloc_percpu_gfp(
+			max_states * sizeof(u64), sizeof(u64), GFP_ATOMIC);
+	if (!uid_entry->time_in_state) {
+		kfree(uid_entry);
+		return NULL;
+	}
 	uid_entry->uid = uid;
-
-	hash_add(uid_hash_table, &uid_entry->hash, uid);
-
+	uid_entry->max_states = max_states;
+
+	spin_lock_irqsave(&uid_lock, flags);
+	old = find_uid_entry(uid);
+	if (!old)
+		hash_add_rcu(uid_hash_table, &uid_entry->hash, uid);
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	if (old) {
+		free_percpu(uid_entry->time_in_state);
+		kfree(uid_entry);
+		return old;
+	}
 	return uid_entry;
 }
 
+/* Sum the per-CPU times of @uid_entry into @times, in clock ticks */
+static void uid_entry_fold(struct uid_entry *uid_entry, u64 *times,
+			   unsigned int nr_states)
+{
+	unsigned int i, cpu;
+	u64 *cpu_times;
+
+	memset(times, 0, nr_states * sizeof(*times));
+	nr_states = min(nr_states, uid_entry->max_states);
+
+	for_each_possible_cpu(cpu) {
+		cpu_times = per_cpu_ptr(uid_entry->time_in_state, cpu);
+		for (i = 0; i < nr_states; i++)
+			times[i] += READ_ONCE(cpu_times[i]);
+	}
+
+	for (i = 0; i < nr_states; i++)
+		times[i] = cputime64_to_clock_t(times[i]);
+}
 
 static int uid_time_in_state_show(struct seq_file *m, void *v)
 {
 	struct uid_entry *uid_entry;
-	struct task_struct *task, *temp;
+	unsigned int nr_states;
 	unsigned long bkt;
+	u64 *times;
 	int i;
 
 	if (!all_freq_table || !cpufreq_all_freq_init)
 		return 0;
 
+	nr_states = all_freq_table->table_size;
+	times = kmalloc_array(nr_states, sizeof(*times), GFP_KERNEL);
+	if (!times)
+		return -ENOMEM;
+
 	seq_puts(m, "uid:");
-	for (i = 0; i < all_freq_table->table_size; ++i)
+	for (i = 0; i < nr_states; ++i)
 		seq_printf(m, " %d", all_freq_table->freq_table[i]);
 	seq_putc(m, '\n');
 
-	rt_mutex_lock(&uid_lock);
+	rcu_read_lock();
+	hash_for_each_rcu(uid_hash_table, bkt, uid_entry, hash) {
+		uid_entry_fold(uid_entry, times, nr_states);
+
+		seq_printf(m, "%d:", uid_entry->uid);
+		for (i = 0; i < nr_states; ++i)
+			seq_printf(m, " %lu", (unsigned long)times[i]);
+		seq_putc(m, '\n');
+	}
+	rcu_read_unlock();
+
+	kfree(times);
+	return 0;
+}
+
+struct uid_time_in_state_reader {
+	struct mutex lock;
+	u64 since;		/* jiffies_64 of the previous snapshot */
+	bool full;		/* no snapshot taken yet */
+	void *buf;
+	size_t len;
+};
+
+/*
+ * Build the binary snapshot described in <linux/cpufreq_stats.h>, holding
+ * the UIDs charged since the previous snapshot of @reader.
+ */
+static int uid_time_in_state_snapshot(struct uid_time_in_state_reader *reader)
+{
+	struct uid_time_in_state_header *hdr;
+	struct uid_time_in_state_record *rec;
+	struct uid_entry *uid_entry;
+	unsigned int nr_states, nr_uids = 0, max_uids = 0;
+	size_t rec_size, size;
+	unsigned long bkt;
+	u64 now;
+	u32 *freqs;
+	int i;
+
+	nr_states = all_freq_table->table_size;
+	rec_size = sizeof(*rec) + nr_states * sizeof(rec->time[0]);
 
 	rcu_read_lock();
-	do_each_thread(temp, task) {
-		/* if this task has exited, we have already accounted for all
-		 * time in state
-		 */
-		if (!task->time_in_state)
-			continue;
+	hash_for_each_rcu(uid_hash_table, bkt, uid_entry, hash)
+		max_uids++;
+	rcu_read_unlock();
 
-		uid_entry = find_or_register_uid(from_kuid_munged(
-			current_user_ns(), task_uid(task)));
-		if (!uid_entry)
-			continue;
+	/* Leave room for UIDs that appear while the snapshot is taken */
+	max_uids += 64;
+	size = sizeof(*hdr) + nr_states * sizeof(*freqs) + max_uids * rec_size;
 
-		if (uid_entry->alive_max_states < task->max_states) {
-			uid_entry->alive_time_in_state = krealloc(
-				uid_entry->alive_time_in_state,
-				task->max_states *
-				sizeof(uid_entry->alive_time_in_state[0]),
-				GFP_ATOMIC);
-			memset(uid_entry->alive_time_in_state +
-				uid_entry->alive_max_states,
-				0, (task->max_states -
-				uid_entry->alive_max_states) *
-				sizeof(uid_entry->alive_time_in_state[0]));
-			uid_entry->alive_max_states = task->max_states;
-		}
+	vfree(reader->buf);
+	reader->buf = vmalloc(size);
+	reader->len = 0;
+	if (!reader->buf)
+		return -ENOMEM;
 
-		for (i = 0; i < task->max_states; ++i) {
-			uid_entry->alive_time_in_state[i] +=
-				atomic_read(&task->time_in_state[i]);
-		}
-	} while_each_thread(temp, task);
+	hdr = reader->buf;
+	freqs = (u32 *)(hdr + 1);
+	for (i = 0; i < nr_states; i++)
+		freqs[i] = all_freq_table->freq_table[i];
+	rec = (void *)(freqs + nr_states);
+
+	/* A charge in this very jiffy is reported again next time */
+	now = get_jiffies_64();
+
+	rcu_read_lock();
+	hash_for_each_rcu(uid_hash_table, bkt, uid_entry, hash) {
+		if (nr_uids == max_uids)
+			break;
+		if (!reader->full &&
+		    time_before64(READ_ONCE(uid_entry->last_update),
+				  reader->since))
+			continue;
+
+		rec->uid = uid_entry->uid;
+		rec->reserved = 0;
+		uid_entry_fold(uid_entry, rec->time, nr_states);
+		rec = (void *)rec + rec_size;
+		nr_uids++;
+	}
 	rcu_read_unlock();
 
-	hash_for_each(uid_hash_table, bkt, uid_entry, hash) {
-		int max_states = uid_entry->dead_max_states;
+	hdr->version = UID_TIME_IN_STATE_VERSION;
+	hdr->nr_freqs = nr_states;
+	hdr->nr_uids = nr_uids;
+	hdr->flags = reader->full ? UID_TIME_IN_STATE_FULL : 0;
+
+	reader->len = (void *)rec - reader->buf;
+	reader->since = now;
+	reader->full = false;
+	return 0;
+}
 
-		if (uid_entry->alive_max_states > max_states)
-			max_states = uid_entry->alive_max_states;
-		if (max_states)
-			seq_printf(m, "%d:", uid_entry->uid);
-		for (i = 0; i < max_states; ++i) {
-			u64 total_time_in_state = 0;
+static ssize_t uid_time_in_state_bin_read(struct file *file, char __user *ubuf,
+					  size_t count, loff_t *ppos)
+{
+	struct uid_time_in_state_reader *reader = file->private_data;
+	ssize_t ret;
 
-			if (uid_entry->dead_time_in_state &&
-				i < uid_entry->dead_max_states) {
-				total_time_in_state =
-					uid_entry->dead_time_in_state[i];
-			}
-			if (uid_entry->alive_time_in_state &&
-				i < uid_entry->alive_max_states) {
-				total_time_in_state +=
-					uid_entry->alive_time_in_state[i];
-			}
-			seq_printf(m, " %lu", (unsigned long)
-				cputime_to_clock_t(total_time_in_state));
-		}
-		if (max_states)
-			seq_putc(m, '\n');
+	if (!all_freq_table || !cpufreq_all_freq_init)
+		return 0;
 
-		kfree(uid_entry->alive_time_in_state);
-		uid_entry->alive_time_in_state = NULL;
-		uid_entry->alive_max_states = 0;
+	mutex_lock(&reader->lock);
+	if (*ppos == 0) {
+		ret = uid_time_in_state_snapshot(reader);
+		if (ret)
+			goto out;
 	}
+	ret = simple_read_from_buffer(ubuf, count, ppos, reader->buf,
+				      reader->len);
+out:
+	mutex_unlock(&reader->lock);
+	return ret;
+}
 
-	rt_mutex_unlock(&uid_lock);
+static int uid_time_in_state_bin_open(struct inode *inode, struct file *file)
+{
+	struct uid_time_in_state_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	mutex_init(&reader->lock);
+	reader->full = true;
+	file->private_data = reader;
+	return 0;
+}
+
+static int uid_time_in_state_bin_release(struct inode *inode,
+					 struct file *file)
+{
+	struct uid_time_in_state_reader *reader = file->private_data;
+
+	vfree(reader->buf);
+	kfree(reader);
 	return 0;
 }
 
@@ -316,6 +451,25 @@ static int get_index_all_cpufreq_stat(struct all_cpufreq_stats *all_stat,
 	return -1;
 }
 
+/* Charge @cputime at all_freq_table index @all_freq_i to @task's UID */
+static void uid_charge(struct task_struct *task, int all_freq_i,
+		       cputime_t cputime)
+{
+	struct uid_entry *uid_entry;
+	u64 now = get_jiffies_64();
+	uid_t uid;
+
+	rcu_read_lock();
+	uid = from_kuid_munged(&init_user_ns, task_uid(task));
+	uid_entry = find_or_register_uid(uid);
+	if (uid_entry && all_freq_i < uid_entry->max_states) {
+		this_cpu_ptr(uid_entry->time_in_state)[all_freq_i] += cputime;
+		if (READ_ONCE(uid_entry->last_update) != now)
+			WRITE_ONCE(uid_entry->last_update, now);
+	}
+	rcu_read_unlock();
+}
+
 /* Called without cpufreq_stats_lock held */
 void acct_update_power(struct task_struct *task, cputime_t cputime) {
 	struct cpufreq_power_stats *powerstats;
@@ -329,6 +483,8 @@ void acct_update_power(struct task_struct *task, cputime_t cputime) {
 	if (!task)
 		return;
 
+	uid_sys_stats_tick(task);
+
 	cpu_num = task_cpu(task);
 	stats = per_cpu(cpufreq_stats_table, cpu_num);
 	if (!stats)
@@ -337,6 +493,9 @@ void acct_update_power(struct task_struct *task, cputime_t cputime) {
 	all_freq_i = atomic_read(&stats->all_freq_i);
 	time_in_state = READ_ONCE(task->time_in_state);
 
+	if (all_freq_table && cpufreq_all_freq_init && all_freq_i != -1)
+		uid_charge(task, all_freq_i, cputime);
+
 	/* This function is called from a different context
 	 * Interruptions in between reads/assignements are ok
 	 */
@@ -820,22 +979,65 @@ void cpufreq_task_stats_remove_uids(uid_t uid_start, uid_t uid_end)
 {
 	struct uid_entry *uid_entry;
 	struct hlist_node *tmp;
+	unsigned long flags;
 
-	rt_mutex_lock(&uid_lock);
+	spin_lock_irqsave(&uid_lock, flags);
 
 	for (; uid_start <= uid_end; uid_start++) {
 		hash_for_each_possible_safe(uid_hash_table, uid_entry, tmp,
 			hash, uid_start) {
 			if (uid_start == uid_entry->uid) {
-				hash_del(&uid_entry->hash);
-				kfree(uid_entry->dead_time_in_state);
-				kfree(uid_entry);
+				hash_del_rcu(&uid_entry->hash);
+				call_rcu(&uid_entry->rcu, free_uid_entry);
 			}
 		}
+		/* uid_end may be the largest uid_t */
+		if (uid_start == uid_end)
+			break;
+	}
+
+	spin_unlock_irqrestore(&uid_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_task_stats_remove_uids);
+
+/**
+ * cpufreq_stats_get_time_in_state - residency of a CPU at each frequency
+ * @cpu: any CPU of the policy
+ * @freqs: filled with the frequencies of the policy, in kHz
+ * @time: filled with the time spent at each of them, in jiffies
+ * @max: size of @freqs and @time
+ *
+ * The times are the ones shown in stats/time_in_state, brought up to date.
+ *
+ * Return: the number of entries filled, 0 if @cpu has no statistics.
+ */
+int cpufreq_stats_get_time_in_state(unsigned int cpu, unsigned int *freqs,
+				    u64 *time, unsigned int max)
+{
+	struct cpufreq_policy *policy;
+	struct cpufreq_stats *stat;
+	unsigned int i, n = 0;
+
+	policy = cpufreq_cpu_get(cpu);
+	if (!policy)
+		return 0;
+
+	cpufreq_stats_update(policy->cpu);
+	spin_lock(&cpufreq_stats_lock);
+	stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (stat) {
+		n = min(stat->state_num, max);
+		for (i = 0; i < n; i++) {
+			freqs[i] = stat->freq_table[i];
+			time[i] = stat->time_in_state[i];
+		}
 	}
+	spin_unlock(&cpufreq_stats_lock);
 
-	rt_mutex_unlock(&uid_lock);
+	cpufreq_cpu_put(policy);
+	return n;
 }
+EXPORT_SYMBOL_GPL(cpufreq_stats_get_time_in_state);
 
 static int cpufreq_stat_notifier_policy(struct notifier_block *nb,
 		unsigned long val, void *data)
@@ -930,49 +1132,6 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 }
 
 
-static int process_notifier(struct notifier_block *self,
-			unsigned long cmd, void *v)
-{
-	struct task_struct *task = v;
-	struct uid_entry *uid_entry;
-	uid_t uid;
-	int i;
-
-	if (!task)
-		return NOTIFY_OK;
-
-	rt_mutex_lock(&uid_lock);
-
-	uid = from_kuid_munged(current_user_ns(), task_uid(task));
-	uid_entry = find_or_register_uid(uid);
-	if (!uid_entry) {
-		rt_mutex_unlock(&uid_lock);
-		pr_err("%s: failed to find uid %d\n", __func__, uid);
-		return NOTIFY_OK;
-	}
-
-	if (uid_entry->dead_max_states < task->max_states) {
-		uid_entry->dead_time_in_state = krealloc(
-			uid_entry->dead_time_in_state,
-			task->max_states *
-			sizeof(uid_entry->dead_time_in_state[0]),
-			GFP_ATOMIC);
-		memset(uid_entry->dead_time_in_state +
-			uid_entry->dead_max_states,
-			0, (task->max_states - uid_entry->dead_max_states) *
-			sizeof(uid_entry->dead_time_in_state[0]));
-		uid_entry->dead_max_states = task->max_states;
-	}
-
-	for (i = 0; i < task->max_states; ++i) {
-		uid_entry->dead_time_in_state[i] +=
-			atomic_read(&task->time_in_state[i]);
-	}
-
-	rt_mutex_unlock(&uid_lock);
-	return NOTIFY_OK;
-}
-
 static int uid_time_in_state_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, uid_time_in_state_show, PDE_DATA(inode));
@@ -985,6 +1144,13 @@ static const struct file_operations uid_time_in_state_fops = {
 	.release	= single_release,
 };
 
+static const struct file_operations uid_time_in_state_bin_fops = {
+	.open		= uid_time_in_state_bin_open,
+	.read		= uid_time_in_state_bin_read,
+	.llseek		= default_llseek,
+	.release	= uid_time_in_state_bin_release,
+};
+
 static struct notifier_block notifier_policy_block = {
 	.notifier_call = cpufreq_stat_notifier_policy
 };
@@ -993,10 +1159,6 @@ static struct notifier_block notifier_trans_block = {
 	.notifier_call = cpufreq_stat_notifier_trans
 };
 
-static struct notifier_block process_notifier_block = {
-	.notifier_call	= process_notifier,
-};
-
 static int __init cpufreq_stats_init(void)
 {
 	int ret;
@@ -1045,8 +1207,8 @@ static int __init cpufreq_stats_init(void)
 
 	proc_create_data("uid_time_in_state", 0444, NULL,
 		&uid_time_in_state_fops, NULL);
-
-	profile_event_register(PROFILE_TASK_EXIT, &process_notifier_block);
+	proc_create_data("uid_time_in_state_bin", 0444, NULL,
+		&uid_time_in_state_bin_fops, NULL);
 
 	cpufreq_all_freq_init = true;
 	return 0;
@@ -104,6 +104,42 @@ static int cpuidle_find_deepest_state(struct cpuidle_driver *drv,
 	return ret;
 }
 
+/*
+ * Record whether the residency just measured in state @index was what the
+ * governor aimed for, or whether a shallower or a deeper enabled state
+ * would have fit it better.
+ */
+static void cpuidle_account_residency(struct cpuidle_device *dev,
+				      struct cpuidle_driver *drv, int index)
+{
+	struct cpuidle_state_usage *usage = &dev->states_usage[index];
+	int residency = dev->last_residency;
+	int i;
+
+	if (residency < drv->states[index].target_residency) {
+		for (i = index - 1; i >= 0; i--) {
+			if (drv->states[i].disabled ||
+			    dev->states_usage[i].disable)
+				continue;
+			if (drv->states[i].target_residency <= residency) {
+				usage->above++;
+				return;
+			}
+		}
+	} else {
+		for (i = index + 1; i < drv->state_count; i++) {
+			if (drv->states[i].disabled ||
+			    dev->states_usage[i].disable)
+				continue;
+			if (drv->states[i].target_residency > residency)
+				break;
+			usage->below++;
+			return;
+		}
+	}
+	usage->hits++;
+}
+
 /**
  * cpuidle_enter_state - enter the state and update stats
  * @dev: cpuidle device for this cpu
@@ -143,6 +179,7 @@ int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
 		 */
 		dev->states_usage[entered_state].time += dev->last_residency;
 		dev->states_usage[entered_state].usage++;
+		cpuidle_account_residency(dev, drv, entered_state);
 	} else {
 		dev->last_residency = 0;
 	}
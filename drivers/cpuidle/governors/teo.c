@@ -0,0 +1,294 @@
+/*
+ * teo.c - the timer events oriented idle governor
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+
+/*
+ * Concepts behind the teo governor
+ *
+ * The time until the next timer event is the one thing known for sure
+ * about an idle period; the CPU may be woken up earlier by an interrupt,
+ * but never later.  Instead of scaling that time with a correction factor
+ * like menu does, teo keeps per-CPU statistics of where wakeups landed
+ * relative to it.
+ *
+ * The target residencies of the idle states divide idle durations into
+ * bins: bin i holds the durations from the target residency of state i up
+ * to that of state i + 1, so state i is the best fit for them.  After every
+ * wakeup, the bin of the next timer as seen at entry ("timer bin") and the
+ * bin of the measured idle duration ("wakeup bin") are compared:
+ *
+ *  - if they are the same, the timer bin gets a "hit": the timer, or
+ *    something close enough to it, ended the idle period;
+ *  - otherwise the timer bin gets a "miss" and the wakeup bin an "early
+ *    hit": some other event ended the idle period sooner.
+ *
+ * All metrics decay, so they reflect recent behaviour.  To select a state
+ * for the next idle period, teo takes the deepest state fitting the next
+ * timer.  If its bin has had more hits than misses, the timer is likely to
+ * end this idle period too and that state is used.  Otherwise the CPU is
+ * likely to be woken earlier, by interrupts that have been ending idle
+ * periods in some shallower bin, and the shallower state with the most
+ * early hits is used instead.
+ *
+ * Periodic interrupts that are not timers, such as from devices with a
+ * fixed rate, show up as recent idle periods of similar length.  If most
+ * of the last INTERVALS idle periods were shorter than the duration
+ * picked above, the state fitting their average is used when shallower.
+ */
+
+#define PULSE		1024
+#define DECAY_SHIFT	3
+#define INTERVALS	8
+
+struct teo_idle_state {
+	unsigned int early_hits;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+struct teo_cpu {
+	int last_state_idx;
+	int needs_update;
+
+	unsigned int sleep_length_us;
+	struct teo_idle_state states[CPUIDLE_STATE_MAX];
+	unsigned int intervals[INTERVALS];
+	int interval_idx;
+};
+
+static DEFINE_PER_CPU(struct teo_cpu, teo_cpus);
+
+static bool teo_state_enabled(struct cpuidle_driver *drv,
+			      struct cpuidle_device *dev, int i)
+{
+	return !drv->states[i].disabled && !dev->states_usage[i].disable;
+}
+
+/**
+ * teo_update - account the last idle period to the bins
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void teo_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	int last_idx = cpu_data->last_state_idx;
+	struct cpuidle_state *target = &drv->states[last_idx];
+	unsigned int sleep_length_us = cpu_data->sleep_length_us;
+	unsigned int measured_us;
+	int i, idx_timer = -1, idx_hit = -1;
+
+	/*
+	 * Without a residency measurement, assume the timer woke the CPU up.
+	 * Otherwise deduct the exit latency, as menu does, since the wakeup
+	 * event came before the exit from the state completed.
+	 */
+	if (unlikely(!(target->flags & CPUIDLE_FLAG_TIME_VALID))) {
+		measured_us = sleep_length_us;
+	} else {
+		measured_us = cpuidle_get_last_residency(dev);
+
+		if (measured_us > target->exit_latency)
+			measured_us -= target->exit_latency;
+
+		/* Nothing can wake the CPU up later than the timer */
+		if (measured_us > sleep_length_us)
+			measured_us = sleep_length_us;
+	}
+
+	for (i = 0; i < drv->state_count; i++) {
+		struct teo_idle_state *s = &cpu_data->states[i];
+		unsigned int residency = drv->states[i].target_residency;
+
+		s->early_hits -= s->early_hits >> DECAY_SHIFT;
+		s->hits -= s->hits >> DECAY_SHIFT;
+		s->misses -= s->misses >> DECAY_SHIFT;
+
+		if (residency <= sleep_length_us)
+			idx_timer = i;
+		if (residency <= measured_us)
+			idx_hit = i;
+	}
+
+	if (idx_timer >= 0) {
+		if (idx_timer == idx_hit) {
+			cpu_data->states[idx_timer].hits += PULSE;
+		} else {
+			cpu_data->states[idx_timer].misses += PULSE;
+			if (idx_hit >= 0)
+				cpu_data->states[idx_hit].early_hits += PULSE;
+		}
+	}
+
+	cpu_data->intervals[cpu_data->interval_idx++] = measured_us;
+	if (cpu_data->interval_idx >= INTERVALS)
+		cpu_data->interval_idx = 0;
+}
+
+/* Deepest enabled state below @limit whose target residency fits @us */
+static int teo_find_state(struct cpuidle_driver *drv,
+			  struct cpuidle_device *dev, int limit,
+			  unsigned int us)
+{
+	int i, idx = -1;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < limit; i++) {
+		if (!teo_state_enabled(drv, dev, i))
+			continue;
+		if (drv->states[i].target_residency > us)
+			break;
+		idx = i;
+	}
+	return idx;
+}
+
+/**
+ * teo_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int teo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int duration_us, hits = 0, misses = 0, early_hits = 0;
+	unsigned int count = 0;
+	u64 sum = 0;
+	int i, idx = -1, max_early_idx = -1;
+
+	if (cpu_data->needs_update) {
+		teo_update(drv, dev);
+		cpu_data->needs_update = 0;
+	}
+
+	cpu_data->last_state_idx = CPUIDLE_DRIVER_STATE_START - 1;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	cpu_data->sleep_length_us = ktime_to_us(tick_nohz_get_sleep_length());
+	duration_us = cpu_data->sleep_length_us;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < drv->state_count; i++) {
+		struct teo_idle_state *s = &cpu_data->states[i];
+
+		if (!teo_state_enabled(drv, dev, i))
+			continue;
+
+		/* Shallow enough for the latency limit */
+		if (drv->states[i].exit_latency > latency_req)
+			break;
+		if (drv->states[i].target_residency > duration_us)
+			break;
+
+		idx = i;
+		hits = s->hits;
+		misses = s->misses;
+		if (early_hits < s->early_hits) {
+			early_hits = s->early_hits;
+			max_early_idx = i;
+		}
+	}
+
+	/*
+	 * The timer's bin has been missed more often than hit: expect an
+	 * earlier wakeup, in the bin that has had most of them.
+	 */
+	if (hits <= misses && max_early_idx >= 0 && max_early_idx < idx) {
+		idx = max_early_idx;
+		duration_us = drv->states[idx].target_residency;
+	}
+
+	/* Repeating short idle periods the bins have not caught up with */
+	for (i = 0; i < INTERVALS; i++) {
+		if (cpu_data->intervals[i] < duration_us) {
+			sum += cpu_data->intervals[i];
+			count++;
+		}
+	}
+	if (idx >= 0 && count > INTERVALS / 2) {
+		i = teo_find_state(drv, dev, idx, div_u64(sum, count));
+		if (i >= 0)
+			idx = i;
+	}
+
+	/*
+	 * Like menu, default to the first non-polling state rather than
+	 * busy polling unless the timer is really close.
+	 */
+	if (idx < 0 && cpu_data->sleep_length_us > 5 &&
+	    teo_state_enabled(drv, dev, CPUIDLE_DRIVER_STATE_START) &&
+	    drv->states[CPUIDLE_DRIVER_STATE_START].exit_latency <= latency_req)
+		idx = CPUIDLE_DRIVER_STATE_START;
+
+	if (idx >= 0)
+		cpu_data->last_state_idx = idx;
+
+	return cpu_data->last_state_idx;
+}
+
+/**
+ * teo_reflect - records that data structures need update
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ */
+static void teo_reflect(struct cpuidle_device *dev, int index)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+
+	cpu_data->last_state_idx = index;
+	if (index >= 0)
+		cpu_data->needs_update = 1;
+}
+
+/**
+ * teo_enable_device - initializes the statistics of a CPU
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int teo_enable_device(struct cpuidle_driver *drv,
+			     struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = &per_cpu(teo_cpus, dev->cpu);
+	int i;
+
+	memset(cpu_data, 0, sizeof(*cpu_data));
+
+	/* No history yet: do not let it pull selection to shallow states */
+	for (i = 0; i < INTERVALS; i++)
+		cpu_data->intervals[i] = UINT_MAX;
+
+	return 0;
+}
+
+static struct cpuidle_governor teo_governor = {
+	.name =		"teo",
+	.rating =	19,
+	.enable =	teo_enable_device,
+	.select =	teo_select,
+	.reflect =	teo_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_teo - initializes the governor
+ */
+static int __init init_teo(void)
+{
+	return cpuidle_register_governor(&teo_governor);
+}
+
+postcore_initcall(init_teo);
@@ -24,10 +24,12 @@
 #include <linux/platform_device.h>
 #include <linux/of.h>
 #include <linux/of_irq.h>
+#include <linux/of_device.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
 #include <linux/cpu_pm.h>
 #include <linux/cpu.h>
+#include <linux/math64.h>
 #include "governor.h"
 #include "governor_memlat.h"
 #include <linux/perf_event.h>
@@ -36,11 +38,44 @@ enum ev_index {
 	INST_IDX,
 	L2DM_IDX,
 	CYC_IDX,
+	STALL_IDX,
 	NUM_EVENTS
 };
 #define INST_EV		0x08
 #define L2DM_EV		0x17
 #define CYC_EV		0x11
+#define STALL_EV	0x24
+
+/*
+ * The perf events counted on each CPU.  The stall event is optional: if
+ * the PMU does not support it, the monitor reports no stalls.
+ */
+struct memlat_events {
+	u32 type;
+	u64 config[NUM_EVENTS];
+};
+
+/* ARMv8 PMU raw events, as used on the MSM parts */
+static const struct memlat_events arm_events = {
+	.type = PERF_TYPE_RAW,
+	.config = {
+		[INST_IDX] = INST_EV,
+		[L2DM_IDX] = L2DM_EV,
+		[CYC_IDX] = CYC_EV,
+		[STALL_IDX] = STALL_EV,
+	},
+};
+
+/* Generic hardware events, mapped by any PMU driver, e.g. x86 or KVM's */
+static const struct memlat_events generic_events = {
+	.type = PERF_TYPE_HARDWARE,
+	.config = {
+		[INST_IDX] = PERF_COUNT_HW_INSTRUCTIONS,
+		[L2DM_IDX] = PERF_COUNT_HW_CACHE_MISSES,
+		[CYC_IDX] = PERF_COUNT_HW_CPU_CYCLES,
+		[STALL_IDX] = PERF_COUNT_HW_STALLED_CYCLES_BACKEND,
+	},
+};
 
 struct event_data {
 	struct perf_event *pevent;
@@ -49,6 +84,7 @@ struct event_data {
 
 struct memlat_hwmon_data {
 	struct event_data events[NUM_EVENTS];
+	const struct memlat_events *set;
 	ktime_t prev_ts;
 	bool init_pending;
 };
@@ -56,6 +92,7 @@ static DEFINE_PER_CPU(struct memlat_hwmon_data, pm_data);
 
 struct cpu_grp_info {
 	cpumask_t cpus;
+	const struct memlat_events *events;
 	struct memlat_hwmon hw;
 	struct notifier_block arm_memlat_cpu_notif;
 };
@@ -100,7 +137,7 @@ static void read_perf_counters(int cpu, struct cpu_grp_info *cpu_grp)
 	int cpu_idx;
 	struct memlat_hwmon_data *hw_data = &per_cpu(pm_data, cpu);
 	struct memlat_hwmon *hw = &cpu_grp->hw;
-	unsigned long cyc_cnt;
+	unsigned long cyc_cnt, stall_cnt = 0;
 
 	if (hw_data->init_pending)
 		return;
@@ -115,6 +152,11 @@ static void read_perf_counters(int cpu, struct cpu_grp_info *cpu_grp)
 
 	cyc_cnt = read_event(&hw_data->events[CYC_IDX]);
 	hw->core_stats[cpu_idx].freq = compute_freq(hw_data, cyc_cnt);
+
+	if (hw_data->events[STALL_IDX].pevent)
+		stall_cnt = read_event(&hw_data->events[STALL_IDX]);
+	hw->core_stats[cpu_idx].stall_pct = cyc_cnt ?
+		min_t(u64, div64_u64((u64)stall_cnt * 100, cyc_cnt), 100) : 0;
 }
 
 static unsigned long get_cnt(struct memlat_hwmon *hw)
@@ -135,7 +177,9 @@ static void delete_events(struct memlat_hwmon_data *hw_data)
 
 	for (i = 0; i < NUM_EVENTS; i++) {
 		hw_data->events[i].prev_count = 0;
-		perf_event_release_kernel(hw_data->events[i].pevent);
+		if (hw_data->events[i].pevent)
+			perf_event_release_kernel(hw_data->events[i].pevent);
+		hw_data->events[i].pevent = NULL;
 	}
 }
 
@@ -159,13 +203,14 @@ static void stop_hwmon(struct memlat_hwmon *hw)
 		hw->core_stats[idx].inst_count = 0;
 		hw->core_stats[idx].mem_count = 0;
 		hw->core_stats[idx].freq = 0;
+		hw->core_stats[idx].stall_pct = 0;
 	}
 	put_online_cpus();
 
 	unregister_cpu_notifier(&cpu_grp->arm_memlat_cpu_notif);
 }
 
-static struct perf_event_attr *alloc_attr(void)
+static struct perf_event_attr *alloc_attr(u32 type)
 {
 	struct perf_event_attr *attr;
 
@@ -173,7 +218,7 @@ static struct perf_event_attr *alloc_attr(void)
 	if (!attr)
 		return ERR_PTR(-ENOMEM);
 
-	attr->type = PERF_TYPE_RAW;
+	attr->type = type;
 	attr->size = sizeof(struct perf_event_attr);
 	attr->pinned = 1;
 	attr->exclude_idle = 1;
@@ -181,43 +226,37 @@ static struct perf_event_attr *alloc_attr(void)
 	return attr;
 }
 
-static int set_events(struct memlat_hwmon_data *hw_data, int cpu)
+static int set_events(struct memlat_hwmon_data *hw_data, int cpu,
+		      const struct memlat_events *events)
 {
 	struct perf_event *pevent;
 	struct perf_event_attr *attr;
-	int err;
+	int i, err;
 
 	/* Allocate an attribute for event initialization */
-	attr = alloc_attr();
+	attr = alloc_attr(events->type);
 	if (IS_ERR(attr))
 		return PTR_ERR(attr);
 
-	attr->config = INST_EV;
-	pevent = perf_event_create_kernel_counter(attr, cpu, NULL, NULL, NULL);
-	if (IS_ERR(pevent))
-		goto err_out;
-	hw_data->events[INST_IDX].pevent = pevent;
-	perf_event_enable(hw_data->events[INST_IDX].pevent);
-
-	attr->config = L2DM_EV;
-	pevent = perf_event_create_kernel_counter(attr, cpu, NULL, NULL, NULL);
-	if (IS_ERR(pevent))
-		goto err_out;
-	hw_data->events[L2DM_IDX].pevent = pevent;
-	perf_event_enable(hw_data->events[L2DM_IDX].pevent);
-
-	attr->config = CYC_EV;
-	pevent = perf_event_create_kernel_counter(attr, cpu, NULL, NULL, NULL);
-	if (IS_ERR(pevent))
-		goto err_out;
-	hw_data->events[CYC_IDX].pevent = pevent;
-	perf_event_enable(hw_data->events[CYC_IDX].pevent);
+	for (i = 0; i < NUM_EVENTS; i++) {
+		attr->config = events->config[i];
+		pevent = perf_event_create_kernel_counter(attr, cpu, NULL,
+							  NULL, NULL);
+		if (IS_ERR(pevent)) {
+			if (i == STALL_IDX)
+				continue;
+			goto err_out;
+		}
+		hw_data->events[i].pevent = pevent;
+		perf_event_enable(hw_data->events[i].pevent);
+	}
 
 	kfree(attr);
 	return 0;
 
 err_out:
 	err = PTR_ERR(pevent);
+	delete_events(hw_data);
 	kfree(attr);
 	return err;
 }
@@ -231,7 +270,7 @@ static int arm_memlat_cpu_callback(struct notifier_block *nb,
 	if ((action != CPU_ONLINE) || !hw_data->init_pending)
 		return NOTIFY_OK;
 
-	if (set_events(hw_data, cpu))
+	if (set_events(hw_data, cpu, hw_data->set))
 		pr_warn("Failed to create perf event for CPU%lu\n", cpu);
 
 	hw_data->init_pending = false;
@@ -251,7 +290,8 @@ static int start_hwmon(struct memlat_hwmon *hw)
 	get_online_cpus();
 	for_each_cpu(cpu, &cpu_grp->cpus) {
 		hw_data = &per_cpu(pm_data, cpu);
-		ret = set_events(hw_data, cpu);
+		hw_data->set = cpu_grp->events;
+		ret = set_events(hw_data, cpu, cpu_grp->events);
 		if (ret) {
 			if (!cpu_online(cpu)) {
 				hw_data->init_pending = true;
@@ -294,18 +334,44 @@ static int get_mask_from_dev_handle(struct platform_device *pdev,
 	return ret;
 }
 
-static int arm_memlat_mon_driver_probe(struct platform_device *pdev)
+static struct of_device_id match_table[] = {
+	{ .compatible = "qcom,arm-memlat-mon", .data = &arm_events },
+	{ .compatible = "perf-memlat-mon", .data = &generic_events },
+	{}
+};
+
+static const struct platform_device_id id_table[] = {
+	{ "perf-memlat-mon", (kernel_ulong_t)&generic_events },
+	{}
+};
+
+/* Target and CPUs from the device tree, or from platform data without one */
+static int get_target_and_cpus(struct platform_device *pdev,
+			       struct cpu_grp_info *cpu_grp)
 {
 	struct device *dev = &pdev->dev;
-	struct memlat_hwmon *hw;
-	struct cpu_grp_info *cpu_grp;
-	int cpu, ret;
+	struct memlat_mon_platform_data *pdata = dev_get_platdata(dev);
+	struct memlat_hwmon *hw = &cpu_grp->hw;
+	const struct of_device_id *match;
 
-	cpu_grp = devm_kzalloc(dev, sizeof(*cpu_grp), GFP_KERNEL);
-	if (!cpu_grp)
-		return -ENOMEM;
-	cpu_grp->arm_memlat_cpu_notif.notifier_call = arm_memlat_cpu_callback;
-	hw = &cpu_grp->hw;
+	if (!dev->of_node) {
+		if (!pdata || !pdata->target) {
+			dev_err(dev, "No platform data\n");
+			return -ENODEV;
+		}
+		cpu_grp->events = (const struct memlat_events *)
+				  platform_get_device_id(pdev)->driver_data;
+		hw->dev = pdata->target;
+		cpumask_and(&cpu_grp->cpus, &pdata->cpus, cpu_possible_mask);
+		if (cpumask_empty(&cpu_grp->cpus)) {
+			dev_err(dev, "CPU list is empty\n");
+			return -ENODEV;
+		}
+		return 0;
+	}
+
+	match = of_match_device(match_table, dev);
+	cpu_grp->events = match->data;
 
 	hw->dev = dev;
 	hw->of_node = of_parse_phandle(dev->of_node, "qcom,target-dev", 0);
@@ -318,6 +384,25 @@ static int arm_memlat_mon_driver_probe(struct platform_device *pdev)
 		dev_err(dev, "CPU list is empty\n");
 		return -ENODEV;
 	}
+	return 0;
+}
+
+static int arm_memlat_mon_driver_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct memlat_hwmon *hw;
+	struct cpu_grp_info *cpu_grp;
+	int cpu, ret;
+
+	cpu_grp = devm_kzalloc(dev, sizeof(*cpu_grp), GFP_KERNEL);
+	if (!cpu_grp)
+		return -ENOMEM;
+	cpu_grp->arm_memlat_cpu_notif.notifier_call = arm_memlat_cpu_callback;
+	hw = &cpu_grp->hw;
+
+	ret = get_target_and_cpus(pdev, cpu_grp);
+	if (ret)
+		return ret;
 
 	hw->num_cores = cpumask_weight(&cpu_grp->cpus);
 	hw->core_stats = devm_kzalloc(dev, hw->num_cores *
@@ -341,13 +426,9 @@ static int arm_memlat_mon_driver_probe(struct platform_device *pdev)
 	return 0;
 }
 
-static struct of_device_id match_table[] = {
-	{ .compatible = "qcom,arm-memlat-mon" },
-	{}
-};
-
 static struct platform_driver arm_memlat_mon_driver = {
 	.probe = arm_memlat_mon_driver_probe,
+	.id_table = id_table,
 	.driver = {
 		.name = "arm-memlat-mon",
 		.of_match_table = match_table,
@@ -21,6 +21,7 @@
 #include <linux/delay.h>
 #include <linux/ktime.h>
 #include <linux/time.h>
+#include <linux/math64.h>
 #include <linux/err.h>
 #include <linux/errno.h>
 #include <linux/mutex.h>
@@ -33,10 +34,29 @@
 
 #include <trace/events/power.h>
 
+#define MAX_VOTES	16
+
+/* Samples that ended in one vote, and how stalled the cores were */
+struct memlat_vote_stats {
+	unsigned long freq;
+	u64 samples;
+	u64 stall_sum;
+};
+
+struct memlat_stats {
+	u64 samples;
+	u64 bound;
+	u64 other;
+	unsigned int nr_votes;
+	struct memlat_vote_stats votes[MAX_VOTES];
+};
+
 struct memlat_node {
 	unsigned int ratio_ceil;
+	unsigned int stall_floor;
 	unsigned int freq_thresh_mhz;
 	unsigned int mult_factor;
+	struct memlat_stats stats;
 	bool mon_started;
 	struct list_head list;
 	void *orig_data;
@@ -83,29 +103,76 @@ show_attr(__attr)			\
 store_attr(__attr, min, max)		\
 static DEVICE_ATTR(__attr, 0644, show_##__attr, store_##__attr)
 
+static unsigned int core_ratio(struct dev_stats *stats)
+{
+	unsigned int ratio = stats->inst_count;
+
+	if (stats->mem_count)
+		ratio /= stats->mem_count;
+	return ratio;
+}
+
+/*
+ * A core is latency bound if it retires few instructions per cache miss
+ * and, when a stall floor is set and the monitor counts stalls, also spends
+ * enough of its cycles stalled for more memory bandwidth to help.
+ */
+static bool core_is_bound(struct memlat_node *node, struct dev_stats *stats,
+			  unsigned int ratio)
+{
+	if (!ratio || ratio > node->ratio_ceil)
+		return false;
+	return !node->stall_floor || stats->stall_pct >= node->stall_floor;
+}
+
+static void account_vote(struct memlat_node *node, unsigned long freq,
+			 unsigned int stall_pct)
+{
+	struct memlat_stats *st = &node->stats;
+	unsigned int i;
+
+	st->samples++;
+	if (freq)
+		st->bound++;
+
+	for (i = 0; i < st->nr_votes; i++)
+		if (st->votes[i].freq == freq)
+			break;
+	if (i == st->nr_votes) {
+		if (i == MAX_VOTES) {
+			st->other++;
+			return;
+		}
+		st->votes[i].freq = freq;
+		st->nr_votes++;
+	}
+	st->votes[i].samples++;
+	st->votes[i].stall_sum += stall_pct;
+}
+
 static unsigned long compute_dev_vote(struct devfreq *df)
 {
 	int i, lat_dev;
 	struct memlat_node *node = df->data;
 	struct memlat_hwmon *hw = node->hw;
 	unsigned long max_freq = 0;
-	unsigned int ratio;
+	unsigned int ratio, max_stall = 0;
 
 	hw->get_cnt(hw);
 
 	for (i = 0; i < hw->num_cores; i++) {
-		ratio = hw->core_stats[i].inst_count;
-
-		if (hw->core_stats[i].mem_count)
-			ratio /= hw->core_stats[i].mem_count;
+		ratio = core_ratio(&hw->core_stats[i]);
 
 		trace_memlat_dev_meas(dev_name(df->dev.parent),
 					hw->core_stats[i].id,
 					hw->core_stats[i].inst_count,
 					hw->core_stats[i].mem_count,
-					hw->core_stats[i].freq, ratio);
+					hw->core_stats[i].freq, ratio,
+					hw->core_stats[i].stall_pct);
+
+		max_stall = max(max_stall, hw->core_stats[i].stall_pct);
 
-		if (ratio && ratio <= node->ratio_ceil
+		if (core_is_bound(node, &hw->core_stats[i], ratio)
 		    && hw->core_stats[i].freq >= node->freq_thresh_mhz
 		    && hw->core_stats[i].freq > max_freq) {
 			lat_dev = i;
@@ -113,6 +180,8 @@ static unsigned long compute_dev_vote(struct devfreq *df)
 		}
 	}
 
+	account_vote(node, max_freq * node->mult_factor, max_stall);
+
 	if (max_freq)
 		trace_memlat_dev_update(dev_name(df->dev.parent),
 					hw->core_stats[lat_dev].id,
@@ -131,7 +200,8 @@ static struct memlat_node *find_memlat_node(struct devfreq *df)
 	mutex_lock(&list_lock);
 	list_for_each_entry(node, &memlat_list, list)
 		if (node->hw->dev == df->dev.parent ||
-		    node->hw->of_node == df->dev.parent->of_node) {
+		    (node->hw->of_node &&
+		     node->hw->of_node == df->dev.parent->of_node)) {
 			found = node;
 			break;
 		}
@@ -189,6 +259,7 @@ static int gov_start(struct devfreq *df)
 	hw->df = df;
 	node->orig_data = df->data;
 	df->data = node;
+	memset(&node->stats, 0, sizeof(node->stats));
 
 	if (start_monitor(df))
 		goto err_start;
@@ -234,13 +305,60 @@ static int devfreq_memlat_get_freq(struct devfreq *df,
 }
 
 gov_attr(ratio_ceil, 1U, 1000U);
+gov_attr(stall_floor, 0U, 100U);
 gov_attr(freq_thresh_mhz, 300U, 5000U);
 gov_attr(mult_factor, 1U, 10U);
 
+/*
+ * The last sample of every core, then how often each frequency was voted
+ * since the governor started and the average stall percentage of the most
+ * stalled core in those samples.
+ */
+static ssize_t show_stats(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct devfreq *df = to_devfreq(dev);
+	struct memlat_node *node = df->data;
+	struct memlat_hwmon *hw = node->hw;
+	struct memlat_stats *st = &node->stats;
+	struct dev_stats *cs;
+	ssize_t cnt = 0;
+	int i;
+
+	mutex_lock(&df->lock);
+	cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt,
+			 "core inst mem ratio stall%% freq\n");
+	for (i = 0; i < hw->num_cores; i++) {
+		cs = &hw->core_stats[i];
+		cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt,
+				 "%d %lu %lu %u %u %lu\n", cs->id,
+				 cs->inst_count, cs->mem_count,
+				 core_ratio(cs), cs->stall_pct, cs->freq);
+	}
+
+	cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt,
+			 "samples %llu bound %llu other %llu\n",
+			 st->samples, st->bound, st->other);
+	cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt, "vote samples stall%%\n");
+	for (i = 0; i < st->nr_votes; i++)
+		cnt += scnprintf(buf + cnt, PAGE_SIZE - cnt,
+				 "%lu %llu %llu\n", st->votes[i].freq,
+				 st->votes[i].samples,
+				 div64_u64(st->votes[i].stall_sum,
+					   st->votes[i].samples));
+	mutex_unlock(&df->lock);
+
+	return cnt;
+}
+
+static DEVICE_ATTR(stats, 0444, show_stats, NULL);
+
 static struct attribute *dev_attr[] = {
 	&dev_attr_ratio_ceil.attr,
+	&dev_attr_stall_floor.attr,
 	&dev_attr_freq_thresh_mhz.attr,
 	&dev_attr_mult_factor.attr,
+	&dev_attr_stats.attr,
 	NULL,
 };
 
@@ -333,6 +451,34 @@ int register_memlat(struct device *dev, struct memlat_hwmon *hw)
 
 	return ret;
 }
+EXPORT_SYMBOL_GPL(register_memlat);
+
+/*
+ * Undo register_memlat().  The devfreq device using @hw must have been
+ * removed, or switched to another governor, first.
+ */
+void unregister_memlat(struct memlat_hwmon *hw)
+{
+	struct memlat_node *node, *found = NULL;
+
+	mutex_lock(&list_lock);
+	list_for_each_entry(node, &memlat_list, list)
+		if (node->hw == hw) {
+			found = node;
+			list_del(&node->list);
+			break;
+		}
+	mutex_unlock(&list_lock);
+
+	if (!found)
+		return;
+
+	mutex_lock(&state_lock);
+	if (!--use_cnt)
+		devfreq_remove_governor(&devfreq_gov_memlat);
+	mutex_unlock(&state_lock);
+}
+EXPORT_SYMBOL_GPL(unregister_memlat);
 
 MODULE_DESCRIPTION("HW monitor based dev DDR bandwidth voting driver");
 MODULE_LICENSE("GPL v2");
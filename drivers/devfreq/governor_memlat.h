@@ -15,6 +15,7 @@
 #define _GOVERNOR_BW_HWMON_H
 
 #include <linux/kernel.h>
+#include <linux/cpumask.h>
 #include <linux/devfreq.h>
 
 /**
@@ -23,12 +24,16 @@
  * @mem_count:			Number of memory accesses made.
  * @freq:			Effective frequency of the device in the
  *				last interval.
+ * @stall_pct:			Percentage of cycles stalled in the last
+ *				interval, 0 if the monitor cannot count
+ *				stalls.
  */
 struct dev_stats {
 	int id;
 	unsigned long inst_count;
 	unsigned long mem_count;
 	unsigned long freq;
+	unsigned int stall_pct;
 };
 
 /**
@@ -65,8 +70,22 @@ struct memlat_hwmon {
 	struct devfreq *df;
 };
 
+/**
+ * struct memlat_mon_platform_data - perf based monitor without DT
+ * @cpus:			CPUs to monitor.
+ * @target:			Device whose devfreq node the monitor feeds.
+ *
+ * Used by the "perf-memlat-mon" platform device, which counts generic
+ * perf hardware events and so works on any architecture with a PMU.
+ */
+struct memlat_mon_platform_data {
+	cpumask_t cpus;
+	struct device *target;
+};
+
 #ifdef CONFIG_DEVFREQ_GOV_MEMLAT
 int register_memlat(struct device *dev, struct memlat_hwmon *hw);
+void unregister_memlat(struct memlat_hwmon *hw);
 int update_memlat(struct memlat_hwmon *hw);
 #else
 static inline int register_memlat(struct device *dev,
@@ -74,6 +93,9 @@ static inline int register_memlat(struct device *dev,
 {
 	return 0;
 }
+static inline void unregister_memlat(struct memlat_hwmon *hw)
+{
+}
 static inline int update_memlat(struct memlat_hwmon *hw)
 {
 	return 0;
@@ -0,0 +1,565 @@
+/*
+ * offload engine driver that runs memcpy, xor and raid6 p+q descriptors
+ * on spare CPUs
+ *
+ * Without an offload engine the async_tx api computes parity in the
+ * submitting thread, so md raid456 stripe handling stalls while it does.
+ * This driver registers a dma_device with one channel per online CPU
+ * whose descriptors are executed, in submission order, by a work item on
+ * an unbound workqueue.  Completion, callbacks and dependency chains are
+ * handled the same way a hardware engine's cleanup path would handle
+ * them, so the submitting thread is free to go on issuing I/O.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/cpumask.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/platform_device.h>
+#include <linux/raid/pq.h>
+#include <linux/raid/xor.h>
+
+#include "dmaengine.h"
+
+#define CPU_DMA_NAME		"cpu-dma"
+
+/* sources per descriptor; async_gen_syndrome never asks for more */
+#define CPU_DMA_MAX_SRCS	253
+
+static unsigned int max_channels;
+module_param(max_channels, uint, S_IRUGO);
+MODULE_PARM_DESC(max_channels,
+		 "Maximum number of channels to register (default: one per online CPU)");
+
+struct cpu_dma_chan {
+	struct dma_chan common;
+	spinlock_t lock;
+	struct list_head submitted;	/* tx_submit()ed, not yet issued */
+	struct list_head issued;	/* waiting to be executed */
+	struct list_head completed;	/* done, waiting for the client ack */
+	bool busy;			/* someone is executing ->issued */
+	struct work_struct work;
+};
+
+struct cpu_dma_device {
+	struct dma_device common;
+	struct platform_device *pdev;
+	struct workqueue_struct *wq;
+	unsigned int chancnt;
+	struct cpu_dma_chan chan[0];
+};
+
+/*
+ * For DMA_PQ descriptors whose coefficients are {02}^i of increasing i the
+ * sources are laid out in ptr[] the way raid6_call.gen_syndrome() wants
+ * them, with holes filled by the zero page and P and Q at the end, and scf
+ * is NULL.  Anything else (p or q disabled, continuation, the recovery
+ * code's arbitrary coefficients) keeps the sources packed, copies the
+ * coefficients after ptr[] and goes through the generic loop.
+ */
+struct cpu_dma_desc {
+	struct dma_async_tx_descriptor txd;
+	struct list_head node;
+	enum dma_transaction_type type;
+	size_t len;
+	void *dest;
+	void *p;
+	void *q;
+	const u8 *scf;
+	unsigned int src_cnt;
+	void *ptr[0];
+};
+
+#define to_cpu_dma_chan(chan)	\
+	container_of(chan, struct cpu_dma_chan, common)
+
+#define to_cpu_dma_desc(tx)	\
+	container_of(tx, struct cpu_dma_desc, txd)
+
+static struct cpu_dma_device *cpu_dma;
+
+/* inverse of raid6_gfexp[], 0xff for the unused log of zero */
+static u8 cpu_dma_gflog[256];
+
+/* the engine is the CPU: bus addresses map straight back to the lowmem map */
+static void *cpu_dma_addr(struct dma_chan *chan, dma_addr_t addr)
+{
+	return phys_to_virt(dma_to_phys(chan->device->dev, addr));
+}
+
+static void cpu_dma_do_xor(struct cpu_dma_desc *d)
+{
+	unsigned int i, cnt;
+
+	/* ptr[0] is the destination itself when it is also a source */
+	if (d->ptr[0] != d->dest)
+		memcpy(d->dest, d->ptr[0], d->len);
+
+	for (i = 1; i < d->src_cnt; i += cnt) {
+		cnt = min_t(unsigned int, d->src_cnt - i, MAX_XOR_BLOCKS);
+		xor_blocks(cnt, d->len, d->dest, &d->ptr[i]);
+	}
+}
+
+static void cpu_dma_do_pq(struct cpu_dma_desc *d)
+{
+	bool cont = d->txd.flags & DMA_PREP_CONTINUE;
+	u8 *p = d->p, *q = d->q;
+	unsigned int k;
+	size_t i;
+	u8 wp, wq, b;
+
+	if (!d->scf) {
+		raid6_call.gen_syndrome(d->src_cnt + 2, d->len, d->ptr);
+		return;
+	}
+
+	for (i = 0; i < d->len; i++) {
+		wp = (cont && p) ? p[i] : 0;
+		wq = (cont && q) ? q[i] : 0;
+		for (k = 0; k < d->src_cnt; k++) {
+			b = ((u8 *)d->ptr[k])[i];
+			wp ^= b;
+			wq ^= raid6_gfmul[d->scf[k]][b];
+		}
+		if (p)
+			p[i] = wp;
+		if (q)
+			q[i] = wq;
+	}
+}
+
+static void cpu_dma_exec(struct cpu_dma_desc *d)
+{
+	switch (d->type) {
+	case DMA_MEMCPY:
+		memcpy(d->dest, d->ptr[0], d->len);
+		break;
+	case DMA_XOR:
+		cpu_dma_do_xor(d);
+		break;
+	case DMA_PQ:
+		cpu_dma_do_pq(d);
+		break;
+	default:
+		break;
+	}
+}
+
+/* free the completed descriptors the client is done with */
+static void cpu_dma_clean(struct cpu_dma_chan *c)
+{
+	struct cpu_dma_desc *d, *_d;
+
+	list_for_each_entry_safe(d, _d, &c->completed, node) {
+		if (!async_tx_test_ack(&d->txd))
+			continue;
+		list_del(&d->node);
+		kfree(d);
+	}
+}
+
+/*
+ * Execute everything issued on @c, in order.  Only one context runs a
+ * channel at a time, which is what keeps fenced descriptors behind the
+ * ones they depend on.
+ */
+static void cpu_dma_run(struct cpu_dma_chan *c, bool can_sleep)
+{
+	struct cpu_dma_desc *d;
+
+	spin_lock_bh(&c->lock);
+	if (c->busy) {
+		spin_unlock_bh(&c->lock);
+		return;
+	}
+	c->busy = true;
+
+	while (!list_empty(&c->issued)) {
+		d = list_first_entry(&c->issued, struct cpu_dma_desc, node);
+		list_del(&d->node);
+		spin_unlock_bh(&c->lock);
+
+		cpu_dma_exec(d);
+
+		/* results must be visible before the cookie says so */
+		smp_wmb();
+		spin_lock_bh(&c->lock);
+		dma_cookie_complete(&d->txd);
+		spin_unlock_bh(&c->lock);
+
+		dma_descriptor_unmap(&d->txd);
+		if (d->txd.callback)
+			d->txd.callback(d->txd.callback_param);
+		dma_run_dependencies(&d->txd);
+
+		if (can_sleep)
+			cond_resched();
+
+		spin_lock_bh(&c->lock);
+		list_add_tail(&d->node, &c->completed);
+	}
+
+	c->busy = false;
+	cpu_dma_clean(c);
+	spin_unlock_bh(&c->lock);
+}
+
+static void cpu_dma_work(struct work_struct *work)
+{
+	cpu_dma_run(container_of(work, struct cpu_dma_chan, work), true);
+}
+
+static dma_cookie_t cpu_dma_tx_submit(struct dma_async_tx_descriptor *tx)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(tx->chan);
+	struct cpu_dma_desc *d = to_cpu_dma_desc(tx);
+	dma_cookie_t cookie;
+
+	spin_lock_bh(&c->lock);
+	cookie = dma_cookie_assign(tx);
+	list_add_tail(&d->node, &c->submitted);
+	spin_unlock_bh(&c->lock);
+
+	return cookie;
+}
+
+static void cpu_dma_issue_pending(struct dma_chan *chan)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	bool queue;
+
+	spin_lock_bh(&c->lock);
+	list_splice_tail_init(&c->submitted, &c->issued);
+	queue = !list_empty(&c->issued);
+	spin_unlock_bh(&c->lock);
+
+	if (queue)
+		queue_work(cpu_dma->wq, &c->work);
+}
+
+/*
+ * Pollers such as dma_sync_wait() may spin with preemption disabled, so
+ * rather than waiting for the worker they execute the channel themselves
+ * when it is idle.
+ */
+static enum dma_status cpu_dma_tx_status(struct dma_chan *chan,
+					 dma_cookie_t cookie,
+					 struct dma_tx_state *txstate)
+{
+	enum dma_status ret;
+
+	ret = dma_cookie_status(chan, cookie, txstate);
+	if (ret == DMA_COMPLETE)
+		return ret;
+
+	cpu_dma_run(to_cpu_dma_chan(chan), false);
+
+	return dma_cookie_status(chan, cookie, txstate);
+}
+
+static struct cpu_dma_desc *
+cpu_dma_alloc_desc(struct dma_chan *chan, enum dma_transaction_type type,
+		   unsigned int nptr, size_t extra, size_t len,
+		   unsigned long flags)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	struct cpu_dma_desc *d;
+
+	spin_lock_bh(&c->lock);
+	cpu_dma_clean(c);
+	spin_unlock_bh(&c->lock);
+
+	d = kzalloc(sizeof(*d) + nptr * sizeof(void *) + extra, GFP_ATOMIC);
+	if (!d)
+		return NULL;
+
+	dma_async_tx_descriptor_init(&d->txd, chan);
+	d->txd.tx_submit = cpu_dma_tx_submit;
+	d->txd.flags = flags;
+	d->type = type;
+	d->len = len;
+
+	return d;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
+		    size_t len, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_MEMCPY, 1, 0, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dest = cpu_dma_addr(chan, dest);
+	d->ptr[0] = cpu_dma_addr(chan, src);
+	d->src_cnt = 1;
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_xor(struct dma_chan *chan, dma_addr_t dest, dma_addr_t *src,
+		 unsigned int src_cnt, size_t len, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+	unsigned int i;
+
+	if (unlikely(!src_cnt || src_cnt > CPU_DMA_MAX_SRCS))
+		return NULL;
+
+	d = cpu_dma_alloc_desc(chan, DMA_XOR, src_cnt, 0, len, flags);
+	if (!d)
+		return NULL;
+
+	d->dest = cpu_dma_addr(chan, dest);
+	d->src_cnt = src_cnt;
+	for (i = 0; i < src_cnt; i++) {
+		d->ptr[i] = cpu_dma_addr(chan, src[i]);
+		/* xor is commutative: fold into the destination first */
+		if (i && d->ptr[i] == d->dest)
+			swap(d->ptr[i], d->ptr[0]);
+	}
+
+	return &d->txd;
+}
+
+/*
+ * Return the number of data disks a gen_syndrome() call needs to match
+ * @scf, or 0 if the coefficients are not increasing powers of {02}.
+ */
+static unsigned int cpu_dma_pq_disks(const unsigned char *scf,
+				     unsigned int src_cnt, size_t len,
+				     unsigned long flags)
+{
+	unsigned int k;
+	int log, prev = -1;
+
+	if (flags & (DMA_PREP_PQ_DISABLE_P | DMA_PREP_PQ_DISABLE_Q |
+		     DMA_PREP_CONTINUE))
+		return 0;
+
+	/* every gen_syndrome() implementation works on 512 byte multiples */
+	if (!IS_ALIGNED(len, 512))
+		return 0;
+
+	for (k = 0; k < src_cnt; k++) {
+		log = cpu_dma_gflog[scf[k]];
+		if (log == 0xff || log <= prev)
+			return 0;
+		prev = log;
+	}
+
+	/* holes are filled with the zero page */
+	if (prev + 1 != src_cnt && len > PAGE_SIZE)
+		return 0;
+
+	return prev + 1;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_pq(struct dma_chan *chan, dma_addr_t *dst, dma_addr_t *src,
+		unsigned int src_cnt, const unsigned char *scf, size_t len,
+		unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+	unsigned int disks, k;
+	u8 *coefs;
+
+	if (unlikely(!src_cnt || src_cnt > CPU_DMA_MAX_SRCS))
+		return NULL;
+
+	disks = cpu_dma_pq_disks(scf, src_cnt, len, flags);
+	if (disks) {
+		d = cpu_dma_alloc_desc(chan, DMA_PQ, disks + 2, 0, len, flags);
+		if (!d)
+			return NULL;
+
+		d->src_cnt = disks;
+		for (k = 0; k < disks; k++)
+			d->ptr[k] = (void *)raid6_empty_zero_page;
+		for (k = 0; k < src_cnt; k++)
+			d->ptr[cpu_dma_gflog[scf[k]]] = cpu_dma_addr(chan, src[k]);
+		d->ptr[disks] = cpu_dma_addr(chan, dst[0]);
+		d->ptr[disks + 1] = cpu_dma_addr(chan, dst[1]);
+
+		return &d->txd;
+	}
+
+	d = cpu_dma_alloc_desc(chan, DMA_PQ, src_cnt, src_cnt, len, flags);
+	if (!d)
+		return NULL;
+
+	coefs = (u8 *)&d->ptr[src_cnt];
+	d->src_cnt = src_cnt;
+	for (k = 0; k < src_cnt; k++) {
+		d->ptr[k] = cpu_dma_addr(chan, src[k]);
+		coefs[k] = scf[k];
+	}
+	d->scf = coefs;
+	if (!(flags & DMA_PREP_PQ_DISABLE_P))
+		d->p = cpu_dma_addr(chan, dst[0]);
+	if (!(flags & DMA_PREP_PQ_DISABLE_Q))
+		d->q = cpu_dma_addr(chan, dst[1]);
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *
+cpu_dma_prep_interrupt(struct dma_chan *chan, unsigned long flags)
+{
+	struct cpu_dma_desc *d;
+
+	d = cpu_dma_alloc_desc(chan, DMA_INTERRUPT, 0, 0, 0, flags);
+
+	return d ? &d->txd : NULL;
+}
+
+static int cpu_dma_alloc_chan_resources(struct dma_chan *chan)
+{
+	dma_cookie_init(chan);
+
+	return 0;
+}
+
+static void cpu_dma_free_chan_resources(struct dma_chan *chan)
+{
+	struct cpu_dma_chan *c = to_cpu_dma_chan(chan);
+	struct cpu_dma_desc *d, *_d;
+
+	flush_work(&c->work);
+
+	spin_lock_bh(&c->lock);
+	list_splice_tail_init(&c->submitted, &c->completed);
+	list_splice_tail_init(&c->issued, &c->completed);
+	list_for_each_entry_safe(d, _d, &c->completed, node) {
+		list_del(&d->node);
+		kfree(d);
+	}
+	spin_unlock_bh(&c->lock);
+}
+
+static int __init cpu_dma_init(void)
+{
+	struct platform_device_info pdevinfo = {
+		.name = CPU_DMA_NAME,
+		.id = PLATFORM_DEVID_NONE,
+		.dma_mask = DMA_BIT_MASK(64),
+	};
+	struct dma_device *dma;
+	struct cpu_dma_chan *c;
+	unsigned int i, n;
+	int ret;
+
+	n = num_online_cpus();
+	if (max_channels)
+		n = min(n, max_channels);
+
+	cpu_dma = kzalloc(sizeof(*cpu_dma) + n * sizeof(cpu_dma->chan[0]),
+			  GFP_KERNEL);
+	if (!cpu_dma)
+		return -ENOMEM;
+	cpu_dma->chancnt = n;
+
+	memset(cpu_dma_gflog, 0xff, sizeof(cpu_dma_gflog));
+	for (i = 0; i < 255; i++)
+		cpu_dma_gflog[raid6_gfexp[i]] = i;
+
+	/* md may be writing back dirty pages through us */
+	cpu_dma->wq = alloc_workqueue("cpu_dma", WQ_UNBOUND | WQ_HIGHPRI |
+				      WQ_MEM_RECLAIM, 0);
+	if (!cpu_dma->wq) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	cpu_dma->pdev = platform_device_register_full(&pdevinfo);
+	if (IS_ERR(cpu_dma->pdev)) {
+		ret = PTR_ERR(cpu_dma->pdev);
+		goto err_wq;
+	}
+
+	/* the CPU is coherent with itself, skip the cache maintenance */
+#ifdef set_arch_dma_coherent_ops
+	set_arch_dma_coherent_ops(&cpu_dma->pdev->dev);
+#endif
+
+	dma = &cpu_dma->common;
+	dma->dev = &cpu_dma->pdev->dev;
+	INIT_LIST_HEAD(&dma->channels);
+
+	dma_cap_set(DMA_MEMCPY, dma->cap_mask);
+	dma_cap_set(DMA_XOR, dma->cap_mask);
+	dma_cap_set(DMA_PQ, dma->cap_mask);
+	dma_cap_set(DMA_INTERRUPT, dma->cap_mask);
+
+	dma->max_xor = CPU_DMA_MAX_SRCS;
+	dma_set_maxpq(dma, CPU_DMA_MAX_SRCS, 1);
+
+	dma->device_alloc_chan_resources = cpu_dma_alloc_chan_resources;
+	dma->device_free_chan_resources = cpu_dma_free_chan_resources;
+	dma->device_prep_dma_memcpy = cpu_dma_prep_memcpy;
+	dma->device_prep_dma_xor = cpu_dma_prep_xor;
+	dma->device_prep_dma_pq = cpu_dma_prep_pq;
+	dma->device_prep_dma_interrupt = cpu_dma_prep_interrupt;
+	dma->device_tx_status = cpu_dma_tx_status;
+	dma->device_issue_pending = cpu_dma_issue_pending;
+
+	for (i = 0; i < n; i++) {
+		c = &cpu_dma->chan[i];
+		spin_lock_init(&c->lock);
+		INIT_LIST_HEAD(&c->submitted);
+		INIT_LIST_HEAD(&c->issued);
+		INIT_LIST_HEAD(&c->completed);
+		INIT_WORK(&c->work, cpu_dma_work);
+		c->common.device = dma;
+		list_add_tail(&c->common.device_node, &dma->channels);
+	}
+
+	ret = dma_async_device_register(dma);
+	if (ret)
+		goto err_pdev;
+
+	dev_info(dma->dev, "%u channels ( %s%s%s)\n", n,
+		 dma_has_cap(DMA_PQ, dma->cap_mask) ? "pq " : "",
+		 dma_has_cap(DMA_XOR, dma->cap_mask) ? "xor " : "",
+		 dma_has_cap(DMA_MEMCPY, dma->cap_mask) ? "cpy " : "");
+
+	return 0;
+
+err_pdev:
+	platform_device_unregister(cpu_dma->pdev);
+err_wq:
+	destroy_workqueue(cpu_dma->wq);
+err_free:
+	kfree(cpu_dma);
+	return ret;
+}
+module_init(cpu_dma_init);
+
+static void __exit cpu_dma_exit(void)
+{
+	dma_async_device_unregister(&cpu_dma->common);
+	platform_device_unregister(cpu_dma->pdev);
+	destroy_workqueue(cpu_dma->wq);
+	kfree(cpu_dma);
+}
+module_exit(cpu_dma_exit);
+
+MODULE_DESCRIPTION("CPU worker pool offload engine for the async_tx api");
+MODULE_LICENSE("GPL");
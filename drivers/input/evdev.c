@@ -14,6 +14,10 @@
 #define EVDEV_MINORS		32
 #define EVDEV_MIN_BUFFER_SIZE	64U
 #define EVDEV_BUF_PACKETS	8
+/* The ring is shared by all clients, give slow ones more slack */
+#define EVDEV_RING_CLIENTS	4
+/* @grab of entries a grab left behind, skipped by every client */
+#define EVDEV_GRAB_GONE		U32_MAX
 
 #include <linux/poll.h>
 #include <linux/sched.h>
@@ -40,187 +44,142 @@ struct evdev {
 	struct device dev;
 	struct cdev cdev;
 	bool exist;
+	/* shared event ring, written under the input device's event_lock */
+	struct evdev_ring_header *ring;
+	struct evdev_ring_event *ring_events;
+	unsigned int ring_size;
+	unsigned int grab_head; /* ring position the current grab started at */
+	struct mutex map_lock; /* protects mapped and the grab against faults */
+	struct list_head mapped; /* clients that mapped the ring */
+	atomic_t client_id;
 };
 
 struct evdev_client {
-	unsigned int head;
-	unsigned int tail;
-	unsigned int packet_head; /* [future] position of the first element of next packet */
-	spinlock_t buffer_lock; /* protects access to buffer, head and tail */
+	unsigned int tail; /* ring position of the next event to read */
+	unsigned int id;
+	/* events of a type in flush_mask before flush[type] are stale */
+	unsigned long flush_mask[BITS_TO_LONGS(EV_CNT)];
+	unsigned int flush[EV_CNT];
+	unsigned int packet_len; /* events read since the last SYN_REPORT */
+	bool packet_skipped; /* some events of this packet were skipped */
+	bool syn_dropped; /* SYN_DROPPED is to be read next */
+	spinlock_t buffer_lock; /* protects the fields above */
 	struct wake_lock wake_lock;
 	bool use_wake_lock;
 	char name[28];
 	struct fasync_struct *fasync;
 	struct evdev *evdev;
 	struct list_head node;
+	struct address_space *mapping; /* of the file that mapped the ring */
+	struct list_head map_node;
 	int clkid;
 	bool revoked;
-	unsigned int bufsize;
-	struct input_event buffer[];
 };
 
 /* flush queued events of type @type, caller must hold client->buffer_lock */
 static void __evdev_flush_queue(struct evdev_client *client, unsigned int type)
 {
-	unsigned int i, head, num;
-	unsigned int mask = client->bufsize - 1;
-	bool is_report;
-	struct input_event *ev;
-
 	BUG_ON(type == EV_SYN);
 
-	head = client->tail;
-	client->packet_head = client->tail;
-
-	/* init to 1 so a leading SYN_REPORT will not be dropped */
-	num = 1;
-
-	for (i = client->tail; i != client->head; i = (i + 1) & mask) {
-		ev = &client->buffer[i];
-		is_report = ev->type == EV_SYN && ev->code == SYN_REPORT;
-
-		if (ev->type == type) {
-			/* drop matched entry */
-			continue;
-		} else if (is_report && !num) {
-			/* drop empty SYN_REPORT groups */
-			continue;
-		} else if (head != i) {
-			/* move entry to fill the gap */
-			client->buffer[head].time = ev->time;
-			client->buffer[head].type = ev->type;
-			client->buffer[head].code = ev->code;
-			client->buffer[head].value = ev->value;
-		}
-
-		num++;
-		head = (head + 1) & mask;
-
-		if (is_report) {
-			num = 0;
-			client->packet_head = head;
-		}
-	}
-
-	client->head = head;
+	/* everything before the current head is older than the caller's state */
+	client->flush[type] = READ_ONCE(client->evdev->ring->head);
+	__set_bit(type, client->flush_mask);
 }
 
 /* queue SYN_DROPPED event */
 static void evdev_queue_syn_dropped(struct evdev_client *client)
 {
 	unsigned long flags;
-	struct input_event ev;
-	ktime_t time;
-
-	time = (client->clkid == CLOCK_MONOTONIC) ?
-		ktime_get() : ktime_get_real();
-
-	ev.time = ktime_to_timeval(time);
-	ev.type = EV_SYN;
-	ev.code = SYN_DROPPED;
-	ev.value = 0;
 
 	spin_lock_irqsave(&client->buffer_lock, flags);
-
-	client->buffer[client->head++] = ev;
-	client->head &= client->bufsize - 1;
-
-	if (unlikely(client->head == client->tail)) {
-		/* drop queue but keep our SYN_DROPPED event */
-		client->tail = (client->head - 1) & (client->bufsize - 1);
-		client->packet_head = client->tail;
-	}
-
+	client->syn_dropped = true;
 	spin_unlock_irqrestore(&client->buffer_lock, flags);
 }
 
-static void __pass_event(struct evdev_client *client,
-			 const struct input_event *event)
+static void evdev_ring_put(struct evdev *evdev, unsigned int pos,
+			   const struct input_value *v, u32 grab,
+			   s64 mono, s64 real)
 {
-	client->buffer[client->head++] = *event;
-	client->head &= client->bufsize - 1;
-
-	if (unlikely(client->head == client->tail)) {
-		/*
-		 * This effectively "drops" all unconsumed events, leaving
-		 * EV_SYN/SYN_DROPPED plus the newest event in the queue.
-		 */
-		client->tail = (client->head - 2) & (client->bufsize - 1);
-
-		client->buffer[client->tail].time = event->time;
-		client->buffer[client->tail].type = EV_SYN;
-		client->buffer[client->tail].code = SYN_DROPPED;
-		client->buffer[client->tail].value = 0;
-
-		client->packet_head = client->tail;
-		if (client->use_wake_lock)
-			wake_unlock(&client->wake_lock);
-	}
-
-	if (event->type == EV_SYN && event->code == SYN_REPORT) {
-		client->packet_head = client->head;
-		if (client->use_wake_lock)
-			wake_lock(&client->wake_lock);
-		kill_fasync(&client->fasync, SIGIO, POLL_IN);
-	}
+	struct evdev_ring_event *e =
+		&evdev->ring_events[pos & (evdev->ring_size - 1)];
+
+	/* Readers still on the old entry must see that it is going away */
+	WRITE_ONCE(e->seq, EVDEV_RING_BUSY);
+	smp_wmb();
+
+	e->grab = grab;
+	e->mono_ns = mono;
+	e->real_ns = real;
+	e->type = v->type;
+	e->code = v->code;
+	e->value = v->value;
+
+	smp_wmb();
+	WRITE_ONCE(e->seq, pos & ~EVDEV_RING_BUSY);
 }
 
-static void evdev_pass_values(struct evdev_client *client,
-			const struct input_value *vals, unsigned int count,
-			ktime_t mono, ktime_t real)
+static void evdev_notify_client(struct evdev_client *client)
 {
-	struct evdev *evdev = client->evdev;
-	const struct input_value *v;
-	struct input_event event;
-	bool wakeup = false;
-
 	if (client->revoked)
 		return;
 
-	event.time = ktime_to_timeval(client->clkid == CLOCK_MONOTONIC ?
-				      mono : real);
-
-	/* Interrupts are disabled, just acquire the lock. */
+	/*
+	 * use_wake_lock is toggled under buffer_lock; pairs with the unlock
+	 * in evdev_fetch_next_event().
+	 */
 	spin_lock(&client->buffer_lock);
-
-	for (v = vals; v != vals + count; v++) {
-		event.type = v->type;
-		event.code = v->code;
-		event.value = v->value;
-		__pass_event(client, &event);
-		if (v->type == EV_SYN && v->code == SYN_REPORT)
-			wakeup = true;
-	}
-
+	if (client->use_wake_lock)
+		wake_lock(&client->wake_lock);
 	spin_unlock(&client->buffer_lock);
-
-	if (wakeup)
-		wake_up_interruptible(&evdev->wait);
+	kill_fasync(&client->fasync, SIGIO, POLL_IN);
 }
 
 /*
  * Pass incoming events to all connected clients.
+ *
+ * The input core calls this with the device's event_lock held, so this is
+ * the only writer of the ring.  Clients are only notified once per batch,
+ * and only if it completes a packet.
  */
 static void evdev_events(struct input_handle *handle,
 			 const struct input_value *vals, unsigned int count)
 {
 	struct evdev *evdev = handle->private;
+	struct evdev_ring_header *ring = evdev->ring;
 	struct evdev_client *client;
-	ktime_t time_mono, time_real;
+	const struct input_value *v;
+	unsigned int head = ring->head, packet_head = ring->packet_head;
+	s64 time_mono, time_real;
+	u32 grab_id;
 
-	time_mono = ktime_get();
-	time_real = ktime_mono_to_real(time_mono);
+	time_mono = ktime_to_ns(ktime_get());
+	time_real = ktime_to_ns(ktime_mono_to_real(ns_to_ktime(time_mono)));
 
 	rcu_read_lock();
 
 	client = rcu_dereference(evdev->grab);
+	grab_id = client ? client->id : 0;
 
-	if (client)
-		evdev_pass_values(client, vals, count, time_mono, time_real);
-	else
-		list_for_each_entry_rcu(client, &evdev->client_list, node)
-			evdev_pass_values(client, vals, count,
-					  time_mono, time_real);
+	for (v = vals; v != vals + count; v++) {
+		evdev_ring_put(evdev, head++, v, grab_id, time_mono, time_real);
+		if (v->type == EV_SYN && v->code == SYN_REPORT)
+			packet_head = head;
+	}
+
+	smp_store_release(&ring->head, head);
+
+	if (packet_head != ring->packet_head) {
+		smp_store_release(&ring->packet_head, packet_head);
+
+		if (client)
+			evdev_notify_client(client);
+		else
+			list_for_each_entry_rcu(client, &evdev->client_list,
+						node)
+				evdev_notify_client(client);
+
+		wake_up_interruptible(&evdev->wait);
+	}
 
 	rcu_read_unlock();
 }
@@ -262,15 +221,22 @@ static void evdev_free(struct device *dev)
 	struct evdev *evdev = container_of(dev, struct evdev, dev);
 
 	input_put_device(evdev->handle.dev);
+	vfree(evdev->ring);
 	kfree(evdev);
 }
 
 /*
  * Grabs an event device (along with underlying input device).
  * This function is called with evdev->mutex taken.
+ *
+ * The other clients' mappings of the ring are torn down first and can
+ * not be faulted back in until the grab is released, so that only the
+ * grabbing client sees the events it gets.
  */
 static int evdev_grab(struct evdev *evdev, struct evdev_client *client)
 {
+	struct input_dev *dev = evdev->handle.dev;
+	struct evdev_client *mapped;
 	int error;
 
 	if (evdev->grab)
@@ -280,22 +246,66 @@ static int evdev_grab(struct evdev *evdev, struct evdev_client *client)
 	if (error)
 		return error;
 
+	mutex_lock(&evdev->map_lock);
+
+	list_for_each_entry(mapped, &evdev->mapped, map_node)
+		if (mapped != client)
+			unmap_mapping_range(mapped->mapping, 0, 0, 1);
+
+	spin_lock_irq(&dev->event_lock);
+	evdev->grab_head = evdev->ring->head;
 	rcu_assign_pointer(evdev->grab, client);
+	spin_unlock_irq(&dev->event_lock);
+
+	mutex_unlock(&evdev->map_lock);
 
 	return 0;
 }
 
+/*
+ * Overwrite what is left in the ring of the events of @client's grab, so
+ * that the other clients cannot map them once the grab is gone.  Unread
+ * ones are lost to @client, which gets SYN_DROPPED instead.  Caller must
+ * hold the input device's event_lock.
+ */
+static void evdev_scrub_grab(struct evdev *evdev, struct evdev_client *client)
+{
+	static const struct input_value gone;
+	unsigned int head = evdev->ring->head;
+	unsigned int start = evdev->grab_head, pos;
+
+	if (head - start > evdev->ring_size)
+		start = head - evdev->ring_size;
+
+	spin_lock(&client->buffer_lock);
+	pos = (int)(client->tail - start) > 0 ? client->tail : start;
+	if (pos != head)
+		client->syn_dropped = true;
+	spin_unlock(&client->buffer_lock);
+
+	for (pos = start; pos != head; pos++)
+		evdev_ring_put(evdev, pos, &gone, EVDEV_GRAB_GONE, 0, 0);
+}
+
 static int evdev_ungrab(struct evdev *evdev, struct evdev_client *client)
 {
 	struct evdev_client *grab = rcu_dereference_protected(evdev->grab,
 					lockdep_is_held(&evdev->mutex));
+	struct input_dev *dev = evdev->handle.dev;
 
 	if (grab != client)
 		return  -EINVAL;
 
+	mutex_lock(&evdev->map_lock);
+	spin_lock_irq(&dev->event_lock);
+	evdev_scrub_grab(evdev, client);
 	rcu_assign_pointer(evdev->grab, NULL);
+	spin_unlock_irq(&dev->event_lock);
+	mutex_unlock(&evdev->map_lock);
+
 	synchronize_rcu();
 	input_release_device(&evdev->handle);
+	wake_up_interruptible(&evdev->wait);
 
 	return 0;
 }
@@ -372,15 +382,16 @@ static int evdev_release(struct inode *inode, struct file *file)
 	evdev_ungrab(evdev, client);
 	mutex_unlock(&evdev->mutex);
 
+	mutex_lock(&evdev->map_lock);
+	list_del(&client->map_node);
+	mutex_unlock(&evdev->map_lock);
+
 	evdev_detach_client(evdev, client);
 
 	if (client->use_wake_lock)
 		wake_lock_destroy(&client->wake_lock);
 
-	if (is_vmalloc_addr(client))
-		vfree(client);
-	else
-		kfree(client);
+	kfree(client);
 
 	evdev_close_device(evdev);
 
@@ -399,20 +410,17 @@ static unsigned int evdev_compute_buffer_size(struct input_dev *dev)
 static int evdev_open(struct inode *inode, struct file *file)
 {
 	struct evdev *evdev = container_of(inode->i_cdev, struct evdev, cdev);
-	unsigned int bufsize = evdev_compute_buffer_size(evdev->handle.dev);
-	unsigned int size = sizeof(struct evdev_client) +
-					bufsize * sizeof(struct input_event);
 	struct evdev_client *client;
 	int error;
 
-	client = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
-	if (!client)
-		client = vzalloc(size);
+	client = kzalloc(sizeof(struct evdev_client), GFP_KERNEL);
 	if (!client)
 		return -ENOMEM;
 
-	client->bufsize = bufsize;
+	client->id = atomic_inc_return(&evdev->client_id);
+	client->tail = smp_load_acquire(&evdev->ring->head);
 	spin_lock_init(&client->buffer_lock);
+	INIT_LIST_HEAD(&client->map_node);
 	snprintf(client->name, sizeof(client->name), "%s-%d",
 			dev_name(&evdev->dev), task_tgid_vnr(current));
 	client->evdev = evdev;
@@ -429,7 +437,7 @@ static int evdev_open(struct inode *inode, struct file *file)
 
  err_free_client:
 	evdev_detach_client(evdev, client);
-	kvfree(client);
+	kfree(client);
 	return error;
 }
 
@@ -470,22 +478,178 @@ static ssize_t evdev_write(struct file *file, const char __user *buffer,
 	return retval;
 }
 
+static void evdev_fill_event(struct evdev_client *client,
+			     struct input_event *event, s64 mono, s64 real,
+			     unsigned int type, unsigned int code, int value)
+{
+	event->time = ns_to_timeval(client->clkid == CLOCK_MONOTONIC ?
+				    mono : real);
+	event->type = type;
+	event->code = code;
+	event->value = value;
+}
+
+/* skip an event read from the ring? caller must hold client->buffer_lock */
+static bool evdev_skip_event(struct evdev_client *client, unsigned int pos,
+			     u32 grab, unsigned int type, unsigned int code)
+{
+	bool skip = false;
+
+	if (grab && grab != client->id) {
+		/* delivered to the grabbing client only */
+		skip = true;
+	} else if (type < EV_CNT && test_bit(type, client->flush_mask)) {
+		if ((int)(pos - client->flush[type]) < 0)
+			skip = true;
+		else
+			__clear_bit(type, client->flush_mask);
+	}
+
+	if (skip) {
+		client->packet_skipped = true;
+		return true;
+	}
+
+	if (type != EV_SYN || code != SYN_REPORT) {
+		client->packet_len++;
+		return false;
+	}
+
+	/* drop SYN_REPORT of packets that were skipped altogether */
+	skip = client->packet_skipped && !client->packet_len;
+	client->packet_len = 0;
+	client->packet_skipped = false;
+	return skip;
+}
+
+/*
+ * Copy the entry at the client's tail.  If the writer lapped the client,
+ * resume at a packet boundary with SYN_DROPPED and return false.  Caller
+ * must hold client->buffer_lock.
+ */
+static bool evdev_ring_get(struct evdev_client *client,
+			   struct evdev_ring_event *ev)
+{
+	struct evdev *evdev = client->evdev;
+	struct evdev_ring_header *ring = evdev->ring;
+	struct evdev_ring_event *e =
+		&evdev->ring_events[client->tail & (evdev->ring_size - 1)];
+
+	ev->seq = READ_ONCE(e->seq);
+	smp_rmb();
+	ev->grab = e->grab;
+	ev->mono_ns = e->mono_ns;
+	ev->real_ns = e->real_ns;
+	ev->type = e->type;
+	ev->code = e->code;
+	ev->value = e->value;
+	smp_rmb();
+
+	if (ev->seq == (client->tail & ~EVDEV_RING_BUSY) &&
+	    READ_ONCE(e->seq) == ev->seq &&
+	    READ_ONCE(ring->head) - client->tail <= evdev->ring_size)
+		return true;
+
+	/* lapped by the writer, resume at a packet boundary */
+	client->tail = smp_load_acquire(&ring->packet_head);
+	client->packet_len = 0;
+	client->packet_skipped = false;
+	client->syn_dropped = true;
+	return false;
+}
+
+/* would evdev_skip_event() skip it? caller must hold client->buffer_lock */
+static bool evdev_event_hidden(struct evdev_client *client, unsigned int pos,
+			       const struct evdev_ring_event *ev)
+{
+	if (ev->grab && ev->grab != client->id)
+		return true;
+
+	if (ev->type < EV_CNT && test_bit(ev->type, client->flush_mask) &&
+	    (int)(pos - client->flush[ev->type]) < 0)
+		return true;
+
+	return ev->type == EV_SYN && ev->code == SYN_REPORT &&
+	       client->packet_skipped && !client->packet_len;
+}
+
+/*
+ * Has complete packets or SYN_DROPPED to read?  Events the client would
+ * skip, like those of another client's grab, are skipped on the way so
+ * they neither wake it up nor keep it awake.  Caller must hold
+ * client->buffer_lock.
+ */
+static bool __evdev_client_pending(struct evdev_client *client)
+{
+	struct evdev_ring_header *ring = client->evdev->ring;
+	unsigned int packet_head = smp_load_acquire(&ring->packet_head);
+	struct evdev_ring_event ev;
+
+	while (!client->syn_dropped && client->tail != packet_head) {
+		if (!evdev_ring_get(client, &ev))
+			break;
+		if (!evdev_event_hidden(client, client->tail, &ev))
+			return true;
+		evdev_skip_event(client, client->tail++, ev.grab,
+				 ev.type, ev.code);
+	}
+
+	return client->syn_dropped;
+}
+
+static bool evdev_client_pending(struct evdev_client *client)
+{
+	unsigned long flags;
+	bool pending;
+
+	spin_lock_irqsave(&client->buffer_lock, flags);
+	pending = __evdev_client_pending(client);
+	spin_unlock_irqrestore(&client->buffer_lock, flags);
+
+	return pending;
+}
+
 static int evdev_fetch_next_event(struct evdev_client *client,
 				  struct input_event *event)
 {
-	int have_event;
+	struct evdev *evdev = client->evdev;
+	struct evdev_ring_header *ring = evdev->ring;
+	struct evdev_ring_event ev;
+	unsigned int packet_head;
+	int have_event = 0;
 
 	spin_lock_irq(&client->buffer_lock);
 
-	have_event = client->packet_head != client->tail;
-	if (have_event) {
-		*event = client->buffer[client->tail++];
-		client->tail &= client->bufsize - 1;
-		if (client->use_wake_lock &&
-		    client->packet_head == client->tail)
-			wake_unlock(&client->wake_lock);
+	packet_head = smp_load_acquire(&ring->packet_head);
+
+	while (!client->syn_dropped && client->tail != packet_head) {
+		if (!evdev_ring_get(client, &ev))
+			break;
+
+		if (!evdev_skip_event(client, client->tail++, ev.grab,
+				      ev.type, ev.code)) {
+			evdev_fill_event(client, event, ev.mono_ns, ev.real_ns,
+					 ev.type, ev.code, ev.value);
+			have_event = 1;
+			break;
+		}
+	}
+
+	if (!have_event && client->syn_dropped) {
+		client->syn_dropped = false;
+		evdev_fill_event(client, event, ktime_to_ns(ktime_get()),
+				 ktime_to_ns(ktime_get_real()),
+				 EV_SYN, SYN_DROPPED, 0);
+		have_event = 1;
 	}
 
+	/* nothing older than the head is left to flush */
+	if (client->tail == READ_ONCE(ring->head))
+		bitmap_zero(client->flush_mask, EV_CNT);
+
+	if (client->use_wake_lock && !__evdev_client_pending(client))
+		wake_unlock(&client->wake_lock);
+
 	spin_unlock_irq(&client->buffer_lock);
 
 	return have_event;
@@ -507,7 +671,7 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 		if (!evdev->exist || client->revoked)
 			return -ENODEV;
 
-		if (client->packet_head == client->tail &&
+		if (!evdev_client_pending(client) &&
 		    (file->f_flags & O_NONBLOCK))
 			return -EAGAIN;
 
@@ -532,7 +696,7 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 
 		if (!(file->f_flags & O_NONBLOCK)) {
 			error = wait_event_interruptible(evdev->wait,
-					client->packet_head != client->tail ||
+					evdev_client_pending(client) ||
 					!evdev->exist || client->revoked);
 			if (error)
 				return error;
@@ -556,12 +720,101 @@ static unsigned int evdev_poll(struct file *file, poll_table *wait)
 	else
 		mask = POLLHUP | POLLERR;
 
-	if (client->packet_head != client->tail)
+	if (evdev_client_pending(client))
 		mask |= POLLIN | POLLRDNORM;
 
 	return mask;
 }
 
+static size_t evdev_ring_length(struct evdev *evdev)
+{
+	return PAGE_ALIGN(PAGE_SIZE +
+			  evdev->ring_size * sizeof(struct evdev_ring_event));
+}
+
+/* is the device grabbed by a client other than @client? */
+static bool evdev_grabbed_by_other(struct evdev *evdev,
+				   struct evdev_client *client)
+{
+	struct evdev_client *grab = rcu_access_pointer(evdev->grab);
+
+	return grab && grab != client;
+}
+
+/*
+ * Pages of the ring are inserted one at a time under map_lock, so that
+ * evdev_grab() can tear the mapping down without racing with a fault.
+ */
+static int evdev_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct evdev_client *client = vma->vm_private_data;
+	struct evdev *evdev = client->evdev;
+	unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+	int ret = VM_FAULT_SIGBUS;
+	int error;
+
+	mutex_lock(&evdev->map_lock);
+
+	if (offset < evdev_ring_length(evdev) &&
+	    !evdev_grabbed_by_other(evdev, client)) {
+		error = vm_insert_page(vma,
+				(unsigned long)vmf->virtual_address,
+				vmalloc_to_page((void *)evdev->ring + offset));
+		if (!error || error == -EBUSY)
+			ret = VM_FAULT_NOPAGE;
+		else if (error == -ENOMEM)
+			ret = VM_FAULT_OOM;
+	}
+
+	mutex_unlock(&evdev->map_lock);
+	return ret;
+}
+
+static const struct vm_operations_struct evdev_vm_ops = {
+	.fault		= evdev_vm_fault,
+};
+
+/*
+ * The shared ring is mapped read-only; clients that read it directly
+ * report their position with EVIOCSRINGTAIL.  While another client holds
+ * a grab it cannot be mapped.
+ */
+static int evdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct evdev_client *client = file->private_data;
+	struct evdev *evdev = client->evdev;
+	unsigned long length = vma->vm_end - vma->vm_start;
+	int error = 0;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	if (vma->vm_pgoff > evdev_ring_length(evdev) >> PAGE_SHIFT ||
+	    length > evdev_ring_length(evdev) -
+			(vma->vm_pgoff << PAGE_SHIFT))
+		return -EINVAL;
+
+	mutex_lock(&evdev->map_lock);
+
+	if (evdev_grabbed_by_other(evdev, client)) {
+		error = -EBUSY;
+		goto out;
+	}
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_MIXEDMAP | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &evdev_vm_ops;
+	vma->vm_private_data = client;
+
+	if (list_empty(&client->map_node)) {
+		client->mapping = file->f_mapping;
+		list_add_tail(&client->map_node, &evdev->mapped);
+	}
+ out:
+	mutex_unlock(&evdev->map_lock);
+	return error;
+}
+
 #ifdef CONFIG_COMPAT
 
 #define BITS_PER_LONG_COMPAT (sizeof(compat_long_t) * 8)
@@ -742,10 +995,9 @@ static int evdev_handle_set_keycode_v2(struct input_dev *dev, void __user *p)
  * event so user-space will notice missing events.
  *
  * LOCKING:
- * We need to take event_lock before buffer_lock to avoid dead-locks. But we
- * need the even_lock only to guarantee consistent state. We can safely release
- * it while flushing the queue. This allows input-core to handle filters while
- * we flush the queue.
+ * We need to take event_lock before buffer_lock to avoid dead-locks. Holding
+ * event_lock keeps the ring head in step with the state we copy, and flushing
+ * only records that head, so both locks are held just briefly.
  */
 static int evdev_handle_get_val(struct evdev_client *client,
 				struct input_dev *dev, unsigned int type,
@@ -767,11 +1019,10 @@ static int evdev_handle_get_val(struct evdev_client *client,
 
 	memcpy(mem, bits, len);
 
-	spin_unlock(&dev->event_lock);
-
 	__evdev_flush_queue(client, type);
 
-	spin_unlock_irq(&client->buffer_lock);
+	spin_unlock(&client->buffer_lock);
+	spin_unlock_irq(&dev->event_lock);
 
 	ret = bits_to_user(mem, maxbit, maxlen, p, compat);
 	if (ret < 0)
@@ -832,7 +1083,7 @@ static int evdev_enable_suspend_block(struct evdev *evdev,
 	spin_lock_irq(&client->buffer_lock);
 	wake_lock_init(&client->wake_lock, WAKE_LOCK_SUSPEND, client->name);
 	client->use_wake_lock = true;
-	if (client->packet_head != client->tail)
+	if (__evdev_client_pending(client))
 		wake_lock(&client->wake_lock);
 	spin_unlock_irq(&client->buffer_lock);
 	return 0;
@@ -852,6 +1103,45 @@ static int evdev_disable_suspend_block(struct evdev *evdev,
 	return 0;
 }
 
+static int evdev_get_ring_info(struct evdev *evdev,
+			       struct evdev_client *client, void __user *p)
+{
+	struct evdev_ring_info info = {
+		.version	= EVDEV_RING_VERSION,
+		.size		= evdev->ring_size,
+		.offset		= PAGE_SIZE,
+		.length		= evdev_ring_length(evdev),
+		.id		= client->id,
+	};
+
+	return copy_to_user(p, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+/* Catch up with a client that read the mapped ring up to @pos */
+static int evdev_set_ring_tail(struct evdev *evdev,
+			       struct evdev_client *client, unsigned int pos)
+{
+	unsigned int packet_head;
+	int error = 0;
+
+	spin_lock_irq(&client->buffer_lock);
+
+	packet_head = smp_load_acquire(&evdev->ring->packet_head);
+	if (packet_head - pos > evdev->ring_size) {
+		error = -EINVAL;
+		goto out;
+	}
+
+	client->tail = pos;
+	client->packet_len = 0;
+	client->packet_skipped = false;
+	if (client->use_wake_lock && !__evdev_client_pending(client))
+		wake_unlock(&client->wake_lock);
+ out:
+	spin_unlock_irq(&client->buffer_lock);
+	return error;
+}
+
 static long evdev_do_ioctl(struct file *file, unsigned int cmd,
 			   void __user *p, int compat_mode)
 {
@@ -933,6 +1223,14 @@ static long evdev_do_ioctl(struct file *file, unsigned int cmd,
 		client->clkid = i;
 		return 0;
 
+	case EVIOCGRINGINFO:
+		return evdev_get_ring_info(evdev, client, p);
+
+	case EVIOCSRINGTAIL:
+		if (get_user(u, ip))
+			return -EFAULT;
+		return evdev_set_ring_tail(evdev, client, u);
+
 	case EVIOCGKEYCODE:
 		return evdev_handle_get_keycode(dev, p);
 
@@ -1111,6 +1409,7 @@ static const struct file_operations evdev_fops = {
 	.read		= evdev_read,
 	.write		= evdev_write,
 	.poll		= evdev_poll,
+	.mmap		= evdev_mmap,
 	.open		= evdev_open,
 	.release	= evdev_release,
 	.unlocked_ioctl	= evdev_ioctl,
@@ -1178,9 +1477,23 @@ static int evdev_connect(struct input_handler *handler, struct input_dev *dev,
 	INIT_LIST_HEAD(&evdev->client_list);
 	spin_lock_init(&evdev->client_lock);
 	mutex_init(&evdev->mutex);
+	mutex_init(&evdev->map_lock);
+	INIT_LIST_HEAD(&evdev->mapped);
 	init_waitqueue_head(&evdev->wait);
 	evdev->exist = true;
 
+	evdev->ring_size = evdev_compute_buffer_size(dev) * EVDEV_RING_CLIENTS;
+	evdev->ring = vmalloc_user(PAGE_SIZE + evdev->ring_size *
+				   sizeof(struct evdev_ring_event));
+	if (!evdev->ring) {
+		kfree(evdev);
+		error = -ENOMEM;
+		goto err_free_minor;
+	}
+	evdev->ring->version = EVDEV_RING_VERSION;
+	evdev->ring->size = evdev->ring_size;
+	evdev->ring_events = (void *)evdev->ring + PAGE_SIZE;
+
 	dev_no = minor;
 	/* Normalize device number if it falls into legacy range */
 	if (dev_no < EVDEV_MINOR_BASE + EVDEV_MINORS)
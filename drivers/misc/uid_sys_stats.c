@@ -20,19 +20,29 @@
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
 #include <linux/profile.h>
 #include <linux/rtmutex.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
+#include <linux/user_namespace.h>
 #include <linux/cpufreq.h>
 
 #define UID_HASH_BITS	10
 static DECLARE_HASHTABLE(hash_table, UID_HASH_BITS);
 
+/*
+ * uid_lock serialises the proc file writers and the per-task entries of
+ * CONFIG_UID_SYS_STATS_DEBUG.  uid_hash_lock is only taken to add entries
+ * to hash_table and to remove them; lookups, including the ones from the
+ * tick and from task exit, use RCU.
+ */
 static DEFINE_RT_MUTEX(uid_lock);
+static DEFINE_SPINLOCK(uid_hash_lock);
 static struct proc_dir_entry *cpu_parent;
 static struct proc_dir_entry *io_parent;
 static struct proc_dir_entry *proc_parent;
@@ -63,17 +73,23 @@ struct task_entry {
 	struct hlist_node hash;
 };
 
-struct uid_entry {
-	uid_t uid;
+/*
+ * Totals of a UID, charged on each CPU by the tasks that run or exit
+ * there.  I/O goes to the bucket of the UID's state at the time.
+ */
+struct uid_stats {
 	cputime_t utime;
 	cputime_t stime;
-	cputime_t active_utime;
-	cputime_t active_stime;
-	unsigned long long active_power;
 	unsigned long long power;
+	struct io_stats io[UID_STATE_BUCKET_SIZE];
+};
+
+struct uid_entry {
+	uid_t uid;
 	int state;
-	struct io_stats io[UID_STATE_SIZE];
+	struct uid_stats __percpu *stats;
 	struct hlist_node hash;
+	struct rcu_head rcu;
 #ifdef CONFIG_UID_SYS_STATS_DEBUG
 	DECLARE_HASHTABLE(task_entries, UID_HASH_BITS);
 #endif
@@ -87,6 +103,7 @@ static u64 compute_write_bytes(struct task_struct *task)
 	return task->ioac.write_bytes - task->ioac.cancelled_write_bytes;
 }
 
+#ifdef CONFIG_UID_SYS_STATS_DEBUG
 static void compute_io_bucket_stats(struct io_stats *io_bucket,
 					struct io_stats *io_curr,
 					struct io_stats *io_last,
@@ -120,7 +137,6 @@ static void compute_io_bucket_stats(struct io_stats *io_bucket,
 	memset(io_dead, 0, sizeof(struct io_stats));
 }
 
-#ifdef CONFIG_UID_SYS_STATS_DEBUG
 static void get_full_task_comm(struct task_entry *task_entry,
 		struct task_struct *task)
 {
@@ -289,29 +305,89 @@ static void show_io_uid_tasks(struct seq_file *m, struct uid_entry *uid_entry)
 				task_entry->io[UID_STATE_BACKGROUND].fsync);
 	}
 }
+
+static struct uid_entry *find_uid_entry(uid_t uid);
+
+/*
+ * Refresh the per-task entries of @only, or of every UID if @only is NULL,
+ * from the task list.  Caller must hold uid_lock.
+ */
+static void update_io_uid_tasks(struct uid_entry *only)
+{
+	struct uid_entry *uid_entry;
+	struct task_struct *task, *temp;
+	unsigned long bkt;
+	uid_t uid;
+
+	rcu_read_lock();
+	if (only)
+		set_io_uid_tasks_zero(only);
+	else
+		hash_for_each_rcu(hash_table, bkt, uid_entry, hash)
+			set_io_uid_tasks_zero(uid_entry);
+
+	do_each_thread(temp, task) {
+		uid = from_kuid_munged(&init_user_ns, task_uid(task));
+		if (only && uid != only->uid)
+			continue;
+		uid_entry = only ? only : find_uid_entry(uid);
+		if (!uid_entry)
+			continue;
+		add_uid_tasks_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
+	} while_each_thread(temp, task);
+
+	if (only)
+		compute_io_uid_tasks(only);
+	else
+		hash_for_each_rcu(hash_table, bkt, uid_entry, hash)
+			compute_io_uid_tasks(uid_entry);
+	rcu_read_unlock();
+}
+
+static void exit_uid_task(uid_t uid, struct task_struct *task)
+{
+	struct uid_entry *uid_entry;
+
+	rt_mutex_lock(&uid_lock);
+	rcu_read_lock();
+	uid_entry = find_uid_entry(uid);
+	rcu_read_unlock();
+	if (uid_entry)
+		add_uid_tasks_io_stats(uid_entry, task, UID_STATE_DEAD_TASKS);
+	rt_mutex_unlock(&uid_lock);
+}
 #else
 static void remove_uid_tasks(struct uid_entry *uid_entry) {};
-static void set_io_uid_tasks_zero(struct uid_entry *uid_entry) {};
-static void add_uid_tasks_io_stats(struct uid_entry *uid_entry,
-		struct task_struct *task, int slot) {};
-static void compute_io_uid_tasks(struct uid_entry *uid_entry) {};
+static void update_io_uid_tasks(struct uid_entry *only) {};
+static void exit_uid_task(uid_t uid, struct task_struct *task) {};
 static void show_io_uid_tasks(struct seq_file *m,
 		struct uid_entry *uid_entry) {}
 #endif
 
+/* Caller must hold uid_hash_lock or the RCU read lock */
 static struct uid_entry *find_uid_entry(uid_t uid)
 {
 	struct uid_entry *uid_entry;
-	hash_for_each_possible(hash_table, uid_entry, hash, uid) {
+	hash_for_each_possible_rcu(hash_table, uid_entry, hash, uid) {
 		if (uid_entry->uid == uid)
 			return uid_entry;
 	}
 	return NULL;
 }
 
+static void free_uid_entry(struct rcu_head *rcu)
+{
+	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
+
+	free_percpu(uid_entry->stats);
+	kfree(uid_entry);
+}
+
+/* Caller must hold the RCU read lock */
 static struct uid_entry *find_or_register_uid(uid_t uid)
 {
-	struct uid_entry *uid_entry;
+	struct uid_entry *uid_entry, *old;
+	unsigned long flags;
 
 	uid_entry = find_uid_entry(uid);
 	if (uid_entry)
@@ -321,72 +397,145 @@ static struct uid_entry *find_or_register_uid(uid_t uid)
 	if (!uid_entry)
 		return NULL;
 
+	uid_entry->stats = alloc_percpu_gfp(struct uid_stats, GFP_ATOMIC);
+	if (!uid_entry->stats) {
+		kfree(uid_entry);
+		return NULL;
+	}
 	uid_entry->uid = uid;
 #ifdef CONFIG_UID_SYS_STATS_DEBUG
 	hash_init(uid_entry->task_entries);
 #endif
-	hash_add(hash_table, &uid_entry->hash, uid);
 
+	spin_lock_irqsave(&uid_hash_lock, flags);
+	old = find_uid_entry(uid);
+	if (!old)
+		hash_add_rcu(hash_table, &uid_entry->hash, uid);
+	spin_unlock_irqrestore(&uid_hash_lock, flags);
+
+	if (old) {
+		free_uid_entry(&uid_entry->rcu);
+		return old;
+	}
 	return uid_entry;
 }
 
-static int uid_cputime_show(struct seq_file *m, void *v)
+/*
+ * Add what a counter of the task grew by since it was last charged.  A
+ * counter that went down, like write_bytes after a cancelled write, is
+ * not taken back.
+ */
+#define charge_delta(sum, last, now)		\
+do {						\
+	if ((now) > (last))			\
+		(sum) += (now) - (last);	\
+	(last) = (now);				\
+} while (0)
+
+/*
+ * Charge to @uid_entry what @task used since it was last charged.  Only
+ * called for the running task, from the tick and at exit; interrupts are
+ * disabled so the two never interleave.
+ */
+static void uid_entry_charge(struct uid_entry *uid_entry,
+			     struct task_struct *task)
+{
+	struct uid_stats_snapshot *last = &task->uid_stats_last;
+	struct uid_stats *stats;
+	struct io_stats *io;
+	cputime_t utime, stime;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	stats = this_cpu_ptr(uid_entry->stats);
+
+	if (last->owner != task) {
+		memset(last, 0, sizeof(*last));
+		last->owner = task;
+	}
+
+	task_cputime_adjusted(task, &utime, &stime);
+
+	charge_delta(stats->utime, last->utime, utime);
+	charge_delta(stats->stime, last->stime, stime);
+	charge_delta(stats->power, last->power, task->cpu_power);
+
+	io = &stats->io[ACCESS_ONCE(uid_entry->state)];
+	charge_delta(io->read_bytes, last->read_bytes, task->ioac.read_bytes);
+	charge_delta(io->write_bytes, last->write_bytes,
+		     compute_write_bytes(task));
+	charge_delta(io->rchar, last->rchar, task->ioac.rchar);
+	charge_delta(io->wchar, last->wchar, task->ioac.wchar);
+	charge_delta(io->fsync, last->fsync, task->ioac.syscfs);
+	local_irq_restore(flags);
+}
+
+static void add_io_stats(struct io_stats *sum, const struct io_stats *io)
+{
+	sum->read_bytes += io->read_bytes;
+	sum->write_bytes += io->write_bytes;
+	sum->rchar += io->rchar;
+	sum->wchar += io->wchar;
+	sum->fsync += io->fsync;
+}
+
+/* Fold the per-CPU totals of @uid_entry */
+static void uid_entry_sum(struct uid_entry *uid_entry, struct uid_stats *sum)
+{
+	struct uid_stats *stats;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(uid_entry->stats, cpu);
+		sum->utime += stats->utime;
+		sum->stime += stats->stime;
+		sum->power += stats->power;
+		for (i = 0; i < UID_STATE_BUCKET_SIZE; i++)
+			add_io_stats(&sum->io[i], &stats->io[i]);
+	}
+}
+
+/*
+ * Called through acct_update_power() from the cputime accounting of the
+ * tick, for the task running on this CPU, so that the proc files only
+ * have to add up the per-CPU totals.
+ */
+void uid_sys_stats_tick(struct task_struct *task)
 {
 	struct uid_entry *uid_entry;
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-	cputime_t utime;
-	cputime_t stime;
-	unsigned long bkt;
 	uid_t uid;
 
-	rt_mutex_lock(&uid_lock);
+	if (is_idle_task(task))
+		return;
 
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		uid_entry->active_stime = 0;
-		uid_entry->active_utime = 0;
-		uid_entry->active_power = 0;
-	}
+	rcu_read_lock();
+	uid = from_kuid_munged(&init_user_ns, task_uid(task));
+	uid_entry = find_or_register_uid(uid);
+	if (uid_entry)
+		uid_entry_charge(uid_entry, task);
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(uid_sys_stats_tick);
 
-	read_lock(&tasklist_lock);
-	do_each_thread(temp, task) {
-		uid = from_kuid_munged(user_ns, task_uid(task));
-		uid_entry = find_or_register_uid(uid);
-		if (!uid_entry) {
-			read_unlock(&tasklist_lock);
-			rt_mutex_unlock(&uid_lock);
-			pr_err("%s: failed to find the uid_entry for uid %d\n",
-				__func__, uid);
-			return -ENOMEM;
-		}
-		/* if this task is exiting, we have already accounted for the
-		 * time and power.
-		 */
-		if (task->cpu_power == ULLONG_MAX)
-			continue;
-		task_cputime_adjusted(task, &utime, &stime);
-		uid_entry->active_utime += utime;
-		uid_entry->active_stime += stime;
-		uid_entry->active_power += task->cpu_power;
-	} while_each_thread(temp, task);
-	read_unlock(&tasklist_lock);
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		cputime_t total_utime = uid_entry->utime +
-							uid_entry->active_utime;
-		cputime_t total_stime = uid_entry->stime +
-							uid_entry->active_stime;
-		unsigned long long total_power = uid_entry->power +
-							uid_entry->active_power;
+static int uid_cputime_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *uid_entry;
+	struct uid_stats total;
+	unsigned long bkt;
+
+	rcu_read_lock();
+	hash_for_each_rcu(hash_table, bkt, uid_entry, hash) {
+		uid_entry_sum(uid_entry, &total);
 		seq_printf(m, "%d: %llu %llu %llu\n", uid_entry->uid,
 			(unsigned long long)jiffies_to_msecs(
-				cputime_to_jiffies(total_utime)) * USEC_PER_MSEC,
+				cputime_to_jiffies(total.utime)) * USEC_PER_MSEC,
 			(unsigned long long)jiffies_to_msecs(
-				cputime_to_jiffies(total_stime)) * USEC_PER_MSEC,
-			total_power);
+				cputime_to_jiffies(total.stime)) * USEC_PER_MSEC,
+			total.power);
 	}
+	rcu_read_unlock();
 
-	rt_mutex_unlock(&uid_lock);
 	return 0;
 }
 
@@ -452,18 +601,20 @@ static ssize_t uid_remove_write(struct file *file,
 	cpufreq_task_stats_remove_uids(uid_start, uid_end);
 
 	rt_mutex_lock(&uid_lock);
+	spin_lock_irq(&uid_hash_lock);
 
 	for (; uid_start <= uid_end; uid_start++) {
 		hash_for_each_possible_safe(hash_table, uid_entry, tmp,
 							hash, uid_start) {
 			if (uid_start == uid_entry->uid) {
 				remove_uid_tasks(uid_entry);
-				hash_del(&uid_entry->hash);
-				kfree(uid_entry);
+				hash_del_rcu(&uid_entry->hash);
+				call_rcu(&uid_entry->rcu, free_uid_entry);
 			}
 		}
 	}
 
+	spin_unlock_irq(&uid_hash_lock);
 	rt_mutex_unlock(&uid_lock);
 
 	return count;
@@ -476,103 +627,36 @@ static const struct file_operations uid_remove_fops = {
 };
 
 
-static void add_uid_io_stats(struct uid_entry *uid_entry,
-			struct task_struct *task, int slot)
-{
-	struct io_stats *io_slot = &uid_entry->io[slot];
-
-	io_slot->read_bytes += task->ioac.read_bytes;
-	io_slot->write_bytes += compute_write_bytes(task);
-	io_slot->rchar += task->ioac.rchar;
-	io_slot->wchar += task->ioac.wchar;
-	io_slot->fsync += task->ioac.syscfs;
-
-	add_uid_tasks_io_stats(uid_entry, task, slot);
-}
-
-static void update_io_stats_all_locked(void)
-{
-	struct uid_entry *uid_entry;
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-	unsigned long bkt;
-	uid_t uid;
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
-			sizeof(struct io_stats));
-		set_io_uid_tasks_zero(uid_entry);
-	}
-
-	rcu_read_lock();
-	do_each_thread(temp, task) {
-		uid = from_kuid_munged(user_ns, task_uid(task));
-		uid_entry = find_or_register_uid(uid);
-		if (!uid_entry)
-			continue;
-		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
-	} while_each_thread(temp, task);
-	rcu_read_unlock();
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
-					&uid_entry->io[UID_STATE_TOTAL_CURR],
-					&uid_entry->io[UID_STATE_TOTAL_LAST],
-					&uid_entry->io[UID_STATE_DEAD_TASKS]);
-		compute_io_uid_tasks(uid_entry);
-	}
-}
-
-static void update_io_stats_uid_locked(struct uid_entry *uid_entry)
-{
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-
-	memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
-		sizeof(struct io_stats));
-	set_io_uid_tasks_zero(uid_entry);
-
-	rcu_read_lock();
-	do_each_thread(temp, task) {
-		if (from_kuid_munged(user_ns, task_uid(task)) != uid_entry->uid)
-			continue;
-		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
-	} while_each_thread(temp, task);
-	rcu_read_unlock();
-
-	compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
-				&uid_entry->io[UID_STATE_TOTAL_CURR],
-				&uid_entry->io[UID_STATE_TOTAL_LAST],
-				&uid_entry->io[UID_STATE_DEAD_TASKS]);
-	compute_io_uid_tasks(uid_entry);
-}
-
-
 static int uid_io_show(struct seq_file *m, void *v)
 {
 	struct uid_entry *uid_entry;
+	struct uid_stats total;
+	struct io_stats *io = total.io;
 	unsigned long bkt;
 
 	rt_mutex_lock(&uid_lock);
 
-	update_io_stats_all_locked();
+	update_io_uid_tasks(NULL);
 
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
+	rcu_read_lock();
+	hash_for_each_rcu(hash_table, bkt, uid_entry, hash) {
+		uid_entry_sum(uid_entry, &total);
 		seq_printf(m, "%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
 				uid_entry->uid,
-				uid_entry->io[UID_STATE_FOREGROUND].rchar,
-				uid_entry->io[UID_STATE_FOREGROUND].wchar,
-				uid_entry->io[UID_STATE_FOREGROUND].read_bytes,
-				uid_entry->io[UID_STATE_FOREGROUND].write_bytes,
-				uid_entry->io[UID_STATE_BACKGROUND].rchar,
-				uid_entry->io[UID_STATE_BACKGROUND].wchar,
-				uid_entry->io[UID_STATE_BACKGROUND].read_bytes,
-				uid_entry->io[UID_STATE_BACKGROUND].write_bytes,
-				uid_entry->io[UID_STATE_FOREGROUND].fsync,
-				uid_entry->io[UID_STATE_BACKGROUND].fsync);
+				io[UID_STATE_FOREGROUND].rchar,
+				io[UID_STATE_FOREGROUND].wchar,
+				io[UID_STATE_FOREGROUND].read_bytes,
+				io[UID_STATE_FOREGROUND].write_bytes,
+				io[UID_STATE_BACKGROUND].rchar,
+				io[UID_STATE_BACKGROUND].wchar,
+				io[UID_STATE_BACKGROUND].read_bytes,
+				io[UID_STATE_BACKGROUND].write_bytes,
+				io[UID_STATE_FOREGROUND].fsync,
+				io[UID_STATE_BACKGROUND].fsync);
 
 		show_io_uid_tasks(m, uid_entry);
 	}
+	rcu_read_unlock();
 
 	rt_mutex_unlock(&uid_lock);
 	return 0;
@@ -620,7 +704,10 @@ static ssize_t uid_procstat_write(struct file *file,
 
 	rt_mutex_lock(&uid_lock);
 
+	/* Entries are only removed under uid_lock */
+	rcu_read_lock();
 	uid_entry = find_or_register_uid(uid);
+	rcu_read_unlock();
 	if (!uid_entry) {
 		rt_mutex_unlock(&uid_lock);
 		return -EINVAL;
@@ -631,9 +718,13 @@ static ssize_t uid_procstat_write(struct file *file,
 		return count;
 	}
 
-	update_io_stats_uid_locked(uid_entry);
+	/*
+	 * Tasks of the UID that are running now charge what they did since
+	 * their last tick to the new state.
+	 */
+	update_io_uid_tasks(uid_entry);
 
-	uid_entry->state = state;
+	ACCESS_ONCE(uid_entry->state) = state;
 
 	rt_mutex_unlock(&uid_lock);
 
@@ -651,30 +742,25 @@ static int process_notifier(struct notifier_block *self,
 {
 	struct task_struct *task = v;
 	struct uid_entry *uid_entry;
-	cputime_t utime, stime;
 	uid_t uid;
 
 	if (!task)
 		return NOTIFY_OK;
 
-	rt_mutex_lock(&uid_lock);
-	uid = from_kuid_munged(current_user_ns(), task_uid(task));
+	uid = from_kuid_munged(&init_user_ns, task_uid(task));
+
+	rcu_read_lock();
 	uid_entry = find_or_register_uid(uid);
+	if (uid_entry)
+		uid_entry_charge(uid_entry, task);
+	rcu_read_unlock();
+
 	if (!uid_entry) {
 		pr_err("%s: failed to find uid %d\n", __func__, uid);
-		goto exit;
+		return NOTIFY_OK;
 	}
 
-	task_cputime_adjusted(task, &utime, &stime);
-	uid_entry->utime += utime;
-	uid_entry->stime += stime;
-	uid_entry->power += task->cpu_power;
-	task->cpu_power = ULLONG_MAX;
-
-	add_uid_io_stats(uid_entry, task, UID_STATE_DEAD_TASKS);
-
-exit:
-	rt_mutex_unlock(&uid_lock);
+	exit_uid_task(uid, task);
 	return NOTIFY_OK;
 }
 
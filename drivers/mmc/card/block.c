@@ -206,7 +206,7 @@ static void mmc_blk_put(struct mmc_blk_data *md)
 	md->usage--;
 	if (md->usage == 0) {
 		int devidx = mmc_get_devidx(md->disk);
-		blk_cleanup_queue(md->queue.queue);
+		mmc_exit_queue(&md->queue);
 
 		__clear_bit(devidx, dev_use);
 
@@ -2942,7 +2942,7 @@ static bool is_cmdq_dcmd_req(struct request_queue *q, int tag)
 	struct mmc_queue_req *mq_rq;
 	struct mmc_cmdq_req *cmdq_req;
 
-	req = blk_queue_find_tag(q, tag);
+	req = mmc_queue_find_tag(q->queuedata, tag);
 	if (WARN_ON(!req))
 		goto out;
 	mq_rq = req->special;
@@ -2970,6 +2970,7 @@ static void mmc_blk_cmdq_reset_all(struct mmc_host *host, int err)
 	struct mmc_card *card = host->card;
 	struct mmc_cmdq_context_info *ctx_info = &host->cmdq_ctx;
 	struct request_queue *q;
+	unsigned long requeue = 0;
 	int itag = 0;
 	int ret = 0;
 
@@ -3000,11 +3001,10 @@ static void mmc_blk_cmdq_reset_all(struct mmc_host *host, int err)
 					&ctx_info->active_reqs));
 		mmc_host_clk_release(host);
 		mmc_put_card(card);
+		requeue |= 1UL << itag;
 	}
 
-	spin_lock_irq(q->queue_lock);
-	blk_queue_invalidate_tags(q);
-	spin_unlock_irq(q->queue_lock);
+	mmc_queue_invalidate_tags(q->queuedata, requeue);
 }
 
 static void mmc_blk_cmdq_shutdown(struct mmc_queue *mq)
@@ -3453,7 +3453,7 @@ out:
 	if (!ctx_info->active_reqs)
 		wake_up_interruptible(&host->cmdq_ctx.queue_empty_wq);
 
-	if (blk_queue_stopped(mq->queue) && !ctx_info->active_reqs)
+	if (mmc_queue_stopped(mq) && !ctx_info->active_reqs)
 		complete(&mq->cmdq_shutdown_complete);
 
 	return;
@@ -3743,7 +3743,7 @@ static int mmc_blk_cmdq_issue_rq(struct mmc_queue *mq, struct request *req)
 	struct mmc_host *host = card->host;
 	unsigned int cmd_flags = req ? req->cmd_flags : 0;
 
-	mmc_get_card(card);
+	mmc_ctx_get_card(card, mmc_queue_ctx(mq));
 
 	if (!card->host->cmdq_ctx.active_reqs && mmc_card_doing_bkops(card)) {
 		ret = mmc_cmdq_halt(card->host, true);
@@ -3840,7 +3840,7 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 
 	if (req && !mq->mqrq_prev->req) {
 		/* claim host only for the first request */
-		mmc_get_card(card);
+		mmc_ctx_get_card(card, mmc_queue_ctx(mq));
 
 		if (mmc_card_doing_bkops(host->card)) {
 			ret = mmc_stop_bkops(host->card);
@@ -4030,7 +4030,9 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		md->queue.cmdq_shutdown = mmc_blk_cmdq_shutdown;
 	}
 
+	/* packing fetches and requeues requests on the legacy queue */
 	if (mmc_card_mmc(card) && !card->cmdq_init &&
+	    !mmc_queue_mq(&md->queue) &&
 	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
 	    (md->flags & MMC_BLK_CMD23) &&
 	    card->ext_csd.packed_event_en) {
@@ -32,22 +32,37 @@
  */
 #define DEFAULT_NUM_REQS_TO_START_PACK 17
 
+/* Queue depth in blk-mq mode when the card has no command queue */
+#define MMC_QUEUE_MQ_DEPTH	64
+
+static bool use_blk_mq = IS_ENABLED(CONFIG_MMC_BLOCK_MQ);
+module_param(use_blk_mq, bool, 0444);
+MODULE_PARM_DESC(use_blk_mq, "Use blk-mq for the MMC block queues");
+
 /*
- * Prepare a MMC request. This just filters out odd stuff.
+ * Whether a request has to be killed rather than issued.
  */
-static int mmc_prep_request(struct request_queue *q, struct request *req)
+static bool mmc_kill_request(struct mmc_queue *mq, struct request *req)
 {
-	struct mmc_queue *mq = q->queuedata;
-
 	/*
 	 * We only like normal block requests and discards.
 	 */
 	if (req->cmd_type != REQ_TYPE_FS && !(req->cmd_flags & REQ_DISCARD)) {
 		blk_dump_rq_flags(req, "MMC bad request");
-		return BLKPREP_KILL;
+		return true;
 	}
 
-	if (mq && (mmc_card_removed(mq->card) || mmc_access_rpmb(mq)))
+	return mq && (mmc_card_removed(mq->card) || mmc_access_rpmb(mq));
+}
+
+/*
+ * Prepare a MMC request. This just filters out odd stuff.
+ */
+static int mmc_prep_request(struct request_queue *q, struct request *req)
+{
+	struct mmc_queue *mq = q->queuedata;
+
+	if (mmc_kill_request(mq, req))
 		return BLKPREP_KILL;
 
 	req->cmd_flags |= REQ_DONTPREP;
@@ -80,6 +95,24 @@ static bool mmc_check_blk_queue_start_tag(struct request_queue *q,
 	return !!ret;
 }
 
+/*
+ * Whether @req can be issued to the command queue now: a flush/discard
+ * needs the direct command slot free, and cmdq must be neither halted,
+ * disabled nor in error state.
+ */
+static bool mmc_cmdq_can_issue(struct mmc_host *host, struct request *req)
+{
+	struct mmc_cmdq_context_info *ctx = &host->cmdq_ctx;
+
+	return !((req->cmd_flags & (REQ_FLUSH | REQ_DISCARD))
+		  && test_bit(CMDQ_STATE_DCMD_ACTIVE, &ctx->curr_state))
+		&& !(!host->card->part_curr && !mmc_card_suspended(host->card)
+		     && mmc_host_halt(host))
+		&& !(!host->card->part_curr && mmc_host_cq_disable(host) &&
+			!mmc_card_suspended(host->card))
+		&& !test_bit(CMDQ_STATE_ERR, &ctx->curr_state);
+}
+
 static inline void mmc_cmdq_ready_wait(struct mmc_host *host,
 					struct mmc_queue *mq)
 {
@@ -97,14 +130,8 @@ static inline void mmc_cmdq_ready_wait(struct mmc_host *host,
 	 * 5. free tag available to process the new request.
 	 */
 	wait_event(ctx->wait, kthread_should_stop()
-		|| (mmc_peek_request(mq) &&
-		!((mq->cmdq_req_peeked->cmd_flags & (REQ_FLUSH | REQ_DISCARD))
-		  && test_bit(CMDQ_STATE_DCMD_ACTIVE, &ctx->curr_state))
-		&& !(!host->card->part_curr && !mmc_card_suspended(host->card)
-		     && mmc_host_halt(host))
-		&& !(!host->card->part_curr && mmc_host_cq_disable(host) &&
-			!mmc_card_suspended(host->card))
-		&& !test_bit(CMDQ_STATE_ERR, &ctx->curr_state)
+		|| (mmc_peek_request(mq)
+		&& mmc_cmdq_can_issue(host, mq->cmdq_req_peeked)
 		&& !mmc_check_blk_queue_start_tag(q, mq->cmdq_req_peeked)));
 }
 
@@ -137,6 +164,41 @@ static int mmc_cmdq_thread(void *d)
 	return 0;
 }
 
+/*
+ * Issue @req, or wait for the request in flight to complete if @req is
+ * NULL, then make the current request the previous one.  Returns false
+ * if the wait was cut short by a new request.  Called with thread_sem
+ * held and mqrq_cur->req set to @req.
+ */
+static bool mmc_queue_issue(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_queue_req *tmp;
+	unsigned int cmd_flags = req ? req->cmd_flags : 0;
+
+	mq->issue_fn(mq, req);
+	if (test_bit(MMC_QUEUE_NEW_REQUEST, &mq->flags)) {
+		clear_bit(MMC_QUEUE_NEW_REQUEST, &mq->flags);
+		return false;
+	}
+
+	/*
+	 * Current request becomes previous request
+	 * and vice versa.
+	 * In case of special requests, current request
+	 * has been finished. Do not assign it to previous
+	 * request.
+	 */
+	if (cmd_flags & MMC_REQ_SPECIAL_MASK)
+		mq->mqrq_cur->req = NULL;
+
+	mq->mqrq_prev->brq.mrq.data = NULL;
+	mq->mqrq_prev->req = NULL;
+	tmp = mq->mqrq_prev;
+	mq->mqrq_prev = mq->mqrq_cur;
+	mq->mqrq_cur = tmp;
+	return true;
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -150,8 +212,6 @@ static int mmc_queue_thread(void *d)
 	down(&mq->thread_sem);
 	do {
 		struct request *req = NULL;
-		struct mmc_queue_req *tmp;
-		unsigned int cmd_flags = 0;
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
@@ -161,28 +221,8 @@ static int mmc_queue_thread(void *d)
 
 		if (req || mq->mqrq_prev->req) {
 			set_current_state(TASK_RUNNING);
-			cmd_flags = req ? req->cmd_flags : 0;
-			mq->issue_fn(mq, req);
-			if (test_bit(MMC_QUEUE_NEW_REQUEST, &mq->flags)) {
-				clear_bit(MMC_QUEUE_NEW_REQUEST, &mq->flags);
+			if (!mmc_queue_issue(mq, req))
 				continue; /* fetch again */
-			}
-
-			/*
-			 * Current request becomes previous request
-			 * and vice versa.
-			 * In case of special requests, current request
-			 * has been finished. Do not assign it to previous
-			 * request.
-			 */
-			if (cmd_flags & MMC_REQ_SPECIAL_MASK)
-				mq->mqrq_cur->req = NULL;
-
-			mq->mqrq_prev->brq.mrq.data = NULL;
-			mq->mqrq_prev->req = NULL;
-			tmp = mq->mqrq_prev;
-			mq->mqrq_prev = mq->mqrq_cur;
-			mq->mqrq_cur = tmp;
 		} else {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
@@ -205,6 +245,24 @@ static void mmc_cmdq_dispatch_req(struct request_queue *q)
 	wake_up(&mq->card->host->cmdq_ctx.wait);
 }
 
+/*
+ * New MMC request arrived when the issuer may be blocked on the previous
+ * request to be complete with no current request: make it return so the
+ * new request can be started while the previous one is still going.
+ */
+static void mmc_queue_new_request(struct mmc_queue *mq)
+{
+	struct mmc_context_info *cntx = &mq->card->host->context_info;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cntx->lock, flags);
+	if (cntx->is_waiting_last_req) {
+		cntx->is_new_req = true;
+		wake_up_interruptible(&cntx->wait);
+	}
+	spin_unlock_irqrestore(&cntx->lock, flags);
+}
+
 /*
  * Generic MMC request handler.  This is called for any queue on a
  * particular host.  When the host is not busy, we look for a request
@@ -215,8 +273,6 @@ static void mmc_request_fn(struct request_queue *q)
 {
 	struct mmc_queue *mq = q->queuedata;
 	struct request *req;
-	unsigned long flags;
-	struct mmc_context_info *cntx;
 
 	if (!mq) {
 		while ((req = blk_fetch_request(q)) != NULL) {
@@ -226,23 +282,152 @@ static void mmc_request_fn(struct request_queue *q)
 		return;
 	}
 
-	cntx = &mq->card->host->context_info;
-	if (!mq->mqrq_cur->req && mq->mqrq_prev->req) {
-		/*
-		 * New MMC request arrived when MMC thread may be
-		 * blocked on the previous request to be complete
-		 * with no current request fetched
-		 */
-		spin_lock_irqsave(&cntx->lock, flags);
-		if (cntx->is_waiting_last_req) {
-			cntx->is_new_req = true;
-			wake_up_interruptible(&cntx->wait);
-		}
-		spin_unlock_irqrestore(&cntx->lock, flags);
-	} else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
+	if (!mq->mqrq_cur->req && mq->mqrq_prev->req)
+		mmc_queue_new_request(mq);
+	else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
 		wake_up_process(mq->thread);
 }
 
+/*
+ * blk-mq mode.  Requests are issued from ->queue_rq(), by the submitting
+ * task for sync IO, with thread_sem serializing the issuers the way it
+ * serialized the queue thread against suspend.  On a command queue the
+ * blk-mq tags are the CMDQ task slots, one slot being kept for direct
+ * commands.  Otherwise the request in flight overlaps with preparing the
+ * next one as with the queue thread, and complete_work finishes the last
+ * request once nothing more has been queued.
+ */
+static void mmc_cmdq_softirq_done(struct request *rq);
+enum blk_eh_timer_return mmc_cmdq_rq_timed_out(struct request *req);
+
+static int mmc_cmdq_queue_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_host *host = mq->card->host;
+
+	wait_event(host->cmdq_ctx.wait,
+		   test_bit(MMC_QUEUE_SUSPENDED, &mq->flags) ||
+		   mmc_cmdq_can_issue(host, req));
+	if (test_bit(MMC_QUEUE_SUSPENDED, &mq->flags))
+		return BLK_MQ_RQ_QUEUE_BUSY;
+
+	blk_mq_start_request(req);
+	/*
+	 * Don't requeue if cmdq_issue_fn fails, recovery comes from the
+	 * completion softirq as with the cmdq thread.
+	 */
+	mq->cmdq_issue_fn(mq, req);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static int mmc_mq_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req,
+			   bool last)
+{
+	struct mmc_queue *mq = req->q->queuedata;
+	int ret = BLK_MQ_RQ_QUEUE_OK;
+
+	if (!mq || mmc_kill_request(mq, req))
+		goto kill;
+
+	if (test_bit(MMC_QUEUE_SUSPENDED, &mq->flags))
+		return BLK_MQ_RQ_QUEUE_BUSY;
+
+	if (!mq->mqrq_cmdq)
+		mmc_queue_new_request(mq);
+	down(&mq->thread_sem);
+	/* mmc_cleanup_queue() may have run while we waited */
+	if (!req->q->queuedata) {
+		up(&mq->thread_sem);
+		goto kill;
+	}
+
+	mq->ctx.task = current;
+	if (mq->mqrq_cmdq) {
+		ret = mmc_cmdq_queue_rq(mq, req);
+	} else {
+		blk_mq_start_request(req);
+		mq->mqrq_cur->req = req;
+		mmc_queue_issue(mq, req);
+		if (last && mq->mqrq_prev->req)
+			kblockd_schedule_work(&mq->complete_work);
+	}
+	mq->ctx.task = NULL;
+	up(&mq->thread_sem);
+
+	return ret;
+
+kill:
+	req->cmd_flags |= REQ_QUIET;
+	return BLK_MQ_RQ_QUEUE_ERROR;
+}
+
+/* Wait for the request in flight when nothing more has been queued */
+static void mmc_queue_complete_work(struct work_struct *work)
+{
+	struct mmc_queue *mq = container_of(work, struct mmc_queue,
+					    complete_work);
+
+	down(&mq->thread_sem);
+	if (mq->mqrq_prev->req) {
+		mq->ctx.task = current;
+		mq->mqrq_cur->req = NULL;
+		mmc_queue_issue(mq, NULL);
+		mq->ctx.task = NULL;
+	}
+	up(&mq->thread_sem);
+}
+
+static enum blk_eh_timer_return mmc_cmdq_mq_timed_out(struct request *req,
+						      bool reserved)
+{
+	return mmc_cmdq_rq_timed_out(req);
+}
+
+static struct blk_mq_ops mmc_mq_ops = {
+	.queue_rq	= mmc_mq_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+static struct blk_mq_ops mmc_cmdq_mq_ops = {
+	.queue_rq	= mmc_mq_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= mmc_cmdq_softirq_done,
+	.timeout	= mmc_cmdq_mq_timed_out,
+};
+
+static struct request_queue *mmc_mq_init_queue(struct mmc_queue *mq,
+					       struct mmc_card *card,
+					       bool cmdq)
+{
+	struct blk_mq_tag_set *set = &mq->tag_set;
+	struct request_queue *q;
+
+	memset(set, 0, sizeof(*set));
+	if (cmdq) {
+		set->ops = &mmc_cmdq_mq_ops;
+		/* one slot is reserved for dcmd requests */
+		set->queue_depth = card->ext_csd.cmdq_depth - 1;
+		set->timeout = 120 * HZ;
+	} else {
+		set->ops = &mmc_mq_ops;
+		set->queue_depth = MMC_QUEUE_MQ_DEPTH;
+	}
+	set->nr_hw_queues = 1;
+	set->numa_node = NUMA_NO_NODE;
+	set->flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_BLOCKING;
+
+	if (blk_mq_alloc_tag_set(set))
+		return NULL;
+
+	q = blk_mq_init_queue(set);
+	if (IS_ERR(q)) {
+		blk_mq_free_tag_set(set);
+		return NULL;
+	}
+
+	INIT_WORK(&mq->complete_work, mmc_queue_complete_work);
+	return q;
+}
+
 static struct scatterlist *mmc_alloc_sg(int sg_len, int *err)
 {
 	struct scatterlist *sg;
@@ -329,7 +514,10 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	mq->card = card;
 	if (card->ext_csd.cmdq_support &&
 	    (area_type == MMC_BLK_DATA_AREA_MAIN)) {
-		mq->queue = blk_init_queue(mmc_cmdq_dispatch_req, lock);
+		if (use_blk_mq)
+			mq->queue = mmc_mq_init_queue(mq, card, true);
+		else
+			mq->queue = blk_init_queue(mmc_cmdq_dispatch_req, lock);
 		if (!mq->queue)
 			return -ENOMEM;
 		mmc_cmdq_setup_queue(mq, card);
@@ -337,13 +525,15 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		if (ret) {
 			pr_err("%s: %d: cmdq: unable to set-up\n",
 			       mmc_hostname(card->host), ret);
-			blk_cleanup_queue(mq->queue);
+			mmc_exit_queue(mq);
 		} else {
 			sema_init(&mq->thread_sem, 1);
 			/* hook for pm qos cmdq init */
 			if (card->host->cmdq_ops->init)
 				card->host->cmdq_ops->init(card->host);
 			mq->queue->queuedata = mq;
+			if (mmc_queue_mq(mq))
+				return 0;
 			mq->thread = kthread_run(mmc_cmdq_thread, mq,
 						 "mmc-cmdqd/%d%s",
 						 host->index,
@@ -358,7 +548,10 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		}
 	}
 
-	mq->queue = blk_init_queue(mmc_request_fn, lock);
+	if (use_blk_mq)
+		mq->queue = mmc_mq_init_queue(mq, card, false);
+	else
+		mq->queue = blk_init_queue(mmc_request_fn, lock);
 	if (!mq->queue)
 		return -ENOMEM;
 
@@ -369,7 +562,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		min_t(int, (int)card->ext_csd.max_packed_writes,
 		     DEFAULT_NUM_REQS_TO_START_PACK);
 
-	blk_queue_prep_rq(mq->queue, mmc_prep_request);
+	if (!mmc_queue_mq(mq))
+		blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
 	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, mq->queue);
 	if (mmc_can_erase(card))
@@ -474,6 +668,9 @@ success:
 	if (card->host->ops->init)
 		card->host->ops->init(card->host);
 
+	if (mmc_queue_mq(mq))
+		return 0;
+
 	mq->thread = kthread_run(mmc_queue_thread, mq, "mmcqd/%d%s",
 		host->index, subname ? subname : "");
 
@@ -500,7 +697,7 @@ success:
 	kfree(mqrq_prev->bounce_buf);
 	mqrq_prev->bounce_buf = NULL;
 
-	blk_cleanup_queue(mq->queue);
+	mmc_exit_queue(mq);
 	return ret;
 }
 
@@ -514,14 +711,25 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	/* Make sure the queue isn't suspended, as that will deadlock */
 	mmc_queue_resume(mq);
 
-	/* Then terminate our worker thread */
-	kthread_stop(mq->thread);
-
-	/* Empty the queue */
-	spin_lock_irqsave(q->queue_lock, flags);
-	q->queuedata = NULL;
-	blk_start_queue(q);
-	spin_unlock_irqrestore(q->queue_lock, flags);
+	if (mmc_queue_mq(mq)) {
+		/* Fail new requests, then let the issuers drain */
+		spin_lock_irqsave(q->queue_lock, flags);
+		q->queuedata = NULL;
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		down(&mq->thread_sem);
+		up(&mq->thread_sem);
+		flush_work(&mq->complete_work);
+		blk_mq_start_stopped_hw_queues(q, true);
+	} else {
+		/* Then terminate our worker thread */
+		kthread_stop(mq->thread);
+
+		/* Empty the queue */
+		spin_lock_irqsave(q->queue_lock, flags);
+		q->queuedata = NULL;
+		blk_start_queue(q);
+		spin_unlock_irqrestore(q->queue_lock, flags);
+	}
 
 	kfree(mqrq_cur->bounce_sg);
 	mqrq_cur->bounce_sg = NULL;
@@ -647,20 +855,23 @@ int mmc_cmdq_init(struct mmc_queue *mq, struct mmc_card *card)
 		}
 	}
 
-	ret = blk_queue_init_tags(mq->queue, q_depth, NULL);
-	if (ret) {
-		pr_warn("%s: unable to allocate cmdq tags %d\n",
-				mmc_card_name(card), q_depth);
-		goto free_mqrq_sg;
+	/* in blk-mq mode tags, completion and timeout come with the tag set */
+	if (!mmc_queue_mq(mq)) {
+		ret = blk_queue_init_tags(mq->queue, q_depth, NULL);
+		if (ret) {
+			pr_warn("%s: unable to allocate cmdq tags %d\n",
+					mmc_card_name(card), q_depth);
+			goto free_mqrq_sg;
+		}
+
+		blk_queue_softirq_done(mq->queue, mmc_cmdq_softirq_done);
+		blk_queue_rq_timed_out(mq->queue, mmc_cmdq_rq_timed_out);
+		blk_queue_rq_timeout(mq->queue, 120 * HZ);
 	}
 
-	blk_queue_softirq_done(mq->queue, mmc_cmdq_softirq_done);
 	INIT_WORK(&mq->cmdq_err_work, mmc_cmdq_error_work);
 	init_completion(&mq->cmdq_shutdown_complete);
 	init_completion(&mq->cmdq_pending_req_done);
-
-	blk_queue_rq_timed_out(mq->queue, mmc_cmdq_rq_timed_out);
-	blk_queue_rq_timeout(mq->queue, 120 * HZ);
 	card->cmdq_init = true;
 
 	goto out;
@@ -679,9 +890,11 @@ void mmc_cmdq_clean(struct mmc_queue *mq, struct mmc_card *card)
 	int i;
 	int q_depth = card->ext_csd.cmdq_depth - 1;
 
-	blk_free_tags(mq->queue->queue_tags);
-	mq->queue->queue_tags = NULL;
-	blk_queue_free_tags(mq->queue);
+	if (!mmc_queue_mq(mq)) {
+		blk_free_tags(mq->queue->queue_tags);
+		mq->queue->queue_tags = NULL;
+		blk_queue_free_tags(mq->queue);
+	}
 
 	for (i = 0; i < q_depth; i++)
 		kfree(mq->mqrq_cmdq[i].sg);
@@ -689,6 +902,114 @@ void mmc_cmdq_clean(struct mmc_queue *mq, struct mmc_card *card)
 	mq->mqrq_cmdq = NULL;
 }
 
+/**
+ * mmc_exit_queue - release the block request queue
+ * @mq: MMC queue
+ *
+ * Counterpart of the request queue allocation in mmc_init_queue(), once
+ * mmc_cleanup_queue() has run and the queue has no more users.
+ */
+void mmc_exit_queue(struct mmc_queue *mq)
+{
+	bool blk_mq = mmc_queue_mq(mq);
+
+	blk_cleanup_queue(mq->queue);
+	if (blk_mq)
+		blk_mq_free_tag_set(&mq->tag_set);
+}
+
+/*
+ * Whether the queue is stopped, on behalf of the cmdq completion which
+ * is shared by both modes.
+ */
+bool mmc_queue_stopped(struct mmc_queue *mq)
+{
+	if (mmc_queue_mq(mq))
+		return test_bit(MMC_QUEUE_SUSPENDED, &mq->flags);
+	return blk_queue_stopped(mq->queue);
+}
+
+/* The request holding a cmdq slot */
+struct request *mmc_queue_find_tag(struct mmc_queue *mq, int tag)
+{
+	if (mmc_queue_mq(mq))
+		return blk_mq_tag_to_rq(mq->tag_set.tags[0], tag);
+	return blk_queue_find_tag(mq->queue, tag);
+}
+
+/**
+ * mmc_queue_invalidate_tags - requeue the requests of a command queue
+ * @mq: MMC queue
+ * @tags: slots of the requests to requeue
+ *
+ * Puts the requests back to the block layer after a cmdq reset.  The
+ * legacy queue requeues all of its tagged requests.
+ */
+void mmc_queue_invalidate_tags(struct mmc_queue *mq, unsigned long tags)
+{
+	struct request_queue *q = mq->queue;
+	int tag;
+
+	if (!mmc_queue_mq(mq)) {
+		spin_lock_irq(q->queue_lock);
+		blk_queue_invalidate_tags(q);
+		spin_unlock_irq(q->queue_lock);
+		return;
+	}
+
+	for_each_set_bit(tag, &tags, BITS_PER_LONG)
+		blk_mq_requeue_request(mmc_queue_find_tag(mq, tag));
+	blk_mq_kick_requeue_list(q);
+}
+
+/*
+ * Suspend in blk-mq mode: stop dispatching and hold thread_sem like the
+ * legacy queue thread does, once nothing is left in flight.
+ */
+static int mmc_mq_queue_suspend(struct mmc_queue *mq, int wait)
+{
+	struct mmc_host *host = mq->card->host;
+	bool cmdq = mq->mqrq_cmdq;
+
+	if (test_and_set_bit(MMC_QUEUE_SUSPENDED, &mq->flags))
+		return 0;
+
+	blk_mq_stop_hw_queues(mq->queue);
+	if (cmdq)
+		wake_up(&host->cmdq_ctx.wait);
+
+	if (!wait) {
+		if (down_trylock(&mq->thread_sem))
+			goto busy;
+		if (cmdq ? host->cmdq_ctx.active_reqs :
+		    (mq->mqrq_prev->req || work_pending(&mq->complete_work))) {
+			up(&mq->thread_sem);
+			goto busy;
+		}
+		return 0;
+	}
+
+	/* shutdown/reboot: complete what is in flight */
+	down(&mq->thread_sem);
+	if (cmdq) {
+		if (host->cmdq_ctx.active_reqs)
+			wait_for_completion(&mq->cmdq_shutdown_complete);
+		mq->cmdq_shutdown(mq);
+	} else {
+		while (mq->mqrq_prev->req) {
+			mq->mqrq_cur->req = NULL;
+			mmc_queue_issue(mq, NULL);
+		}
+	}
+	return 0;
+
+busy:
+	/* Abort the suspend, requests are being processed */
+	clear_bit(MMC_QUEUE_SUSPENDED, &mq->flags);
+	blk_mq_start_stopped_hw_queues(mq->queue, true);
+	return -EBUSY;
+}
+
 /**
  * mmc_queue_suspend - suspend a MMC request queue
  * @mq: MMC queue to suspend
@@ -706,6 +1027,9 @@ int mmc_queue_suspend(struct mmc_queue *mq, int wait)
 	struct mmc_card *card = mq->card;
 	struct request *req;
 
+	if (mmc_queue_mq(mq))
+		return mmc_mq_queue_suspend(mq, wait);
+
 	if (card->cmdq_init && blk_queue_tagged(q)) {
 		struct mmc_host *host = card->host;
 
@@ -788,6 +1112,12 @@ void mmc_queue_resume(struct mmc_queue *mq)
 
 	if (test_and_clear_bit(MMC_QUEUE_SUSPENDED, &mq->flags)) {
 
+		if (mmc_queue_mq(mq)) {
+			up(&mq->thread_sem);
+			blk_mq_start_stopped_hw_queues(q, true);
+			return;
+		}
+
 		if (!(card->cmdq_init && blk_queue_tagged(q)))
 			up(&mq->thread_sem);
 
@@ -1,6 +1,8 @@
 #ifndef MMC_QUEUE_H
 #define MMC_QUEUE_H
 
+#include <linux/blk-mq.h>
+
 #define MMC_REQ_SPECIAL_MASK	(REQ_DISCARD | REQ_FLUSH)
 
 struct request;
@@ -76,11 +78,32 @@ struct mmc_queue {
 	int (*err_check_fn) (struct mmc_card *, struct mmc_async_req *);
 	void (*packed_test_fn) (struct request_queue *, struct mmc_queue_req *);
 	void (*cmdq_shutdown)(struct mmc_queue *);
+
+	/* blk-mq mode, see mmc_queue_mq() */
+	struct blk_mq_tag_set	tag_set;
+	struct mmc_ctx		ctx;		/* host claims of the queue */
+	struct work_struct	complete_work;	/* finishes the last request */
 };
 
+/*
+ * In blk-mq mode requests are dispatched from ->queue_rq() by the
+ * submitting task, or kblockd, instead of from the queue thread.
+ */
+static inline bool mmc_queue_mq(struct mmc_queue *mq)
+{
+	return mq->queue && mq->queue->mq_ops;
+}
+
+/* Context to claim the host with on behalf of the queue */
+static inline struct mmc_ctx *mmc_queue_ctx(struct mmc_queue *mq)
+{
+	return mmc_queue_mq(mq) ? &mq->ctx : NULL;
+}
+
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
 			  const char *, int);
 extern void mmc_cleanup_queue(struct mmc_queue *);
+extern void mmc_exit_queue(struct mmc_queue *);
 extern int mmc_queue_suspend(struct mmc_queue *, int);
 extern void mmc_queue_resume(struct mmc_queue *);
 
@@ -98,5 +121,9 @@ extern void print_mmc_packing_stats(struct mmc_card *card);
 
 extern int mmc_cmdq_init(struct mmc_queue *mq, struct mmc_card *card);
 extern void mmc_cmdq_clean(struct mmc_queue *mq, struct mmc_card *card);
+extern bool mmc_queue_stopped(struct mmc_queue *mq);
+extern struct request *mmc_queue_find_tag(struct mmc_queue *mq, int tag);
+extern void mmc_queue_invalidate_tags(struct mmc_queue *mq,
+				      unsigned long tags);
 
 #endif
@@ -1994,18 +1994,39 @@ unsigned int mmc_align_data_size(struct mmc_card *card, unsigned int sz)
 }
 EXPORT_SYMBOL(mmc_align_data_size);
 
+static inline bool mmc_ctx_matches(struct mmc_host *host, struct mmc_ctx *ctx,
+				   struct task_struct *task)
+{
+	return host->claimer == ctx ||
+	       (!ctx && task && host->claimer->task == task);
+}
+
+static inline void mmc_ctx_set_claimer(struct mmc_host *host,
+				       struct mmc_ctx *ctx,
+				       struct task_struct *task)
+{
+	if (!host->claimer)
+		host->claimer = ctx ? ctx : &host->default_ctx;
+	if (task)
+		host->claimer->task = task;
+}
+
 /**
- *	__mmc_claim_host - exclusively claim a host
+ *	__mmc_ctx_claim_host - exclusively claim a host for a context
  *	@host: mmc host to claim
+ *	@ctx: context to claim the host for, or NULL for the current task
  *	@abort: whether or not the operation should be aborted
  *
  *	Claim a host for a set of operations.  If @abort is non null and
  *	dereference a non-zero value then this will return prematurely with
  *	that non-zero value without acquiring the lock.  Returns zero
- *	with the lock held otherwise.
+ *	with the lock held otherwise.  Claims made with the same @ctx nest
+ *	whatever task they come from.
  */
-int __mmc_claim_host(struct mmc_host *host, atomic_t *abort)
+int __mmc_ctx_claim_host(struct mmc_host *host, struct mmc_ctx *ctx,
+			 atomic_t *abort)
 {
+	struct task_struct *task = ctx ? NULL : current;
 	DECLARE_WAITQUEUE(wait, current);
 	unsigned long flags;
 	int stop;
@@ -2018,7 +2039,7 @@ int __mmc_claim_host(struct mmc_host *host, atomic_t *abort)
 	while (1) {
 		set_current_state(TASK_UNINTERRUPTIBLE);
 		stop = abort ? atomic_read(abort) : 0;
-		if (stop || !host->claimed || host->claimer == current)
+		if (stop || !host->claimed || mmc_ctx_matches(host, ctx, task))
 			break;
 		spin_unlock_irqrestore(&host->lock, flags);
 		schedule();
@@ -2027,7 +2048,7 @@ int __mmc_claim_host(struct mmc_host *host, atomic_t *abort)
 	set_current_state(TASK_RUNNING);
 	if (!stop) {
 		host->claimed = 1;
-		host->claimer = current;
+		mmc_ctx_set_claimer(host, ctx, task);
 		host->claim_cnt += 1;
 	} else
 		wake_up(&host->wq);
@@ -2037,6 +2058,19 @@ int __mmc_claim_host(struct mmc_host *host, atomic_t *abort)
 		host->ops->enable(host);
 	return stop;
 }
+EXPORT_SYMBOL(__mmc_ctx_claim_host);
+
+/**
+ *	__mmc_claim_host - exclusively claim a host
+ *	@host: mmc host to claim
+ *	@abort: whether or not the operation should be aborted
+ *
+ *	As __mmc_ctx_claim_host(), claiming for the current task.
+ */
+int __mmc_claim_host(struct mmc_host *host, atomic_t *abort)
+{
+	return __mmc_ctx_claim_host(host, NULL, abort);
+}
 
 EXPORT_SYMBOL(__mmc_claim_host);
 
@@ -2056,9 +2090,10 @@ int mmc_try_claim_host(struct mmc_host *host, unsigned int delay_ms)
 
 	do {
 		spin_lock_irqsave(&host->lock, flags);
-		if (!host->claimed || host->claimer == current) {
+		if (!host->claimed ||
+		    mmc_ctx_matches(host, NULL, current)) {
 			host->claimed = 1;
-			host->claimer = current;
+			mmc_ctx_set_claimer(host, NULL, current);
 			host->claim_cnt += 1;
 			claimed_host = 1;
 		}
@@ -2094,6 +2129,7 @@ void mmc_release_host(struct mmc_host *host)
 		spin_unlock_irqrestore(&host->lock, flags);
 	} else {
 		host->claimed = 0;
+		host->claimer->task = NULL;
 		host->claimer = NULL;
 		spin_unlock_irqrestore(&host->lock, flags);
 		wake_up(&host->wq);
@@ -2105,15 +2141,21 @@ EXPORT_SYMBOL(mmc_release_host);
  * This is a helper function, which fetches a runtime pm reference for the
  * card device and also claims the host.
  */
-void mmc_get_card(struct mmc_card *card)
+void mmc_ctx_get_card(struct mmc_card *card, struct mmc_ctx *ctx)
 {
 	pm_runtime_get_sync(&card->dev);
-	mmc_claim_host(card->host);
+	__mmc_ctx_claim_host(card->host, ctx, NULL);
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	if (mmc_bus_needs_resume(card->host))
 		mmc_resume_bus(card->host);
 #endif
 }
+EXPORT_SYMBOL(mmc_ctx_get_card);
+
+void mmc_get_card(struct mmc_card *card)
+{
+	mmc_ctx_get_card(card, NULL);
+}
 EXPORT_SYMBOL(mmc_get_card);
 
 
@@ -95,7 +95,8 @@ static void sdhci_dump_state(struct sdhci_host *host)
 
 	pr_info("%s: clk: %d clk-gated: %d claimer: %s pwr: %d host->irq = %d\n",
 		mmc_hostname(mmc), host->clock, mmc->clk_gated,
-		mmc->claimer->comm, host->pwr,
+		mmc->claimer && mmc->claimer->task ?
+		mmc->claimer->task->comm : "none", host->pwr,
 		(host->flags & SDHCI_HOST_IRQ_STATUS));
 	pr_info("%s: rpmstatus[pltfm](runtime-suspend:usage_count:disable_depth)(%d:%d:%d)\n",
 		mmc_hostname(mmc), mmc->parent->power.runtime_status,
@@ -83,6 +83,12 @@ struct power_table {
  * @dyn_power_table_entries: number of entries in the @dyn_power_table array
  * @cpu_dev: the first cpu_device from @allowed_cpus that has OPPs registered
  * @plat_get_static_power: callback to calculate the static power
+ * @res_freqs: frequencies of the policy, as reported by cpufreq_stats
+ * @res_time: time spent at each of @res_freqs, as of the latest call to
+ *	cpufreq_get_requested_power(), followed by room for the next reading
+ * @res_entries: number of entries in @res_freqs
+ * @res_count: number of entries in the previous reading held in @res_time,
+ *	0 if there is none
  *
  * This structure is required for keeping information of each registered
  * cpufreq_cooling_device.
@@ -103,6 +109,10 @@ struct cpufreq_cooling_device {
 	int dyn_power_table_entries;
 	struct device *cpu_dev;
 	get_static_t plat_get_static_power;
+	unsigned int *res_freqs;
+	u64 *res_time;
+	unsigned int res_entries;
+	unsigned int res_count;
 };
 static DEFINE_IDR(cpufreq_idr);
 static DEFINE_MUTEX(cooling_cpufreq_lock);
@@ -434,20 +444,78 @@ static int get_static_power(struct cpufreq_cooling_device *cpufreq_device,
 						     voltage, power);
 }
 
+/**
+ * get_residency_power() - average power at full load since the last call
+ * @cpufreq_device:	&cpufreq_cooling_device for this cdev
+ * @cpu:	an online cpu of @cpufreq_device
+ * @power:	pointer in which to store the power
+ *
+ * Weigh the power of each frequency by the time cpufreq_stats says the
+ * cpus spent at it since the previous call.  Unlike the power of the
+ * current frequency, this accounts for a governor that changed
+ * frequency during the period, as interactive or schedutil do on every
+ * burst of load.
+ *
+ * Return: true if @power was set, false if cpufreq_stats has no times
+ * for this period.
+ */
+static bool get_residency_power(struct cpufreq_cooling_device *cpufreq_device,
+				int cpu, u32 *power)
+{
+	unsigned int i, n = cpufreq_device->res_entries;
+	u64 *last = cpufreq_device->res_time, *now = last + n;
+	u64 delta, total = 0, energy = 0;
+	bool valid;
+
+	if (!n)
+		return false;
+
+	n = cpufreq_stats_get_time_in_state(cpu, cpufreq_device->res_freqs,
+					    now, n);
+
+	/*
+	 * The stats table is recreated, with its times reset, when the
+	 * policy goes away and comes back.  Any time going backwards or a
+	 * change in the number of frequencies means the previous reading
+	 * is stale; keep the new one and report nothing for this period.
+	 */
+	valid = n && n == cpufreq_device->res_count;
+	for (i = 0; valid && i < n; i++)
+		if (now[i] < last[i])
+			valid = false;
+
+	for (i = 0; valid && i < n; i++) {
+		delta = now[i] - last[i];
+		total += delta;
+		energy += delta * cpu_freq_to_power(cpufreq_device,
+						    cpufreq_device->res_freqs[i]);
+	}
+	memcpy(last, now, n * sizeof(*last));
+	cpufreq_device->res_count = n;
+
+	if (!valid || !total)
+		return false;
+
+	*power = div64_u64(energy, total);
+	return true;
+}
+
 /**
  * get_dynamic_power() - calculate the dynamic power
  * @cpufreq_device:	&cpufreq_cooling_device for this cdev
+ * @cpu:	an online cpu of @cpufreq_device
  * @freq:	current frequency
  *
  * Return: the dynamic power consumed by the cpus described by
  * @cpufreq_device.
  */
 static u32 get_dynamic_power(struct cpufreq_cooling_device *cpufreq_device,
-			     unsigned long freq)
+			     int cpu, unsigned long freq)
 {
 	u32 raw_cpu_power;
 
-	raw_cpu_power = cpu_freq_to_power(cpufreq_device, freq);
+	if (!get_residency_power(cpufreq_device, cpu, &raw_cpu_power))
+		raw_cpu_power = cpu_freq_to_power(cpufreq_device, freq);
 	return (raw_cpu_power * cpufreq_device->last_load) / 100;
 }
 
@@ -539,13 +607,10 @@ static int cpufreq_set_cur_state(struct thermal_cooling_device *cdev,
  * Instead, we calculate the current power on the assumption that the
  * immediate future will look like the immediate past.
  *
- * We use the current frequency and the average load since this
- * function was last called.  In reality, there could have been
- * multiple opps since this function was last called and that affects
- * the load calculation.  While it's not perfectly accurate, this
- * simplification is good enough and works.  REVISIT this, as more
- * complex code may be needed if experiments show that it's not
- * accurate enough.
+ * We use the average load since this function was last called and the
+ * power of the frequencies used in that time, weighted by their
+ * residency in cpufreq_stats.  Without cpufreq_stats, the current
+ * frequency stands for all of them.
  *
  * Return: 0 on success, -E* if getting the static power failed.
  */
@@ -554,7 +619,7 @@ static int cpufreq_get_requested_power(struct thermal_cooling_device *cdev,
 				       u32 *power)
 {
 	unsigned long freq;
-	int i = 0, cpu, ret;
+	int i = 0, cpu, any_cpu, ret;
 	u32 static_power, dynamic_power, total_load = 0;
 	struct cpufreq_cooling_device *cpufreq_device = cdev->devdata;
 	u32 *load_cpu = NULL;
@@ -571,6 +636,7 @@ static int cpufreq_get_requested_power(struct thermal_cooling_device *cdev,
 	}
 
 	freq = cpufreq_quick_get(cpu);
+	any_cpu = cpu;
 
 	if (trace_thermal_power_cpu_get_power_enabled()) {
 		u32 ncpus = cpumask_weight(&cpufreq_device->allowed_cpus);
@@ -596,7 +662,7 @@ static int cpufreq_get_requested_power(struct thermal_cooling_device *cdev,
 
 	cpufreq_device->last_load = total_load;
 
-	dynamic_power = get_dynamic_power(cpufreq_device, freq);
+	dynamic_power = get_dynamic_power(cpufreq_device, any_cpu, freq);
 	ret = get_static_power(cpufreq_device, tz, freq, &static_power);
 	if (ret) {
 		if (load_cpu)
@@ -833,6 +899,16 @@ __cpufreq_cooling_register(struct device_node *np,
 			cool_dev = ERR_PTR(ret);
 			goto free_table;
 		}
+
+		/* Best effort: without these the current frequency is used */
+		cpufreq_dev->res_freqs = kcalloc(cpufreq_dev->max_level + 1,
+					sizeof(*cpufreq_dev->res_freqs),
+					GFP_KERNEL);
+		cpufreq_dev->res_time = kcalloc(2 * (cpufreq_dev->max_level + 1),
+					sizeof(*cpufreq_dev->res_time),
+					GFP_KERNEL);
+		if (cpufreq_dev->res_freqs && cpufreq_dev->res_time)
+			cpufreq_dev->res_entries = cpufreq_dev->max_level + 1;
 	}
 
 	ret = get_idr(&cpufreq_idr, &cpufreq_dev->id);
@@ -879,6 +955,8 @@ __cpufreq_cooling_register(struct device_node *np,
 remove_idr:
 	release_idr(&cpufreq_idr, cpufreq_dev->id);
 free_table:
+	kfree(cpufreq_dev->res_time);
+	kfree(cpufreq_dev->res_freqs);
 	kfree(cpufreq_dev->freq_table);
 free_time_in_idle_timestamp:
 	kfree(cpufreq_dev->time_in_idle_timestamp);
@@ -1026,6 +1104,8 @@ void cpufreq_cooling_unregister(struct thermal_cooling_device *cdev)
 	release_idr(&cpufreq_idr, cpufreq_dev->id);
 	kfree(cpufreq_dev->time_in_idle_timestamp);
 	kfree(cpufreq_dev->time_in_idle);
+	kfree(cpufreq_dev->res_time);
+	kfree(cpufreq_dev->res_freqs);
 	kfree(cpufreq_dev->freq_table);
 	kfree(cpufreq_dev);
 }
@@ -54,6 +54,50 @@ static inline s64 div_frac(s64 x, s64 y)
 	return div_s64(x << FRAC_BITS, y);
 }
 
+/*
+ * The thermal model is first order: over one passive polling period,
+ *
+ *   T[k+1] - T[k] = gain * (P[k] - sustainable_power)
+ *                   - decay * (T[k] - control_temp)
+ *
+ * where P[k] is the power the actors consumed during the period.  It
+ * follows from heat flowing out through a thermal resistance R with a
+ * time constant tau: decay is the period over tau and gain is decay * R.
+ * Writing the ambient temperature in terms of the sustainable power,
+ * which holds the zone at control_temp, leaves those two parameters.
+ * They are estimated online with a normalised least mean squares filter,
+ * which needs no matrix maths and cannot overflow.
+ *
+ * MODEL_FRAC_BITS is larger than FRAC_BITS as decay is typically a
+ * hundredth or less.
+ */
+#define MODEL_FRAC_BITS		16
+#define MODEL_ONE		(1LL << MODEL_FRAC_BITS)
+/* NLMS step size, as a shift */
+#define MODEL_STEP_SHIFT	2
+/* Samples to learn from before the model is trusted */
+#define MODEL_WARMUP		8
+/* Longest horizon, in polling periods */
+#define MAX_HORIZON		64
+
+/**
+ * struct thermal_model - online estimate of the zone's thermal behaviour
+ * @gain:	temperature rise per period per mW above sustainable power,
+ *		in millicelsius, MODEL_FRAC_BITS fixed point
+ * @decay:	share of the distance to control_temp recovered per
+ *		period, MODEL_FRAC_BITS fixed point
+ * @samples:	number of periods learnt from
+ * @prev_temp:	temperature at the start of the current period
+ * @prev_valid:	@prev_temp belongs to the previous polling period
+ */
+struct thermal_model {
+	s64 gain;
+	s64 decay;
+	unsigned int samples;
+	long prev_temp;
+	bool prev_valid;
+};
+
 /**
  * struct power_allocator_params - parameters for the power allocator governor
  * @err_integral:	accumulated error in the PID controller.
@@ -64,14 +108,117 @@ static inline s64 div_frac(s64 x, s64 y)
  * @trip_max_desired_temperature:	last passive trip point of the thermal
  *					zone.  The temperature we are
  *					controlling for.
+ * @model:	thermal model used by the predictive controller
  */
 struct power_allocator_params {
 	s64 err_integral;
 	s32 prev_err;
 	int trip_switch_on;
 	int trip_max_desired_temperature;
+	struct thermal_model model;
 };
 
+/**
+ * reset_thermal_model() - start the model from what the trips imply
+ * @tz:		thermal zone we are operating in
+ * @model:	the model to reset
+ * @temp_range:	control temperature minus switch on temperature
+ *
+ * Assume a time constant of 16 periods and that the zone would reach
+ * the switch on temperature when idle, so that @temp_range takes the
+ * sustainable power.
+ */
+static void reset_thermal_model(struct thermal_zone_device *tz,
+				struct thermal_model *model, u32 temp_range)
+{
+	model->decay = MODEL_ONE / 16;
+	model->gain = div_s64(model->decay * temp_range,
+			      tz->tzp->sustainable_power);
+	model->gain = max_t(s64, model->gain, 1);
+	model->samples = 0;
+	model->prev_valid = false;
+}
+
+/**
+ * update_thermal_model() - learn from the period that just ended
+ * @tz:		thermal zone we are operating in
+ * @model:	the model to update
+ * @current_temp:	the temperature at the end of the period
+ * @control_temp:	the target temperature
+ * @power:	power consumed by the actors during the period, in mW
+ */
+static void update_thermal_model(struct thermal_zone_device *tz,
+				 struct thermal_model *model,
+				 unsigned long current_temp,
+				 unsigned long control_temp, u32 power)
+{
+	s64 x1, x2, y, err, norm;
+
+	if (!model->prev_valid)
+		goto out;
+
+	/* Regressors and observed change, bounded to keep products small */
+	x1 = clamp_t(s64, (s64)power - tz->tzp->sustainable_power,
+		     -S16_MAX, S16_MAX);
+	x2 = clamp_t(s64, (s64)control_temp - model->prev_temp,
+		     -S16_MAX, S16_MAX);
+	y = clamp_t(s64, (s64)current_temp - model->prev_temp,
+		    -S16_MAX, S16_MAX);
+
+	err = (y << MODEL_FRAC_BITS) - model->gain * x1 - model->decay * x2;
+	norm = x1 * x1 + x2 * x2 + 1;
+
+	model->gain += div64_s64((err >> MODEL_STEP_SHIFT) * x1, norm);
+	model->decay += div64_s64((err >> MODEL_STEP_SHIFT) * x2, norm);
+
+	/* Heat must raise the temperature and the zone must cool down */
+	model->gain = clamp_t(s64, model->gain, 1, MODEL_ONE << 8);
+	model->decay = clamp_t(s64, model->decay, MODEL_ONE >> 12,
+			       MODEL_ONE >> 1);
+
+	if (model->samples < MODEL_WARMUP)
+		model->samples++;
+out:
+	model->prev_temp = current_temp;
+	model->prev_valid = true;
+}
+
+/**
+ * predict_power() - power that brings the zone to @control_temp
+ * @tz:		thermal zone we are operating in
+ * @model:	the thermal model
+ * @current_temp:	the current temperature in millicelsius
+ * @control_temp:	the target temperature in millicelsius
+ * @horizon:	number of periods to look ahead
+ *
+ * With the power held at P for @horizon periods, the model gives
+ *
+ *   e[H] = a * e[0] + gain * (P - sustainable_power) * (1 - a) / decay
+ *
+ * for e = T - control_temp and a = (1 - decay)^H.  Solving e[H] = 0
+ * gives the power returned, relative to sustainable_power.  A short
+ * horizon reacts harder; a long one converges more smoothly.
+ *
+ * Return: the power offset from sustainable_power, in mW.
+ */
+static s64 predict_power(struct thermal_zone_device *tz,
+			 struct thermal_model *model,
+			 unsigned long current_temp,
+			 unsigned long control_temp, int horizon)
+{
+	s64 a = MODEL_ONE, err, num, den;
+	int i;
+
+	for (i = 0; i < horizon; i++)
+		a = (a * (MODEL_ONE - model->decay)) >> MODEL_FRAC_BITS;
+
+	err = (s64)current_temp - (s64)control_temp;
+	num = -err * ((a * model->decay) >> MODEL_FRAC_BITS);
+	den = (model->gain * (MODEL_ONE - a)) >> MODEL_FRAC_BITS;
+
+	return div64_s64(num, max_t(s64, den, 1));
+}
+
 /**
  * pid_controller() - PID controller
  * @tz:	thermal zone we are operating in
@@ -89,6 +236,12 @@ struct power_allocator_params {
  * the system warmer.  If the system is mostly idle, there's no point
  * in accumulating positive error.
  *
+ * Once the thermal model has been learnt and the zone has a
+ * prediction_horizon, the proportional term is replaced by the power
+ * the model predicts will settle the temperature at @control_temp by
+ * the end of the horizon.  The integral term then only has to correct
+ * the model's bias.
+ *
  * Return: The power budget for the next period.
  */
 static u32 pid_controller(struct thermal_zone_device *tz,
@@ -106,7 +259,19 @@ static u32 pid_controller(struct thermal_zone_device *tz,
 	err = int_to_frac(err);
 
 	/* Calculate the proportional term */
-	p = mul_frac(err < 0 ? tz->tzp->k_po : tz->tzp->k_pu, err);
+	if (tz->tzp->prediction_horizon > 0 &&
+	    params->model.samples >= MODEL_WARMUP) {
+		int horizon = min(tz->tzp->prediction_horizon, MAX_HORIZON);
+
+		p = int_to_frac(predict_power(tz, &params->model,
+					      current_temp, control_temp,
+					      horizon));
+		trace_thermal_power_allocator_model(tz,
+				params->model.gain, params->model.decay,
+				horizon, frac_to_int(p));
+	} else {
+		p = mul_frac(err < 0 ? tz->tzp->k_po : tz->tzp->k_pu, err);
+	}
 
 	/*
 	 * Calculate the integral term
@@ -304,6 +469,9 @@ static int allocate_power(struct thermal_zone_device *tz,
 		i++;
 	}
 
+	update_thermal_model(tz, &params->model, current_temp, control_temp,
+			     total_req_power);
+
 	power_range = pid_controller(tz, current_temp, control_temp,
 				     max_allocatable_power);
 
@@ -461,6 +629,7 @@ static int power_allocator_bind(struct thermal_zone_device *tz)
 	 */
 
 	reset_pid_controller(params);
+	reset_thermal_model(tz, &params->model, temperature_threshold);
 
 	tz->governor_data = params;
 
@@ -508,6 +677,8 @@ static int power_allocator_throttle(struct thermal_zone_device *tz, int trip)
 	if (current_temp < switch_on_temp) {
 		tz->passive = 0;
 		reset_pid_controller(params);
+		/* No samples while off: the next period is not contiguous */
+		params->model.prev_valid = false;
 		allow_maximum_power(tz);
 		return 0;
 	}
@@ -648,6 +648,7 @@ static int dummy_queue(struct usb_ep *_ep, struct usb_request *_req,
 	if (ep->desc && (ep->desc->bEndpointAddress & USB_DIR_IN) &&
 			list_empty(&dum->fifo_req.queue) &&
 			list_empty(&ep->queue) &&
+			!_req->num_sgs &&
 			_req->length <= FIFO_SIZE) {
 		req = &dum->fifo_req;
 		req->req = *_req;
@@ -672,6 +673,50 @@ static int dummy_queue(struct usb_ep *_ep, struct usb_request *_req,
 	return 0;
 }
 
+/*
+ * Queue a chain under one lock.  The emulated FIFO is left to single
+ * requests: a chain is for keeping the queue deep, and the host side
+ * picks it up on its next frame.
+ */
+static int dummy_queue_list(struct usb_ep *_ep, struct list_head *reqs,
+		gfp_t mem_flags)
+{
+	struct dummy_ep		*ep;
+	struct usb_request	*_req;
+	struct dummy_request	*req;
+	struct dummy		*dum;
+	struct dummy_hcd	*dum_hcd;
+	unsigned long		flags;
+	int			retval = 0;
+
+	ep = usb_ep_to_dummy_ep(_ep);
+	if (!_ep || (!ep->desc && _ep->name != ep0name))
+		return -EINVAL;
+
+	dum = ep_to_dummy(ep);
+	dum_hcd = gadget_to_dummy_hcd(&dum->gadget);
+	if (!dum->driver || !is_enabled(dum_hcd))
+		return -ESHUTDOWN;
+
+	spin_lock_irqsave(&dum->lock, flags);
+	while (!list_empty(reqs)) {
+		_req = list_first_entry(reqs, struct usb_request, list);
+		req = usb_request_to_dummy_request(_req);
+		if (!list_empty(&req->queue) || !_req->complete) {
+			retval = -EINVAL;
+			break;
+		}
+
+		list_del_init(&_req->list);
+		_req->status = -EINPROGRESS;
+		_req->actual = 0;
+		list_add_tail(&req->queue, &ep->queue);
+	}
+	spin_unlock_irqrestore(&dum->lock, flags);
+
+	return retval;
+}
+
 static int dummy_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 {
 	struct dummy_ep		*ep;
@@ -757,6 +802,7 @@ static const struct usb_ep_ops dummy_ep_ops = {
 	.free_request	= dummy_free_request,
 
 	.queue		= dummy_queue,
+	.queue_list	= dummy_queue_list,
 	.dequeue	= dummy_dequeue,
 
 	.set_halt	= dummy_set_halt,
@@ -978,6 +1024,7 @@ static int dummy_udc_probe(struct platform_device *pdev)
 	memzero_explicit(&dum->gadget, sizeof(struct usb_gadget));
 	dum->gadget.name = gadget_name;
 	dum->gadget.ops = &dummy_ops;
+	dum->gadget.sg_supported = 1;
 	if (mod_data.is_super_speed)
 		dum->gadget.max_speed = USB_SPEED_SUPER;
 	else if (mod_data.is_high_speed)
@@ -1227,10 +1274,35 @@ static int dummy_urb_dequeue(struct usb_hcd *hcd, struct urb *urb, int status)
 	return rc;
 }
 
+/* copy between the urb and the request's buf or scatterlist */
+static void dummy_copy_req(struct dummy_request *req, u32 off, void *ubuf,
+		u32 len, int to_host)
+{
+	struct usb_request *_req = &req->req;
+	void *rbuf;
+
+	off += _req->actual;
+	if (_req->num_sgs) {
+		if (to_host)
+			sg_pcopy_to_buffer(_req->sg, _req->num_sgs, ubuf, len,
+					off);
+		else
+			sg_pcopy_from_buffer(_req->sg, _req->num_sgs, ubuf,
+					len, off);
+		return;
+	}
+
+	rbuf = _req->buf + off;
+	if (to_host)
+		memcpy(ubuf, rbuf, len);
+	else
+		memcpy(rbuf, ubuf, len);
+}
+
 static int dummy_perform_transfer(struct urb *urb, struct dummy_request *req,
 		u32 len)
 {
-	void *ubuf, *rbuf;
+	void *ubuf;
 	struct urbp *urbp = urb->hcpriv;
 	int to_host;
 	struct sg_mapping_iter *miter = &urbp->miter;
@@ -1239,14 +1311,10 @@ static int dummy_perform_transfer(struct urb *urb, struct dummy_request *req,
 	bool next_sg;
 
 	to_host = usb_pipein(urb->pipe);
-	rbuf = req->req.buf + req->req.actual;
 
 	if (!urb->num_sgs) {
 		ubuf = urb->transfer_buffer + urb->actual_length;
-		if (to_host)
-			memcpy(ubuf, rbuf, len);
-		else
-			memcpy(rbuf, ubuf, len);
+		dummy_copy_req(req, 0, ubuf, len, to_host);
 		return len;
 	}
 
@@ -1270,12 +1338,8 @@ static int dummy_perform_transfer(struct urb *urb, struct dummy_request *req,
 		ubuf = miter->addr;
 		this_sg = min_t(u32, len, miter->length);
 		miter->consumed = this_sg;
+		dummy_copy_req(req, trans, ubuf, this_sg, to_host);
 		trans += this_sg;
-
-		if (to_host)
-			memcpy(ubuf, rbuf, this_sg);
-		else
-			memcpy(rbuf, ubuf, this_sg);
 		len -= this_sg;
 
 		if (!len)
@@ -1285,8 +1349,6 @@ static int dummy_perform_transfer(struct urb *urb, struct dummy_request *req,
 			WARN_ON_ONCE(1);
 			return -EINVAL;
 		}
-
-		rbuf += this_sg;
 	} while (1);
 
 	sg_miter_stop(miter);
@@ -1299,6 +1361,7 @@ static int transfer(struct dummy_hcd *dum_hcd, struct urb *urb,
 {
 	struct dummy		*dum = dum_hcd->dum;
 	struct dummy_request	*req;
+	LIST_HEAD(done);
 
 top:
 	/* if there's no request queued, the device is NAKing; return */
@@ -1395,9 +1458,15 @@ top:
 		if (req->req.status != -EINPROGRESS) {
 			list_del_init(&req->queue);
 
-			spin_unlock(&dum->lock);
-			usb_gadget_giveback_request(&ep->ep, &req->req);
-			spin_lock(&dum->lock);
+			/* drivers taking chains get them after the scan */
+			if (ep->ep.complete_list) {
+				list_add_tail(&req->req.list, &done);
+			} else {
+				spin_unlock(&dum->lock);
+				usb_gadget_giveback_request(&ep->ep,
+						&req->req);
+				spin_lock(&dum->lock);
+			}
 
 			/* requests might have been unlinked... */
 			rescan = 1;
@@ -1411,6 +1480,16 @@ top:
 		if (rescan)
 			goto top;
 	}
+
+	if (!list_empty(&done)) {
+		spin_unlock(&dum->lock);
+		usb_gadget_giveback_list(&ep->ep, &done);
+		spin_lock(&dum->lock);
+
+		/* the driver may have queued more for this urb */
+		if (*status == -EINPROGRESS && limit > 0)
+			goto top;
+	}
 	return limit;
 }
 
@@ -131,6 +131,86 @@ void usb_gadget_giveback_request(struct usb_ep *ep,
 }
 EXPORT_SYMBOL_GPL(usb_gadget_giveback_request);
 
+/**
+ * usb_gadget_giveback_list - give a chain of requests back to the gadget layer
+ * @ep: the endpoint the requests completed on
+ * @reqs: the completed requests, linked through their list fields
+ * Context: in_interrupt()
+ *
+ * This is called by device controller drivers that complete several
+ * requests at once.  If the gadget driver set the endpoint's complete_list()
+ * the whole chain is handed to it in one call, otherwise each request is
+ * given back in order as by usb_gadget_giveback_request().  @reqs is empty
+ * on return.
+ */
+void usb_gadget_giveback_list(struct usb_ep *ep, struct list_head *reqs)
+{
+	struct usb_request	*req;
+
+	list_for_each_entry(req, reqs, list) {
+		if (likely(req->status == 0)) {
+			usb_led_activity(USB_LED_EVENT_GADGET);
+			break;
+		}
+	}
+
+	if (ep->complete_list) {
+		ep->complete_list(ep, reqs);
+		WARN_ON(!list_empty(reqs));
+		return;
+	}
+
+	while (!list_empty(reqs)) {
+		req = list_first_entry(reqs, struct usb_request, list);
+		list_del_init(&req->list);
+		req->complete(ep, req);
+	}
+}
+EXPORT_SYMBOL_GPL(usb_gadget_giveback_list);
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * usb_ep_queue_list - queues a chain of requests to an endpoint
+ * @ep: the endpoint the requests are queued to
+ * @reqs: the requests, linked through their list fields
+ * @gfp_flags: GFP_* flags to use if the lower level must allocate memory
+ *
+ * Queues each request on @reqs in order, with the same rules as
+ * usb_ep_queue().  Controllers that implement queue_list() take the chain
+ * in one call, typically under one lock and with one hardware kick; the
+ * others get one queue() call per request.
+ *
+ * Requests are taken off @reqs as they are queued.  On error the request
+ * that failed and those after it are left on @reqs, not queued; the ones
+ * before it were queued and complete as usual.
+ *
+ * Returns zero, or the negative error code of the request that could not
+ * be queued.
+ */
+int usb_ep_queue_list(struct usb_ep *ep, struct list_head *reqs,
+		gfp_t gfp_flags)
+{
+	struct usb_request	*req;
+	int			ret;
+
+	if (ep->ops->queue_list)
+		return ep->ops->queue_list(ep, reqs, gfp_flags);
+
+	while (!list_empty(reqs)) {
+		req = list_first_entry(reqs, struct usb_request, list);
+		/* it may complete, and be reused, before queue() returns */
+		list_del_init(&req->list);
+		ret = usb_ep_queue(ep, req, gfp_flags);
+		if (ret) {
+			list_add(&req->list, reqs);
+			return ret;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(usb_ep_queue_list);
+
 /* ------------------------------------------------------------------------- */
 
 static void usb_gadget_state_work(struct work_struct *work)
@@ -32,6 +32,8 @@
 #include <linux/parser.h>
 #include <linux/idr.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/dcache.h>
 #include <net/9p/9p.h>
 #include <net/9p/client.h>
 #include <net/9p/transport.h>
@@ -61,6 +63,8 @@ enum {
 	Opt_access, Opt_posixacl,
 	/* Lock timeout option */
 	Opt_locktimeout,
+	/* Metadata cache timeouts */
+	Opt_actimeo, Opt_negtimeo,
 	/* Error token */
 	Opt_err
 };
@@ -81,6 +85,8 @@ static const match_table_t tokens = {
 	{Opt_access, "access=%s"},
 	{Opt_posixacl, "posixacl"},
 	{Opt_locktimeout, "locktimeout=%u"},
+	{Opt_actimeo, "actimeo=%u"},
+	{Opt_negtimeo, "negtimeo=%u"},
 	{Opt_err, NULL}
 };
 
@@ -319,6 +325,27 @@ static int v9fs_parse_options(struct v9fs_session_info *v9ses, char *opts)
 			v9ses->session_lock_timeout = (long)option * HZ;
 			break;
 
+		case Opt_actimeo:
+		case Opt_negtimeo:
+			r = match_int(&args[0], &option);
+			if (r < 0) {
+				p9_debug(P9_DEBUG_ERROR,
+					 "integer field, but no integer?\n");
+				ret = r;
+				continue;
+			}
+			if (option < 0) {
+				p9_debug(P9_DEBUG_ERROR,
+					 "cache timeouts must not be negative.\n");
+				ret = -EINVAL;
+				continue;
+			}
+			if (token == Opt_actimeo)
+				v9ses->attr_timeout = (unsigned long)option * HZ;
+			else
+				v9ses->neg_timeout = (unsigned long)option * HZ;
+			break;
+
 		default:
 			continue;
 		}
@@ -503,6 +530,158 @@ void v9fs_session_begin_cancel(struct v9fs_session_info *v9ses)
 	p9_client_begin_disconnect(v9ses->clnt);
 }
 
+static int v9fs_test_qid_path(struct inode *inode, void *data)
+{
+	return V9FS_I(inode)->qid.path == ((struct p9_qid *)data)->path;
+}
+
+/*
+ * Forget what is cached about an object that changed on the server:
+ * its attributes, the unused dentries below it if it is a directory
+ * and its page cache if it is a file.
+ */
+static void v9fs_inval_qid(struct v9fs_session_info *v9ses,
+			   struct super_block *sb, struct p9_qid *qid)
+{
+	struct inode *inode, *root = sb->s_root->d_inode;
+	struct dentry *dentry;
+
+	inode = ilookup5(sb, v9fs_qid2ino(qid), v9fs_test_qid_path, qid);
+	if (!inode && V9FS_I(root)->qid.path == qid->path)
+		inode = igrab(root);
+	if (!inode)
+		return;
+
+	p9_debug(P9_DEBUG_VFS, "invalidate inode %lu\n", inode->i_ino);
+	v9fs_invalidate_inode_attr(inode);
+	if (S_ISDIR(inode->i_mode)) {
+		dentry = d_find_alias(inode);
+		if (dentry) {
+			shrink_dcache_parent(dentry);
+			dput(dentry);
+		}
+	} else if (S_ISREG(inode->i_mode) && v9fs_cache_loose(v9ses)) {
+		invalidate_mapping_pages(inode->i_mapping, 0, -1);
+	}
+	iput(inode);
+}
+
+struct v9fs_inval_args {
+	struct v9fs_session_info *v9ses;
+	struct super_block *sb;
+	struct p9_fid *fid;
+};
+
+/*
+ * Keep one Tinvalidate outstanding for the life of the mount.  The first
+ * error, including the one from a server that does not know the message,
+ * ends the loop: cached metadata then simply ages out by the timeouts.
+ */
+static int v9fs_inval_thread(void *data)
+{
+	struct v9fs_inval_args *args = data;
+	struct v9fs_session_info *v9ses = args->v9ses;
+	struct super_block *sb = args->sb;
+	struct p9_fid *fid = args->fid;
+	struct p9_qid *qids;
+	int16_t nqids;
+	int err, i;
+
+	kfree(args);
+	/* v9fs_inval_stop() interrupts the pending request with SIGKILL */
+	allow_signal(SIGKILL);
+
+	while (!ACCESS_ONCE(v9ses->inval_stop)) {
+		err = p9_client_invalidate(fid, &nqids, &qids);
+		if (err) {
+			p9_debug(P9_DEBUG_VFS, "Tinvalidate returned %d\n",
+				 err);
+			break;
+		}
+		for (i = 0; i < nqids; i++)
+			v9fs_inval_qid(v9ses, sb, &qids[i]);
+		kfree(qids);
+	}
+	p9_client_clunk(fid);
+	complete(&v9ses->inval_done);
+
+	while (!kthread_should_stop()) {
+		flush_signals(current);
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+/**
+ * v9fs_inval_start - listen for invalidations pushed by the server
+ * @v9ses: session information structure
+ * @sb: superblock of the session
+ * @fid: root fid of the session
+ *
+ * Only worth it when metadata is cached, and only 9P2000.L servers may
+ * implement the extension.  Failing to start is not an error.
+ */
+
+void v9fs_inval_start(struct v9fs_session_info *v9ses,
+		      struct super_block *sb, struct p9_fid *fid)
+{
+	struct v9fs_inval_args *args;
+	struct task_struct *task;
+
+	if (!v9fs_proto_dotl(v9ses) || !v9fs_cache_dentries(v9ses))
+		return;
+
+	args = kmalloc(sizeof(*args), GFP_KERNEL);
+	if (!args)
+		return;
+	args->v9ses = v9ses;
+	args->sb = sb;
+	args->fid = p9_client_walk(fid, 0, NULL, 1);
+	if (IS_ERR(args->fid)) {
+		kfree(args);
+		return;
+	}
+
+	init_completion(&v9ses->inval_done);
+	v9ses->inval_stop = 0;
+	task = kthread_run(v9fs_inval_thread, args, "v9fs-inval");
+	if (IS_ERR(task)) {
+		p9_client_clunk(args->fid);
+		kfree(args);
+		return;
+	}
+	v9ses->inval_task = task;
+}
+
+/**
+ * v9fs_inval_stop - stop listening for invalidations
+ * @v9ses: session information structure
+ *
+ * Must be called before the superblock goes away.
+ */
+
+void v9fs_inval_stop(struct v9fs_session_info *v9ses)
+{
+	struct task_struct *task = v9ses->inval_task;
+
+	if (!task)
+		return;
+
+	v9ses->inval_stop = 1;
+	/*
+	 * A signal that arrives just before the request is sent is held
+	 * back by p9_client_rpc(), so keep sending until the thread is out.
+	 */
+	do {
+		send_sig(SIGKILL, task, 1);
+	} while (!wait_for_completion_timeout(&v9ses->inval_done, HZ / 10));
+	kthread_stop(task);
+	v9ses->inval_task = NULL;
+}
+
 extern int v9fs_error_init(void);
 
 static struct kobject *v9fs_kobj;
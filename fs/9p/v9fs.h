@@ -24,6 +24,7 @@
 #define FS_9P_V9FS_H
 
 #include <linux/backing-dev.h>
+#include <linux/completion.h>
 
 /**
  * enum p9_session_flags - option flags for each 9P session
@@ -87,6 +88,11 @@ enum p9_cache_modes {
  * @uid: if %V9FS_ACCESS_SINGLE, the numeric uid which mounted the hierarchy
  * @clnt: reference to 9P network client instantiated for this session
  * @slist: reference to list of registered 9p sessions
+ * @attr_timeout: how long inode attributes are trusted, in jiffies
+ * @neg_timeout: how long negative dentries are trusted, in jiffies
+ * @inval_task: thread waiting for invalidations pushed by the server
+ * @inval_stop: set when @inval_task is to stop
+ * @inval_done: completed when @inval_task no longer talks to the server
  *
  * This structure holds state for each session instance established during
  * a sys_mount() .
@@ -118,6 +124,11 @@ struct v9fs_session_info {
 	struct backing_dev_info bdi;
 	struct rw_semaphore rename_sem;
 	long session_lock_timeout; /* retry interval for blocking locks */
+	unsigned long attr_timeout;
+	unsigned long neg_timeout;
+	struct task_struct *inval_task;
+	int inval_stop;
+	struct completion inval_done;
 };
 
 /* cache_validity flags */
@@ -130,6 +141,7 @@ struct v9fs_inode {
 #endif
 	struct p9_qid qid;
 	unsigned int cache_validity;
+	unsigned long attr_time;	/* jiffies when attributes were fetched */
 	struct p9_fid *writeback_fid;
 	struct mutex v_mutex;
 	struct inode vfs_inode;
@@ -145,6 +157,9 @@ struct p9_fid *v9fs_session_init(struct v9fs_session_info *, const char *,
 extern void v9fs_session_close(struct v9fs_session_info *v9ses);
 extern void v9fs_session_cancel(struct v9fs_session_info *v9ses);
 extern void v9fs_session_begin_cancel(struct v9fs_session_info *v9ses);
+extern void v9fs_inval_start(struct v9fs_session_info *v9ses,
+			     struct super_block *sb, struct p9_fid *fid);
+extern void v9fs_inval_stop(struct v9fs_session_info *v9ses);
 extern struct dentry *v9fs_vfs_lookup(struct inode *dir, struct dentry *dentry,
 			unsigned int flags);
 extern int v9fs_vfs_unlink(struct inode *i, struct dentry *d);
@@ -190,6 +205,42 @@ static inline int v9fs_proto_dotl(struct v9fs_session_info *v9ses)
 	return v9ses->flags & V9FS_PROTO_2000L;
 }
 
+static inline int v9fs_cache_loose(struct v9fs_session_info *v9ses)
+{
+	return v9ses->cache == CACHE_LOOSE || v9ses->cache == CACHE_FSCACHE;
+}
+
+/*
+ * Whether dentries are kept and revalidated rather than dropped as soon
+ * as they are unused: always with a loose cache, otherwise if attributes
+ * or negative lookups may be cached for a while.
+ */
+static inline int v9fs_cache_dentries(struct v9fs_session_info *v9ses)
+{
+	return v9fs_cache_loose(v9ses) || v9ses->attr_timeout ||
+	       v9ses->neg_timeout;
+}
+
+/**
+ * v9fs_attr_cached - whether the cached attributes of an inode can be used
+ * @inode: inode in question
+ *
+ * Without actimeo a loose cache trusts attributes until they are
+ * invalidated and no cache never does.  With actimeo they are trusted
+ * for that long after being fetched.
+ */
+static inline bool v9fs_attr_cached(struct inode *inode)
+{
+	struct v9fs_session_info *v9ses = v9fs_inode2v9ses(inode);
+	struct v9fs_inode *v9inode = V9FS_I(inode);
+
+	if (v9inode->cache_validity & V9FS_INO_INVALID_ATTR)
+		return false;
+	if (!v9ses->attr_timeout)
+		return v9fs_cache_loose(v9ses);
+	return time_before(jiffies, v9inode->attr_time + v9ses->attr_timeout);
+}
+
 /**
  * v9fs_get_inode_from_fid - Helper routine to populate an inode by
  * issuing a attribute request
@@ -52,6 +52,12 @@ extern const struct file_operations v9fs_cached_file_operations;
 extern const struct file_operations v9fs_cached_file_operations_dotl;
 extern const struct file_operations v9fs_mmap_file_operations;
 extern const struct file_operations v9fs_mmap_file_operations_dotl;
+/*
+ * Number of message sized chunks of one read or write that are kept in
+ * flight at once.
+ */
+#define V9FS_PAR_CHUNKS	8
+
 extern struct kmem_cache *v9fs_inode_cache;
 
 struct inode *v9fs_alloc_inode(struct super_block *sb);
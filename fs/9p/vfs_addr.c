@@ -34,6 +34,9 @@
 #include <linux/idr.h>
 #include <linux/sched.h>
 #include <linux/aio.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
 #include <net/9p/9p.h>
 #include <net/9p/client.h>
 
@@ -101,6 +104,55 @@ static int v9fs_vfs_readpage(struct file *filp, struct page *page)
 	return v9fs_fid_readpage(filp->private_data, page);
 }
 
+/**
+ * v9fs_fid_readpage_run - read pages with consecutive indices in from 9P
+ *
+ * @fid: fid being read
+ * @pages: locked pages already in the page cache
+ * @nr: number of pages
+ *
+ * The pages are read with a single v9fs_fid_readn() so that large runs
+ * are transferred in parallel chunks.  On failure the pages are left
+ * !Uptodate for ->readpage to retry.
+ */
+static void v9fs_fid_readpage_run(struct p9_fid *fid, struct page **pages,
+				  unsigned nr)
+{
+	struct inode *inode = pages[0]->mapping->host;
+	size_t len = (size_t)nr << PAGE_CACHE_SHIFT;
+	ssize_t retval;
+	char *buffer;
+	unsigned i;
+
+	buffer = nr > 1 ? vmap(pages, nr, VM_MAP, PAGE_KERNEL) : NULL;
+	if (!buffer) {
+		for (i = 0; i < nr; i++) {
+			v9fs_fid_readpage(fid, pages[i]);
+			page_cache_release(pages[i]);
+		}
+		return;
+	}
+
+	retval = v9fs_fid_readn(fid, buffer, NULL, len, page_offset(pages[0]));
+	if (retval >= 0) {
+		memset(buffer + retval, 0, len - retval);
+		flush_kernel_vmap_range(buffer, len);
+	}
+	vunmap(buffer);
+
+	for (i = 0; i < nr; i++) {
+		if (retval >= 0) {
+			flush_dcache_page(pages[i]);
+			SetPageUptodate(pages[i]);
+			v9fs_readpage_to_fscache(inode, pages[i]);
+		} else {
+			v9fs_uncache_page(inode, pages[i]);
+		}
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+}
+
 /**
  * v9fs_vfs_readpages - read a set of pages from 9P
  *
@@ -116,6 +168,8 @@ static int v9fs_vfs_readpages(struct file *filp, struct address_space *mapping,
 {
 	int ret = 0;
 	struct inode *inode;
+	struct page **run, *page;
+	unsigned nr = 0;
 
 	inode = mapping->host;
 	p9_debug(P9_DEBUG_VFS, "inode: %p file: %p\n", inode, filp);
@@ -124,10 +178,33 @@ static int v9fs_vfs_readpages(struct file *filp, struct address_space *mapping,
 	if (ret == 0)
 		return ret;
 
-	ret = read_cache_pages(mapping, pages, v9fs_fid_readpage,
-			filp->private_data);
-	p9_debug(P9_DEBUG_VFS, "  = %d\n", ret);
-	return ret;
+	run = kmalloc(nr_pages * sizeof(struct page *), GFP_KERNEL);
+	if (!run) {
+		ret = read_cache_pages(mapping, pages, v9fs_fid_readpage,
+				       filp->private_data);
+		p9_debug(P9_DEBUG_VFS, "  = %d\n", ret);
+		return ret;
+	}
+
+	/* The list is in reverse index order: take runs from the tail */
+	while (!list_empty(pages)) {
+		page = list_entry(pages->prev, struct page, lru);
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  GFP_KERNEL)) {
+			page_cache_release(page);
+			continue;
+		}
+		if (nr && page->index != run[nr - 1]->index + 1) {
+			v9fs_fid_readpage_run(filp->private_data, run, nr);
+			nr = 0;
+		}
+		run[nr++] = page;
+	}
+	if (nr)
+		v9fs_fid_readpage_run(filp->private_data, run, nr);
+	kfree(run);
+	return 0;
 }
 
 /**
@@ -49,12 +49,14 @@
  */
 static int v9fs_cached_dentry_delete(const struct dentry *dentry)
 {
+	struct v9fs_session_info *v9ses = dentry->d_sb->s_fs_info;
+
 	p9_debug(P9_DEBUG_VFS, " dentry: %pd (%p)\n",
 		 dentry, dentry);
 
-	/* Don't cache negative dentries */
+	/* Cache negative dentries only if they time out */
 	if (!dentry->d_inode)
-		return 1;
+		return !v9ses->neg_timeout;
 	return 0;
 }
 
@@ -78,24 +80,26 @@ static int v9fs_lookup_revalidate(struct dentry *dentry, unsigned int flags)
 {
 	struct p9_fid *fid;
 	struct inode *inode;
-	struct v9fs_inode *v9inode;
+	struct v9fs_session_info *v9ses;
 
 	if (flags & LOOKUP_RCU)
 		return -ECHILD;
 
+	v9ses = v9fs_dentry2v9ses(dentry);
 	inode = dentry->d_inode;
-	if (!inode)
+	if (!inode) {
+		if (v9ses->neg_timeout &&
+		    time_after_eq(jiffies, dentry->d_time + v9ses->neg_timeout))
+			return 0;
 		goto out_valid;
+	}
 
-	v9inode = V9FS_I(inode);
-	if (v9inode->cache_validity & V9FS_INO_INVALID_ATTR) {
+	if (!v9fs_attr_cached(inode)) {
 		int retval;
-		struct v9fs_session_info *v9ses;
 		fid = v9fs_fid_lookup(dentry);
 		if (IS_ERR(fid))
 			return PTR_ERR(fid);
 
-		v9ses = v9fs_inode2v9ses(inode);
 		if (v9fs_proto_dotl(v9ses))
 			retval = v9fs_refresh_inode_dotl(fid, inode);
 		else
@@ -34,10 +34,15 @@
 #include <linux/list.h>
 #include <linux/pagemap.h>
 #include <linux/utsname.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 #include <asm/uaccess.h>
 #include <linux/idr.h>
 #include <net/9p/9p.h>
 #include <net/9p/client.h>
+#include <net/9p/transport.h>
 
 #include "v9fs.h"
 #include "v9fs_vfs.h"
@@ -367,18 +372,9 @@ out_err:
 	return ret;
 }
 
-/**
- * v9fs_fid_readn - read from a fid
- * @fid: fid to read
- * @data: data buffer to read data into
- * @udata: user data buffer to read data into
- * @count: size of buffer
- * @offset: offset at which to read data
- *
- */
-ssize_t
-v9fs_fid_readn(struct p9_fid *fid, char *data, char __user *udata, u32 count,
-	       u64 offset)
+static ssize_t
+v9fs_fid_readn_seq(struct p9_fid *fid, char *data, char __user *udata,
+		   u32 count, u64 offset)
 {
 	int n, total, size;
 
@@ -408,6 +404,271 @@ v9fs_fid_readn(struct p9_fid *fid, char *data, char __user *udata, u32 count,
 	return total;
 }
 
+static ssize_t
+v9fs_fid_writen_seq(struct p9_fid *fid, const char __user *data,
+		    size_t count, u64 offset)
+{
+	int n;
+	size_t total = 0;
+
+	do {
+		n = p9_client_write(fid, NULL, data+total, offset+total, count);
+		if (n <= 0)
+			break;
+		count -= n;
+		total += n;
+	} while (count > 0);
+
+	if (n < 0)
+		return n;
+	return total;
+}
+
+/*
+ * Reads and writes spanning several messages are split into message sized
+ * chunks and up to V9FS_PAR_CHUNKS of them are kept in flight at once, by
+ * the caller and by helpers on system_unbound_wq.  Each chunk is an
+ * ordinary p9_client_read/write on a kernel mapping of the buffer, so with
+ * a zero-copy transport the pages go to the server directly and the
+ * chunks can use different transport queues.
+ */
+struct v9fs_par_io {
+	struct p9_fid *fid;
+	char *data;
+	u64 offset;
+	u32 count;
+	u32 chunk;
+	int write;
+	int nr_chunks;
+	atomic_t next;
+	atomic_t stop;
+	atomic_t left;
+	struct completion done;
+	int res[V9FS_PAR_CHUNKS];
+};
+
+struct v9fs_par_work {
+	struct work_struct work;
+	struct v9fs_par_io *io;
+};
+
+/*
+ * Chunks after the first failed or short one are not issued; their result
+ * would not be reported anyway.
+ */
+static void v9fs_par_run(struct v9fs_par_io *io)
+{
+	u32 off, len;
+	int i, stop;
+
+	while ((i = atomic_inc_return(&io->next) - 1) < io->nr_chunks) {
+		off = i * io->chunk;
+		len = min(io->chunk, io->count - off);
+		if (i > atomic_read(&io->stop))
+			io->res[i] = 0;
+		else if (io->write)
+			io->res[i] = p9_client_write(io->fid, io->data + off,
+						     NULL, io->offset + off,
+						     len);
+		else
+			io->res[i] = p9_client_read(io->fid, io->data + off,
+						    NULL, io->offset + off,
+						    len);
+		if (io->res[i] < (int)len) {
+			stop = atomic_read(&io->stop);
+			while (i < stop)
+				stop = atomic_cmpxchg(&io->stop, stop, i);
+		}
+		if (atomic_dec_and_test(&io->left))
+			complete(&io->done);
+	}
+}
+
+static void v9fs_par_work_fn(struct work_struct *work)
+{
+	v9fs_par_run(container_of(work, struct v9fs_par_work, work)->io);
+}
+
+/*
+ * Transfer at most V9FS_PAR_CHUNKS chunks of a kernel buffer.  Only the
+ * bytes up to the first failed or short chunk are reported, as a
+ * sequential loop would have stopped there.
+ */
+static ssize_t v9fs_par_window(struct p9_fid *fid, char *data, u32 count,
+			       u64 offset, u32 chunk, int write)
+{
+	struct v9fs_par_work works[V9FS_PAR_CHUNKS - 1];
+	struct v9fs_par_io io;
+	ssize_t total = 0;
+	int i, nr_works;
+
+	io.fid = fid;
+	io.data = data;
+	io.offset = offset;
+	io.count = count;
+	io.chunk = chunk;
+	io.write = write;
+	io.nr_chunks = DIV_ROUND_UP(count, chunk);
+	atomic_set(&io.next, 0);
+	atomic_set(&io.stop, io.nr_chunks);
+	atomic_set(&io.left, io.nr_chunks);
+	init_completion(&io.done);
+
+	nr_works = io.nr_chunks - 1;
+	for (i = 0; i < nr_works; i++) {
+		works[i].io = &io;
+		INIT_WORK_ONSTACK(&works[i].work, v9fs_par_work_fn);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+	v9fs_par_run(&io);
+	wait_for_completion(&io.done);
+	for (i = 0; i < nr_works; i++) {
+		cancel_work_sync(&works[i].work);
+		destroy_work_on_stack(&works[i].work);
+	}
+
+	for (i = 0; i < io.nr_chunks; i++) {
+		if (io.res[i] < 0)
+			return total ? total : io.res[i];
+		total += io.res[i];
+		if (io.res[i] < min(chunk, count - i * chunk))
+			break;
+	}
+	return total;
+}
+
+/*
+ * Map a window of a user buffer into the kernel for v9fs_par_window().
+ * The pages count against the transports' ceiling of pinned pages.
+ * Returns -EAGAIN if the pages could not be pinned, in which case the
+ * caller falls back to the sequential path for that window.
+ */
+static ssize_t v9fs_par_window_user(struct p9_fid *fid,
+				    const char __user *udata, u32 count,
+				    u64 offset, u32 chunk, int write)
+{
+	unsigned long first = (unsigned long)udata & PAGE_MASK;
+	int nr_pages, pinned, i;
+	struct page **pages;
+	ssize_t ret;
+	void *vaddr;
+
+	nr_pages = (((unsigned long)udata + count - 1) >> PAGE_SHIFT) -
+		   (first >> PAGE_SHIFT) + 1;
+	pages = kmalloc(nr_pages * sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -EAGAIN;
+
+	ret = p9_pin_account(nr_pages);
+	if (ret) {
+		kfree(pages);
+		return ret;
+	}
+
+	pinned = get_user_pages_fast(first, nr_pages, !write, pages);
+	if (pinned < nr_pages) {
+		ret = -EAGAIN;
+		goto out_put;
+	}
+	vaddr = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!vaddr) {
+		ret = -EAGAIN;
+		goto out_put;
+	}
+
+	ret = v9fs_par_window(fid, vaddr + offset_in_page(udata), count,
+			      offset, chunk, write);
+	vunmap(vaddr);
+	if (!write)
+		for (i = 0; i < nr_pages; i++)
+			set_page_dirty_lock(pages[i]);
+out_put:
+	for (i = 0; i < pinned; i++)
+		put_page(pages[i]);
+	p9_pin_release(nr_pages);
+	kfree(pages);
+	return ret;
+}
+
+/* Was @fid opened for appending?  Then every write lands at the end. */
+static bool v9fs_fid_append(struct p9_fid *fid)
+{
+	if (fid->mode == -1)
+		return false;
+	if (p9_is_proto_dotl(fid->clnt))
+		return fid->mode & P9_DOTL_APPEND;
+	return fid->mode & P9_OAPPEND;
+}
+
+static bool v9fs_par_ok(struct p9_fid *fid, size_t count, u32 chunk)
+{
+	return fid->clnt->trans_mod->zc_request && count >= 2 * chunk &&
+	       !(fid->qid.type & P9_QTDIR) && !v9fs_fid_append(fid);
+}
+
+/*
+ * Transfer @count bytes window by window.  Exactly one of @data and
+ * @udata is set; a user pointer under KERNEL_DS is a kernel buffer.
+ */
+static ssize_t v9fs_par_io(struct p9_fid *fid, char *data,
+			   const char __user *udata, size_t count, u64 offset,
+			   u32 chunk, int write)
+{
+	size_t window = V9FS_PAR_CHUNKS * chunk;
+	ssize_t n, total = 0;
+	size_t len;
+
+	if (udata && segment_eq(get_fs(), KERNEL_DS)) {
+		data = (__force char *)udata;
+		udata = NULL;
+	}
+
+	while (count) {
+		len = min(count, window);
+		if (data) {
+			n = v9fs_par_window(fid, data + total, len,
+					    offset + total, chunk, write);
+		} else {
+			n = v9fs_par_window_user(fid, udata + total, len,
+						 offset + total, chunk, write);
+			if (n == -EAGAIN)
+				n = write ?
+				    v9fs_fid_writen_seq(fid, udata + total,
+							len, offset + total) :
+				    v9fs_fid_readn_seq(fid, NULL,
+						(char __user *)udata + total,
+						len, offset + total);
+		}
+		if (n < 0)
+			return total ? total : n;
+		total += n;
+		if (n < len)
+			break;
+		count -= len;
+	}
+	return total;
+}
+
+/**
+ * v9fs_fid_readn - read from a fid
+ * @fid: fid to read
+ * @data: data buffer to read data into
+ * @udata: user data buffer to read data into
+ * @count: size of buffer
+ * @offset: offset at which to read data
+ *
+ */
+ssize_t
+v9fs_fid_readn(struct p9_fid *fid, char *data, char __user *udata, u32 count,
+	       u64 offset)
+{
+	u32 size = fid->iounit ? fid->iounit : fid->clnt->msize - P9_IOHDRSZ;
+
+	if (v9fs_par_ok(fid, count, size))
+		return v9fs_par_io(fid, data, udata, count, offset, size, 0);
+	return v9fs_fid_readn_seq(fid, data, udata, count, offset);
+}
+
 /**
  * v9fs_file_readn - read from a file
  * @filp: file pointer to read
@@ -461,22 +722,23 @@ v9fs_file_write_internal(struct inode *inode, struct p9_fid *fid,
 			 const char __user *data, size_t count,
 			 loff_t *offset, int invalidate)
 {
-	int n;
+	ssize_t n;
 	loff_t i_size;
 	size_t total = 0;
 	loff_t origin = *offset;
 	unsigned long pg_start, pg_end;
+	u32 size;
 
 	p9_debug(P9_DEBUG_VFS, "data %p count %d offset %x\n",
 		 data, (int)count, (int)*offset);
 
-	do {
-		n = p9_client_write(fid, NULL, data+total, origin+total, count);
-		if (n <= 0)
-			break;
-		count -= n;
-		total += n;
-	} while (count > 0);
+	size = fid->iounit ? fid->iounit : fid->clnt->msize - P9_IOHDRSZ;
+	if (v9fs_par_ok(fid, count, size))
+		n = v9fs_par_io(fid, NULL, data, count, origin, size, 1);
+	else
+		n = v9fs_fid_writen_seq(fid, data, count, origin);
+	if (n > 0)
+		total = n;
 
 	if (invalidate && (total > 0)) {
 		pg_start = origin >> PAGE_CACHE_SHIFT;
@@ -490,6 +752,8 @@ v9fs_file_write_internal(struct inode *inode, struct p9_fid *fid,
 			inode_add_bytes(inode, *offset - i_size);
 			i_size_write(inode, *offset);
 		}
+		/* mtime and friends changed on the server */
+		v9fs_invalidate_inode_attr(inode);
 	}
 	if (n < 0)
 		return n;
@@ -248,6 +248,7 @@ struct inode *v9fs_alloc_inode(struct super_block *sb)
 #endif
 	v9inode->writeback_fid = NULL;
 	v9inode->cache_validity = 0;
+	v9inode->attr_time = jiffies;
 	mutex_init(&v9inode->v_mutex);
 	return &v9inode->vfs_inode;
 }
@@ -809,6 +810,8 @@ struct dentry *v9fs_vfs_lookup(struct inode *dir, struct dentry *dentry,
 	fid = p9_client_walk(dfid, 1, &name, 1);
 	if (IS_ERR(fid)) {
 		if (fid == ERR_PTR(-ENOENT)) {
+			/* negtimeo counts from here */
+			dentry->d_time = jiffies;
 			d_add(dentry, NULL);
 			return NULL;
 		}
@@ -1062,7 +1065,7 @@ v9fs_vfs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 
 	p9_debug(P9_DEBUG_VFS, "dentry: %p\n", dentry);
 	v9ses = v9fs_dentry2v9ses(dentry);
-	if (v9ses->cache == CACHE_LOOSE || v9ses->cache == CACHE_FSCACHE) {
+	if (v9fs_attr_cached(dentry->d_inode)) {
 		generic_fillattr(dentry->d_inode, stat);
 		return 0;
 	}
@@ -1070,6 +1073,15 @@ v9fs_vfs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 	if (IS_ERR(fid))
 		return PTR_ERR(fid);
 
+	if (v9fs_cache_loose(v9ses)) {
+		int retval = v9fs_refresh_inode(fid, dentry->d_inode);
+
+		if (retval)
+			return retval;
+		generic_fillattr(dentry->d_inode, stat);
+		return 0;
+	}
+
 	st = p9_client_stat(fid);
 	if (IS_ERR(st))
 		return PTR_ERR(st);
@@ -1203,6 +1215,7 @@ v9fs_stat2inode(struct p9_wstat *stat, struct inode *inode,
 	/* not real number of blocks, but 512 byte ones ... */
 	inode->i_blocks = (i_size_read(inode) + 512 - 1) >> 9;
 	v9inode->cache_validity &= ~V9FS_INO_INVALID_ATTR;
+	v9inode->attr_time = jiffies;
 }
 
 /**
@@ -482,7 +482,7 @@ v9fs_vfs_getattr_dotl(struct vfsmount *mnt, struct dentry *dentry,
 
 	p9_debug(P9_DEBUG_VFS, "dentry: %p\n", dentry);
 	v9ses = v9fs_dentry2v9ses(dentry);
-	if (v9ses->cache == CACHE_LOOSE || v9ses->cache == CACHE_FSCACHE) {
+	if (v9fs_attr_cached(dentry->d_inode)) {
 		generic_fillattr(dentry->d_inode, stat);
 		return 0;
 	}
@@ -490,6 +490,16 @@ v9fs_vfs_getattr_dotl(struct vfsmount *mnt, struct dentry *dentry,
 	if (IS_ERR(fid))
 		return PTR_ERR(fid);
 
+	/* Attributes timed out: refresh them but keep the cached i_size */
+	if (v9fs_cache_loose(v9ses)) {
+		int retval = v9fs_refresh_inode_dotl(fid, dentry->d_inode);
+
+		if (retval)
+			return retval;
+		generic_fillattr(dentry->d_inode, stat);
+		return 0;
+	}
+
 	/* Ask for all the fields in stat structure. Server will return
 	 * whatever it supports
 	 */
@@ -675,6 +685,7 @@ v9fs_stat2inode_dotl(struct p9_stat_dotl *stat, struct inode *inode)
 	 * because the inode structure does not have fields for them.
 	 */
 	v9inode->cache_validity &= ~V9FS_INO_INVALID_ATTR;
+	v9inode->attr_time = jiffies;
 }
 
 static int
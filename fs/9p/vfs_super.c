@@ -86,8 +86,11 @@ v9fs_fill_super(struct super_block *sb, struct v9fs_session_info *v9ses,
 	} else
 		sb->s_op = &v9fs_super_ops;
 	sb->s_bdi = &v9ses->bdi;
+	/* Read ahead far enough to keep all parallel read chunks busy */
 	if (v9ses->cache)
-		sb->s_bdi->ra_pages = (VM_MAX_READAHEAD * 1024)/PAGE_CACHE_SIZE;
+		sb->s_bdi->ra_pages = max_t(unsigned long,
+			(VM_MAX_READAHEAD * 1024)/PAGE_CACHE_SIZE,
+			V9FS_PAR_CHUNKS * v9ses->maxdata / PAGE_CACHE_SIZE);
 
 	sb->s_flags |= MS_ACTIVE | MS_DIRSYNC | MS_NOATIME;
 	if (!v9ses->cache)
@@ -144,7 +147,7 @@ static struct dentry *v9fs_mount(struct file_system_type *fs_type, int flags,
 	}
 	v9fs_fill_super(sb, v9ses, flags, data);
 
-	if (v9ses->cache == CACHE_LOOSE || v9ses->cache == CACHE_FSCACHE)
+	if (v9fs_cache_dentries(v9ses))
 		sb->s_d_op = &v9fs_cached_dentry_operations;
 	else
 		sb->s_d_op = &v9fs_dentry_operations;
@@ -169,6 +172,7 @@ static struct dentry *v9fs_mount(struct file_system_type *fs_type, int flags,
 			goto release_sb;
 		}
 		root->d_inode->i_ino = v9fs_qid2ino(&st->qid);
+		V9FS_I(root->d_inode)->qid = st->qid;
 		v9fs_stat2inode_dotl(st, root->d_inode);
 		kfree(st);
 	} else {
@@ -180,6 +184,7 @@ static struct dentry *v9fs_mount(struct file_system_type *fs_type, int flags,
 		}
 
 		root->d_inode->i_ino = v9fs_qid2ino(&st->qid);
+		V9FS_I(root->d_inode)->qid = st->qid;
 		v9fs_stat2inode(st, root->d_inode, sb);
 
 		p9stat_free(st);
@@ -189,6 +194,7 @@ static struct dentry *v9fs_mount(struct file_system_type *fs_type, int flags,
 	if (retval)
 		goto release_sb;
 	v9fs_fid_add(root, fid);
+	v9fs_inval_start(v9ses, sb, fid);
 
 	p9_debug(P9_DEBUG_VFS, " simple set mount, return 0\n");
 	return dget(sb->s_root);
@@ -224,6 +230,7 @@ static void v9fs_kill_super(struct super_block *s)
 
 	p9_debug(P9_DEBUG_VFS, " %p\n", s);
 
+	v9fs_inval_stop(v9ses);
 	kill_anon_super(s);
 
 	v9fs_session_cancel(v9ses);
@@ -27,6 +27,8 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/bitops.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
 #include <trace/events/jbd2.h>
 
 /*
@@ -361,6 +363,152 @@ static void jbd2_block_tag_csum_set(journal_t *j, journal_block_tag_t *tag,
 	else
 		tag->t_checksum = cpu_to_be16(csum32);
 }
+
+static void jbd2_submit_log_buf(struct buffer_head *bh)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = journal_end_buffer_io_sync;
+	submit_bh(WRITE_SYNC, bh);
+}
+
+/*
+ * Large batches of log blocks are checksummed and submitted in chunks
+ * of JBD2_PAR_CHUNK blocks by the commit thread and up to
+ * JBD2_PAR_WORKERS helpers on jbd2_commit_wq.  Chunks are handed out
+ * through an atomic counter and the commit thread takes them too, so
+ * the commit never waits on a worker that did not get to run.
+ */
+#define JBD2_PAR_CHUNK		16
+#define JBD2_PAR_WORKERS	8
+
+struct jbd2_log_batch {
+	journal_t		*journal;
+	struct buffer_head	**wbuf;
+	journal_block_tag_t	**wtag;
+	__u32			tid;
+	int			bufs;
+	int			nr_chunks;
+	atomic_t		next_chunk;
+	atomic_t		chunks_left;
+	struct completion	done;
+};
+
+struct jbd2_log_batch_work {
+	struct work_struct	work;
+	struct jbd2_log_batch	*batch;
+};
+
+static void jbd2_log_batch_run(struct jbd2_log_batch *batch)
+{
+	struct blk_plug plug;
+	int chunk, start, end, i;
+
+	blk_start_plug(&plug);
+	while ((chunk = atomic_inc_return(&batch->next_chunk) - 1) <
+	       batch->nr_chunks) {
+		/* wbuf[0] is the descriptor, tags start at wbuf[1] */
+		start = 1 + chunk * JBD2_PAR_CHUNK;
+		end = min(start + JBD2_PAR_CHUNK, batch->bufs);
+		for (i = start; i < end; i++) {
+			jbd2_block_tag_csum_set(batch->journal, batch->wtag[i],
+						batch->wbuf[i], batch->tid);
+			jbd2_submit_log_buf(batch->wbuf[i]);
+		}
+		if (atomic_dec_and_test(&batch->chunks_left))
+			complete(&batch->done);
+	}
+	blk_finish_plug(&plug);
+}
+
+static void jbd2_log_batch_work_fn(struct work_struct *work)
+{
+	struct jbd2_log_batch_work *w =
+		container_of(work, struct jbd2_log_batch_work, work);
+
+	jbd2_log_batch_run(w->batch);
+}
+
+/*
+ * Checksum the tags and the descriptor of one batch of log blocks and
+ * submit them.  wbuf[0] is the descriptor block and wtag[i] the tag
+ * describing wbuf[i].  @descriptor is NULL when the journal aborted
+ * while the batch was being built; its checksum is then left alone.
+ *
+ * Returns the number of blocks that were handled in parallel.
+ */
+static int jbd2_submit_log_batch(journal_t *journal,
+				 transaction_t *commit_transaction,
+				 struct buffer_head *descriptor,
+				 int bufs, __u32 *crc32_sum)
+{
+	struct buffer_head **wbuf = journal->j_wbuf;
+	journal_block_tag_t **wtag = journal->j_wtag;
+	struct jbd2_log_batch_work works[JBD2_PAR_WORKERS];
+	struct jbd2_log_batch batch;
+	int nr_workers, i;
+
+	if (!descriptor ||
+	    JBD2_HAS_COMPAT_FEATURE(journal, JBD2_FEATURE_COMPAT_CHECKSUM) ||
+	    !jbd2_journal_has_csum_v2or3(journal) ||
+	    bufs - 1 < 2 * JBD2_PAR_CHUNK || num_online_cpus() < 2) {
+		for (i = 1; i < bufs; i++)
+			jbd2_block_tag_csum_set(journal, wtag[i], wbuf[i],
+						commit_transaction->t_tid);
+		if (descriptor)
+			jbd2_descr_block_csum_set(journal, descriptor);
+
+		for (i = 0; i < bufs; i++) {
+			struct buffer_head *bh = wbuf[i];
+			/*
+			 * Compute checksum.
+			 */
+			if (JBD2_HAS_COMPAT_FEATURE(journal,
+				JBD2_FEATURE_COMPAT_CHECKSUM)) {
+				*crc32_sum =
+				    jbd2_checksum_data(*crc32_sum, bh);
+			}
+			jbd2_submit_log_buf(bh);
+		}
+		return 0;
+	}
+
+	batch.journal = journal;
+	batch.wbuf = wbuf;
+	batch.wtag = wtag;
+	batch.tid = commit_transaction->t_tid;
+	batch.bufs = bufs;
+	batch.nr_chunks = DIV_ROUND_UP(bufs - 1, JBD2_PAR_CHUNK);
+	atomic_set(&batch.next_chunk, 0);
+	atomic_set(&batch.chunks_left, batch.nr_chunks);
+	init_completion(&batch.done);
+
+	nr_workers = min3(num_online_cpus() - 1,
+			  (unsigned int)batch.nr_chunks - 1,
+			  (unsigned int)JBD2_PAR_WORKERS);
+	for (i = 0; i < nr_workers; i++) {
+		INIT_WORK_ONSTACK(&works[i].work, jbd2_log_batch_work_fn);
+		works[i].batch = &batch;
+		queue_work(jbd2_commit_wq, &works[i].work);
+	}
+
+	jbd2_log_batch_run(&batch);
+	wait_for_completion(&batch.done);
+
+	/* Workers that found nothing left may still be pending or running */
+	for (i = 0; i < nr_workers; i++) {
+		cancel_work_sync(&works[i].work);
+		destroy_work_on_stack(&works[i].work);
+	}
+
+	/* All tags are final now, so the descriptor can be sealed */
+	jbd2_descr_block_csum_set(journal, descriptor);
+	jbd2_submit_log_buf(descriptor);
+
+	return bufs - 1;
+}
+
 /*
  * jbd2_journal_commit_transaction
  *
@@ -374,11 +522,12 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	struct journal_head *jh;
 	struct buffer_head *descriptor;
 	struct buffer_head **wbuf = journal->j_wbuf;
+	journal_block_tag_t **wtag = journal->j_wtag;
 	int bufs;
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
+	ktime_t start_time, phase_start;
 	u64 commit_time;
 	char *tagp = NULL;
 	journal_header_t *header;
@@ -386,7 +535,6 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int space_left = 0;
 	int first_tag = 0;
 	int tag_flag;
-	int i;
 	int tag_bytes = journal_tag_bytes(journal);
 	struct buffer_head *cbh = NULL; /* For transactional checksums */
 	__u32 crc32_sum = ~0;
@@ -545,6 +693,14 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	wake_up(&journal->j_wait_transaction_locked);
 	write_unlock(&journal->j_state_lock);
 
+	/*
+	 * A fast commit of this transaction may still be running.  No new
+	 * one can start now, and the fast commit area is reset when this
+	 * commit is done.
+	 */
+	wait_event(journal->j_fc_wait,
+		   !(journal->j_flags & JBD2_FAST_COMMIT_ONGOING));
+
 	jbd_debug(3, "JBD2: commit phase 2a\n");
 
 	/*
@@ -577,6 +733,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	stats.run.rs_blocks =
 		atomic_read(&commit_transaction->t_outstanding_credits);
 	stats.run.rs_blocks_logged = 0;
+	stats.run.rs_blocks_parallel = 0;
+	stats.run.rs_submit_ns = 0;
 
 	J_ASSERT(commit_transaction->t_nr_buffers <=
 		 atomic_read(&commit_transaction->t_outstanding_credits));
@@ -605,8 +763,11 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 			 * any descriptor buffers which may have been
 			 * already allocated, even if we are now
 			 * aborting. */
-			if (!commit_transaction->t_buffers)
+			if (!commit_transaction->t_buffers) {
+				/* Don't seal a partial descriptor */
+				descriptor = NULL;
 				goto start_journal_io;
+			}
 			continue;
 		}
 
@@ -638,6 +799,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 			first_tag = 1;
 			set_buffer_jwrite(descriptor);
 			set_buffer_dirty(descriptor);
+			wtag[bufs] = NULL;
 			wbuf[bufs++] = descriptor;
 
 			/* Record it so that we can wait for IO
@@ -695,8 +857,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 		tag = (journal_block_tag_t *) tagp;
 		write_tag_block(journal, tag, jh2bh(jh)->b_blocknr);
 		tag->t_flags = cpu_to_be16(tag_flag);
-		jbd2_block_tag_csum_set(journal, tag, wbuf[bufs],
-					commit_transaction->t_tid);
+		wtag[bufs] = tag;
 		tagp += tag_bytes;
 		space_left -= tag_bytes;
 		bufs++;
@@ -722,26 +883,15 @@ void jbd2_journal_commit_transaction(journal_t *journal)
                            the last tag we set up. */
 
 			tag->t_flags |= cpu_to_be16(JBD2_FLAG_LAST_TAG);
-
-			jbd2_descr_block_csum_set(journal, descriptor);
 start_journal_io:
-			for (i = 0; i < bufs; i++) {
-				struct buffer_head *bh = wbuf[i];
-				/*
-				 * Compute checksum.
-				 */
-				if (JBD2_HAS_COMPAT_FEATURE(journal,
-					JBD2_FEATURE_COMPAT_CHECKSUM)) {
-					crc32_sum =
-					    jbd2_checksum_data(crc32_sum, bh);
-				}
-
-				lock_buffer(bh);
-				clear_buffer_dirty(bh);
-				set_buffer_uptodate(bh);
-				bh->b_end_io = journal_end_buffer_io_sync;
-				submit_bh(WRITE_SYNC, bh);
-			}
+			phase_start = ktime_get();
+			stats.run.rs_blocks_parallel +=
+				jbd2_submit_log_batch(journal,
+						      commit_transaction,
+						      descriptor, bufs,
+						      &crc32_sum);
+			stats.run.rs_submit_ns += ktime_to_ns(ktime_sub(
+						ktime_get(), phase_start));
 			cond_resched();
 			stats.run.rs_blocks_logged += bufs;
 
@@ -752,7 +902,10 @@ start_journal_io:
 		}
 	}
 
+	phase_start = ktime_get();
 	err = journal_finish_inode_data_buffers(journal, commit_transaction);
+	stats.run.rs_data_wait_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							  phase_start));
 	if (err) {
 		printk(KERN_WARNING
 			"JBD2: Detected IO errors while flushing file data "
@@ -819,6 +972,7 @@ start_journal_io:
 	*/
 
 	jbd_debug(3, "JBD2: commit phase 3\n");
+	phase_start = ktime_get();
 
 	while (!list_empty(&io_bufs)) {
 		struct buffer_head *bh = list_entry(io_bufs.prev,
@@ -879,6 +1033,8 @@ start_journal_io:
 		__brelse(bh);		/* One for getblk */
 		/* AKPM: bforget here */
 	}
+	stats.run.rs_log_wait_ns = ktime_to_ns(ktime_sub(ktime_get(),
+							 phase_start));
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -889,6 +1045,7 @@ start_journal_io:
 	commit_transaction->t_state = T_COMMIT_JFLUSH;
 	write_unlock(&journal->j_state_lock);
 
+	phase_start = ktime_get();
 	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
 				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
 		err = journal_submit_commit_record(journal, commit_transaction,
@@ -903,6 +1060,8 @@ start_journal_io:
 	    journal->j_flags & JBD2_BARRIER) {
 		blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
 	}
+	stats.run.rs_commit_ns = ktime_to_ns(ktime_sub(ktime_get(),
+						       phase_start));
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -1111,6 +1270,8 @@ restart_loop:
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
+	/* Fast commits logged so far are part of this commit now */
+	journal->j_fc_off = 0;
 	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
@@ -1160,5 +1321,10 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	journal->j_stats.run.rs_blocks_parallel += stats.run.rs_blocks_parallel;
+	journal->j_stats.run.rs_submit_ns += stats.run.rs_submit_ns;
+	journal->j_stats.run.rs_data_wait_ns += stats.run.rs_data_wait_ns;
+	journal->j_stats.run.rs_log_wait_ns += stats.run.rs_log_wait_ns;
+	journal->j_stats.run.rs_commit_ns += stats.run.rs_commit_ns;
 	spin_unlock(&journal->j_history_lock);
 }
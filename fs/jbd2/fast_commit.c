@@ -0,0 +1,384 @@
+/*
+ * linux/fs/jbd2/fast_commit.c
+ *
+ * This file is part of the Linux kernel and is made available under
+ * the terms of the GNU General Public License, version 2, or at your
+ * option, any later version, incorporated herein by reference.
+ *
+ * Fast commits for the generic filesystem journaling code.
+ *
+ * An fsync normally has to commit the whole running transaction, with
+ * every metadata block it dirtied.  When the filesystem can describe the
+ * changes of the inodes being synced as inode deltas (new size and mtime,
+ * a few changed block map ranges) it can instead log those deltas to the
+ * fast commit area at the end of the journal and leave the transaction
+ * running.  Recovery replays the deltas on top of the last complete
+ * transaction; the next full commit makes them obsolete.
+ *
+ * The filesystem drives a fast commit as follows:
+ *
+ *	err = jbd2_fc_begin_commit(journal, tid);
+ *	if (err == -EALREADY)
+ *		done, tid is already committed
+ *	else if (err)
+ *		jbd2_complete_transaction(journal, tid);
+ *	else {
+ *		write and wait on the file data;
+ *		for each inode to sync
+ *			if (jbd2_fc_log_inode(journal, &delta))
+ *				return jbd2_fc_end_commit_fallback(journal);
+ *		return jbd2_fc_end_commit(journal);
+ *	}
+ *
+ * and calls jbd2_fc_mark_ineligible() from any handle that makes changes
+ * an inode delta cannot express, so that fsync commits in full until the
+ * transaction is committed.
+ */
+
+#include <linux/time.h>
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/errno.h>
+#include <linux/blkdev.h>
+#include <linux/crc32.h>
+
+/* Room kept free in every fast commit block for a tail record */
+#define FC_TAIL_BYTES	(sizeof(struct jbd2_fc_tl) + \
+			 sizeof(struct jbd2_fc_tail))
+
+/*
+ * Checksum used for fast commits: crc32c if the journal has v2/v3
+ * checksums, crc32 otherwise.
+ */
+__u32 jbd2_fc_csum(journal_t *journal, __u32 crc, const void *buf,
+		   unsigned int len)
+{
+	if (journal->j_chksum_driver)
+		return jbd2_chksum(journal, crc, buf, len);
+	return crc32_be(crc, buf, len);
+}
+
+static void jbd2_fc_count(journal_t *journal, int fast)
+{
+	spin_lock(&journal->j_history_lock);
+	if (fast)
+		journal->j_stats.ts_fc_commits++;
+	else
+		journal->j_stats.ts_fc_fallbacks++;
+	spin_unlock(&journal->j_history_lock);
+}
+
+static void jbd2_fc_done(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/* Wait for the fast commit blocks submitted so far and release them */
+static int jbd2_fc_wait_bufs(journal_t *journal)
+{
+	struct buffer_head *bh;
+	int err = 0;
+
+	while (!list_empty(&journal->j_fc_bufs)) {
+		bh = list_entry(journal->j_fc_bufs.next, struct buffer_head,
+				b_assoc_buffers);
+		list_del_init(&bh->b_assoc_buffers);
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+		__brelse(bh);
+	}
+	return err;
+}
+
+static void jbd2_fc_submit_block(journal_t *journal, int write_op)
+{
+	struct buffer_head *bh = journal->j_fc_bh;
+
+	journal->j_fc_bh = NULL;
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(write_op, bh);
+	list_add_tail(&bh->b_assoc_buffers, &journal->j_fc_bufs);
+}
+
+/* Start the next block of the fast commit area */
+static int jbd2_fc_next_block(journal_t *journal)
+{
+	journal_header_t *header;
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	unsigned long offset;
+	int err;
+
+	offset = journal->j_fc_first + journal->j_fc_off;
+	if (offset >= journal->j_maxlen)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal, offset, &blocknr);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	header = (journal_header_t *)bh->b_data;
+	header->h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	header->h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	header->h_sequence = cpu_to_be32(journal->j_fc_tid);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_off++;
+	journal->j_fc_bh = bh;
+	journal->j_fc_bh_off = sizeof(journal_header_t);
+	return 0;
+}
+
+/*
+ * Make room for a record with @len bytes of value, moving on to the next
+ * block if the current one is full, and return a pointer to the value.
+ */
+static void *jbd2_fc_reserve(journal_t *journal, int tag, unsigned int len)
+{
+	struct jbd2_fc_tl *tl;
+	unsigned int size = sizeof(*tl) + len;
+	int err;
+
+	if (size + FC_TAIL_BYTES > journal->j_blocksize -
+				   sizeof(journal_header_t))
+		return ERR_PTR(-E2BIG);
+
+	if (journal->j_fc_bh &&
+	    journal->j_fc_bh_off + size + FC_TAIL_BYTES >
+	    journal->j_blocksize) {
+		journal->j_fc_csum = jbd2_fc_csum(journal, journal->j_fc_csum,
+						  journal->j_fc_bh->b_data,
+						  journal->j_blocksize);
+		jbd2_fc_submit_block(journal, WRITE_SYNC);
+	}
+	if (!journal->j_fc_bh) {
+		err = jbd2_fc_next_block(journal);
+		if (err)
+			return ERR_PTR(err);
+	}
+
+	tl = (struct jbd2_fc_tl *)(journal->j_fc_bh->b_data +
+				   journal->j_fc_bh_off);
+	tl->fc_tag = cpu_to_be16(tag);
+	tl->fc_len = cpu_to_be16(len);
+	journal->j_fc_bh_off += size;
+	return tl + 1;
+}
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the caller needs to be stable.
+ *
+ * Returns 0 if the caller may now log inode deltas for @tid, -EALREADY
+ * if @tid is committed already, and an error if @tid has to be committed
+ * in full: the journal has no fast commit area, @tid is no longer the
+ * running transaction or it was marked ineligible.  Only one fast commit
+ * is written at a time.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	while (journal->j_flags & JBD2_FAST_COMMIT_ONGOING &&
+	       !tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		wait_event(journal->j_fc_wait,
+			   !(journal->j_flags & JBD2_FAST_COMMIT_ONGOING));
+		write_lock(&journal->j_state_lock);
+	}
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+
+	/*
+	 * The fast commit area is reset when a full commit completes, so
+	 * none can be written while one is in progress.
+	 */
+	transaction = journal->j_running_transaction;
+	if (!transaction || transaction->t_tid != tid ||
+	    transaction->t_fc_ineligible ||
+	    journal->j_committing_transaction ||
+	    is_journal_aborted(journal)) {
+		write_unlock(&journal->j_state_lock);
+		jbd2_fc_count(journal, 0);
+		return -EINVAL;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	journal->j_fc_tid = tid;
+	journal->j_fc_start_off = journal->j_fc_off;
+	write_unlock(&journal->j_state_lock);
+
+	journal->j_fc_bh = NULL;
+	journal->j_fc_csum = journal->j_chksum_driver ?
+			     journal->j_csum_seed : ~0;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * int jbd2_fc_log_inode() - log an inode delta in the current fast commit
+ * @journal: Journal to act on.
+ * @delta: The changes to log.
+ *
+ * Returns -E2BIG if @delta has more ranges than a record can hold and
+ * -ENOSPC if the fast commit area is full.  The caller must then finish
+ * with jbd2_fc_end_commit_fallback().
+ */
+int jbd2_fc_log_inode(journal_t *journal,
+		      const struct jbd2_fc_inode_delta *delta)
+{
+	struct jbd2_fc_inode *fi;
+	unsigned int i;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (delta->nr_ranges > JBD2_FC_MAX_RANGES)
+		return -E2BIG;
+
+	fi = jbd2_fc_reserve(journal, JBD2_FC_TAG_INODE, sizeof(*fi) +
+			     delta->nr_ranges * sizeof(struct jbd2_fc_range));
+	if (IS_ERR(fi))
+		return PTR_ERR(fi);
+
+	fi->fi_ino = cpu_to_be64(delta->ino);
+	fi->fi_size = cpu_to_be64(delta->size);
+	fi->fi_mtime_sec = cpu_to_be64(delta->mtime.tv_sec);
+	fi->fi_mtime_nsec = cpu_to_be32(delta->mtime.tv_nsec);
+	fi->fi_nr_ranges = cpu_to_be32(delta->nr_ranges);
+	for (i = 0; i < delta->nr_ranges; i++) {
+		fi->fi_ranges[i].fr_lblk = cpu_to_be32(delta->ranges[i].lblk);
+		fi->fi_ranges[i].fr_len = cpu_to_be32(delta->ranges[i].len);
+		fi->fi_ranges[i].fr_pblk = cpu_to_be64(delta->ranges[i].pblk);
+	}
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_log_inode);
+
+/**
+ * int jbd2_fc_end_commit() - write out the current fast commit
+ * @journal: Journal to act on.
+ *
+ * Seals the fast commit with its tail record and waits until it is on
+ * stable storage.  The file data covered by the logged deltas must have
+ * been written and waited on already.  If the fast commit cannot be
+ * written, the transaction is committed in full instead.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	struct jbd2_fc_tl *tl;
+	struct jbd2_fc_tail *tail;
+	struct buffer_head *bh;
+	int write_op = WRITE_SYNC;
+	int err;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (!journal->j_fc_bh) {
+		err = jbd2_fc_next_block(journal);
+		if (err)
+			return jbd2_fc_end_commit_fallback(journal);
+	}
+
+	/* jbd2_fc_reserve() always leaves room for the tail */
+	bh = journal->j_fc_bh;
+	tl = (struct jbd2_fc_tl *)(bh->b_data + journal->j_fc_bh_off);
+	tl->fc_tag = cpu_to_be16(JBD2_FC_TAG_TAIL);
+	tl->fc_len = cpu_to_be16(sizeof(*tail));
+	tail = (struct jbd2_fc_tail *)(tl + 1);
+	tail->ft_tid = cpu_to_be32(journal->j_fc_tid);
+	journal->j_fc_bh_off += FC_TAIL_BYTES;
+	tail->ft_checksum = cpu_to_be32(jbd2_fc_csum(journal,
+				journal->j_fc_csum, bh->b_data,
+				(char *)&tail->ft_checksum - bh->b_data));
+
+	/*
+	 * The tail makes the fast commit valid, so the file data and the
+	 * other blocks have to be stable before it is.
+	 */
+	if (journal->j_flags & JBD2_BARRIER) {
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		write_op = WRITE_FLUSH_FUA;
+	}
+	err = jbd2_fc_wait_bufs(journal);
+	if (!err) {
+		jbd2_fc_submit_block(journal, write_op);
+		err = jbd2_fc_wait_bufs(journal);
+	}
+	if (err)
+		return jbd2_fc_end_commit_fallback(journal);
+
+	jbd2_fc_done(journal);
+	jbd2_fc_count(journal, 1);
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * int jbd2_fc_end_commit_fallback() - give up on the current fast commit
+ * @journal: Journal to act on.
+ *
+ * Drops what was logged so far and commits the transaction in full.
+ * Returns the result of that commit.
+ */
+int jbd2_fc_end_commit_fallback(journal_t *journal)
+{
+	tid_t tid = journal->j_fc_tid;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (journal->j_fc_bh) {
+		brelse(journal->j_fc_bh);
+		journal->j_fc_bh = NULL;
+	}
+	jbd2_fc_wait_bufs(journal);
+
+	/* Without a valid tail recovery never looks at these blocks */
+	write_lock(&journal->j_state_lock);
+	journal->j_fc_off = journal->j_fc_start_off;
+	write_unlock(&journal->j_state_lock);
+	jbd2_fc_done(journal);
+	jbd2_fc_count(journal, 0);
+
+	return jbd2_complete_transaction(journal, tid);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
+/**
+ * void jbd2_fc_mark_ineligible() - make fsync commit this transaction in full
+ * @handle: Handle making changes that inode deltas cannot describe.
+ */
+void jbd2_fc_mark_ineligible(handle_t *handle)
+{
+	transaction_t *transaction = handle->h_transaction;
+	journal_t *journal;
+
+	if (is_handle_aborted(handle))
+		return;
+	journal = transaction->t_journal;
+	write_lock(&journal->j_state_lock);
+	transaction->t_fc_ineligible = 1;
+	write_unlock(&journal->j_state_lock);
+}
+EXPORT_SYMBOL(jbd2_fc_mark_ineligible);
@@ -43,6 +43,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
+#include <linux/workqueue.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -79,6 +80,7 @@ EXPORT_SYMBOL(jbd2_journal_init_inode);
 EXPORT_SYMBOL(jbd2_journal_check_used_features);
 EXPORT_SYMBOL(jbd2_journal_check_available_features);
 EXPORT_SYMBOL(jbd2_journal_set_features);
+EXPORT_SYMBOL(jbd2_fc_init);
 EXPORT_SYMBOL(jbd2_journal_load);
 EXPORT_SYMBOL(jbd2_journal_destroy);
 EXPORT_SYMBOL(jbd2_journal_abort);
@@ -962,6 +964,11 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 		   "each up to %u blocks\n",
 		   s->stats->ts_tid, s->stats->ts_requested,
 		   s->journal->j_max_transaction_buffers);
+	if (JBD2_HAS_INCOMPAT_FEATURE(s->journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		seq_printf(seq, "%lu fast commits, %lu fsyncs fell back to "
+			   "a full commit\n", s->stats->ts_fc_commits,
+			   s->stats->ts_fc_fallbacks);
 	if (s->stats->ts_tid == 0)
 		return 0;
 	seq_printf(seq, "average: \n  %ums waiting for transaction\n",
@@ -986,6 +993,21 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "  %lu blocks checksummed in parallel per transaction\n",
+	    s->stats->run.rs_blocks_parallel / s->stats->ts_tid);
+	seq_printf(seq, "commit phases, average: \n");
+	seq_printf(seq, "  %lluus checksumming and submitting log blocks\n",
+	    div64_u64(s->stats->run.rs_submit_ns,
+		      s->stats->ts_tid * NSEC_PER_USEC));
+	seq_printf(seq, "  %lluus waiting for data blocks\n",
+	    div64_u64(s->stats->run.rs_data_wait_ns,
+		      s->stats->ts_tid * NSEC_PER_USEC));
+	seq_printf(seq, "  %lluus waiting for log blocks\n",
+	    div64_u64(s->stats->run.rs_log_wait_ns,
+		      s->stats->ts_tid * NSEC_PER_USEC));
+	seq_printf(seq, "  %lluus writing commit block\n",
+	    div64_u64(s->stats->run.rs_commit_ns,
+		      s->stats->ts_tid * NSEC_PER_USEC));
 	return 0;
 }
 
@@ -1089,6 +1111,8 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
+	INIT_LIST_HEAD(&journal->j_fc_bufs);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1164,7 +1188,9 @@ journal_t * jbd2_journal_init_dev(struct block_device *bdev,
 	n = journal->j_blocksize / sizeof(journal_block_tag_t);
 	journal->j_wbufsize = n;
 	journal->j_wbuf = kmalloc(n * sizeof(struct buffer_head*), GFP_KERNEL);
-	if (!journal->j_wbuf) {
+	journal->j_wtag = kmalloc(n * sizeof(journal_block_tag_t *),
+				  GFP_KERNEL);
+	if (!journal->j_wbuf || !journal->j_wtag) {
 		printk(KERN_ERR "%s: Can't allocate bhs for commit thread\n",
 			__func__);
 		goto out_err;
@@ -1182,6 +1208,7 @@ journal_t * jbd2_journal_init_dev(struct block_device *bdev,
 
 	return journal;
 out_err:
+	kfree(journal->j_wtag);
 	kfree(journal->j_wbuf);
 	jbd2_stats_proc_exit(journal);
 	kfree(journal);
@@ -1230,7 +1257,9 @@ journal_t * jbd2_journal_init_inode (struct inode *inode)
 	n = journal->j_blocksize / sizeof(journal_block_tag_t);
 	journal->j_wbufsize = n;
 	journal->j_wbuf = kmalloc(n * sizeof(struct buffer_head*), GFP_KERNEL);
-	if (!journal->j_wbuf) {
+	journal->j_wtag = kmalloc(n * sizeof(journal_block_tag_t *),
+				  GFP_KERNEL);
+	if (!journal->j_wbuf || !journal->j_wtag) {
 		printk(KERN_ERR "%s: Can't allocate bhs for commit thread\n",
 			__func__);
 		goto out_err;
@@ -1256,6 +1285,7 @@ journal_t * jbd2_journal_init_inode (struct inode *inode)
 
 	return journal;
 out_err:
+	kfree(journal->j_wtag);
 	kfree(journal->j_wbuf);
 	jbd2_stats_proc_exit(journal);
 	kfree(journal);
@@ -1281,13 +1311,27 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+/*
+ * Number of blocks at the end of the journal set aside for fast commits
+ */
+static unsigned long jbd2_fc_blocks(journal_t *journal)
+{
+	unsigned long n;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+	n = be32_to_cpu(journal->j_superblock->s_num_fc_blks);
+	return n ? n : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - jbd2_fc_blocks(journal);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1297,6 +1341,8 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	journal->j_fc_first = last;
+	journal->j_fc_off = 0;
 
 	journal->j_head = first;
 	journal->j_tail = first;
@@ -1616,6 +1662,14 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_fc_blocks(journal) >= journal->j_last - journal->j_first) {
+		printk(KERN_WARNING "JBD2: fast commit area of %lu blocks "
+		       "leaves no room for the log\n",
+		       jbd2_fc_blocks(journal));
+		return -EINVAL;
+	}
+	journal->j_last -= jbd2_fc_blocks(journal);
+	journal->j_fc_first = journal->j_last;
 	return 0;
 }
 
@@ -1755,6 +1809,7 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	kfree(journal->j_wtag);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 
@@ -1856,6 +1911,10 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 	if (!jbd2_journal_check_available_features(journal, compat, ro, incompat))
 		return 0;
 
+	/* The fast commit area has to be carved out by jbd2_fc_init() */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+
 	/* If enabling v2 checksums, turn on v3 instead */
 	if (incompat & JBD2_FEATURE_INCOMPAT_CSUM_V2) {
 		incompat &= ~JBD2_FEATURE_INCOMPAT_CSUM_V2;
@@ -2013,6 +2072,66 @@ out:
 	return err;
 }
 
+/**
+ * int jbd2_fc_init() - Enable fast commits on a journal
+ * @journal: Journal to act on.
+ * @num_fc_blks: Number of blocks to set aside for fast commits, 0 for
+ *	the default.
+ *
+ * Flush the journal and move the end of the log in to leave its last
+ * @num_fc_blks blocks for fast commits.  This sets
+ * JBD2_FEATURE_INCOMPAT_FAST_COMMIT, so older kernels will refuse the
+ * journal from now on.  Must not race with handles being started.
+ * Returns 0 if fast commits are enabled, or a negative error.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long maxlen = be32_to_cpu(sb->s_maxlen);
+	int err;
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+	if (!jbd2_journal_check_available_features(journal, 0, 0,
+				JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EINVAL;
+
+	if (!num_fc_blks)
+		num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+	if (journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+	    maxlen + 1)
+		return -EINVAL;
+
+	err = jbd2_journal_flush(journal);
+	if (err)
+		return err;
+
+	/* The log is empty now, so it can restart at its first block */
+	mutex_lock(&journal->j_checkpoint_mutex);
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction) {
+		write_unlock(&journal->j_state_lock);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+		return -EBUSY;
+	}
+	journal->j_last = maxlen - num_fc_blks;
+	journal->j_head = journal->j_first;
+	journal->j_tail = journal->j_first;
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	sb->s_num_fc_blks = cpu_to_be32(num_fc_blks);
+	sb->s_feature_incompat |=
+		cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	write_unlock(&journal->j_state_lock);
+
+	err = jbd2_write_superblock(journal, WRITE_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+	return err;
+}
+
 /**
  * int jbd2_journal_wipe() - Wipe journal contents
  * @journal: Journal to act on.
@@ -2687,6 +2806,12 @@ static void jbd2_journal_destroy_caches(void)
 	jbd2_journal_destroy_slabs();
 }
 
+/*
+ * Workers that checksum and submit log blocks for the commit threads.
+ * Commits can be needed to free memory, hence the rescuer.
+ */
+struct workqueue_struct *jbd2_commit_wq;
+
 static int __init journal_init(void)
 {
 	int ret;
@@ -2694,6 +2819,12 @@ static int __init journal_init(void)
 	BUILD_BUG_ON(sizeof(struct journal_superblock_s) != 1024);
 
 	ret = journal_init_caches();
+	if (ret == 0) {
+		jbd2_commit_wq = alloc_workqueue("jbd2-commit",
+					WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+		if (!jbd2_commit_wq)
+			ret = -ENOMEM;
+	}
 	if (ret == 0) {
 		jbd2_create_jbd_stats_proc_entry();
 	} else {
@@ -2710,6 +2841,7 @@ static void __exit journal_exit(void)
 		printk(KERN_ERR "JBD2: leaked %d journal_heads!\n", n);
 #endif
 	jbd2_remove_jbd_stats_proc_entry();
+	destroy_workqueue(jbd2_commit_wq);
 	jbd2_journal_destroy_caches();
 }
 
@@ -36,6 +36,7 @@ struct recovery_info
 	int		nr_replays;
 	int		nr_revokes;
 	int		nr_revoke_hits;
+	int		nr_fc_replays;
 };
 
 enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
@@ -43,6 +44,7 @@ static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
 				tid_t, struct recovery_info *);
+static int fc_do_replay(journal_t *journal, struct recovery_info *info);
 
 #ifdef __KERNEL__
 
@@ -264,8 +266,16 @@ int jbd2_journal_recover(journal_t *journal)
 	if (!sb->s_start) {
 		jbd_debug(1, "No recovery required, last transaction %d\n",
 			  be32_to_cpu(sb->s_sequence));
-		journal->j_transaction_sequence = be32_to_cpu(sb->s_sequence) + 1;
-		return 0;
+		/* ...but the next one may have been fast committed */
+		if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+			journal->j_transaction_sequence =
+				be32_to_cpu(sb->s_sequence) + 1;
+			return 0;
+		}
+		info.end_transaction = be32_to_cpu(sb->s_sequence);
+		err = 0;
+		goto fast_commits;
 	}
 
 	err = do_one_pass(journal, &info, PASS_SCAN);
@@ -280,6 +290,14 @@ int jbd2_journal_recover(journal_t *journal)
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
 
+fast_commits:
+	if (!err && JBD2_HAS_INCOMPAT_FEATURE(journal,
+				JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		err = fc_do_replay(journal, &info);
+		jbd_debug(1, "JBD2: Replayed %d inode deltas of transaction "
+			  "%u\n", info.nr_fc_replays, info.end_transaction);
+	}
+
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
@@ -875,3 +893,177 @@ static int scan_revoke_records(journal_t *journal, struct buffer_head *bh,
 	}
 	return 0;
 }
+
+/*
+ * Read a block of the fast commit area.  It lies past j_last, where
+ * do_readahead() does not go.
+ */
+static int fc_read(journal_t *journal, unsigned long offset,
+		   struct buffer_head **bhp)
+{
+	unsigned long long blocknr;
+	struct buffer_head *bh;
+	int err;
+
+	*bhp = NULL;
+	err = jbd2_journal_bmap(journal, offset, &blocknr);
+	if (err) {
+		printk(KERN_ERR "JBD2: bad block at offset %lu\n", offset);
+		return err;
+	}
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	if (!bh_uptodate_or_lock(bh) && bh_submit_read(bh)) {
+		printk(KERN_ERR "JBD2: Failed to read block at offset %lu\n",
+		       offset);
+		brelse(bh);
+		return -EIO;
+	}
+	*bhp = bh;
+	return 0;
+}
+
+static int fc_replay_inode(journal_t *journal, struct jbd2_fc_inode *fi,
+			   unsigned int len, struct recovery_info *info)
+{
+	struct jbd2_fc_inode_delta delta;
+	unsigned int i;
+	int err;
+
+	delta.nr_ranges = be32_to_cpu(fi->fi_nr_ranges);
+	if (delta.nr_ranges > JBD2_FC_MAX_RANGES ||
+	    len != sizeof(*fi) + delta.nr_ranges * sizeof(fi->fi_ranges[0]))
+		return -EIO;
+
+	delta.ino = be64_to_cpu(fi->fi_ino);
+	delta.size = be64_to_cpu(fi->fi_size);
+	delta.mtime.tv_sec = be64_to_cpu(fi->fi_mtime_sec);
+	delta.mtime.tv_nsec = be32_to_cpu(fi->fi_mtime_nsec);
+	for (i = 0; i < delta.nr_ranges; i++) {
+		delta.ranges[i].lblk = be32_to_cpu(fi->fi_ranges[i].fr_lblk);
+		delta.ranges[i].len = be32_to_cpu(fi->fi_ranges[i].fr_len);
+		delta.ranges[i].pblk = be64_to_cpu(fi->fi_ranges[i].fr_pblk);
+	}
+
+	err = journal->j_fc_replay(journal, &delta);
+	if (!err)
+		info->nr_fc_replays++;
+	return err;
+}
+
+/*
+ * Walk the records of a fast commit block of transaction @tid.  Returns
+ * the tail record, NULL if the fast commit goes on in the next block, or
+ * an ERR_PTR if the block does not belong to a fast commit of @tid or,
+ * when @info is set, if replaying one of its deltas failed.
+ */
+static struct jbd2_fc_tail *fc_walk_block(journal_t *journal,
+					  struct buffer_head *bh, tid_t tid,
+					  struct recovery_info *info)
+{
+	journal_header_t *header = (journal_header_t *)bh->b_data;
+	struct jbd2_fc_tl *tl;
+	unsigned int off = sizeof(journal_header_t);
+	unsigned int len;
+	int err;
+
+	if (header->h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+	    header->h_blocktype != cpu_to_be32(JBD2_FC_BLOCK) ||
+	    header->h_sequence != cpu_to_be32(tid))
+		return ERR_PTR(-ENOENT);
+
+	while (off + sizeof(*tl) <= journal->j_blocksize) {
+		tl = (struct jbd2_fc_tl *)(bh->b_data + off);
+		len = be16_to_cpu(tl->fc_len);
+		if (!tl->fc_tag)
+			break;
+		if (off + sizeof(*tl) + len > journal->j_blocksize)
+			return ERR_PTR(-EIO);
+
+		switch (be16_to_cpu(tl->fc_tag)) {
+		case JBD2_FC_TAG_TAIL:
+			if (len != sizeof(struct jbd2_fc_tail))
+				return ERR_PTR(-EIO);
+			return (struct jbd2_fc_tail *)(tl + 1);
+		case JBD2_FC_TAG_INODE:
+			if (!info)
+				break;
+			err = fc_replay_inode(journal,
+					      (struct jbd2_fc_inode *)(tl + 1),
+					      len, info);
+			if (err)
+				return ERR_PTR(err);
+			break;
+		default:
+			return ERR_PTR(-EIO);
+		}
+		off += sizeof(*tl) + len;
+	}
+	return NULL;
+}
+
+/*
+ * Replay the fast commits written for the transaction that follows the
+ * last complete one.  They are laid out one after the other from the
+ * start of the fast commit area, and each is only applied once its tail
+ * checksum proves that all of it made it to disk.
+ */
+static int fc_do_replay(journal_t *journal, struct recovery_info *info)
+{
+	tid_t tid = info->end_transaction;
+	unsigned long start = journal->j_fc_first;
+	unsigned long next;
+	struct jbd2_fc_tail *tail;
+	struct buffer_head *bh;
+	__u32 csum;
+	int err;
+
+	while (start < journal->j_maxlen) {
+		csum = journal->j_chksum_driver ? journal->j_csum_seed : ~0;
+		for (next = start; ; next++) {
+			if (next >= journal->j_maxlen)
+				return 0;
+			err = fc_read(journal, next, &bh);
+			if (err)
+				return err;
+			tail = fc_walk_block(journal, bh, tid, NULL);
+			if (IS_ERR(tail)) {
+				brelse(bh);
+				return 0;
+			}
+			if (!tail) {
+				csum = jbd2_fc_csum(journal, csum, bh->b_data,
+						    journal->j_blocksize);
+				brelse(bh);
+				continue;
+			}
+			csum = jbd2_fc_csum(journal, csum, bh->b_data,
+				(char *)&tail->ft_checksum - bh->b_data);
+			if (tail->ft_tid != cpu_to_be32(tid) ||
+			    tail->ft_checksum != cpu_to_be32(csum)) {
+				brelse(bh);
+				return 0;
+			}
+			brelse(bh);
+			break;
+		}
+
+		/* Blocks start to next hold a complete fast commit */
+		if (!journal->j_fc_replay) {
+			printk(KERN_ERR "JBD2: no way to replay the fast "
+			       "commits on %s\n", journal->j_devname);
+			return -EOPNOTSUPP;
+		}
+		for (; start <= next; start++) {
+			err = fc_read(journal, start, &bh);
+			if (err)
+				return err;
+			tail = fc_walk_block(journal, bh, tid, info);
+			brelse(bh);
+			if (IS_ERR(tail))
+				return PTR_ERR(tail);
+		}
+	}
+	return 0;
+}
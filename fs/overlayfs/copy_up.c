@@ -16,6 +16,7 @@
 #include <linux/uaccess.h>
 #include <linux/sched.h>
 #include <linux/namei.h>
+#include <linux/ktime.h>
 #include "overlayfs.h"
 
 #define OVL_COPY_UP_CHUNK_SIZE (1 << 20)
@@ -89,6 +90,8 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 	struct file *new_file;
 	loff_t old_pos = 0;
 	loff_t new_pos = 0;
+	loff_t data_end = 0;
+	bool skip_holes = true;
 	int error = 0;
 
 	if (len == 0)
@@ -104,19 +107,40 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		goto out_fput;
 	}
 
-	/* FIXME: copy up sparse files efficiently */
-	while (len) {
+	while (old_pos < len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
 		long bytes;
 
-		if (len < this_len)
-			this_len = len;
-
 		if (signal_pending_state(TASK_KILLABLE, current)) {
 			error = -EINTR;
 			break;
 		}
 
+		/*
+		 * Only copy the data extents: holes read back as zeroes
+		 * anyway and stay holes in the copy.
+		 */
+		if (skip_holes && old_pos >= data_end) {
+			loff_t data = vfs_llseek(old_file, old_pos, SEEK_DATA);
+
+			if (data == -ENXIO)
+				break;
+			if (data < 0) {
+				skip_holes = false;
+				data_end = len;
+			} else {
+				data_end = vfs_llseek(old_file, data, SEEK_HOLE);
+				if (data_end <= data || data_end > len)
+					data_end = len;
+				old_pos = new_pos = data;
+				if (old_pos >= len)
+					break;
+			}
+		}
+
+		if (data_end - old_pos < this_len)
+			this_len = data_end - old_pos;
+
 		bytes = do_splice_direct(old_file, &old_pos,
 					 new_file, &new_pos,
 					 this_len, SPLICE_F_MOVE);
@@ -125,10 +149,21 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 		WARN_ON(old_pos != new_pos);
-
-		len -= bytes;
+		atomic64_add(bytes, &ovl_stats.copy_up_bytes);
 	}
 
+	/* A trailing hole is not written: set the size explicitly */
+	if (!error && i_size_read(file_inode(new_file)) < len) {
+		struct iattr attr = {
+			.ia_valid = ATTR_SIZE | ATTR_FILE,
+			.ia_size = len,
+			.ia_file = new_file,
+		};
+
+		mutex_lock(&file_inode(new_file)->i_mutex);
+		error = notify_change(new->dentry, &attr, NULL);
+		mutex_unlock(&file_inode(new_file)->i_mutex);
+	}
 	if (!error)
 		error = vfs_fsync(new_file, 0);
 	fput(new_file);
@@ -314,6 +349,7 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	const struct cred *old_cred;
 	struct cred *override_cred;
 	char *link = NULL;
+	u64 start;
 
 	ovl_path_upper(parent, &parentpath);
 	upperdir = parentpath.dentry;
@@ -369,11 +405,14 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		goto out_put_cred;
 	}
 
+	start = ktime_get_ns();
 	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
 				 stat, attr, link);
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
+		atomic64_inc(&ovl_stats.copy_up);
+		atomic64_add(ktime_get_ns() - start, &ovl_stats.copy_up_ns);
 	}
 out_unlock:
 	unlock_rename(workdir, upperdir);
@@ -8,8 +8,10 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/atomic.h>
 
 struct ovl_entry;
+struct ovl_dir_cache;
 
 enum ovl_path_type {
 	OVL_PATH_PURE_UPPER,
@@ -20,6 +22,18 @@ enum ovl_path_type {
 
 extern const char *ovl_opaque_xattr;
 
+/* Counters shown in <debugfs>/overlayfs/stats */
+struct ovl_stats {
+	atomic64_t readdir_hits;	/* opens served by a kept cache */
+	atomic64_t readdir_builds;	/* merged caches built */
+	atomic64_t readdir_ns;		/* time spent building them */
+	atomic64_t copy_up;		/* objects copied up */
+	atomic64_t copy_up_bytes;	/* file data copied up */
+	atomic64_t copy_up_ns;		/* time spent copying up */
+};
+
+extern struct ovl_stats ovl_stats;
+
 static inline int ovl_do_rmdir(struct inode *dir, struct dentry *dentry)
 {
 	int err = vfs_rmdir(dir, dentry);
@@ -155,6 +169,7 @@ extern const struct file_operations ovl_dir_operations;
 int ovl_check_empty_dir(struct dentry *dentry, struct list_head *list);
 void ovl_cleanup_whiteouts(struct dentry *upper, struct list_head *list);
 void ovl_cache_free(struct list_head *list);
+void ovl_dir_cache_free(struct ovl_dir_cache *cache);
 
 /* inode.c */
 int ovl_setattr(struct dentry *dentry, struct iattr *attr);
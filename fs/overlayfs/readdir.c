@@ -15,6 +15,7 @@
 #include <linux/rbtree.h>
 #include <linux/security.h>
 #include <linux/cred.h>
+#include <linux/ktime.h>
 #include "overlayfs.h"
 
 struct ovl_cache_entry {
@@ -28,9 +29,27 @@ struct ovl_cache_entry {
 	char name[];
 };
 
+/*
+ * What a layer directory looked like when the merged cache was built.
+ * ctime moves on every entry change, and unlike mtime it cannot be set
+ * back, not even by copy up restoring the parent's timestamps.
+ */
+struct ovl_layer_stamp {
+	unsigned long ino;
+	struct timespec ctime;
+};
+
+/*
+ * The merged cache stays on the dentry after the last close and is
+ * reused while the overlay version and both layer stamps match.  It is
+ * freed with the dentry, or by the last user once it has been replaced.
+ */
 struct ovl_dir_cache {
 	long refcount;
 	u64 version;
+	bool keep;
+	struct ovl_layer_stamp upper;
+	struct ovl_layer_stamp lower;
 	struct list_head entries;
 };
 
@@ -164,6 +183,51 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
+void ovl_dir_cache_free(struct ovl_dir_cache *cache)
+{
+	ovl_cache_free(&cache->entries);
+	kfree(cache);
+}
+
+/*
+ * Returns false if the directory changed in the same timestamp tick as
+ * @now, in which case a later change could go unnoticed.
+ */
+static bool ovl_layer_stamp_get(struct dentry *realdir,
+				struct ovl_layer_stamp *stamp,
+				struct timespec *now)
+{
+	struct inode *inode;
+
+	if (!realdir)
+		return false;
+	inode = realdir->d_inode;
+	stamp->ino = inode->i_ino;
+	stamp->ctime = inode->i_ctime;
+	if (now)
+		*now = current_fs_time(inode->i_sb);
+	return !now || !timespec_equal(&stamp->ctime, now);
+}
+
+static bool ovl_layer_stamp_match(struct dentry *realdir,
+				  struct ovl_layer_stamp *stamp)
+{
+	struct ovl_layer_stamp cur;
+
+	if (!realdir)
+		return false;
+	ovl_layer_stamp_get(realdir, &cur, NULL);
+	return cur.ino == stamp->ino &&
+	       timespec_equal(&cur.ctime, &stamp->ctime);
+}
+
+static bool ovl_cache_valid(struct dentry *dentry, struct ovl_dir_cache *cache)
+{
+	return ovl_dentry_version_get(dentry) == cache->version &&
+	       ovl_layer_stamp_match(ovl_dentry_upper(dentry), &cache->upper) &&
+	       ovl_layer_stamp_match(ovl_dentry_lower(dentry), &cache->lower);
+}
+
 static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 {
 	struct ovl_dir_cache *cache = od->cache;
@@ -172,11 +236,12 @@ static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(dentry) == cache)
+		if (ovl_dir_cache(dentry) == cache) {
+			if (cache->keep)
+				return;
 			ovl_set_dir_cache(dentry, NULL);
-
-		ovl_cache_free(&cache->entries);
-		kfree(cache);
+		}
+		ovl_dir_cache_free(cache);
 	}
 }
 
@@ -222,7 +287,7 @@ static void ovl_dir_reset(struct file *file)
 	struct dentry *dentry = file->f_path.dentry;
 	enum ovl_path_type type = ovl_path_type(dentry);
 
-	if (cache && ovl_dentry_version_get(dentry) != cache->version) {
+	if (cache && !ovl_cache_valid(dentry, cache)) {
 		ovl_cache_put(od, dentry);
 		od->cache = NULL;
 	}
@@ -333,12 +398,18 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
 	struct ovl_dir_cache *cache;
+	struct timespec now;
+	u64 start;
 
 	cache = ovl_dir_cache(dentry);
-	if (cache && ovl_dentry_version_get(dentry) == cache->version) {
+	if (cache && ovl_cache_valid(dentry, cache)) {
 		cache->refcount++;
+		atomic64_inc(&ovl_stats.readdir_hits);
 		return cache;
 	}
+	/* An unused stale cache has nobody left to free it */
+	if (cache && !cache->refcount)
+		ovl_dir_cache_free(cache);
 	ovl_set_dir_cache(dentry, NULL);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
@@ -348,14 +419,23 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	cache->refcount = 1;
 	INIT_LIST_HEAD(&cache->entries);
 
+	/* Stamp before reading so that changes while reading are seen */
+	cache->version = ovl_dentry_version_get(dentry);
+	cache->keep = ovl_layer_stamp_get(ovl_dentry_upper(dentry),
+					  &cache->upper, &now);
+	cache->keep &= ovl_layer_stamp_get(ovl_dentry_lower(dentry),
+					   &cache->lower, &now);
+
+	start = ktime_get_ns();
 	res = ovl_dir_read_merged(dentry, &cache->entries);
 	if (res) {
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
 		return ERR_PTR(res);
 	}
+	atomic64_inc(&ovl_stats.readdir_builds);
+	atomic64_add(ktime_get_ns() - start, &ovl_stats.readdir_ns);
 
-	cache->version = ovl_dentry_version_get(dentry);
 	ovl_set_dir_cache(dentry, cache);
 
 	return cache;
@@ -18,6 +18,7 @@
 #include <linux/sched.h>
 #include <linux/statfs.h>
 #include <linux/seq_file.h>
+#include <linux/debugfs.h>
 #include "overlayfs.h"
 
 MODULE_AUTHOR("Miklos Szeredi <miklos@szeredi.hu>");
@@ -60,6 +61,9 @@ struct ovl_entry {
 
 const char *ovl_opaque_xattr = "trusted.overlay.opaque";
 
+struct ovl_stats ovl_stats;
+static struct dentry *ovl_debugfs_root;
+
 
 enum ovl_path_type ovl_path_type(struct dentry *dentry)
 {
@@ -261,6 +265,8 @@ static void ovl_dentry_release(struct dentry *dentry)
 	struct ovl_entry *oe = dentry->d_fsdata;
 
 	if (oe) {
+		if (oe->cache)
+			ovl_dir_cache_free(oe->cache);
 		dput(oe->__upperdentry);
 		dput(oe->lowerdentry);
 		kfree_rcu(oe, rcu);
@@ -842,13 +848,56 @@ static struct file_system_type ovl_fs_type = {
 };
 MODULE_ALIAS_FS("overlay");
 
+static int ovl_stats_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "readdir_hits %lld\n",
+		   (long long)atomic64_read(&ovl_stats.readdir_hits));
+	seq_printf(m, "readdir_builds %lld\n",
+		   (long long)atomic64_read(&ovl_stats.readdir_builds));
+	seq_printf(m, "readdir_build_us %lld\n",
+		   (long long)atomic64_read(&ovl_stats.readdir_ns) /
+		   NSEC_PER_USEC);
+	seq_printf(m, "copy_up %lld\n",
+		   (long long)atomic64_read(&ovl_stats.copy_up));
+	seq_printf(m, "copy_up_bytes %lld\n",
+		   (long long)atomic64_read(&ovl_stats.copy_up_bytes));
+	seq_printf(m, "copy_up_us %lld\n",
+		   (long long)atomic64_read(&ovl_stats.copy_up_ns) /
+		   NSEC_PER_USEC);
+	return 0;
+}
+
+static int ovl_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ovl_stats_show, NULL);
+}
+
+static const struct file_operations ovl_stats_fops = {
+	.open		= ovl_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init ovl_init(void)
 {
-	return register_filesystem(&ovl_fs_type);
+	int err;
+
+	err = register_filesystem(&ovl_fs_type);
+	if (err)
+		return err;
+
+	/* The counters are best effort: no debugfs is not an error */
+	ovl_debugfs_root = debugfs_create_dir("overlayfs", NULL);
+	if (!IS_ERR_OR_NULL(ovl_debugfs_root))
+		debugfs_create_file("stats", S_IRUGO, ovl_debugfs_root, NULL,
+				    &ovl_stats_fops);
+	return 0;
 }
 
 static void __exit ovl_exit(void)
 {
+	debugfs_remove_recursive(ovl_debugfs_root);
 	unregister_filesystem(&ovl_fs_type);
 }
 
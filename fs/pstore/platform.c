@@ -28,7 +28,12 @@
 #include <linux/console.h>
 #include <linux/module.h>
 #include <linux/pstore.h>
+#ifdef CONFIG_PSTORE_ZSTD_COMPRESS
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+#else
 #include <linux/zlib.h>
+#endif
 #include <linux/string.h>
 #include <linux/timer.h>
 #include <linux/slab.h>
@@ -69,10 +74,16 @@ struct pstore_info *psinfo;
 static char *backend;
 
 /* Compression parameters */
+#ifdef CONFIG_PSTORE_ZSTD_COMPRESS
+#define COMPR_LEVEL ZSTD_DEFAULT_CLEVEL
+static void *workspace;
+static size_t workspace_sz;
+#else
 #define COMPR_LEVEL 6
 #define WINDOW_BITS 12
 #define MEM_LEVEL 4
 static struct z_stream_s stream;
+#endif
 
 static char *big_oops_buf;
 static size_t big_oops_buf_sz;
@@ -129,6 +140,31 @@ bool pstore_cannot_block_path(enum kmsg_dump_reason reason)
 }
 EXPORT_SYMBOL_GPL(pstore_cannot_block_path);
 
+#ifdef CONFIG_PSTORE_ZSTD_COMPRESS
+static int pstore_compress(const void *in, void *out, size_t inlen,
+							size_t outlen)
+{
+	int err;
+
+	err = zstd_compress(in, inlen, out, &outlen, workspace, workspace_sz,
+			    COMPR_LEVEL);
+	if (err || outlen >= inlen)
+		return -EIO;
+
+	return outlen;
+}
+
+static int pstore_decompress(void *in, void *out, size_t inlen, size_t outlen)
+{
+	int err;
+
+	err = zstd_decompress(in, inlen, out, &outlen, workspace, workspace_sz);
+	if (err)
+		return -EIO;
+
+	return outlen;
+}
+#else
 /* Derived from logfs_compress() */
 static int pstore_compress(const void *in, void *out, size_t inlen,
 							size_t outlen)
@@ -193,6 +229,7 @@ static int pstore_decompress(void *in, void *out, size_t inlen, size_t outlen)
 error:
 	return ret;
 }
+#endif
 
 static void allocate_buf_for_compression(void)
 {
@@ -222,17 +259,30 @@ static void allocate_buf_for_compression(void)
 	big_oops_buf_sz = (psinfo->bufsize * 100) / cmpr;
 	big_oops_buf = kmalloc(big_oops_buf_sz, GFP_KERNEL);
 	if (big_oops_buf) {
+#ifdef CONFIG_PSTORE_ZSTD_COMPRESS
+		size = max(zstd_compress_workspace_size(COMPR_LEVEL,
+							big_oops_buf_sz),
+			zstd_decompress_workspace_size(big_oops_buf_sz));
+		workspace = vmalloc(size);
+		workspace_sz = workspace ? size : 0;
+		if (!workspace) {
+#else
 		size = max(zlib_deflate_workspacesize(WINDOW_BITS, MEM_LEVEL),
 			zlib_inflate_workspacesize());
 		stream.workspace = kmalloc(size, GFP_KERNEL);
 		if (!stream.workspace) {
+#endif
 			pr_err("No memory for compression workspace; skipping compression\n");
 			kfree(big_oops_buf);
 			big_oops_buf = NULL;
 		}
 	} else {
 		pr_err("No memory for uncompressed data; skipping compression\n");
+#ifdef CONFIG_PSTORE_ZSTD_COMPRESS
+		workspace = NULL;
+#else
 		stream.workspace = NULL;
+#endif
 	}
 
 }
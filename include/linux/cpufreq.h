@@ -115,6 +115,17 @@ struct cpufreq_policy {
 	wait_queue_head_t	transition_wait;
 	struct task_struct	*transition_task; /* Task which is doing the transition */
 
+	/*
+	 * Fast switch flags:
+	 * - fast_switch_possible should be set by the driver if it can
+	 *   guarantee that frequency can be changed on any CPU sharing the
+	 *   policy and that the change will affect all of the policy CPUs then.
+	 * - fast_switch_enabled is to be set by governors that support fast
+	 *   frequency switching with the help of cpufreq_enable_fast_switch().
+	 */
+	bool			fast_switch_possible;
+	bool			fast_switch_enabled;
+
 	/* For cpufreq driver's internal use */
 	void			*driver_data;
 };
@@ -240,6 +251,14 @@ struct cpufreq_driver {
 				  unsigned int relation);	/* Deprecated */
 	int		(*target_index)(struct cpufreq_policy *policy,
 					unsigned int index);
+	/*
+	 * Only for drivers that set policy->fast_switch_possible.  Called
+	 * with interrupts disabled from scheduler context, so it must not
+	 * sleep; it returns the frequency actually set, or 0 on failure.
+	 * No transition notifiers are sent for fast switches.
+	 */
+	unsigned int	(*fast_switch)(struct cpufreq_policy *policy,
+				       unsigned int target_freq);
 	/*
 	 * Only for drivers with target_index() and CPUFREQ_ASYNC_NOTIFICATION
 	 * unset.
@@ -485,6 +504,10 @@ int cpufreq_driver_target(struct cpufreq_policy *policy,
 int __cpufreq_driver_target(struct cpufreq_policy *policy,
 				   unsigned int target_freq,
 				   unsigned int relation);
+void cpufreq_enable_fast_switch(struct cpufreq_policy *policy);
+void cpufreq_disable_fast_switch(struct cpufreq_policy *policy);
+unsigned int cpufreq_driver_fast_switch(struct cpufreq_policy *policy,
+					unsigned int target_freq);
 int cpufreq_register_governor(struct cpufreq_governor *governor);
 void cpufreq_unregister_governor(struct cpufreq_governor *governor);
 
@@ -654,6 +677,16 @@ void acct_update_power(struct task_struct *p, cputime_t cputime);
 void cpufreq_task_stats_init(struct task_struct *p);
 void cpufreq_task_stats_exit(struct task_struct *p);
 void cpufreq_task_stats_remove_uids(uid_t uid_start, uid_t uid_end);
+#ifdef CONFIG_CPU_FREQ_STAT
+int cpufreq_stats_get_time_in_state(unsigned int cpu, unsigned int *freqs,
+				    u64 *time, unsigned int max);
+#else
+static inline int cpufreq_stats_get_time_in_state(unsigned int cpu,
+			unsigned int *freqs, u64 *time, unsigned int max)
+{
+	return 0;
+}
+#endif
 
 struct pid_namespace;
 int  proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
@@ -33,6 +33,9 @@ struct cpuidle_state_usage {
 	unsigned long long	disable;
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	unsigned long long	hits;	/* residency fit this state */
+	unsigned long long	above;	/* too short: a shallower state fit */
+	unsigned long long	below;	/* long enough for a deeper state */
 };
 
 struct cpuidle_state {
@@ -125,6 +125,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -269,7 +270,10 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__u32	s_padding[41];
+/* 0x00F8 */
+	__be32	s_num_fc_blks;		/* Nr of blocks for fast commits */
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -294,6 +298,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
@@ -302,7 +307,54 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
+
+/*
+ * Fast commits
+ *
+ * With INCOMPAT_FAST_COMMIT the last s_num_fc_blks blocks of the journal
+ * are kept out of the log.  An fsync that only changed a few inodes can
+ * then log the changes as inode deltas there instead of committing the
+ * running transaction.  Each fast commit block starts with a
+ * journal_header_t of type JBD2_FC_BLOCK whose sequence is the tid of
+ * the running transaction, followed by records that never cross a block
+ * boundary.  A record with fc_tag 0 ends the block.  The last block of a
+ * fast commit ends with a JBD2_FC_TAG_TAIL record holding a checksum of
+ * every byte of the fast commit before it.
+ *
+ * Recovery replays the fast commits of the transaction that follows the
+ * last complete one, in order, up to the first one that is incomplete.
+ */
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS	256
+
+#define JBD2_FC_TAG_INODE	1
+#define JBD2_FC_TAG_TAIL	2
+
+struct jbd2_fc_tl {
+	__be16		fc_tag;
+	__be16		fc_len;		/* bytes of value after this header */
+};
+
+struct jbd2_fc_range {
+	__be32		fr_lblk;
+	__be32		fr_len;
+	__be64		fr_pblk;	/* 0 if the range was punched out */
+};
+
+struct jbd2_fc_inode {
+	__be64		fi_ino;
+	__be64		fi_size;
+	__be64		fi_mtime_sec;
+	__be32		fi_mtime_nsec;
+	__be32		fi_nr_ranges;
+	struct jbd2_fc_range fi_ranges[0];
+};
+
+struct jbd2_fc_tail {
+	__be32		ft_tid;
+	__be32		ft_checksum;
+};
 
 #ifdef __KERNEL__
 
@@ -646,6 +698,12 @@ struct transaction_s
 	/* Disk flush needs to be sent to fs partition [no locking] */
 	int			t_need_data_flush;
 
+	/*
+	 * The transaction has changes that fast commits cannot describe,
+	 * fsync must commit it in full [j_state_lock]
+	 */
+	unsigned int		t_fc_ineligible:1;
+
 	/*
 	 * For use by the filesystem to store fs-specific data
 	 * structures associated with the transaction
@@ -664,11 +722,20 @@ struct transaction_run_stats_s {
 	__u32			rs_handle_count;
 	__u32			rs_blocks;
 	__u32			rs_blocks_logged;
+	__u32			rs_blocks_parallel;
+
+	/* Commit phases, in nanoseconds */
+	u64			rs_submit_ns;
+	u64			rs_data_wait_ns;
+	u64			rs_log_wait_ns;
+	u64			rs_commit_ns;
 };
 
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	unsigned long		ts_requested;
+	unsigned long		ts_fc_commits;	/* fsyncs done by fast commit */
+	unsigned long		ts_fc_fallbacks; /* ... and by a full commit */
 	struct transaction_run_stats_s run;
 };
 
@@ -683,6 +750,24 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/*
+ * In-memory form of a fast commit record: the new size and mtime of an
+ * inode and the ranges of its block map that changed.
+ */
+#define JBD2_FC_MAX_RANGES	8
+
+struct jbd2_fc_inode_delta {
+	u64			ino;
+	loff_t			size;
+	struct timespec		mtime;
+	unsigned int		nr_ranges;
+	struct {
+		u32		lblk;
+		u32		len;
+		u64		pblk;	/* 0 if the range was punched out */
+	} ranges[JBD2_FC_MAX_RANGES];
+};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -743,6 +828,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbuf: array of buffer_heads for jbd2_journal_commit_transaction
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
+ * @j_wtag: the descriptor tag of each buffer in j_wbuf
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
@@ -751,6 +837,17 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
  * @j_private: An opaque pointer to fs-private information.
+ * @j_fc_first: first block of the fast commit area
+ * @j_fc_off: blocks of the fast commit area used by the running transaction
+ * @j_fc_start_off: value of j_fc_off when the current fast commit began
+ * @j_fc_bh: fast commit block being filled
+ * @j_fc_bh_off: write offset in j_fc_bh
+ * @j_fc_csum: running checksum of the current fast commit
+ * @j_fc_tid: transaction the current fast commit belongs to
+ * @j_fc_bufs: fast commit blocks submitted and not yet waited for
+ * @j_fc_wait: Wait queue to wait for a fast commit to finish
+ * @j_fc_replay: called by recovery for every inode delta found in the
+ *	fast commit area
  */
 
 struct journal_s
@@ -946,6 +1043,7 @@ struct journal_s
 	 * array of bhs for jbd2_journal_commit_transaction
 	 */
 	struct buffer_head	**j_wbuf;
+	journal_block_tag_t	**j_wtag;
 	int			j_wbufsize;
 
 	/*
@@ -993,6 +1091,31 @@ struct journal_s
 
 	/* Precomputed journal UUID checksum for seeding other checksums */
 	__u32 j_csum_seed;
+
+	/*
+	 * Fast commit area, blocks j_fc_first up to j_maxlen, and the
+	 * part of it used since the last full commit [j_state_lock]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_off;
+
+	/*
+	 * The fast commit being written.  Owned by whoever set
+	 * JBD2_FAST_COMMIT_ONGOING.
+	 */
+	unsigned long		j_fc_start_off;
+	struct buffer_head	*j_fc_bh;
+	unsigned int		j_fc_bh_off;
+	__u32			j_fc_csum;
+	tid_t			j_fc_tid;
+	struct list_head	j_fc_bufs;
+
+	/* Wait queue for JBD2_FAST_COMMIT_ONGOING to clear */
+	wait_queue_head_t	j_fc_wait;
+
+	/* Applies an inode delta found in the fast commit area */
+	int			(*j_fc_replay)(journal_t *journal,
+				const struct jbd2_fc_inode_delta *delta);
 };
 
 /*
@@ -1008,6 +1131,8 @@ struct journal_s
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* A fast commit is being
+						 * written */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1041,6 +1166,7 @@ void jbd2_update_log_tail(journal_t *journal, tid_t tid, unsigned long block);
 
 /* Commit management */
 extern void jbd2_journal_commit_transaction(journal_t *);
+extern struct workqueue_struct *jbd2_commit_wq;
 
 /* Checkpoint list management */
 void __jbd2_journal_clean_checkpoint_list(journal_t *journal, bool destroy);
@@ -1175,6 +1301,17 @@ extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
 extern void	   jbd2_journal_init_jbd_inode(struct jbd2_inode *jinode, struct inode *inode);
 extern void	   jbd2_journal_release_jbd_inode(journal_t *journal, struct jbd2_inode *jinode);
 
+/* Fast commits */
+extern int	   jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks);
+extern int	   jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+extern int	   jbd2_fc_log_inode(journal_t *journal,
+				     const struct jbd2_fc_inode_delta *delta);
+extern int	   jbd2_fc_end_commit(journal_t *journal);
+extern int	   jbd2_fc_end_commit_fallback(journal_t *journal);
+extern void	   jbd2_fc_mark_ineligible(handle_t *handle);
+extern __u32	   jbd2_fc_csum(journal_t *journal, __u32 crc,
+				const void *buf, unsigned int len);
+
 /*
  * journal_head management
  */
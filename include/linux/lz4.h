@@ -9,7 +9,50 @@
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
  */
-#define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned char *))
+#include <linux/types.h>
+
+/*
+ * LZ4_MEMORY_USAGE : log2 of the compressor hash table size in bytes.
+ * 14 gives a 16KB table, which fits in L1 on most cores.
+ */
+#define LZ4_MEMORY_USAGE	14
+#define LZ4_HASHLOG		(LZ4_MEMORY_USAGE - 2)
+#define LZ4_HASH_SIZE_U32	(1 << LZ4_HASHLOG)
+
+/*
+ * LZ4_ACCELERATION_DEFAULT : acceleration factor used by lz4_compress().
+ * Each successive value skips more input while searching for matches,
+ * trading roughly 3% ratio for 3% speed per step.
+ */
+#define LZ4_ACCELERATION_DEFAULT	1
+#define LZ4_ACCELERATION_MAX		65537
+
+/*
+ * struct lz4_stream - compression state, also usable for streaming
+ * Must be reset with lz4_reset_stream() (or zeroed) before first use.
+ * Fields are private to lib/lz4.
+ */
+struct lz4_stream {
+	u32 hashtable[LZ4_HASH_SIZE_U32];
+	u32 current_offset;
+	u32 init_check;
+	const u8 *dictionary;
+	u32 dict_size;
+};
+
+/*
+ * struct lz4_stream_decode - decompression state for linked blocks
+ * Initialise with lz4_set_stream_decode() before first use.
+ * Fields are private to lib/lz4.
+ */
+struct lz4_stream_decode {
+	const u8 *external_dict;
+	size_t ext_dict_size;
+	const u8 *prefix_end;
+	size_t prefix_size;
+};
+
+#define LZ4_MEM_COMPRESS	sizeof(struct lz4_stream)
 #define LZ4HC_MEM_COMPRESS	(65538 * sizeof(unsigned char *))
 
 /*
@@ -39,6 +82,26 @@ static inline size_t lz4_compressbound(size_t isize)
 int lz4_compress(const unsigned char *src, size_t src_len,
 		unsigned char *dst, size_t *dst_len, void *wrkmem);
 
+/*
+ * lz4_compress_fast()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : on input, the capacity of 'dst'; on success, the size
+ *		of the compressed data
+ *	workmem : address of the working memory.
+ *		This requires 'workmem' of size LZ4_MEM_COMPRESS.
+ *	acceleration : LZ4_ACCELERATION_DEFAULT gives the best ratio,
+ *		larger values compress faster but less; values < 1 are
+ *		treated as LZ4_ACCELERATION_DEFAULT.
+ *	return  : Success if return 0
+ *		  Error if return (< 0), including when the compressed
+ *		  data does not fit in 'dst_len' bytes
+ */
+int lz4_compress_fast(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem,
+		int acceleration);
+
  /*
   * lz4hc_compress()
   *	 src	 : source address of the original data
@@ -81,7 +144,58 @@ int lz4_decompress(const unsigned char *src, size_t *src_len,
  *	return  : Success if return 0
  *		  Error if return (< 0)
  *	note :  Destination buffer must be already allocated.
+ *		Malformed input never makes the decoder read or write
+ *		outside of the given buffers.
  */
 int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
 		unsigned char *dest, size_t *dest_len);
+
+/*
+ * Streaming compression
+ *
+ * lz4_reset_stream() prepares a stream for a new, independent sequence of
+ * blocks.  lz4_load_dict() primes it with up to 64KB of dictionary data and
+ * returns the number of dictionary bytes retained.
+ *
+ * lz4_compress_fast_continue() compresses a block that may reference the
+ * previously compressed blocks (or the dictionary).  The previous 64KB of
+ * input must remain accessible and unmodified at the same address, or be
+ * moved out of the way with lz4_save_dict() beforehand.  'dst_len' is the
+ * capacity of 'dst' on input and the compressed size on success.
+ *
+ * lz4_save_dict() copies up to 'max_dict_size' bytes of history into
+ * 'safe_buffer' so that the input buffer can be reused, and returns the
+ * number of bytes saved.
+ */
+void lz4_reset_stream(struct lz4_stream *stream);
+int lz4_load_dict(struct lz4_stream *stream, const unsigned char *dict,
+		size_t dict_size);
+int lz4_compress_fast_continue(struct lz4_stream *stream,
+		const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, int acceleration);
+int lz4_save_dict(struct lz4_stream *stream, unsigned char *safe_buffer,
+		size_t max_dict_size);
+
+/*
+ * Streaming and dictionary decompression
+ *
+ * lz4_set_stream_decode() starts decoding a sequence of linked blocks,
+ * optionally with the same dictionary that was given to lz4_load_dict().
+ * lz4_decompress_safe_continue() then decodes each block in order; blocks
+ * decoded earlier must remain accessible at the same address (up to 64KB).
+ *
+ * lz4_decompress_safe_usingdict() decodes a single block that was
+ * compressed against 'dict'.
+ *
+ * 'dest_len' is the capacity of 'dest' on input and the decoded size on
+ * success.  All return 0 on success and < 0 on malformed input.
+ */
+int lz4_set_stream_decode(struct lz4_stream_decode *stream,
+		const unsigned char *dict, size_t dict_size);
+int lz4_decompress_safe_continue(struct lz4_stream_decode *stream,
+		const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+int lz4_decompress_safe_usingdict(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len,
+		const unsigned char *dict, size_t dict_size);
 #endif
@@ -382,6 +382,16 @@ struct mmc_devfeq_clk_scaling {
 	bool		enable;
 };
 
+/*
+ * A context on whose behalf the host can be claimed.  Claims made with the
+ * same context nest, whichever task makes them, so that e.g. a block queue
+ * can hold the host across requests dispatched and completed by different
+ * tasks.  Plain claims use the host's default context and nest per task.
+ */
+struct mmc_ctx {
+	struct task_struct *task;	/* task the claims are made from */
+};
+
 struct mmc_host {
 	struct device		*parent;
 	struct device		class_dev;
@@ -537,7 +547,8 @@ struct mmc_host {
 	struct mmc_card		*card;		/* device attached to this host */
 
 	wait_queue_head_t	wq;
-	struct task_struct	*claimer;	/* task that has host claimed */
+	struct mmc_ctx		*claimer;	/* context that has host claimed */
+	struct mmc_ctx		default_ctx;	/* context of task claims */
 	struct task_struct	*suspend_task;
 	int			claim_cnt;	/* "claim" nesting count */
 
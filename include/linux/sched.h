@@ -1327,6 +1327,19 @@ enum perf_event_task_context {
 	perf_nr_task_contexts,
 };
 
+#ifdef CONFIG_UID_SYS_STATS
+/*
+ * What drivers/misc/uid_sys_stats.c last charged to the task's UID.  A
+ * copy inherited through fork is recognised by @owner and starts over.
+ */
+struct uid_stats_snapshot {
+	struct task_struct *owner;
+	cputime_t utime, stime;
+	unsigned long long power;
+	u64 read_bytes, write_bytes, rchar, wchar, fsync;
+};
+#endif
+
 struct task_struct {
 	volatile long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
 	void *stack;
@@ -1483,6 +1496,9 @@ struct task_struct {
 	atomic64_t *time_in_state;
 	unsigned int max_states;
 	unsigned long long cpu_power;
+#ifdef CONFIG_UID_SYS_STATS
+	struct uid_stats_snapshot uid_stats_last;
+#endif
 #ifndef CONFIG_VIRT_CPU_ACCOUNTING_NATIVE
 	struct cputime prev_cputime;
 #endif
@@ -2059,6 +2075,38 @@ static inline void sched_get_cpus_busy(struct sched_load *busy,
 static inline void sched_set_io_is_busy(int val) {};
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Scheduler hook for CPU frequency governors.  The scheduler calls
+ * cpufreq_update_util() on a CPU whenever that CPU's utilization changes,
+ * with preemption disabled; @util is ULONG_MAX while RT or deadline tasks
+ * want the highest frequency.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data,
+		     u64 time, unsigned long util, unsigned long max);
+};
+
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+			void (*func)(struct update_util_data *data, u64 time,
+				     unsigned long util, unsigned long max));
+void cpufreq_remove_update_util_hook(int cpu);
+void cpufreq_update_util(u64 time, unsigned long util, unsigned long max);
+#else
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max) { }
+#endif
+
+#ifdef CONFIG_UID_SYS_STATS
+/*
+ * Charges what @task used since its last tick to its UID.  Called from
+ * acct_update_power() with @task running on this CPU.
+ */
+void uid_sys_stats_tick(struct task_struct *task);
+#else
+static inline void uid_sys_stats_tick(struct task_struct *task) { }
+#endif
+
 /*
  * Per process flags
  */
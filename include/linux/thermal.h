@@ -346,6 +346,13 @@ struct thermal_zone_params {
 	/* threshold below which the error is no longer accumulated */
 	s32 integral_cutoff;
 
+	/*
+	 * Number of passive polling periods the power allocator looks
+	 * ahead with its thermal model.  0 leaves the proportional term
+	 * of the PID controller in charge.
+	 */
+	s32 prediction_horizon;
+
 	/*
 	 * @slope:	slope of a linear temperature adjustment curve.
 	 * 		Used by thermal zone drivers.
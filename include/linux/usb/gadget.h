@@ -133,7 +133,9 @@ struct gsi_channel_info {
  *	until the completion function returns, so that any transfers
  *	invalidated by the error may first be dequeued.
  * @context: For use by the completion callback
- * @list: For use by the gadget driver.
+ * @list: For use by the gadget driver.  Chains of requests passed to
+ *	usb_ep_queue_list(), or given back through the endpoint's
+ *	complete_list(), are linked through it.
  * @status: Reports completion code, zero or a negative errno.
  *	Normally, faults block the transfer queue from advancing until
  *	the completion callback returns.
@@ -211,6 +213,8 @@ struct usb_ep_ops {
 
 	int (*queue) (struct usb_ep *ep, struct usb_request *req,
 		gfp_t gfp_flags);
+	int (*queue_list) (struct usb_ep *ep, struct list_head *reqs,
+		gfp_t gfp_flags);
 	int (*dequeue) (struct usb_ep *ep, struct usb_request *req);
 
 	int (*set_halt) (struct usb_ep *ep, int value);
@@ -248,6 +252,11 @@ struct usb_ep_ops {
  * @ep_intr_num: Interrupter number for EP.
  * @endless: In case where endless transfer is being initiated, this is set
  *	to disable usb event interrupt for few events.
+ * @complete_list: Optional, set by the gadget driver.  Controllers that
+ *	complete several requests at once hand them to this function in one
+ *	call, linked through their list fields, instead of calling each
+ *	request's completion.  The function must take every request off
+ *	the list.  Same context rules as a request's completion.
  *
  * the bus controller driver lists all the general purpose endpoints in
  * gadget->ep_list.  the control endpoint (gadget->ep0) is not in that list,
@@ -271,6 +280,8 @@ struct usb_ep {
 	u8			ep_num;
 	u8			ep_intr_num;
 	bool			endless;
+	void			(*complete_list)(struct usb_ep *ep,
+					struct list_head *reqs);
 };
 
 /*-------------------------------------------------------------------------*/
@@ -1329,6 +1340,13 @@ extern void usb_gadget_unmap_request(struct usb_gadget *gadget,
 
 /*-------------------------------------------------------------------------*/
 
+/* utility to queue a chain of requests in one call */
+
+extern int usb_ep_queue_list(struct usb_ep *ep, struct list_head *reqs,
+		gfp_t gfp_flags);
+
+/*-------------------------------------------------------------------------*/
+
 /* utility to set gadget state properly */
 
 extern void usb_gadget_set_state(struct usb_gadget *gadget,
@@ -1347,6 +1365,9 @@ extern void usb_gadget_udc_reset(struct usb_gadget *gadget,
 extern void usb_gadget_giveback_request(struct usb_ep *ep,
 		struct usb_request *req);
 
+extern void usb_gadget_giveback_list(struct usb_ep *ep,
+		struct list_head *reqs);
+
 
 /*-------------------------------------------------------------------------*/
 
@@ -233,6 +233,50 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s);
  */
 XZ_EXTERN void xz_dec_end(struct xz_dec *s);
 
+#if defined(__KERNEL__) && !defined(XZ_PREBOOT)
+/**
+ * xz_dec_mt_probe() - Check if a .xz file can be decoded block-parallel
+ * @in:         Beginning of the .xz file
+ * @in_size:    Size of the .xz file
+ * @out_size:   Total uncompressed size, taken from the Index
+ * @blocks:     Number of Blocks in the Stream
+ *
+ * Returns XZ_OK if in[0..in_size) holds exactly one Stream, optionally
+ * followed by Stream Padding, with a valid Stream Header, Index and
+ * Stream Footer. XZ_FORMAT_ERROR is returned if the buffer doesn't look
+ * like that, for example because it is followed by unrelated data; such
+ * input can still be decoded with xz_dec_run(). Other return values mean
+ * that the headers or the Index are corrupt or unsupported.
+ *
+ * Decoding spreads over at most as many threads as there are Blocks, so
+ * a Stream with a single Block gains nothing from xz_dec_mt_run().
+ */
+XZ_EXTERN enum xz_ret xz_dec_mt_probe(const uint8_t *in, size_t in_size,
+				      uint64_t *out_size, uint32_t *blocks);
+
+/**
+ * xz_dec_mt_run() - Decode a complete .xz file using several threads
+ * @b:          Input and output buffers. b->in[b->in_pos..b->in_size)
+ *              has to hold the whole file as described for
+ *              xz_dec_mt_probe(), and the output buffer has to have room
+ *              for all of the uncompressed data.
+ * @threads:    Maximum number of threads to use, including the calling
+ *              one. Zero means one per online CPU.
+ *
+ * The Blocks are decoded in single-call mode directly into their final
+ * place in the output buffer, so no dictionary needs to be allocated.
+ * On success, XZ_STREAM_END is returned, b->in_pos is set to b->in_size
+ * and b->out_pos is advanced by the uncompressed size. On failure,
+ * b->in_pos and b->out_pos are not modified and the contents of the
+ * output buffer are undefined. XZ_MEM_ERROR is returned if the decoder
+ * states cannot be allocated, XZ_BUF_ERROR if the output buffer is too
+ * small, and the other codes have the same meaning as for xz_dec_run().
+ *
+ * This function may sleep.
+ */
+XZ_EXTERN enum xz_ret xz_dec_mt_run(struct xz_buf *b, unsigned int threads);
+#endif
+
 /*
  * Standalone build (userspace build or in-kernel build for boot time use)
  * needs a CRC32 implementation. For normal in-kernel use, kernel's own
@@ -0,0 +1,96 @@
+#ifndef __ZSTD_H__
+#define __ZSTD_H__
+/*
+ * Zstandard Kernel Interface
+ *
+ * Single-shot compression and decompression of Zstandard frames
+ * (RFC 8878) with caller-provided, bounded working memory. Frames are
+ * produced without dictionary or checksum and always carry the content
+ * size; the decompressor accepts any dictionary-less frame, including
+ * checksummed, multi-frame and skippable-frame input.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+
+/*
+ * Compression levels trade search depth for speed. Level 1 is a greedy
+ * single-probe parser close to LZ4 in speed, the default is a good fit
+ * for zram pages and the top level is meant for write-once images.
+ */
+#define ZSTD_MIN_CLEVEL		1
+#define ZSTD_DEFAULT_CLEVEL	3
+#define ZSTD_MAX_CLEVEL		9
+
+/* Largest block a Zstandard frame may contain */
+#define ZSTD_BLOCKSIZE_MAX	(128 * 1024)
+
+/*
+ * zstd_compress_bound()
+ * Provides the maximum size that zstd_compress() may output in a
+ * "worst case" scenario (input data not compressible)
+ */
+static inline size_t zstd_compress_bound(size_t src_len)
+{
+	return src_len + (src_len >> 8) + 64;
+}
+
+/*
+ * zstd_compress_workspace_size()
+ *	level   : compression level, clamped to [ZSTD_MIN_CLEVEL, ZSTD_MAX_CLEVEL]
+ *	src_len : largest input that will be compressed with this workspace
+ *	return  : size of the working memory needed by zstd_compress()
+ *	note :  Tables are sized down for small inputs, so a workspace for
+ *		4KB pages is a few tens of KB whatever the level.
+ */
+size_t zstd_compress_workspace_size(int level, size_t src_len);
+
+/*
+ * zstd_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : is the input size of 'dst' and the output size of the
+ *		  compressed data, which is returned after compress done.
+ *		  A 'dst' of zstd_compress_bound(src_len) never fails.
+ *	wrkmem  : address of the working memory.
+ *	wrkmem_size : size of 'wrkmem', at least
+ *		  zstd_compress_workspace_size(level, src_len)
+ *	level   : compression level
+ *	return  : Success if return 0
+ *		  -ENOSPC if 'dst' is too small
+ *		  -EINVAL if 'wrkmem' is too small
+ */
+int zstd_compress(const unsigned char *src, size_t src_len,
+		  unsigned char *dst, size_t *dst_len,
+		  void *wrkmem, size_t wrkmem_size, int level);
+
+/*
+ * zstd_decompress_workspace_size()
+ *	dst_len : largest output that will be decompressed with this workspace
+ *	return  : size of the working memory needed by zstd_decompress()
+ */
+size_t zstd_decompress_workspace_size(size_t dst_len);
+
+/*
+ * zstd_decompress()
+ *	src     : source address of the compressed data
+ *	src_len : size of the compressed data
+ *	dst	: output buffer address of the decompressed data
+ *	dst_len : is the input size of 'dst' and the output size of the
+ *		  decompressed data, which is returned after decompress done.
+ *	wrkmem  : address of the working memory.
+ *	wrkmem_size : size of 'wrkmem', at least
+ *		  zstd_decompress_workspace_size(*dst_len)
+ *	return  : Success if return 0
+ *		  -ENOSPC if 'dst' is too small
+ *		  -EINVAL if 'wrkmem' is too small
+ *		  -EBADMSG if the input is corrupted or uses a dictionary
+ *	note :  This function is safe against malicious data.
+ */
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		    unsigned char *dst, size_t *dst_len,
+		    void *wrkmem, size_t wrkmem_size);
+#endif
@@ -89,6 +89,8 @@ void _p9_debug(enum p9_debug_flags level, const char *func,
  * @P9_RRENAME: rename response
  * @P9_TMKDIR: create a directory request
  * @P9_RMKDIR: create a directory response
+ * @P9_TINVALIDATE: wait for the server to change cached objects (extension)
+ * @P9_RINVALIDATE: response with the qids of the objects that changed
  * @P9_TVERSION: version handshake request
  * @P9_RVERSION: version handshake response
  * @P9_TAUTH: request to establish authentication channel
@@ -168,6 +170,8 @@ enum p9_msg_t {
 	P9_RRENAMEAT,
 	P9_TUNLINKAT = 76,
 	P9_RUNLINKAT,
+	P9_TINVALIDATE = 78,
+	P9_RINVALIDATE,
 	P9_TVERSION = 100,
 	P9_RVERSION,
 	P9_TAUTH = 102,
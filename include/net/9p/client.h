@@ -256,6 +256,8 @@ int p9_client_mkdir_dotl(struct p9_fid *fid, char *name, int mode,
 				kgid_t gid, struct p9_qid *);
 int p9_client_lock_dotl(struct p9_fid *fid, struct p9_flock *flock, u8 *status);
 int p9_client_getlock_dotl(struct p9_fid *fid, struct p9_getlock *fl);
+int p9_client_invalidate(struct p9_fid *fid, int16_t *nqids,
+			 struct p9_qid **qids);
 struct p9_req_t *p9_tag_lookup(struct p9_client *, u16);
 void p9_client_cb(struct p9_client *c, struct p9_req_t *req, int status);
 
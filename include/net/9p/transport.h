@@ -69,4 +69,7 @@ void v9fs_unregister_trans(struct p9_trans_module *m);
 struct p9_trans_module *v9fs_get_trans_by_name(char *s);
 struct p9_trans_module *v9fs_get_default_trans(void);
 void v9fs_put_trans(struct p9_trans_module *m);
+
+int p9_pin_account(int nr_pages);
+void p9_pin_release(int nr_pages);
 #endif /* NET_9P_TRANSPORT_H */
@@ -48,6 +48,8 @@
 			 { P9_RRENAMEAT,	"P9_RRENAMEAT" },	\
 			 { P9_TUNLINKAT,	"P9_TUNLINKAT" },	\
 			 { P9_RUNLINKAT,	"P9_RUNLINKAT" },	\
+			 { P9_TINVALIDATE,	"P9_TINVALIDATE" },	\
+			 { P9_RINVALIDATE,	"P9_RINVALIDATE" },	\
 			 { P9_TVERSION,		"P9_TVERSION" },	\
 			 { P9_RVERSION,		"P9_RVERSION" },	\
 			 { P9_TAUTH,		"P9_TAUTH" },		\
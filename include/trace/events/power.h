@@ -1051,9 +1051,10 @@ TRACE_EVENT(cache_hwmon_update,
 TRACE_EVENT(memlat_dev_meas,
 
 	TP_PROTO(const char *name, unsigned int dev_id, unsigned long inst,
-		 unsigned long mem, unsigned long freq, unsigned int ratio),
+		 unsigned long mem, unsigned long freq, unsigned int ratio,
+		 unsigned int stall),
 
-	TP_ARGS(name, dev_id, inst, mem, freq, ratio),
+	TP_ARGS(name, dev_id, inst, mem, freq, ratio, stall),
 
 	TP_STRUCT__entry(
 		__string(name, name)
@@ -1062,6 +1063,7 @@ TRACE_EVENT(memlat_dev_meas,
 		__field(unsigned long, mem)
 		__field(unsigned long, freq)
 		__field(unsigned int, ratio)
+		__field(unsigned int, stall)
 	),
 
 	TP_fast_assign(
@@ -1071,15 +1073,17 @@ TRACE_EVENT(memlat_dev_meas,
 		__entry->mem = mem;
 		__entry->freq = freq;
 		__entry->ratio = ratio;
+		__entry->stall = stall;
 	),
 
-	TP_printk("dev: %s, id=%u, inst=%lu, mem=%lu, freq=%lu, ratio=%u",
+	TP_printk("dev: %s, id=%u, inst=%lu, mem=%lu, freq=%lu, ratio=%u, stall=%u",
 		__get_str(name),
 		__entry->dev_id,
 		__entry->inst,
 		__entry->mem,
 		__entry->freq,
-		__entry->ratio)
+		__entry->ratio,
+		__entry->stall)
 );
 
 TRACE_EVENT(memlat_dev_update,
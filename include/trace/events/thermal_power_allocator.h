@@ -81,6 +81,30 @@ TRACE_EVENT(thermal_power_allocator_pid,
 		  __entry->tz_id, __entry->err, __entry->err_integral,
 		  __entry->p, __entry->i, __entry->d, __entry->output)
 );
+
+TRACE_EVENT(thermal_power_allocator_model,
+	TP_PROTO(struct thermal_zone_device *tz, s64 gain, s64 decay,
+		 int horizon, s64 power),
+	TP_ARGS(tz, gain, decay, horizon, power),
+	TP_STRUCT__entry(
+		__field(int, tz_id  )
+		__field(s64, gain   )
+		__field(s64, decay  )
+		__field(int, horizon)
+		__field(s64, power  )
+	),
+	TP_fast_assign(
+		__entry->tz_id = tz->id;
+		__entry->gain = gain;
+		__entry->decay = decay;
+		__entry->horizon = horizon;
+		__entry->power = power;
+	),
+
+	TP_printk("thermal_zone_id=%d gain=%lld decay=%lld horizon=%d power=%lld",
+		  __entry->tz_id, __entry->gain, __entry->decay,
+		  __entry->horizon, __entry->power)
+);
 #endif /* _TRACE_THERMAL_POWER_ALLOCATOR_H */
 
 /* This part must be outside protection */
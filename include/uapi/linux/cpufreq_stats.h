@@ -0,0 +1,38 @@
+#ifndef _UAPI_LINUX_CPUFREQ_STATS_H
+#define _UAPI_LINUX_CPUFREQ_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Binary format of /proc/uid_time_in_state_bin
+ *
+ * Every read starting at offset 0 takes a new snapshot.  The first snapshot
+ * of an open file holds every UID; later ones only hold the UIDs that were
+ * charged CPU time since the previous snapshot of the same file, so a
+ * reader that polls with pread(fd, buf, size, 0) only receives changes.
+ * Times are cumulative, not deltas.
+ *
+ * A snapshot is a header, then @nr_freqs frequencies in kHz, then @nr_uids
+ * records of @nr_freqs times each in clock ticks (USER_HZ).  A record for
+ * a UID may have fewer meaningful entries than @nr_freqs if it predates a
+ * frequency table change; those entries are zero.
+ */
+#define UID_TIME_IN_STATE_VERSION	1
+
+struct uid_time_in_state_header {
+	__u32 version;
+	__u32 nr_freqs;
+	__u32 nr_uids;
+	__u32 flags;
+};
+
+/* Set in @flags when the snapshot holds every UID, not only changed ones */
+#define UID_TIME_IN_STATE_FULL		0x1
+
+struct uid_time_in_state_record {
+	__u32 uid;
+	__u32 reserved;
+	__u64 time[0];
+};
+
+#endif /* _UAPI_LINUX_CPUFREQ_STATS_H */
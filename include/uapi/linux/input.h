@@ -162,6 +162,79 @@ struct input_keymap_entry {
 
 #define EVIOCSCLOCKID		_IOW('E', 0xa0, int)			/* Set clockid to be used for timestamps */
 
+/*
+ * Shared event ring
+ *
+ * Each event device keeps the events of its input device in one ring that
+ * all of its clients read from, each with its own cursor.  read() serves
+ * events from it, and the ring can also be mapped read-only with mmap() at
+ * offset 0 for EVIOCGRINGINFO's length.  The mapping starts with a struct
+ * evdev_ring_header, followed at @offset by @size struct evdev_ring_event
+ * entries, @size being a power of two.
+ *
+ * Positions in the ring are free running __u32 counters, the entry for
+ * position p being at index p & (size - 1).  @head is the position the next
+ * event will be written to and @packet_head the position after the last
+ * SYN_REPORT written; events up to it form complete packets.  Both are
+ * updated with release semantics and must be read with acquire semantics.
+ *
+ * The @seq of an entry is its position with EVDEV_RING_BUSY cleared, and
+ * has EVDEV_RING_BUSY set while the entry is being rewritten.  A reader at
+ * position p copies the entry and checks that @seq, read before and after
+ * the copy with a read barrier in between, equals p & ~EVDEV_RING_BUSY.
+ * If it does not, or @head - p exceeds @size, the reader has been lapped
+ * and should resume from @packet_head.
+ *
+ * While a client has grabbed the device, entries carry its EVIOCGRINGINFO
+ * @id in @grab and are meant for it only; @grab is 0 otherwise.  Other
+ * clients cannot map the ring during a grab: their mappings fault with
+ * SIGBUS and mmap() fails with EBUSY.  When the grab is released, the
+ * entries it left are overwritten and carry a @grab no client has.
+ * Entries carry both clocks; read() picks the one set with EVIOCSCLOCKID.
+ *
+ * Clients reading the mapping tell the kernel how far they got with
+ * EVIOCSRINGTAIL, which poll() and EVIOCSSUSPENDBLOCK go by.
+ */
+
+#define EVDEV_RING_VERSION	1
+#define EVDEV_RING_BUSY		0x80000000
+
+struct evdev_ring_header {
+	__u32 version;
+	__u32 size;
+	__u32 head;
+	__u32 packet_head;
+};
+
+struct evdev_ring_event {
+	__u32 seq;
+	__u32 grab;
+	__s64 mono_ns;
+	__s64 real_ns;
+	__u16 type;
+	__u16 code;
+	__s32 value;
+};
+
+/**
+ * struct evdev_ring_info - used by EVIOCGRINGINFO ioctl
+ * @version: EVDEV_RING_VERSION
+ * @size: number of entries in the ring
+ * @offset: offset of the first entry in the mapping
+ * @length: length of the mapping in bytes
+ * @id: identifier of this client in the @grab of ring entries
+ */
+struct evdev_ring_info {
+	__u32 version;
+	__u32 size;
+	__u32 offset;
+	__u32 length;
+	__u32 id;
+};
+
+#define EVIOCGRINGINFO		_IOR('E', 0xa2, struct evdev_ring_info)	/* get shared ring layout */
+#define EVIOCSRINGTAIL		_IOW('E', 0xa3, __u32)			/* set ring position read up to */
+
 /*
  * IDs.
  */
@@ -19,6 +19,8 @@
 #include <linux/syscalls.h>
 #include <linux/utime.h>
 #include <linux/initramfs.h>
+#include <linux/vmalloc.h>
+#include <linux/xz.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -447,6 +449,59 @@ static unsigned long my_inptr; /* index of next byte to be processed in inbuf */
 
 #include <linux/decompress/generic.h>
 
+#if defined(CONFIG_XZ_DEC_MT) && IS_BUILTIN(CONFIG_XZ_DEC)
+/*
+ * An xz archive made of several Blocks is decoded on all CPUs into one
+ * buffer, which is then handed to the cpio parser in a single flush.
+ * Returns false, without touching the archive state, if the data is not
+ * a lone multi-Block Stream or the buffer cannot be allocated, so that
+ * the caller falls back to the sequential decompressor.
+ */
+static bool __init unpack_xz_parallel(char *buf, unsigned long len,
+				      const char *compress_name)
+{
+	struct xz_buf b;
+	uint64_t out_size;
+	uint32_t blocks;
+	enum xz_ret ret;
+	u8 *out;
+
+	if (strcmp(compress_name, "xz"))
+		return false;
+
+	if (xz_dec_mt_probe(buf, len, &out_size, &blocks) != XZ_OK ||
+	    blocks < 2 || out_size == 0 || out_size > ULONG_MAX)
+		return false;
+
+	out = vmalloc(out_size);
+	if (!out)
+		return false;
+
+	b.in = buf;
+	b.in_pos = 0;
+	b.in_size = len;
+	b.out = out;
+	b.out_pos = 0;
+	b.out_size = out_size;
+
+	ret = xz_dec_mt_run(&b, 0);
+	if (ret == XZ_STREAM_END) {
+		pr_debug("Decoded %u xz blocks in parallel\n", blocks);
+		flush_buffer(out, b.out_pos);
+		my_inptr = b.in_pos;
+	}
+
+	vfree(out);
+	return ret == XZ_STREAM_END;
+}
+#else
+static inline bool unpack_xz_parallel(char *buf, unsigned long len,
+				      const char *compress_name)
+{
+	return false;
+}
+#endif
+
 static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 {
 	long written;
@@ -483,8 +538,11 @@ static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 		decompress = decompress_method(buf, len, &compress_name);
 		pr_debug("Detected %s compressed data\n", compress_name);
 		if (decompress) {
-			int res = decompress(buf, len, NULL, flush_buffer, NULL,
-				   &my_inptr, error);
+			int res = 0;
+
+			if (!unpack_xz_parallel(buf, len, compress_name))
+				res = decompress(buf, len, NULL, flush_buffer,
+						 NULL, &my_inptr, error);
 			if (res)
 				error("decompressor failed");
 		} else if (compress_name) {
@@ -36,408 +36,563 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/string.h>
 #include <linux/lz4.h>
 #include <asm/unaligned.h>
 #include "lz4defs.h"
 
-/*
- * LZ4_compressCtx :
- * -----------------
- * Compress 'isize' bytes from 'source' into an output buffer 'dest' of
- * maximum size 'maxOutputSize'.  * If it cannot achieve it, compression
- * will stop, and result of the function will be zero.
- * return : the number of bytes written in buffer 'dest', or 0 if the
- * compression fails
- */
-static inline int lz4_compressctx(void *ctx,
-		const char *source,
-		char *dest,
-		int isize,
-		int maxoutputsize)
+#define LZ4_HASH_SIZE_U16	(1 << (LZ4_HASHLOG + 1))
+
+static __always_inline u32 lz4_hash4(u32 sequence,
+				     enum lz4_table_type table_type)
 {
-	HTYPE *hashtable = (HTYPE *)ctx;
-	const u8 *ip = (u8 *)source;
+	if (table_type == LZ4_BY_U16)
+		return (sequence * 2654435761U) >>
+			((MINMATCH * 8) - (LZ4_HASHLOG + 1));
+
+	return (sequence * 2654435761U) >> ((MINMATCH * 8) - LZ4_HASHLOG);
+}
+
 #if LZ4_ARCH64
-	const BYTE * const base = ip;
+static __always_inline u32 lz4_hash5(u64 sequence)
+{
+	const u64 prime5bytes = 889523592379ULL;
+
+#ifdef __BIG_ENDIAN
+	return (u32)(((sequence >> 24) * prime5bytes) >> (64 - LZ4_HASHLOG));
 #else
-	const int base = 0;
+	return (u32)(((sequence << 24) * prime5bytes) >> (64 - LZ4_HASHLOG));
+#endif
+}
+#endif
+
+static __always_inline u32 lz4_hash_position(const void *p,
+					     enum lz4_table_type table_type)
+{
+#if LZ4_ARCH64
+	if (table_type == LZ4_BY_U32)
+		return lz4_hash5(lz4_read_arch(p));
 #endif
-	const u8 *anchor = ip;
-	const u8 *const iend = ip + isize;
+	return lz4_hash4(lz4_read32(p), table_type);
+}
+
+static __always_inline void lz4_put_position_on_hash(const u8 *p, u32 h,
+		void *table_base, enum lz4_table_type table_type,
+		const u8 *src_base)
+{
+	if (table_type == LZ4_BY_U16)
+		((u16 *)table_base)[h] = (u16)(p - src_base);
+	else
+		((u32 *)table_base)[h] = (u32)(p - src_base);
+}
+
+static __always_inline void lz4_put_position(const u8 *p, void *table_base,
+		enum lz4_table_type table_type, const u8 *src_base)
+{
+	u32 const h = lz4_hash_position(p, table_type);
+
+	lz4_put_position_on_hash(p, h, table_base, table_type, src_base);
+}
+
+static __always_inline const u8 *lz4_get_position_on_hash(u32 h,
+		void *table_base, enum lz4_table_type table_type,
+		const u8 *src_base)
+{
+	if (table_type == LZ4_BY_U16)
+		return ((u16 *)table_base)[h] + src_base;
+
+	return ((u32 *)table_base)[h] + src_base;
+}
+
+static __always_inline const u8 *lz4_get_position(const u8 *p,
+		void *table_base, enum lz4_table_type table_type,
+		const u8 *src_base)
+{
+	u32 const h = lz4_hash_position(p, table_type);
+
+	return lz4_get_position_on_hash(h, table_base, table_type, src_base);
+}
+
+/*
+ * lz4_compress_generic :
+ * ----------------------
+ * Compress 'input_size' bytes from 'source' into 'dest'.  All the
+ * directives are compile-time constants at every call site, so each
+ * caller gets a specialised copy of the loop.
+ * 'acceleration' widens the skip step used while no match is found.
+ * return : the number of bytes written in buffer 'dest', or 0 if the
+ * compression fails (output limit reached with 'limited_output' set)
+ */
+static __always_inline int lz4_compress_generic(struct lz4_stream *ctx,
+		const u8 *source, u8 *dest, int input_size,
+		int max_output_size, int limited_output,
+		enum lz4_table_type table_type, enum lz4_dict_type dict,
+		enum lz4_dict_issue dict_issue, u32 acceleration)
+{
+	const u8 *ip = source;
+	const u8 *base;
+	const u8 *low_limit;
+	const u8 *const low_ref_limit = ip - ctx->dict_size;
+	const u8 *const dictionary = ctx->dictionary;
+	const u8 *const dict_end = dictionary + ctx->dict_size;
+	const size_t dict_delta = dict_end - source;
+	const u8 *anchor = source;
+	const u8 *const iend = ip + input_size;
 	const u8 *const mflimit = iend - MFLIMIT;
-	#define MATCHLIMIT (iend - LASTLITERALS)
+	const u8 *const matchlimit = iend - LASTLITERALS;
 
-	u8 *op = (u8 *) dest;
-	u8 *const oend = op + maxoutputsize;
-	int length;
-	const int skipstrength = SKIPSTRENGTH;
-	u32 forwardh;
-	int lastrun;
+	u8 *op = dest;
+	u8 *const olimit = op + max_output_size;
 
-	/* Init */
-	if (isize < MINLENGTH)
-		goto _last_literals;
+	u32 forward_h;
+	size_t ref_delta = 0;
+
+	/* Init conditions */
+	if ((u32)input_size > (u32)LZ4_MAX_INPUT_SIZE)
+		return 0;
+
+	switch (dict) {
+	case LZ4_NO_DICT:
+	default:
+		base = source;
+		low_limit = source;
+		break;
+	case LZ4_WITH_PREFIX64K:
+		base = source - ctx->current_offset;
+		low_limit = source - ctx->dict_size;
+		break;
+	case LZ4_USING_EXT_DICT:
+		base = source - ctx->current_offset;
+		low_limit = source;
+		break;
+	}
+
+	if ((table_type == LZ4_BY_U16) && (input_size >= LZ4_64KLIMIT))
+		return 0;
 
-	memset((void *)hashtable, 0, LZ4_MEM_COMPRESS);
+	if (input_size < MINLENGTH)
+		goto _last_literals;
 
 	/* First Byte */
-	hashtable[LZ4_HASH_VALUE(ip)] = ip - base;
+	lz4_put_position(ip, ctx->hashtable, table_type, base);
 	ip++;
-	forwardh = LZ4_HASH_VALUE(ip);
+	forward_h = lz4_hash_position(ip, table_type);
 
 	/* Main Loop */
 	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
-		const u8 *forwardip = ip;
-		const u8 *ref;
+		const u8 *match;
 		u8 *token;
 
 		/* Find a match */
-		do {
-			u32 h = forwardh;
-			int step = findmatchattempts++ >> skipstrength;
-			ip = forwardip;
-			forwardip = ip + step;
-
-			if (unlikely(forwardip > mflimit))
-				goto _last_literals;
-
-			forwardh = LZ4_HASH_VALUE(forwardip);
-			ref = base + hashtable[h];
-			hashtable[h] = ip - base;
-		} while ((ref < ip - MAX_DISTANCE) || (A32(ref) != A32(ip)));
+		{
+			const u8 *forward_ip = ip;
+			unsigned int step = 1;
+			unsigned int search_match_nb =
+				acceleration << LZ4_SKIPTRIGGER;
+
+			do {
+				u32 const h = forward_h;
+
+				ip = forward_ip;
+				forward_ip += step;
+				step = (search_match_nb++ >> LZ4_SKIPTRIGGER);
+
+				if (unlikely(forward_ip > mflimit))
+					goto _last_literals;
+
+				match = lz4_get_position_on_hash(h,
+					ctx->hashtable, table_type, base);
+
+				if (dict == LZ4_USING_EXT_DICT) {
+					if (match < source) {
+						ref_delta = dict_delta;
+						low_limit = dictionary;
+					} else {
+						ref_delta = 0;
+						low_limit = source;
+					}
+				}
+
+				forward_h = lz4_hash_position(forward_ip,
+							      table_type);
+
+				lz4_put_position_on_hash(ip, h, ctx->hashtable,
+							 table_type, base);
+			} while (((dict_issue == LZ4_DICT_SMALL) ?
+					(match < low_ref_limit) : 0) ||
+				 ((table_type == LZ4_BY_U16) ?
+					0 : (match + MAX_DISTANCE < ip)) ||
+				 (lz4_read32(match + ref_delta) !=
+					lz4_read32(ip)));
+		}
 
 		/* Catch up */
-		while ((ip > anchor) && (ref > (u8 *)source) &&
-			unlikely(ip[-1] == ref[-1])) {
+		while (((ip > anchor) & (match + ref_delta > low_limit)) &&
+		       unlikely(ip[-1] == match[ref_delta - 1])) {
 			ip--;
-			ref--;
+			match--;
 		}
 
 		/* Encode Literal length */
-		length = (int)(ip - anchor);
-		token = op++;
-		/* check output limit */
-		if (unlikely(op + length + (2 + 1 + LASTLITERALS) +
-			(length >> 8) > oend))
-			return 0;
+		{
+			unsigned int const lit_length =
+				(unsigned int)(ip - anchor);
 
-		if (length >= (int)RUN_MASK) {
-			int len;
-			*token = (RUN_MASK << ML_BITS);
-			len = length - RUN_MASK;
-			for (; len > 254 ; len -= 255)
-				*op++ = 255;
-			*op++ = (u8)len;
-		} else
-			*token = (length << ML_BITS);
+			token = op++;
+
+			/* Check output limit */
+			if (limited_output &&
+			    unlikely(op + lit_length + (2 + 1 + LASTLITERALS) +
+				     (lit_length / 255) > olimit))
+				return 0;
+
+			if (lit_length >= RUN_MASK) {
+				int len = (int)lit_length - RUN_MASK;
+
+				*token = (RUN_MASK << ML_BITS);
+				for (; len >= 255; len -= 255)
+					*op++ = 255;
+				*op++ = (u8)len;
+			} else
+				*token = (u8)(lit_length << ML_BITS);
+
+			/* Copy Literals */
+			lz4_wildcopy(op, anchor, op + lit_length);
+			op += lit_length;
+		}
 
-		/* Copy Literals */
-		LZ4_BLINDCOPY(anchor, op, length);
 _next_match:
 		/* Encode Offset */
-		LZ4_WRITE_LITTLEENDIAN_16(op, (u16)(ip - ref));
+		lz4_writele16(op, (u16)(ip - match));
+		op += 2;
 
-		/* Start Counting */
-		ip += MINMATCH;
-		/* MinMatch verified */
-		ref += MINMATCH;
-		anchor = ip;
-		while (likely(ip < MATCHLIMIT - (STEPSIZE - 1))) {
-			#if LZ4_ARCH64
-			u64 diff = A64(ref) ^ A64(ip);
-			#else
-			u32 diff = A32(ref) ^ A32(ip);
-			#endif
-			if (!diff) {
-				ip += STEPSIZE;
-				ref += STEPSIZE;
-				continue;
-			}
-			ip += LZ4_NBCOMMONBYTES(diff);
-			goto _endcount;
-		}
-		#if LZ4_ARCH64
-		if ((ip < (MATCHLIMIT - 3)) && (A32(ref) == A32(ip))) {
-			ip += 4;
-			ref += 4;
-		}
-		#endif
-		if ((ip < (MATCHLIMIT - 1)) && (A16(ref) == A16(ip))) {
-			ip += 2;
-			ref += 2;
-		}
-		if ((ip < MATCHLIMIT) && (*ref == *ip))
-			ip++;
-_endcount:
 		/* Encode MatchLength */
-		length = (int)(ip - anchor);
-		/* Check output limit */
-		if (unlikely(op + (1 + LASTLITERALS) + (length >> 8) > oend))
-			return 0;
-		if (length >= (int)ML_MASK) {
-			*token += ML_MASK;
-			length -= ML_MASK;
-			for (; length > 509 ; length -= 510) {
-				*op++ = 255;
-				*op++ = 255;
+		{
+			unsigned int match_code;
+
+			if ((dict == LZ4_USING_EXT_DICT) &&
+			    (low_limit == dictionary)) {
+				const u8 *limit;
+
+				match += ref_delta;
+				limit = ip + (dict_end - match);
+				if (limit > matchlimit)
+					limit = matchlimit;
+				match_code = lz4_count(ip + MINMATCH,
+						       match + MINMATCH, limit);
+				ip += MINMATCH + match_code;
+				if (ip == limit) {
+					unsigned int const more = lz4_count(ip,
+							source, matchlimit);
+
+					match_code += more;
+					ip += more;
+				}
+			} else {
+				match_code = lz4_count(ip + MINMATCH,
+						       match + MINMATCH,
+						       matchlimit);
+				ip += MINMATCH + match_code;
 			}
-			if (length > 254) {
-				length -= 255;
-				*op++ = 255;
-			}
-			*op++ = (u8)length;
-		} else
-			*token += length;
+
+			/* Check output limit */
+			if (limited_output &&
+			    unlikely(op + (1 + LASTLITERALS) +
+				     (match_code >> 8) > olimit))
+				return 0;
+
+			if (match_code >= ML_MASK) {
+				*token += ML_MASK;
+				match_code -= ML_MASK;
+				lz4_write32(op, 0xFFFFFFFF);
+				while (match_code >= 4 * 255) {
+					op += 4;
+					lz4_write32(op, 0xFFFFFFFF);
+					match_code -= 4 * 255;
+				}
+				op += match_code / 255;
+				*op++ = (u8)(match_code % 255);
+			} else
+				*token += (u8)(match_code);
+		}
+
+		anchor = ip;
 
 		/* Test end of chunk */
-		if (ip > mflimit) {
-			anchor = ip;
+		if (ip > mflimit)
 			break;
-		}
 
 		/* Fill table */
-		hashtable[LZ4_HASH_VALUE(ip-2)] = ip - 2 - base;
+		lz4_put_position(ip - 2, ctx->hashtable, table_type, base);
 
 		/* Test next position */
-		ref = base + hashtable[LZ4_HASH_VALUE(ip)];
-		hashtable[LZ4_HASH_VALUE(ip)] = ip - base;
-		if ((ref > ip - (MAX_DISTANCE + 1)) && (A32(ref) == A32(ip))) {
+		match = lz4_get_position(ip, ctx->hashtable, table_type, base);
+		if (dict == LZ4_USING_EXT_DICT) {
+			if (match < source) {
+				ref_delta = dict_delta;
+				low_limit = dictionary;
+			} else {
+				ref_delta = 0;
+				low_limit = source;
+			}
+		}
+		lz4_put_position(ip, ctx->hashtable, table_type, base);
+		if (((dict_issue == LZ4_DICT_SMALL) ?
+				(match >= low_ref_limit) : 1) &&
+		    (match + MAX_DISTANCE >= ip) &&
+		    (lz4_read32(match + ref_delta) == lz4_read32(ip))) {
 			token = op++;
 			*token = 0;
 			goto _next_match;
 		}
 
 		/* Prepare next loop */
-		anchor = ip++;
-		forwardh = LZ4_HASH_VALUE(ip);
+		forward_h = lz4_hash_position(++ip, table_type);
 	}
 
 _last_literals:
 	/* Encode Last Literals */
-	lastrun = (int)(iend - anchor);
-	if (((char *)op - dest) + lastrun + 1
-		+ ((lastrun + 255 - RUN_MASK) / 255) > (u32)maxoutputsize)
-		return 0;
+	{
+		size_t const last_run = (size_t)(iend - anchor);
 
-	if (lastrun >= (int)RUN_MASK) {
-		*op++ = (RUN_MASK << ML_BITS);
-		lastrun -= RUN_MASK;
-		for (; lastrun > 254 ; lastrun -= 255)
-			*op++ = 255;
-		*op++ = (u8)lastrun;
-	} else
-		*op++ = (lastrun << ML_BITS);
-	memcpy(op, anchor, iend - anchor);
-	op += iend - anchor;
+		if (limited_output &&
+		    ((op - dest) + last_run + 1 +
+		     ((last_run + 255 - RUN_MASK) / 255) > (u32)max_output_size))
+			return 0;
+
+		if (last_run >= RUN_MASK) {
+			size_t accumulator = last_run - RUN_MASK;
+
+			*op++ = RUN_MASK << ML_BITS;
+			for (; accumulator >= 255; accumulator -= 255)
+				*op++ = 255;
+			*op++ = (u8)accumulator;
+		} else {
+			*op++ = (u8)(last_run << ML_BITS);
+		}
+		memcpy(op, anchor, last_run);
+		op += last_run;
+	}
 
 	/* End */
-	return (int)(((char *)op) - dest);
+	return (int)(op - dest);
 }
 
-static inline int lz4_compress64kctx(void *ctx,
-		const char *source,
-		char *dest,
-		int isize,
-		int maxoutputsize)
+void lz4_reset_stream(struct lz4_stream *stream)
 {
-	u16 *hashtable = (u16 *)ctx;
-	const u8 *ip = (u8 *) source;
-	const u8 *anchor = ip;
-	const u8 *const base = ip;
-	const u8 *const iend = ip + isize;
-	const u8 *const mflimit = iend - MFLIMIT;
-	#define MATCHLIMIT (iend - LASTLITERALS)
-
-	u8 *op = (u8 *) dest;
-	u8 *const oend = op + maxoutputsize;
-	int len, length;
-	const int skipstrength = SKIPSTRENGTH;
-	u32 forwardh;
-	int lastrun;
-
-	/* Init */
-	if (isize < MINLENGTH)
-		goto _last_literals;
-
-	memset((void *)hashtable, 0, LZ4_MEM_COMPRESS);
-
-	/* First Byte */
-	ip++;
-	forwardh = LZ4_HASH64K_VALUE(ip);
+	memset(stream, 0, sizeof(*stream));
+}
+EXPORT_SYMBOL(lz4_reset_stream);
 
-	/* Main Loop */
-	for (;;) {
-		int findmatchattempts = (1U << skipstrength) + 3;
-		const u8 *forwardip = ip;
-		const u8 *ref;
-		u8 *token;
+static int lz4_compress_fast_extstate(struct lz4_stream *ctx,
+		const u8 *source, u8 *dest, int input_size,
+		int max_output_size, int acceleration)
+{
+	int limited = max_output_size < (int)lz4_compressbound(input_size);
+
+	lz4_reset_stream(ctx);
+
+	if (acceleration < 1)
+		acceleration = LZ4_ACCELERATION_DEFAULT;
+	if (acceleration > LZ4_ACCELERATION_MAX)
+		acceleration = LZ4_ACCELERATION_MAX;
+
+	if (input_size < LZ4_64KLIMIT)
+		return limited ?
+			lz4_compress_generic(ctx, source, dest, input_size,
+				max_output_size, 1, LZ4_BY_U16, LZ4_NO_DICT,
+				LZ4_NO_DICT_ISSUE, acceleration) :
+			lz4_compress_generic(ctx, source, dest, input_size,
+				max_output_size, 0, LZ4_BY_U16, LZ4_NO_DICT,
+				LZ4_NO_DICT_ISSUE, acceleration);
+
+	return limited ?
+		lz4_compress_generic(ctx, source, dest, input_size,
+			max_output_size, 1, LZ4_BY_U32, LZ4_NO_DICT,
+			LZ4_NO_DICT_ISSUE, acceleration) :
+		lz4_compress_generic(ctx, source, dest, input_size,
+			max_output_size, 0, LZ4_BY_U32, LZ4_NO_DICT,
+			LZ4_NO_DICT_ISSUE, acceleration);
+}
 
-		/* Find a match */
-		do {
-			u32 h = forwardh;
-			int step = findmatchattempts++ >> skipstrength;
-			ip = forwardip;
-			forwardip = ip + step;
+int lz4_compress_fast(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem,
+		int acceleration)
+{
+	int out_len;
 
-			if (forwardip > mflimit)
-				goto _last_literals;
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -1;
 
-			forwardh = LZ4_HASH64K_VALUE(forwardip);
-			ref = base + hashtable[h];
-			hashtable[h] = (u16)(ip - base);
-		} while (A32(ref) != A32(ip));
+	out_len = lz4_compress_fast_extstate(wrkmem, src, dst, src_len,
+			min_t(size_t, *dst_len, INT_MAX), acceleration);
+	if (out_len <= 0)
+		return -1;
 
-		/* Catch up */
-		while ((ip > anchor) && (ref > (u8 *)source)
-			&& (ip[-1] == ref[-1])) {
-			ip--;
-			ref--;
-		}
+	*dst_len = out_len;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress_fast);
 
-		/* Encode Literal length */
-		length = (int)(ip - anchor);
-		token = op++;
-		/* Check output limit */
-		if (unlikely(op + length + (2 + 1 + LASTLITERALS)
-			+ (length >> 8) > oend))
-			return 0;
-		if (length >= (int)RUN_MASK) {
-			*token = (RUN_MASK << ML_BITS);
-			len = length - RUN_MASK;
-			for (; len > 254 ; len -= 255)
-				*op++ = 255;
-			*op++ = (u8)len;
-		} else
-			*token = (length << ML_BITS);
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	*dst_len = lz4_compressbound(src_len);
 
-		/* Copy Literals */
-		LZ4_BLINDCOPY(anchor, op, length);
+	return lz4_compress_fast(src, src_len, dst, dst_len, wrkmem,
+				 LZ4_ACCELERATION_DEFAULT);
+}
+EXPORT_SYMBOL(lz4_compress);
 
-_next_match:
-		/* Encode Offset */
-		LZ4_WRITE_LITTLEENDIAN_16(op, (u16)(ip - ref));
+int lz4_load_dict(struct lz4_stream *stream, const unsigned char *dict,
+		size_t dict_size)
+{
+	const u8 *p = dict;
+	const u8 *const dict_end = p + dict_size;
+	const u8 *base;
 
-		/* Start Counting */
-		ip += MINMATCH;
-		/* MinMatch verified */
-		ref += MINMATCH;
-		anchor = ip;
+	if (stream->init_check || stream->current_offset > 1 * GB)
+		lz4_reset_stream(stream);
 
-		while (ip < MATCHLIMIT - (STEPSIZE - 1)) {
-			#if LZ4_ARCH64
-			u64 diff = A64(ref) ^ A64(ip);
-			#else
-			u32 diff = A32(ref) ^ A32(ip);
-			#endif
-
-			if (!diff) {
-				ip += STEPSIZE;
-				ref += STEPSIZE;
-				continue;
-			}
-			ip += LZ4_NBCOMMONBYTES(diff);
-			goto _endcount;
-		}
-		#if LZ4_ARCH64
-		if ((ip < (MATCHLIMIT - 3)) && (A32(ref) == A32(ip))) {
-			ip += 4;
-			ref += 4;
-		}
-		#endif
-		if ((ip < (MATCHLIMIT - 1)) && (A16(ref) == A16(ip))) {
-			ip += 2;
-			ref += 2;
-		}
-		if ((ip < MATCHLIMIT) && (*ref == *ip))
-			ip++;
-_endcount:
+	if (dict_size < LZ4_HASH_UNIT) {
+		stream->dictionary = NULL;
+		stream->dict_size = 0;
+		return 0;
+	}
 
-		/* Encode MatchLength */
-		len = (int)(ip - anchor);
-		/* Check output limit */
-		if (unlikely(op + (1 + LASTLITERALS) + (len >> 8) > oend))
-			return 0;
-		if (len >= (int)ML_MASK) {
-			*token += ML_MASK;
-			len -= ML_MASK;
-			for (; len > 509 ; len -= 510) {
-				*op++ = 255;
-				*op++ = 255;
-			}
-			if (len > 254) {
-				len -= 255;
-				*op++ = 255;
-			}
-			*op++ = (u8)len;
-		} else
-			*token += len;
+	if ((dict_end - p) > 64 * KB)
+		p = dict_end - 64 * KB;
+	stream->current_offset += 64 * KB;
+	base = p - stream->current_offset;
+	stream->dictionary = p;
+	stream->dict_size = (u32)(dict_end - p);
+	stream->current_offset += stream->dict_size;
+
+	while (p <= dict_end - LZ4_HASH_UNIT) {
+		lz4_put_position(p, stream->hashtable, LZ4_BY_U32, base);
+		p += 3;
+	}
 
-		/* Test end of chunk */
-		if (ip > mflimit) {
-			anchor = ip;
-			break;
-		}
+	return stream->dict_size;
+}
+EXPORT_SYMBOL(lz4_load_dict);
 
-		/* Fill table */
-		hashtable[LZ4_HASH64K_VALUE(ip-2)] = (u16)(ip - 2 - base);
+/* Rescale the hash table before current_offset can wrap */
+static void lz4_renorm_dict(struct lz4_stream *stream, const u8 *src)
+{
+	u32 delta;
+	const u8 *dict_end;
+	int i;
+
+	if (stream->current_offset <= 0x80000000 &&
+	    (uintptr_t)stream->current_offset <= (uintptr_t)src)
+		return;
+
+	delta = stream->current_offset - 64 * KB;
+	dict_end = stream->dictionary + stream->dict_size;
+	for (i = 0; i < LZ4_HASH_SIZE_U32; i++) {
+		if (stream->hashtable[i] < delta)
+			stream->hashtable[i] = 0;
+		else
+			stream->hashtable[i] -= delta;
+	}
+	stream->current_offset = 64 * KB;
+	if (stream->dict_size > 64 * KB)
+		stream->dict_size = 64 * KB;
+	stream->dictionary = dict_end - stream->dict_size;
+}
 
-		/* Test next position */
-		ref = base + hashtable[LZ4_HASH64K_VALUE(ip)];
-		hashtable[LZ4_HASH64K_VALUE(ip)] = (u16)(ip - base);
-		if (A32(ref) == A32(ip)) {
-			token = op++;
-			*token = 0;
-			goto _next_match;
-		}
+int lz4_compress_fast_continue(struct lz4_stream *stream,
+		const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, int acceleration)
+{
+	const u8 *const dict_end = stream->dictionary + stream->dict_size;
+	const u8 *smallest = src;
+	const u8 *const src_end = src + src_len;
+	int max_output_size = min_t(size_t, *dst_len, INT_MAX);
+	int small_dict;
+	int out_len;
+
+	if (stream->init_check || src_len > LZ4_MAX_INPUT_SIZE)
+		return -1;
+
+	if (stream->dict_size > 0 && smallest > dict_end)
+		smallest = dict_end;
+	lz4_renorm_dict(stream, smallest);
+
+	if (acceleration < 1)
+		acceleration = LZ4_ACCELERATION_DEFAULT;
+	if (acceleration > LZ4_ACCELERATION_MAX)
+		acceleration = LZ4_ACCELERATION_MAX;
+
+	/* Check overlapping input/dictionary space */
+	if (src_end > stream->dictionary && src_end < dict_end) {
+		stream->dict_size = (u32)(dict_end - src_end);
+		if (stream->dict_size > 64 * KB)
+			stream->dict_size = 64 * KB;
+		if (stream->dict_size < 4)
+			stream->dict_size = 0;
+		stream->dictionary = dict_end - stream->dict_size;
+	}
 
-		/* Prepare next loop */
-		anchor = ip++;
-		forwardh = LZ4_HASH64K_VALUE(ip);
+	small_dict = stream->dict_size < 64 * KB &&
+		     stream->dict_size < stream->current_offset;
+
+	if (dict_end == src) {
+		/* Prefix mode: the new block directly follows the history */
+		if (small_dict)
+			out_len = lz4_compress_generic(stream, src, dst,
+				src_len, max_output_size, 1, LZ4_BY_U32,
+				LZ4_WITH_PREFIX64K, LZ4_DICT_SMALL,
+				acceleration);
+		else
+			out_len = lz4_compress_generic(stream, src, dst,
+				src_len, max_output_size, 1, LZ4_BY_U32,
+				LZ4_WITH_PREFIX64K, LZ4_NO_DICT_ISSUE,
+				acceleration);
+		stream->dict_size += (u32)src_len;
+	} else {
+		/* External dictionary mode */
+		if (small_dict)
+			out_len = lz4_compress_generic(stream, src, dst,
+				src_len, max_output_size, 1, LZ4_BY_U32,
+				LZ4_USING_EXT_DICT, LZ4_DICT_SMALL,
+				acceleration);
+		else
+			out_len = lz4_compress_generic(stream, src, dst,
+				src_len, max_output_size, 1, LZ4_BY_U32,
+				LZ4_USING_EXT_DICT, LZ4_NO_DICT_ISSUE,
+				acceleration);
+		stream->dictionary = src;
+		stream->dict_size = (u32)src_len;
 	}
+	stream->current_offset += (u32)src_len;
 
-_last_literals:
-	/* Encode Last Literals */
-	lastrun = (int)(iend - anchor);
-	if (op + lastrun + 1 + (lastrun - RUN_MASK + 255) / 255 > oend)
-		return 0;
-	if (lastrun >= (int)RUN_MASK) {
-		*op++ = (RUN_MASK << ML_BITS);
-		lastrun -= RUN_MASK;
-		for (; lastrun > 254 ; lastrun -= 255)
-			*op++ = 255;
-		*op++ = (u8)lastrun;
-	} else
-		*op++ = (lastrun << ML_BITS);
-	memcpy(op, anchor, iend - anchor);
-	op += iend - anchor;
-	/* End */
-	return (int)(((char *)op) - dest);
+	if (out_len <= 0)
+		return -1;
+
+	*dst_len = out_len;
+	return 0;
 }
+EXPORT_SYMBOL(lz4_compress_fast_continue);
 
-int lz4_compress(const unsigned char *src, size_t src_len,
-			unsigned char *dst, size_t *dst_len, void *wrkmem)
+int lz4_save_dict(struct lz4_stream *stream, unsigned char *safe_buffer,
+		size_t max_dict_size)
 {
-	int ret = -1;
-	int out_len = 0;
+	const u8 *const previous_dict_end = stream->dictionary +
+					    stream->dict_size;
+	size_t dict_size = min_t(size_t, max_dict_size, 64 * KB);
 
-	if (src_len < LZ4_64KLIMIT)
-		out_len = lz4_compress64kctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
-	else
-		out_len = lz4_compressctx(wrkmem, src, dst, src_len,
-				lz4_compressbound(src_len));
+	if (dict_size > stream->dict_size)
+		dict_size = stream->dict_size;
 
-	if (out_len < 0)
-		goto exit;
+	memmove(safe_buffer, previous_dict_end - dict_size, dict_size);
+	stream->dictionary = safe_buffer;
+	stream->dict_size = (u32)dict_size;
 
-	*dst_len = out_len;
-
-	return 0;
-exit:
-	return ret;
+	return dict_size;
 }
-EXPORT_SYMBOL(lz4_compress);
+EXPORT_SYMBOL(lz4_save_dict);
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("LZ4 compressor");
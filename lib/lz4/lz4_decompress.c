@@ -47,273 +47,290 @@
 
 #include "lz4defs.h"
 
-static const int dec32table[] = {0, 3, 2, 3, 0, 0, 0, 0};
-#if LZ4_ARCH64
+static const unsigned int inc32table[] = {0, 1, 2, 1, 4, 4, 4, 4};
 static const int dec64table[] = {0, 0, 0, -1, 0, 1, 2, 3};
-#endif
 
-static int lz4_uncompress(const char *source, char *dest, int osize)
+/*
+ * lz4_decompress_generic() :
+ * This generic decompression function covers all use cases.
+ * It shall be instantiated several times, using different sets of
+ * directives.  Note that it is important that this generic function is
+ * really inlined, in order to remove useless branches during compilation.
+ *
+ * Literals and matches are copied 8 bytes at a time (wildcopy); the
+ * format guarantees the last LASTLITERALS bytes of a block are literals,
+ * so the over-copy never runs past the end of the output buffer.
+ */
+static __always_inline int lz4_decompress_generic(
+	const u8 *const source,
+	u8 *const dest,
+	int input_size,
+	/*
+	 * If end_on_input == LZ4_END_ON_INPUT_SIZE,
+	 * this value is the max size of Output Buffer.
+	 */
+	int output_size,
+	/* LZ4_END_ON_OUTPUT_SIZE, LZ4_END_ON_INPUT_SIZE */
+	int end_on_input,
+	/* LZ4_NO_DICT, LZ4_WITH_PREFIX64K, LZ4_USING_EXT_DICT */
+	int dict,
+	/* == dest when no prefix */
+	const u8 *const low_prefix,
+	/* only if dict == LZ4_USING_EXT_DICT */
+	const u8 *const dict_start,
+	/* note : = 0 if LZ4_NO_DICT */
+	const size_t dict_size)
 {
-	const BYTE *ip = (const BYTE *) source;
-	const BYTE *ref;
-	BYTE *op = (BYTE *) dest;
-	BYTE * const oend = op + osize;
-	BYTE *cpy;
-	unsigned token;
-	size_t length;
+	/* Local Variables */
+	const u8 *ip = source;
+	const u8 *const iend = ip + input_size;
+
+	u8 *op = dest;
+	u8 *const oend = op + output_size;
+	u8 *cpy;
+
+	const u8 *const low_limit = low_prefix - dict_size;
+	const u8 *const dict_end = dict_start + dict_size;
+
+	const int safe_decode = (end_on_input == LZ4_END_ON_INPUT_SIZE);
+	/* without a dictionary, nothing may reach behind dest */
+	const int check_offset = (safe_decode || dict == LZ4_NO_DICT) &&
+				 (dict_size < (int)(64 * KB));
+
+	/* Special cases */
+	/* Empty output buffer */
+	if (end_on_input && unlikely(output_size == 0))
+		return ((input_size == 1) && (*ip == 0)) ? 0 : -1;
 
+	if (!end_on_input && unlikely(output_size == 0))
+		return (*ip == 0 ? 1 : -1);
+
+	/* Main Loop : decode sequences */
 	while (1) {
+		size_t length;
+		const u8 *match;
+		size_t offset;
+
+		/* get literal length */
+		unsigned int const token = *ip++;
+
+		length = token >> ML_BITS;
 
-		/* get runlength */
-		token = *ip++;
-		length = (token >> ML_BITS);
 		if (length == RUN_MASK) {
-			size_t len;
+			unsigned int s;
 
-			len = *ip++;
-			for (; len == 255; length += 255)
-				len = *ip++;
-			if (unlikely(length > (size_t)(length + len)))
+			do {
+				s = *ip++;
+				length += s;
+			} while (likely(end_on_input ?
+					ip < iend - RUN_MASK : 1) &
+				 (s == 255));
+
+			/* overflow detection */
+			if (safe_decode &&
+			    unlikely((uintptr_t)(op + length) <
+				     (uintptr_t)(op)))
+				goto _output_error;
+			if (safe_decode &&
+			    unlikely((uintptr_t)(ip + length) <
+				     (uintptr_t)(ip)))
 				goto _output_error;
-			length += len;
 		}
 
 		/* copy literals */
 		cpy = op + length;
-		if (unlikely(cpy > oend - COPYLENGTH)) {
-			/*
-			 * Error: not enough place for another match
-			 * (min 4) + 5 literals
-			 */
-			if (cpy != oend)
+		if ((end_on_input &&
+		     ((cpy > oend - MFLIMIT) ||
+		      (ip + length > iend - (2 + 1 + LASTLITERALS)))) ||
+		    (!end_on_input && (cpy > oend - WILDCOPYLENGTH))) {
+			/* Error : block decoding must stop exactly there */
+			if (!end_on_input && (cpy != oend))
+				goto _output_error;
+			/* Error : input must be consumed */
+			if (end_on_input &&
+			    ((ip + length != iend) || (cpy > oend)))
 				goto _output_error;
 
 			memcpy(op, ip, length);
 			ip += length;
-			break; /* EOF */
+			op += length;
+			/* Necessarily EOF, due to parsing restrictions */
+			break;
 		}
-		LZ4_WILDCOPY(ip, op, cpy);
-		ip -= (op - cpy);
+
+		lz4_wildcopy(op, ip, cpy);
+		ip += length;
 		op = cpy;
 
 		/* get offset */
-		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
+		offset = lz4_readle16(ip);
 		ip += 2;
+		match = op - offset;
 
-		/* Error: offset create reference outside destination buffer */
-		if (unlikely(ref < (BYTE *const) dest))
+		/* Error : offset outside buffers */
+		if (check_offset && unlikely(match < low_limit))
 			goto _output_error;
 
 		/* get matchlength */
 		length = token & ML_MASK;
 		if (length == ML_MASK) {
-			for (; *ip == 255; length += 255)
-				ip++;
-			if (unlikely(length > (size_t)(length + *ip)))
+			unsigned int s;
+
+			do {
+				s = *ip++;
+
+				if (end_on_input && (ip > iend - LASTLITERALS))
+					goto _output_error;
+
+				length += s;
+			} while (s == 255);
+
+			/* overflow detection */
+			if (safe_decode &&
+			    unlikely((uintptr_t)(op + length) <
+				     (uintptr_t)op))
 				goto _output_error;
-			length += *ip++;
 		}
 
-		/* copy repeated sequence */
-		if (unlikely((op - ref) < STEPSIZE)) {
-#if LZ4_ARCH64
-			int dec64 = dec64table[op - ref];
-#else
-			const int dec64 = 0;
-#endif
-			op[0] = ref[0];
-			op[1] = ref[1];
-			op[2] = ref[2];
-			op[3] = ref[3];
-			op += 4;
-			ref += 4;
-			ref -= dec32table[op-ref];
-			PUT4(ref, op);
-			op += STEPSIZE - 4;
-			ref -= dec64;
-		} else {
-			LZ4_COPYSTEP(ref, op);
-		}
-		cpy = op + length - (STEPSIZE - 4);
-		if (cpy > (oend - COPYLENGTH)) {
+		length += MINMATCH;
 
-			/* Error: request to write beyond destination buffer */
-			if (cpy > oend)
-				goto _output_error;
-#if LZ4_ARCH64
-			if ((ref + COPYLENGTH) > oend)
-#else
-			if ((ref + COPYLENGTH) > oend ||
-					(op + COPYLENGTH) > oend)
-#endif
-				goto _output_error;
-			LZ4_SECURECOPY(ref, op, (oend - COPYLENGTH));
-			while (op < cpy)
-				*op++ = *ref++;
-			op = cpy;
-			/*
-			 * Check EOF (should never happen, since last 5 bytes
-			 * are supposed to be literals)
-			 */
-			if (op == oend)
+		/* check external dictionary */
+		if (dict == LZ4_USING_EXT_DICT && match < low_prefix) {
+			/* doesn't respect parsing restriction */
+			if (unlikely(op + length > oend - LASTLITERALS))
 				goto _output_error;
+
+			if (length <= (size_t)(low_prefix - match)) {
+				/*
+				 * match can be copied as a single segment
+				 * from external dictionary
+				 */
+				memmove(op, dict_end - (low_prefix - match),
+					length);
+				op += length;
+			} else {
+				/*
+				 * match encompass external
+				 * dictionary and current block
+				 */
+				size_t const copy_size =
+					(size_t)(low_prefix - match);
+				size_t const rest_size = length - copy_size;
+
+				memcpy(op, dict_end - copy_size, copy_size);
+				op += copy_size;
+
+				if (rest_size > (size_t)(op - low_prefix)) {
+					/* overlap copy */
+					u8 *const end_of_match = op + rest_size;
+					const u8 *copy_from = low_prefix;
+
+					while (op < end_of_match)
+						*op++ = *copy_from++;
+				} else {
+					memcpy(op, low_prefix, rest_size);
+					op += rest_size;
+				}
+			}
 			continue;
 		}
-		LZ4_SECURECOPY(ref, op, cpy);
-		op = cpy; /* correction */
-	}
-	/* end of decoding */
-	return (int) (((char *)ip) - source);
-
-	/* write overflow error detected */
-_output_error:
-	return -1;
-}
-
-static int lz4_uncompress_unknownoutputsize(const char *source, char *dest,
-				int isize, size_t maxoutputsize)
-{
-	const BYTE *ip = (const BYTE *) source;
-	const BYTE *const iend = ip + isize;
-	const BYTE *ref;
 
+		/* copy match within block */
+		cpy = op + length;
 
-	BYTE *op = (BYTE *) dest;
-	BYTE * const oend = op + maxoutputsize;
-	BYTE *cpy;
+		if (unlikely(offset < 8)) {
+			const int dec64 = dec64table[offset];
 
-	/* Main Loop */
-	while (ip < iend) {
+			op[0] = match[0];
+			op[1] = match[1];
+			op[2] = match[2];
+			op[3] = match[3];
+			match += inc32table[offset];
+			memcpy(op + 4, match, 4);
+			match -= dec64;
+		} else {
+			lz4_copy8(op, match);
+			match += 8;
+		}
 
-		unsigned token;
-		size_t length;
+		op += 8;
 
-		/* get runlength */
-		token = *ip++;
-		length = (token >> ML_BITS);
-		if (length == RUN_MASK) {
-			int s = 255;
-			while ((ip < iend) && (s == 255)) {
-				s = *ip++;
-				if (unlikely(length > (size_t)(length + s)))
-					goto _output_error;
-				length += s;
-			}
-		}
-		/* copy literals */
-		cpy = op + length;
-		if ((cpy > oend - COPYLENGTH) ||
-			(ip + length > iend - COPYLENGTH)) {
-
-			if (cpy > oend)
-				goto _output_error;/* writes beyond buffer */
-
-			if (ip + length != iend)
-				goto _output_error;/*
-						    * Error: LZ4 format requires
-						    * to consume all input
-						    * at this stage
-						    */
-			memcpy(op, ip, length);
-			op += length;
-			break;/* Necessarily EOF, due to parsing restrictions */
-		}
-		LZ4_WILDCOPY(ip, op, cpy);
-		ip -= (op - cpy);
-		op = cpy;
+		if (unlikely(cpy > oend - 12)) {
+			u8 *const ocopy_limit = oend - (WILDCOPYLENGTH - 1);
 
-		/* get offset */
-		LZ4_READ_LITTLEENDIAN_16(ref, cpy, ip);
-		ip += 2;
-		if (ref < (BYTE * const) dest)
-			goto _output_error;
 			/*
-			 * Error : offset creates reference
-			 * outside of destination buffer
+			 * Error : last LASTLITERALS bytes
+			 * must be literals (uncompressed)
 			 */
+			if (cpy > oend - LASTLITERALS)
+				goto _output_error;
 
-		/* get matchlength */
-		length = (token & ML_MASK);
-		if (length == ML_MASK) {
-			while (ip < iend) {
-				int s = *ip++;
-				if (unlikely(length > (size_t)(length + s)))
-					goto _output_error;
-				length += s;
-				if (s == 255)
-					continue;
-				break;
+			if (op < ocopy_limit) {
+				lz4_wildcopy(op, match, ocopy_limit);
+				match += ocopy_limit - op;
+				op = ocopy_limit;
 			}
-		}
 
-		/* copy repeated sequence */
-		if (unlikely((op - ref) < STEPSIZE)) {
-#if LZ4_ARCH64
-			int dec64 = dec64table[op - ref];
-#else
-			const int dec64 = 0;
-#endif
-				op[0] = ref[0];
-				op[1] = ref[1];
-				op[2] = ref[2];
-				op[3] = ref[3];
-				op += 4;
-				ref += 4;
-				ref -= dec32table[op - ref];
-				PUT4(ref, op);
-				op += STEPSIZE - 4;
-				ref -= dec64;
-		} else {
-			LZ4_COPYSTEP(ref, op);
-		}
-		cpy = op + length - (STEPSIZE-4);
-		if (cpy > oend - COPYLENGTH) {
-			if (cpy > oend)
-				goto _output_error; /* write outside of buf */
-#if LZ4_ARCH64
-			if ((ref + COPYLENGTH) > oend)
-#else
-			if ((ref + COPYLENGTH) > oend ||
-					(op + COPYLENGTH) > oend)
-#endif
-				goto _output_error;
-			LZ4_SECURECOPY(ref, op, (oend - COPYLENGTH));
 			while (op < cpy)
-				*op++ = *ref++;
-			op = cpy;
-			/*
-			 * Check EOF (should never happen, since last 5 bytes
-			 * are supposed to be literals)
-			 */
-			if (op == oend)
-				goto _output_error;
-			continue;
+				*op++ = *match++;
+		} else {
+			lz4_copy8(op, match);
+
+			if (length > 16)
+				lz4_wildcopy(op + 8, match + 8, cpy);
 		}
-		LZ4_SECURECOPY(ref, op, cpy);
+
 		op = cpy; /* correction */
 	}
+
 	/* end of decoding */
-	return (int) (((char *) op) - dest);
+	if (end_on_input)
+		/* Nb of output bytes decoded */
+		return (int)(op - dest);
 
-	/* write overflow error detected */
+	/* Nb of input bytes read */
+	return (int)(ip - source);
+
+	/* Overflow error detected */
 _output_error:
 	return -1;
 }
 
+static int lz4_decompress_safe_generic(const u8 *src, u8 *dest,
+		size_t src_len, size_t *dest_len, int dict,
+		const u8 *low_prefix, const u8 *dict_start, size_t dict_size)
+{
+	int out_len;
+
+	if (src_len > INT_MAX || *dest_len > INT_MAX)
+		return -1;
+
+	out_len = lz4_decompress_generic(src, dest, src_len, *dest_len,
+					 LZ4_END_ON_INPUT_SIZE, dict,
+					 low_prefix, dict_start, dict_size);
+	if (out_len < 0)
+		return -1;
+
+	*dest_len = out_len;
+	return 0;
+}
+
 int lz4_decompress(const unsigned char *src, size_t *src_len,
 		unsigned char *dest, size_t actual_dest_len)
 {
-	int ret = -1;
-	int input_len = 0;
+	int input_len;
+
+	if (actual_dest_len > INT_MAX)
+		return -1;
 
-	input_len = lz4_uncompress(src, dest, actual_dest_len);
+	input_len = lz4_decompress_generic(src, dest, 0, actual_dest_len,
+					   LZ4_END_ON_OUTPUT_SIZE, LZ4_NO_DICT,
+					   dest, NULL, 0);
 	if (input_len < 0)
-		goto exit_0;
+		return -1;
 	*src_len = input_len;
 
 	return 0;
-exit_0:
-	return ret;
 }
 #ifndef STATIC
 EXPORT_SYMBOL(lz4_decompress);
@@ -322,21 +339,87 @@ EXPORT_SYMBOL(lz4_decompress);
 int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
 		unsigned char *dest, size_t *dest_len)
 {
-	int ret = -1;
-	int out_len = 0;
+	return lz4_decompress_safe_generic(src, dest, src_len, dest_len,
+					   LZ4_NO_DICT, dest, NULL, 0);
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+#endif
 
-	out_len = lz4_uncompress_unknownoutputsize(src, dest, src_len,
-					*dest_len);
-	if (out_len < 0)
-		goto exit_0;
-	*dest_len = out_len;
+int lz4_decompress_safe_usingdict(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len,
+		const unsigned char *dict, size_t dict_size)
+{
+	if (dict_size == 0)
+		return lz4_decompress_safe_generic(src, dest, src_len, dest_len,
+						   LZ4_NO_DICT, dest, NULL, 0);
+
+	if (dict + dict_size == dest) {
+		if (dict_size >= 64 * KB - 1)
+			return lz4_decompress_safe_generic(src, dest, src_len,
+					dest_len, LZ4_WITH_PREFIX64K,
+					dest - 64 * KB, NULL, 0);
+		return lz4_decompress_safe_generic(src, dest, src_len,
+				dest_len, LZ4_NO_DICT, dest - dict_size,
+				NULL, 0);
+	}
+
+	return lz4_decompress_safe_generic(src, dest, src_len, dest_len,
+					   LZ4_USING_EXT_DICT, dest,
+					   dict, dict_size);
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_safe_usingdict);
+#endif
+
+int lz4_set_stream_decode(struct lz4_stream_decode *stream,
+		const unsigned char *dict, size_t dict_size)
+{
+	stream->prefix_size = dict_size;
+	stream->prefix_end = dict + dict_size;
+	stream->external_dict = NULL;
+	stream->ext_dict_size = 0;
 
 	return 0;
-exit_0:
-	return ret;
 }
 #ifndef STATIC
-EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+EXPORT_SYMBOL(lz4_set_stream_decode);
+#endif
+
+int lz4_decompress_safe_continue(struct lz4_stream_decode *stream,
+		const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	int ret;
+
+	if (stream->prefix_end == dest) {
+		/* The new block directly follows the previous output */
+		ret = lz4_decompress_safe_generic(src, dest, src_len, dest_len,
+				LZ4_USING_EXT_DICT,
+				stream->prefix_end - stream->prefix_size,
+				stream->external_dict, stream->ext_dict_size);
+		if (ret)
+			return ret;
+		stream->prefix_size += *dest_len;
+		stream->prefix_end += *dest_len;
+	} else {
+		/* The previous output becomes the external dictionary */
+		stream->ext_dict_size = stream->prefix_size;
+		stream->external_dict = stream->prefix_end -
+					stream->ext_dict_size;
+		ret = lz4_decompress_safe_generic(src, dest, src_len, dest_len,
+				LZ4_USING_EXT_DICT, dest,
+				stream->external_dict, stream->ext_dict_size);
+		if (ret)
+			return ret;
+		stream->prefix_size = *dest_len;
+		stream->prefix_end = dest + *dest_len;
+	}
+
+	return 0;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_safe_continue);
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("LZ4 Decompressor");
@@ -155,3 +155,116 @@ typedef struct _U64_S { u64 v; } U64_S;
 		LZ4_WILDCOPY(s, d, e);	\
 		d = e;	\
 	} while (0)
+
+/*
+ * Helpers shared by the generic (accelerated / streaming) compressor and
+ * the wildcopy decoder.
+ */
+#define KB		(1 << 10)
+#define GB		(1U << 30)
+#define WILDCOPYLENGTH	8
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+#define LZ4_SKIPTRIGGER	6
+#define LZ4_HASH_UNIT	sizeof(size_t)
+
+static __always_inline u16 lz4_read16(const void *ptr)
+{
+	return get_unaligned((const u16 *)ptr);
+}
+
+static __always_inline u32 lz4_read32(const void *ptr)
+{
+	return get_unaligned((const u32 *)ptr);
+}
+
+static __always_inline size_t lz4_read_arch(const void *ptr)
+{
+	return get_unaligned((const size_t *)ptr);
+}
+
+static __always_inline void lz4_write32(void *ptr, u32 value)
+{
+	put_unaligned(value, (u32 *)ptr);
+}
+
+static __always_inline u16 lz4_readle16(const void *ptr)
+{
+	return get_unaligned_le16(ptr);
+}
+
+static __always_inline void lz4_writele16(void *ptr, u16 value)
+{
+	put_unaligned_le16(value, ptr);
+}
+
+static __always_inline void lz4_copy8(void *dst, const void *src)
+{
+#if LZ4_ARCH64
+	put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
+#else
+	put_unaligned(get_unaligned((const u32 *)src), (u32 *)dst);
+	put_unaligned(get_unaligned((const u32 *)src + 1), (u32 *)dst + 1);
+#endif
+}
+
+/*
+ * Customized variant of memcpy, which can overwrite up to 7 bytes beyond
+ * dst_end.  Callers guarantee that much slack in the output buffer.
+ */
+static __always_inline void lz4_wildcopy(void *dst, const void *src,
+					 void *dst_end)
+{
+	u8 *d = (u8 *)dst;
+	const u8 *s = (const u8 *)src;
+	u8 *const e = (u8 *)dst_end;
+
+	do {
+		lz4_copy8(d, s);
+		d += 8;
+		s += 8;
+	} while (d < e);
+}
+
+static __always_inline unsigned int lz4_nbcommonbytes(size_t val)
+{
+	return LZ4_NBCOMMONBYTES(val);
+}
+
+/* Length of the common prefix of in and match, not reading past in_limit */
+static __always_inline unsigned int lz4_count(const u8 *in, const u8 *match,
+					      const u8 *in_limit)
+{
+	const u8 *const start = in;
+
+	while (likely(in < in_limit - (STEPSIZE - 1))) {
+		size_t const diff = lz4_read_arch(match) ^ lz4_read_arch(in);
+
+		if (!diff) {
+			in += STEPSIZE;
+			match += STEPSIZE;
+			continue;
+		}
+		in += lz4_nbcommonbytes(diff);
+		return (unsigned int)(in - start);
+	}
+
+#if LZ4_ARCH64
+	if ((in < (in_limit - 3)) && (lz4_read32(match) == lz4_read32(in))) {
+		in += 4;
+		match += 4;
+	}
+#endif
+	if ((in < (in_limit - 1)) && (lz4_read16(match) == lz4_read16(in))) {
+		in += 2;
+		match += 2;
+	}
+	if ((in < in_limit) && (*match == *in))
+		in++;
+
+	return (unsigned int)(in - start);
+}
+
+enum lz4_table_type { LZ4_BY_U32, LZ4_BY_U16 };
+enum lz4_dict_type { LZ4_NO_DICT, LZ4_WITH_PREFIX64K, LZ4_USING_EXT_DICT };
+enum lz4_dict_issue { LZ4_NO_DICT_ISSUE, LZ4_DICT_SMALL };
+enum lz4_end_condition { LZ4_END_ON_OUTPUT_SIZE, LZ4_END_ON_INPUT_SIZE };
@@ -12,19 +12,35 @@
  */
 
 
+/* Version
+ * 0: original lzo version
+ * 1: lzo with support for RLE
+ */
+#define LZO_VERSION 1
+
+/*
+ * 64-bit loads and stores are a single instruction on these architectures,
+ * so the 8/16-byte copy helpers below use them instead of pairs of COPY4.
+ */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define LZO_FAST_64BIT_MEMORY_ACCESS
+#endif
+
 #define COPY4(dst, src)	\
 		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
-#if defined(__x86_64__)
+#if defined(LZO_FAST_64BIT_MEMORY_ACCESS)
 #define COPY8(dst, src)	\
 		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
 #else
 #define COPY8(dst, src)	\
 		COPY4(dst, src); COPY4((dst) + 4, (src) + 4)
 #endif
+#define COPY16(dst, src)	\
+		do { COPY8(dst, src); COPY8((dst) + 8, (src) + 8); } while (0)
 
 #if defined(__BIG_ENDIAN) && defined(__LITTLE_ENDIAN)
 #error "conflicting endian definitions"
-#elif defined(__x86_64__)
+#elif defined(__x86_64__) || defined(__aarch64__)
 #define LZO_USE_CTZ64	1
 #define LZO_USE_CTZ32	1
 #elif defined(__i386__) || defined(__powerpc__)
@@ -36,7 +52,8 @@
 #define M1_MAX_OFFSET	0x0400
 #define M2_MAX_OFFSET	0x0800
 #define M3_MAX_OFFSET	0x4000
-#define M4_MAX_OFFSET	0xbfff
+#define M4_MAX_OFFSET_V0	0xbfff
+#define M4_MAX_OFFSET_V1	0xbffe
 
 #define M1_MIN_LEN	2
 #define M1_MAX_LEN	2
@@ -47,6 +64,9 @@
 #define M4_MIN_LEN	3
 #define M4_MAX_LEN	9
 
+#define MIN_ZERO_RUN_LENGTH	4
+#define MAX_ZERO_RUN_LENGTH	(2047 + MIN_ZERO_RUN_LENGTH)
+
 #define M1_MARKER	0
 #define M2_MARKER	64
 #define M3_MARKER	32
@@ -0,0 +1,224 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   Copyright 2002-2007 H. Peter Anvin - All Rights Reserved
+ *
+ *   This file is part of the Linux kernel, and is made available under
+ *   the terms of the GNU General Public License version 2 or (at your
+ *   option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6test.c
+ *
+ * Test RAID-6 recovery with various algorithms, then time every syndrome
+ * generation and recovery routine usable on this machine
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <linux/raid/pq.h>
+
+#define NDISKS		16	/* Including P and Q */
+
+/* Minimum time spent in each timing loop */
+#define BENCH_NSEC	200000000ULL
+
+const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+char *dataptrs[NDISKS];
+char data[NDISKS][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+char recovi[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+char recovj[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+static void makedata(int start, int stop)
+{
+	int i, j;
+
+	for (i = start; i <= stop; i++) {
+		for (j = 0; j < PAGE_SIZE; j++)
+			data[i][j] = rand();
+
+		dataptrs[i] = data[i];
+	}
+}
+
+static char disk_type(int d)
+{
+	switch (d) {
+	case NDISKS-2:
+		return 'P';
+	case NDISKS-1:
+		return 'Q';
+	default:
+		return 'D';
+	}
+}
+
+static int test_disks(int i, int j)
+{
+	int erra, errb;
+
+	memset(recovi, 0xf0, PAGE_SIZE);
+	memset(recovj, 0xba, PAGE_SIZE);
+
+	dataptrs[i] = recovi;
+	dataptrs[j] = recovj;
+
+	raid6_dual_recov(NDISKS, PAGE_SIZE, i, j, (void **)&dataptrs);
+
+	erra = memcmp(data[i], recovi, PAGE_SIZE);
+	errb = memcmp(data[j], recovj, PAGE_SIZE);
+
+	if (i < NDISKS-2 && j == NDISKS-1) {
+		/* We don't implement the DQ failure scenario, since it's
+		   equivalent to a RAID-5 failure (XOR, then recompute Q) */
+		erra = errb = 0;
+	} else if (erra || errb) {
+		printf("algo=%-8s  faila=%3d(%c)  failb=%3d(%c)  %s\n",
+		       raid6_call.name,
+		       i, disk_type(i),
+		       j, disk_type(j),
+		       !erra ? "ERRB" :
+		       !errb ? "ERRA" : "ERRAB");
+	}
+
+	dataptrs[i] = data[i];
+	dataptrs[j] = data[j];
+
+	return erra || errb;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* MB/s of data disks processed, the figure algos.c prints at boot */
+static unsigned long mbps(unsigned long long loops, unsigned long long ns)
+{
+	return (double)loops * (NDISKS-2) * PAGE_SIZE * 1e9 / ns / (1 << 20);
+}
+
+static void bench_gen(void)
+{
+	unsigned long long t0, ns, loops;
+
+	for (loops = 0, t0 = now_ns(); (ns = now_ns() - t0) < BENCH_NSEC;
+	     loops++)
+		raid6_call.gen_syndrome(NDISKS, PAGE_SIZE, (void **)&dataptrs);
+
+	printf("gen    %-8s %6lu MB/s\n", raid6_call.name, mbps(loops, ns));
+}
+
+/*
+ * Recovery overwrites the failed disks in place, so the same stripe can
+ * be recovered over and over and still be checked at the end.
+ */
+static int bench_recov(const struct raid6_recov_calls *ra)
+{
+	unsigned long long t0, ns2, nsp, loops2, loopsp;
+	int err;
+
+	raid6_2data_recov = ra->data2;
+	raid6_datap_recov = ra->datap;
+
+	for (loops2 = 0, t0 = now_ns(); (ns2 = now_ns() - t0) < BENCH_NSEC;
+	     loops2++)
+		ra->data2(NDISKS, PAGE_SIZE, 0, 1, (void **)&dataptrs);
+
+	for (loopsp = 0, t0 = now_ns(); (nsp = now_ns() - t0) < BENCH_NSEC;
+	     loopsp++)
+		ra->datap(NDISKS, PAGE_SIZE, 0, (void **)&dataptrs);
+
+	err = test_disks(0, 1) + test_disks(0, NDISKS-2);
+
+	printf("recov  %-8s %6lu MB/s 2data  %6lu MB/s datap (gen %s)%s\n",
+	       ra->name, mbps(loops2, ns2), mbps(loopsp, nsp),
+	       raid6_call.name, err ? "  *** ERRORS ***" : "");
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct raid6_calls *const *algo;
+	const struct raid6_recov_calls *const *ra;
+	int i, j, p1, p2;
+	int err = 0;
+
+	makedata(0, NDISKS-1);
+
+	for (ra = raid6_recov_algos; *ra; ra++) {
+		if ((*ra)->valid  && !(*ra)->valid())
+			continue;
+
+		raid6_2data_recov = (*ra)->data2;
+		raid6_datap_recov = (*ra)->datap;
+
+		printf("using recovery %s\n", (*ra)->name);
+
+		for (algo = raid6_algos; *algo; algo++) {
+			if ((*algo)->valid && !(*algo)->valid())
+				continue;
+
+			raid6_call = **algo;
+
+			/* Nuke syndromes */
+			memset(data[NDISKS-2], 0xee, 2*PAGE_SIZE);
+
+			/* Generate assumed good syndrome */
+			raid6_call.gen_syndrome(NDISKS, PAGE_SIZE,
+						(void **)&dataptrs);
+
+			for (i = 0; i < NDISKS-1; i++)
+				for (j = i+1; j < NDISKS; j++)
+					err += test_disks(i, j);
+
+			/* Refresh a couple of disks and regenerate */
+			p1 = rand() % (NDISKS-2);
+			p2 = rand() % (NDISKS-2);
+			makedata(p1 < p2 ? p1 : p2, p1 < p2 ? p2 : p1);
+			raid6_call.gen_syndrome(NDISKS, PAGE_SIZE,
+						(void **)&dataptrs);
+
+			for (i = 0; i < NDISKS-1; i++)
+				for (j = i+1; j < NDISKS; j++)
+					err += test_disks(i, j);
+		}
+		printf("%s\n", err ? "*** ERRORS FOUND ***" : "all OK");
+	}
+
+	printf("\n");
+
+	for (algo = raid6_algos; *algo; algo++) {
+		if ((*algo)->valid && !(*algo)->valid())
+			continue;
+
+		raid6_call = **algo;
+		bench_gen();
+	}
+
+	printf("\n");
+
+	/* Pick the best algorithm, as the kernel would at boot */
+	raid6_select_algo();
+
+	for (ra = raid6_recov_algos; *ra; ra++) {
+		if ((*ra)->valid  && !(*ra)->valid())
+			continue;
+
+		raid6_call.gen_syndrome(NDISKS, PAGE_SIZE, (void **)&dataptrs);
+		err += bench_recov(*ra);
+	}
+
+	if (err)
+		printf("\n*** ERRORS FOUND ***\n");
+
+	return err;
+}
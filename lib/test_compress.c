@@ -0,0 +1,394 @@
+/*
+ * Benchmark module comparing the lib/ compressors
+ *
+ * Runs zlib, LZO, LZO-RLE, LZ4, LZ4HC and zstd over the same page corpora
+ * (zero-filled, sparse, partially zeroed, text and incompressible pages),
+ * checks that every page round-trips and prints compressed size and MB/s
+ * for each, so that zram, pstore and squashfs users can pick an algorithm
+ * from numbers measured on their own hardware.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/zlib.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+#include <linux/zstd.h>
+
+static unsigned int iterations = 500;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of times each page is processed");
+
+#define TEST_PAGES	16
+#define TEST_LEN	(TEST_PAGES * PAGE_SIZE)
+#define TEST_DST_STRIDE	(2 * PAGE_SIZE)
+
+/* zlib parameters used by pstore */
+#define ZLIB_WINDOW_BITS	12
+#define ZLIB_MEM_LEVEL		4
+
+/*
+ * Every algorithm is reduced to the zstd calling convention: *dst_len is
+ * the capacity of 'dst' on entry and the produced length on return.
+ */
+struct compress_algo {
+	const char *name;
+	int level;
+	size_t (*wrkmem_size)(int level);
+	int (*compress)(const u8 *src, size_t src_len, u8 *dst,
+			size_t *dst_len, void *wrkmem, int level);
+	int (*decompress)(const u8 *src, size_t src_len, u8 *dst,
+			  size_t *dst_len, void *wrkmem);
+};
+
+static size_t zlib_wrkmem_size(int level)
+{
+	return max(zlib_deflate_workspacesize(ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL),
+		   zlib_inflate_workspacesize());
+}
+
+static int zlib_test_compress(const u8 *src, size_t src_len, u8 *dst,
+			      size_t *dst_len, void *wrkmem, int level)
+{
+	struct z_stream_s stream = { .workspace = wrkmem };
+	int err;
+
+	err = zlib_deflateInit2(&stream, level, Z_DEFLATED, ZLIB_WINDOW_BITS,
+				ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+	if (err != Z_OK)
+		return -EINVAL;
+
+	stream.next_in = src;
+	stream.avail_in = src_len;
+	stream.next_out = dst;
+	stream.avail_out = *dst_len;
+
+	err = zlib_deflate(&stream, Z_FINISH);
+	zlib_deflateEnd(&stream);
+	if (err != Z_STREAM_END)
+		return -EINVAL;
+
+	*dst_len = stream.total_out;
+	return 0;
+}
+
+static int zlib_test_decompress(const u8 *src, size_t src_len, u8 *dst,
+				size_t *dst_len, void *wrkmem)
+{
+	struct z_stream_s stream = { .workspace = wrkmem };
+	int err;
+
+	err = zlib_inflateInit2(&stream, ZLIB_WINDOW_BITS);
+	if (err != Z_OK)
+		return -EINVAL;
+
+	stream.next_in = src;
+	stream.avail_in = src_len;
+	stream.next_out = dst;
+	stream.avail_out = *dst_len;
+
+	err = zlib_inflate(&stream, Z_FINISH);
+	zlib_inflateEnd(&stream);
+	if (err != Z_STREAM_END)
+		return -EINVAL;
+
+	*dst_len = stream.total_out;
+	return 0;
+}
+
+static size_t lzo_wrkmem_size(int level)
+{
+	return LZO1X_1_MEM_COMPRESS;
+}
+
+static int lzo_test_compress(const u8 *src, size_t src_len, u8 *dst,
+			     size_t *dst_len, void *wrkmem, int level)
+{
+	return lzo1x_1_compress(src, src_len, dst, dst_len, wrkmem) ==
+		LZO_E_OK ? 0 : -EINVAL;
+}
+
+static int lzorle_test_compress(const u8 *src, size_t src_len, u8 *dst,
+				size_t *dst_len, void *wrkmem, int level)
+{
+	return lzorle1x_1_compress(src, src_len, dst, dst_len, wrkmem) ==
+		LZO_E_OK ? 0 : -EINVAL;
+}
+
+static int lzo_test_decompress(const u8 *src, size_t src_len, u8 *dst,
+			       size_t *dst_len, void *wrkmem)
+{
+	return lzo1x_decompress_safe(src, src_len, dst, dst_len) ==
+		LZO_E_OK ? 0 : -EINVAL;
+}
+
+static size_t lz4_wrkmem_size(int level)
+{
+	return LZ4_MEM_COMPRESS;
+}
+
+static size_t lz4hc_wrkmem_size(int level)
+{
+	return LZ4HC_MEM_COMPRESS;
+}
+
+static int lz4_test_compress(const u8 *src, size_t src_len, u8 *dst,
+			     size_t *dst_len, void *wrkmem, int level)
+{
+	return lz4_compress(src, src_len, dst, dst_len, wrkmem) ? -EINVAL : 0;
+}
+
+static int lz4hc_test_compress(const u8 *src, size_t src_len, u8 *dst,
+			       size_t *dst_len, void *wrkmem, int level)
+{
+	return lz4hc_compress(src, src_len, dst, dst_len, wrkmem) ?
+		-EINVAL : 0;
+}
+
+static int lz4_test_decompress(const u8 *src, size_t src_len, u8 *dst,
+			       size_t *dst_len, void *wrkmem)
+{
+	return lz4_decompress_unknownoutputsize(src, src_len, dst, dst_len) ?
+		-EINVAL : 0;
+}
+
+static size_t zstd_wrkmem_size(int level)
+{
+	return max(zstd_compress_workspace_size(level, PAGE_SIZE),
+		   zstd_decompress_workspace_size(PAGE_SIZE));
+}
+
+static int zstd_test_compress(const u8 *src, size_t src_len, u8 *dst,
+			      size_t *dst_len, void *wrkmem, int level)
+{
+	return zstd_compress(src, src_len, dst, dst_len, wrkmem,
+			     zstd_wrkmem_size(level), level);
+}
+
+static int zstd_test_decompress(const u8 *src, size_t src_len, u8 *dst,
+				size_t *dst_len, void *wrkmem)
+{
+	return zstd_decompress(src, src_len, dst, dst_len, wrkmem,
+			       zstd_decompress_workspace_size(PAGE_SIZE));
+}
+
+static const struct compress_algo algos[] = {
+	{ "deflate-1",	1, zlib_wrkmem_size,
+	  zlib_test_compress, zlib_test_decompress },
+	{ "deflate-6",	6, zlib_wrkmem_size,
+	  zlib_test_compress, zlib_test_decompress },
+	{ "lzo",	0, lzo_wrkmem_size,
+	  lzo_test_compress, lzo_test_decompress },
+	{ "lzo-rle",	0, lzo_wrkmem_size,
+	  lzorle_test_compress, lzo_test_decompress },
+	{ "lz4",	0, lz4_wrkmem_size,
+	  lz4_test_compress, lz4_test_decompress },
+	{ "lz4hc",	0, lz4hc_wrkmem_size,
+	  lz4hc_test_compress, lz4_test_decompress },
+	{ "zstd-1",	1, zstd_wrkmem_size,
+	  zstd_test_compress, zstd_test_decompress },
+	{ "zstd-3",	3, zstd_wrkmem_size,
+	  zstd_test_compress, zstd_test_decompress },
+	{ "zstd-9",	9, zstd_wrkmem_size,
+	  zstd_test_compress, zstd_test_decompress },
+};
+
+enum corpus_type {
+	CORPUS_ZERO,
+	CORPUS_SPARSE,
+	CORPUS_HALF_ZERO,
+	CORPUS_TEXT,
+	CORPUS_RANDOM,
+	CORPUS_MAX,
+};
+
+static const char * const corpus_name[CORPUS_MAX] = {
+	[CORPUS_ZERO]		= "zero",
+	[CORPUS_SPARSE]		= "sparse",
+	[CORPUS_HALF_ZERO]	= "half-zero",
+	[CORPUS_TEXT]		= "text",
+	[CORPUS_RANDOM]		= "random",
+};
+
+struct compress_test_buf {
+	u8 *src;
+	u8 *dst;
+	u8 *out;
+	size_t *clen;
+	void *wrkmem;
+};
+
+static void fill_corpus(u8 *buf, size_t len, enum corpus_type type)
+{
+	static const char words[] =
+		"ptr = kmalloc(size, GFP_KERNEL); if (!ptr) return -ENOMEM;\n"
+		"<html><body class=\"main\">hello</body></html> 3.14159 ";
+	size_t i;
+	u32 r;
+
+	switch (type) {
+	case CORPUS_ZERO:
+		memset(buf, 0, len);
+		break;
+	case CORPUS_SPARSE:
+		/* pointers and counters scattered through zeroed memory */
+		memset(buf, 0, len);
+		for (i = 0; i < len; i += 64) {
+			r = prandom_u32();
+			if (r & 1)
+				memcpy(buf + i + (r >> 28) * 4, &r, sizeof(r));
+		}
+		break;
+	case CORPUS_HALF_ZERO:
+		/* live data in the first half, untouched tail */
+		for (i = 0; i < len; i += PAGE_SIZE) {
+			prandom_bytes(buf + i, PAGE_SIZE / 2);
+			memset(buf + i + PAGE_SIZE / 2, 0, PAGE_SIZE / 2);
+		}
+		break;
+	case CORPUS_TEXT:
+		for (i = 0; i < len; i++) {
+			r = prandom_u32();
+			buf[i] = (r % 8) ? words[i % (sizeof(words) - 1)] :
+					   words[r % (sizeof(words) - 1)];
+		}
+		break;
+	case CORPUS_RANDOM:
+	default:
+		prandom_bytes(buf, len);
+		break;
+	}
+}
+
+static u64 mb_per_sec(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	return div64_u64(bytes * 1000, ns);
+}
+
+static int test_compress_algo(struct compress_test_buf *b,
+			      enum corpus_type type, const struct compress_algo *a)
+{
+	ktime_t start;
+	s64 cns, dns;
+	u64 total, clen_total = 0;
+	unsigned int it;
+	int i, ret;
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t dst_len = TEST_DST_STRIDE;
+
+			ret = a->compress(b->src + i * PAGE_SIZE, PAGE_SIZE,
+					  b->dst + i * TEST_DST_STRIDE,
+					  &dst_len, b->wrkmem, a->level);
+			if (ret) {
+				pr_err("%s/%s: compression failed (%d)\n",
+				       a->name, corpus_name[type], ret);
+				return -EINVAL;
+			}
+			b->clen[i] = dst_len;
+		}
+	}
+	cns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t out_len = PAGE_SIZE;
+
+			ret = a->decompress(b->dst + i * TEST_DST_STRIDE,
+					    b->clen[i], b->out + i * PAGE_SIZE,
+					    &out_len, b->wrkmem);
+			if (ret || out_len != PAGE_SIZE) {
+				pr_err("%s/%s: decompression failed (%d)\n",
+				       a->name, corpus_name[type], ret);
+				return -EINVAL;
+			}
+		}
+	}
+	dns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (memcmp(b->src, b->out, TEST_LEN)) {
+		pr_err("%s/%s: round trip mismatch\n", a->name,
+		       corpus_name[type]);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < TEST_PAGES; i++)
+		clen_total += b->clen[i];
+	total = (u64)TEST_LEN * iterations;
+
+	pr_info("%-9s %-9s: %5llu bytes/page  comp %5llu MB/s  decomp %5llu MB/s\n",
+		corpus_name[type], a->name,
+		div64_u64(clen_total, TEST_PAGES),
+		mb_per_sec(total, cns), mb_per_sec(total, dns));
+	return 0;
+}
+
+static int __init test_compress_init(void)
+{
+	struct compress_test_buf b;
+	enum corpus_type type;
+	size_t wrkmem_size = 0;
+	int i, ret = -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(algos); i++)
+		wrkmem_size = max(wrkmem_size,
+				  algos[i].wrkmem_size(algos[i].level));
+
+	b.src = vmalloc(TEST_LEN);
+	b.dst = vmalloc(TEST_PAGES * TEST_DST_STRIDE);
+	b.out = vmalloc(TEST_LEN);
+	b.clen = kcalloc(TEST_PAGES, sizeof(*b.clen), GFP_KERNEL);
+	b.wrkmem = vmalloc(wrkmem_size);
+	if (!b.src || !b.dst || !b.out || !b.clen || !b.wrkmem)
+		goto out;
+
+	pr_info("%u iterations over %d pages per corpus\n", iterations,
+		TEST_PAGES);
+
+	for (type = 0; type < CORPUS_MAX; type++) {
+		fill_corpus(b.src, TEST_LEN, type);
+
+		for (i = 0; i < ARRAY_SIZE(algos); i++) {
+			ret = test_compress_algo(&b, type, &algos[i]);
+			if (ret)
+				goto out;
+			cond_resched();
+		}
+	}
+
+	pr_info("all tests passed\n");
+out:
+	vfree(b.wrkmem);
+	kfree(b.clen);
+	vfree(b.out);
+	vfree(b.dst);
+	vfree(b.src);
+	return ret;
+}
+
+static void __exit test_compress_exit(void)
+{
+}
+
+module_init(test_compress_init);
+module_exit(test_compress_exit);
+
+MODULE_DESCRIPTION("lib/ compressor comparison benchmark module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,271 @@
+/*
+ * Load trace replay module for cpufreq governors
+ *
+ * Replays a few synthetic load traces on one CPU with a bound kthread and
+ * reports how the active governor of that CPU's policy responds.  A trace
+ * is a list of steps giving the share of every millisecond that needs CPU
+ * time at the policy's maximum frequency.  The work is done by spinning at
+ * whatever frequency the governor picked, so a low frequency makes it take
+ * longer and it runs into the following milliseconds.  Each trace reports:
+ *
+ *  - latency: time from a load increase until the frequency first reaches
+ *    what the new load needs, averaged and at worst over the trace;
+ *  - lag: the largest backlog of work that was running late;
+ *  - energy: busy time weighted by (f / f_max)^3, in microseconds at f_max,
+ *    a proxy for dynamic power that ignores idle power.
+ *
+ * Loading it once per governor on the same kernel, e.g. after writing
+ * "interactive" and then "schedutil" to scaling_governor, gives directly
+ * comparable numbers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cpufreq.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static unsigned int cpu;
+module_param(cpu, uint, 0444);
+MODULE_PARM_DESC(cpu, "CPU to replay the traces on");
+
+/* Each trace step lasts a number of 1ms slices */
+#define SLICE_NS	NSEC_PER_MSEC
+/* Frequency is re-read and work accounted at this granularity */
+#define CHUNK_NS	(50 * NSEC_PER_USEC)
+/* Fixed point for frequency ratios */
+#define RATIO_SHIFT	10
+
+struct load_step {
+	unsigned int ms;
+	unsigned int busy_pct;	/* of each slice, at maximum frequency */
+};
+
+struct load_trace {
+	const char *name;
+	const struct load_step *steps;
+	unsigned int nr_steps;
+};
+
+/* Idle, full load, idle: the plain step response */
+static const struct load_step trace_step[] = {
+	{ 300, 0 }, { 300, 100 }, { 300, 0 },
+};
+
+/* Short bursts separated by idle time, as with touch input */
+static const struct load_step trace_touch[] = {
+	{ 100, 0 }, { 30, 80 }, { 70, 5 }, { 30, 80 }, { 70, 5 },
+	{ 30, 80 }, { 70, 5 }, { 30, 80 }, { 200, 0 },
+};
+
+/* Load growing in steps */
+static const struct load_step trace_ramp[] = {
+	{ 100, 10 }, { 100, 30 }, { 100, 50 }, { 100, 70 }, { 100, 90 },
+	{ 100, 0 },
+};
+
+/* Periodic light load, as with video playback at 60 frames per second */
+static const struct load_step trace_video[] = {
+	{ 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 },
+	{ 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 },
+	{ 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 },
+	{ 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 }, { 4, 100 }, { 12, 0 },
+};
+
+#define TRACE(t)	{ #t, trace_##t, ARRAY_SIZE(trace_##t) }
+
+static const struct load_trace traces[] = {
+	TRACE(step),
+	TRACE(touch),
+	TRACE(ramp),
+	TRACE(video),
+};
+
+struct replay_result {
+	u64 latency_sum_ns;
+	u64 latency_max_ns;
+	unsigned int edges;
+	u64 lag_max_ns;
+	u64 energy_ns;
+	u64 elapsed_ns;
+};
+
+struct replay {
+	const struct load_trace *trace;
+	struct cpufreq_policy *policy;
+	struct replay_result res;
+	struct completion done;
+};
+
+static unsigned int freq_ratio(struct cpufreq_policy *policy)
+{
+	unsigned int cur = ACCESS_ONCE(policy->cur);
+
+	return min_t(u64, div_u64((u64)cur << RATIO_SHIFT,
+				  policy->cpuinfo.max_freq),
+		     1 << RATIO_SHIFT);
+}
+
+/*
+ * Spin until @backlog_ns of work at maximum frequency is done or @until is
+ * reached, crediting work and energy at the frequency of each chunk.
+ */
+static void run_work(struct replay *r, s64 *backlog_ns, ktime_t until,
+		     unsigned int need, ktime_t *edge)
+{
+	u64 ratio, elapsed;
+	ktime_t start, now;
+
+	now = ktime_get();
+	while (*backlog_ns > 0 && ktime_before(now, until)) {
+		start = now;
+		ratio = freq_ratio(r->policy);
+		while (ktime_to_ns(ktime_sub(now, start)) < CHUNK_NS)
+			now = ktime_get();
+		elapsed = ktime_to_ns(ktime_sub(now, start));
+
+		*backlog_ns -= (elapsed * ratio) >> RATIO_SHIFT;
+		r->res.energy_ns += (elapsed * ratio * ratio * ratio) >>
+				    (3 * RATIO_SHIFT);
+
+		if (edge->tv64 && ratio >= need) {
+			u64 latency = ktime_to_ns(ktime_sub(now, *edge));
+
+			r->res.latency_sum_ns += latency;
+			r->res.latency_max_ns = max(r->res.latency_max_ns,
+						    latency);
+			r->res.edges++;
+			edge->tv64 = 0;
+		}
+	}
+}
+
+static int replay_thread(void *data)
+{
+	struct replay *r = data;
+	const struct load_trace *t = r->trace;
+	unsigned int i, ms, need = 0, prev_pct = 0;
+	ktime_t start, slice_end, edge = { .tv64 = 0 };
+	s64 backlog = 0, rest;
+
+	start = ktime_get();
+	slice_end = start;
+	for (i = 0; i < t->nr_steps; i++) {
+		const struct load_step *s = &t->steps[i];
+
+		if (s->busy_pct > prev_pct) {
+			/* Frequency that does the step's work in real time */
+			need = (s->busy_pct << RATIO_SHIFT) / 100;
+			edge = ktime_get();
+		}
+		prev_pct = s->busy_pct;
+
+		for (ms = 0; ms < s->ms; ms++) {
+			slice_end = ktime_add_ns(slice_end, SLICE_NS);
+			backlog += div_u64((u64)SLICE_NS * s->busy_pct, 100);
+
+			run_work(r, &backlog, slice_end, need, &edge);
+			if (backlog > 0) {
+				r->res.lag_max_ns = max_t(u64, r->res.lag_max_ns,
+							  backlog);
+				continue;
+			}
+
+			backlog = 0;
+			rest = ktime_to_us(ktime_sub(slice_end, ktime_get()));
+			if (rest > 0)
+				usleep_range(rest, rest + 50);
+		}
+	}
+
+	/* Work left over at the end of the trace still has to be done */
+	run_work(r, &backlog, ktime_add_ns(ktime_get(), NSEC_PER_SEC), need,
+		 &edge);
+	r->res.elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	complete(&r->done);
+	return 0;
+}
+
+static int run_trace(struct cpufreq_policy *policy, const struct load_trace *t)
+{
+	struct task_struct *task;
+	struct replay r = {
+		.trace = t,
+		.policy = policy,
+	};
+	u64 duration = 0;
+	unsigned int i;
+
+	init_completion(&r.done);
+	task = kthread_create(replay_thread, &r, "test_cpufreq/%u", cpu);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	kthread_bind(task, cpu);
+
+	/* Let the previous trace's load decay first */
+	msleep(500);
+	wake_up_process(task);
+	wait_for_completion(&r.done);
+
+	for (i = 0; i < t->nr_steps; i++)
+		duration += t->steps[i].ms;
+
+	pr_info("%-12s %-6s latency avg %6llu us max %6llu us, lag max %6llu us, energy %8llu us, overrun %6llu us\n",
+		policy->governor ? policy->governor->name : "none", t->name,
+		r.res.edges ? div_u64(r.res.latency_sum_ns,
+				      r.res.edges * NSEC_PER_USEC) : 0,
+		div_u64(r.res.latency_max_ns, NSEC_PER_USEC),
+		div_u64(r.res.lag_max_ns, NSEC_PER_USEC),
+		div_u64(r.res.energy_ns, NSEC_PER_USEC),
+		div_u64(max_t(s64, r.res.elapsed_ns -
+			      duration * NSEC_PER_MSEC, 0), NSEC_PER_USEC));
+	return 0;
+}
+
+static int __init test_cpufreq_gov_init(void)
+{
+	struct cpufreq_policy *policy;
+	int i, ret = 0;
+
+	if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return -EINVAL;
+
+	policy = cpufreq_cpu_get(cpu);
+	if (!policy) {
+		pr_err("no cpufreq policy for CPU%u\n", cpu);
+		return -ENODEV;
+	}
+
+	pr_info("CPU%u: %u-%u kHz, governor %s\n", cpu, policy->min,
+		policy->max, policy->governor ? policy->governor->name : "none");
+
+	for (i = 0; i < ARRAY_SIZE(traces); i++) {
+		ret = run_trace(policy, &traces[i]);
+		if (ret)
+			break;
+	}
+
+	cpufreq_cpu_put(policy);
+	return ret;
+}
+
+static void __exit test_cpufreq_gov_exit(void)
+{
+}
+
+module_init(test_cpufreq_gov_init);
+module_exit(test_cpufreq_gov_exit);
+
+MODULE_DESCRIPTION("cpufreq governor load trace replay module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,233 @@
+/*
+ * Test module for the mem_latency devfreq governor
+ *
+ * Registers a software memory latency monitor whose counters follow a
+ * script instead of a PMU, and a devfreq device "test_memlat" on top of it
+ * using the governor.  The script runs a compute bound phase, a memory
+ * bound phase with many stalled cycles and one just as memory heavy but
+ * hardly stalled, the last with the governor's stall_floor set, and checks
+ * the frequency the governor picked in each.  The governor's statistics are
+ * printed at the end.  Loading it needs no PMU, so it runs on any machine.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/devfreq.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include "../drivers/devfreq/governor_memlat.h"
+
+#define NAME		"test_memlat"
+#define SYSFS_DIR	"/sys/class/devfreq/" NAME "/mem_latency/"
+#define NR_CORES	2
+#define POLL_MS		10
+/* Samples the governor gets to settle on a phase */
+#define PHASE_SAMPLES	10
+
+/* The governor's default mult_factor, and the stall_floor of phase 3 */
+#define MULT_FACTOR	8
+#define STALL_FLOOR	50
+
+struct memlat_phase {
+	const char *name;
+	unsigned long inst;
+	unsigned long mem;
+	unsigned long mhz;
+	unsigned int stall_pct;
+	unsigned int stall_floor;
+	unsigned long want;
+};
+
+static unsigned int freq_table[] = { 1600, 4000, 8000, 12000, 16000 };
+
+static const struct memlat_phase phases[] = {
+	{ "compute bound", 1000000, 1000, 1500, 5, 0, 1600 },
+	{ "memory bound", 1000000, 200000, 1500, 60, 0,
+	  1500 * MULT_FACTOR },
+	{ "memory heavy, no stall", 1000000, 200000, 1500, 10, STALL_FLOOR,
+	  1600 },
+};
+
+static const struct memlat_phase *cur_phase;
+static unsigned long cur_freq;
+static struct dev_stats core_stats[NR_CORES];
+static struct device *test_dev;
+
+/* Every core reports the counts of the current phase */
+static unsigned long test_get_cnt(struct memlat_hwmon *hw)
+{
+	const struct memlat_phase *p = ACCESS_ONCE(cur_phase);
+	int i;
+
+	for (i = 0; i < hw->num_cores; i++) {
+		hw->core_stats[i].inst_count = p->inst;
+		hw->core_stats[i].mem_count = p->mem;
+		hw->core_stats[i].freq = p->mhz;
+		hw->core_stats[i].stall_pct = p->stall_pct;
+	}
+	return 0;
+}
+
+static int test_start_hwmon(struct memlat_hwmon *hw)
+{
+	return 0;
+}
+
+static void test_stop_hwmon(struct memlat_hwmon *hw)
+{
+}
+
+static struct memlat_hwmon test_hw = {
+	.start_hwmon = test_start_hwmon,
+	.stop_hwmon = test_stop_hwmon,
+	.get_cnt = test_get_cnt,
+	.num_cores = NR_CORES,
+	.core_stats = core_stats,
+};
+
+/* Lowest table frequency satisfying the vote */
+static int test_target(struct device *dev, unsigned long *freq, u32 flags)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(freq_table) - 1; i++)
+		if (freq_table[i] >= *freq)
+			break;
+	*freq = freq_table[i];
+	ACCESS_ONCE(cur_freq) = *freq;
+	return 0;
+}
+
+static struct devfreq_dev_profile test_profile = {
+	.initial_freq = 1600,
+	.polling_ms = POLL_MS,
+	.target = test_target,
+	.freq_table = freq_table,
+	.max_state = ARRAY_SIZE(freq_table),
+};
+
+static int write_attr(const char *name, unsigned int val)
+{
+	char path[96], buf[16];
+	struct file *file;
+	int len, ret;
+
+	snprintf(path, sizeof(path), SYSFS_DIR "%s", name);
+	file = filp_open(path, O_WRONLY, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+	len = snprintf(buf, sizeof(buf), "%u", val);
+	ret = kernel_write(file, buf, len, 0);
+	filp_close(file, NULL);
+	return ret < 0 ? ret : 0;
+}
+
+static void print_stats(void)
+{
+	struct file *file;
+	char *buf, *line, *p;
+	int len;
+
+	buf = kzalloc(PAGE_SIZE + 1, GFP_KERNEL);
+	if (!buf)
+		return;
+	file = filp_open(SYSFS_DIR "stats", O_RDONLY, 0);
+	if (IS_ERR(file)) {
+		kfree(buf);
+		return;
+	}
+	len = kernel_read(file, 0, buf, PAGE_SIZE);
+	filp_close(file, NULL);
+
+	if (len > 0)
+		for (p = buf; (line = strsep(&p, "\n")) != NULL;)
+			if (*line)
+				pr_info("stats: %s\n", line);
+	kfree(buf);
+}
+
+static int run_phases(void)
+{
+	const struct memlat_phase *p;
+	unsigned long got;
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(phases); i++) {
+		p = &phases[i];
+
+		ret = write_attr("stall_floor", p->stall_floor);
+		if (ret)
+			return ret;
+		ACCESS_ONCE(cur_phase) = p;
+		msleep(PHASE_SAMPLES * POLL_MS);
+
+		got = ACCESS_ONCE(cur_freq);
+		pr_info("%-24s ratio %lu stall %u%%: %lu\n", p->name,
+			p->inst / p->mem, p->stall_pct, got);
+		if (got != p->want) {
+			pr_err("%s: voted %lu, want %lu\n", p->name, got,
+			       p->want);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int __init test_devfreq_memlat_init(void)
+{
+	struct devfreq *df;
+	int i, ret;
+
+	test_dev = root_device_register(NAME);
+	if (IS_ERR(test_dev))
+		return PTR_ERR(test_dev);
+
+	for (i = 0; i < NR_CORES; i++)
+		core_stats[i].id = i;
+	cur_phase = &phases[0];
+	test_hw.dev = test_dev;
+
+	ret = register_memlat(test_dev, &test_hw);
+	if (ret)
+		goto out_dev;
+
+	df = devfreq_add_device(test_dev, &test_profile, "mem_latency", NULL);
+	if (IS_ERR(df)) {
+		ret = PTR_ERR(df);
+		goto out_memlat;
+	}
+
+	ret = run_phases();
+	print_stats();
+
+	devfreq_remove_device(df);
+out_memlat:
+	unregister_memlat(&test_hw);
+out_dev:
+	root_device_unregister(test_dev);
+
+	if (ret) {
+		pr_err("failed: %d\n", ret);
+		return ret;
+	}
+	pr_info("all tests passed\n");
+	return 0;
+}
+
+static void __exit test_devfreq_memlat_exit(void)
+{
+}
+
+module_init(test_devfreq_memlat_init);
+module_exit(test_devfreq_memlat_exit);
+
+MODULE_DESCRIPTION("mem_latency devfreq governor test module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,306 @@
+/*
+ * Test and benchmark module for the in-kernel LZ4 library
+ *
+ * Compresses and decompresses a set of page-sized corpora modelled on
+ * what zram and squashfs see (zero, sparse, text-like, repetitive and
+ * incompressible pages), verifies the round trip and reports throughput
+ * in MB/s for every acceleration level, plus a streaming pass that links
+ * consecutive pages through a 64KB history.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/lz4.h>
+
+static unsigned int iterations = 2000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of times each page is processed");
+
+#define TEST_PAGES	16
+#define TEST_LEN	(TEST_PAGES * PAGE_SIZE)
+
+enum corpus_type {
+	CORPUS_ZERO,
+	CORPUS_SPARSE,
+	CORPUS_TEXT,
+	CORPUS_REPEAT,
+	CORPUS_RANDOM,
+	CORPUS_MAX,
+};
+
+static const char * const corpus_name[CORPUS_MAX] = {
+	[CORPUS_ZERO]	= "zero",
+	[CORPUS_SPARSE]	= "sparse",
+	[CORPUS_TEXT]	= "text",
+	[CORPUS_REPEAT]	= "repeat",
+	[CORPUS_RANDOM]	= "random",
+};
+
+static const int accel_levels[] = { 1, 2, 4, 8, 16, 64 };
+
+struct lz4_test_buf {
+	u8 *src;
+	u8 *dst;
+	u8 *out;
+	size_t *clen;
+	void *wrkmem;
+};
+
+static void fill_corpus(u8 *buf, size_t len, enum corpus_type type)
+{
+	static const char words[] =
+		"the quick brown fox jumps over a lazy dog; 0123456789 "
+		"int main(void) { return 0; } /* kernel */ {\"key\": 1}\n";
+	size_t i;
+	u32 r;
+
+	switch (type) {
+	case CORPUS_ZERO:
+		memset(buf, 0, len);
+		break;
+	case CORPUS_SPARSE:
+		/* mostly-zero pages with scattered words, as in anon memory */
+		memset(buf, 0, len);
+		for (i = 0; i < len; i += sizeof(u64) * 16) {
+			r = prandom_u32();
+			if (r & 1)
+				memcpy(buf + i, &r, sizeof(r));
+		}
+		break;
+	case CORPUS_TEXT:
+		for (i = 0; i < len; i++) {
+			r = prandom_u32();
+			buf[i] = words[r % (sizeof(words) - 1)];
+			if ((r >> 16) % 8)
+				buf[i] = words[i % (sizeof(words) - 1)];
+		}
+		break;
+	case CORPUS_REPEAT:
+		for (i = 0; i < len; i++)
+			buf[i] = (i % 37) * 7;
+		break;
+	case CORPUS_RANDOM:
+	default:
+		prandom_bytes(buf, len);
+		break;
+	}
+}
+
+static u64 mb_per_sec(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	return div64_u64(bytes * 1000, ns);
+}
+
+static int test_lz4_block(struct lz4_test_buf *b, enum corpus_type type,
+			  int accel)
+{
+	ktime_t start;
+	s64 cns, dns;
+	u64 total = 0, clen_total = 0;
+	unsigned int it;
+	int i, ret;
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t dst_len = lz4_compressbound(PAGE_SIZE);
+
+			ret = lz4_compress_fast(b->src + i * PAGE_SIZE,
+					PAGE_SIZE, b->dst + i * 2 * PAGE_SIZE,
+					&dst_len, b->wrkmem, accel);
+			if (ret) {
+				pr_err("%s: compression failed\n",
+				       corpus_name[type]);
+				return ret;
+			}
+			b->clen[i] = dst_len;
+		}
+	}
+	cns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t out_len = PAGE_SIZE;
+
+			ret = lz4_decompress_unknownoutputsize(
+					b->dst + i * 2 * PAGE_SIZE, b->clen[i],
+					b->out + i * PAGE_SIZE, &out_len);
+			if (ret || out_len != PAGE_SIZE) {
+				pr_err("%s: decompression failed\n",
+				       corpus_name[type]);
+				return -EINVAL;
+			}
+		}
+	}
+	dns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (memcmp(b->src, b->out, TEST_LEN)) {
+		pr_err("%s: round trip mismatch (accel %d)\n",
+		       corpus_name[type], accel);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < TEST_PAGES; i++)
+		clen_total += b->clen[i];
+	total = (u64)TEST_LEN * iterations;
+
+	pr_info("%-6s accel %2d: ratio %3llu%%  comp %5llu MB/s  decomp %5llu MB/s\n",
+		corpus_name[type], accel,
+		div64_u64(clen_total * 100, TEST_LEN),
+		mb_per_sec(total, cns), mb_per_sec(total, dns));
+	return 0;
+}
+
+static int test_lz4_stream(struct lz4_test_buf *b, enum corpus_type type)
+{
+	struct lz4_stream_decode sd;
+	size_t clen_total = 0;
+	int i, ret;
+
+	lz4_reset_stream(b->wrkmem);
+	lz4_set_stream_decode(&sd, NULL, 0);
+
+	/*
+	 * Pages are consecutive in b->src and decoded into consecutive
+	 * pages of b->out, so each block sees the previous ones as prefix.
+	 */
+	for (i = 0; i < TEST_PAGES; i++) {
+		size_t dst_len = 2 * PAGE_SIZE;
+		size_t out_len = PAGE_SIZE;
+
+		ret = lz4_compress_fast_continue(b->wrkmem,
+				b->src + i * PAGE_SIZE, PAGE_SIZE,
+				b->dst, &dst_len, LZ4_ACCELERATION_DEFAULT);
+		if (ret) {
+			pr_err("%s: stream compression failed\n",
+			       corpus_name[type]);
+			return ret;
+		}
+		clen_total += dst_len;
+
+		ret = lz4_decompress_safe_continue(&sd, b->dst, dst_len,
+				b->out + i * PAGE_SIZE, &out_len);
+		if (ret || out_len != PAGE_SIZE) {
+			pr_err("%s: stream decompression failed\n",
+			       corpus_name[type]);
+			return -EINVAL;
+		}
+	}
+
+	if (memcmp(b->src, b->out, TEST_LEN)) {
+		pr_err("%s: stream round trip mismatch\n", corpus_name[type]);
+		return -EINVAL;
+	}
+
+	pr_info("%-6s stream   : ratio %3zu%%\n", corpus_name[type],
+		clen_total * 100 / TEST_LEN);
+	return 0;
+}
+
+/*
+ * A hand-built block: one literal, a 4-byte match at offset 1 and 27
+ * trailing literals, 32 bytes of output.  Patching the offset to 2 makes
+ * the match reach one byte behind dest, which must be rejected.
+ */
+static int test_lz4_bad_offset(struct lz4_test_buf *b)
+{
+	u8 *src = b->dst;
+	u8 *dest = b->out + PAGE_SIZE;
+	size_t src_len;
+	int ret;
+
+	memset(src, 0, 64);
+	src[0] = 0x10;		/* 1 literal, match length 4 */
+	src[1] = 'a';
+	src[2] = 0x01;		/* offset 1 */
+	src[3] = 0x00;
+	src[4] = 0xf0;		/* 15 + 12 trailing literals */
+	src[5] = 12;
+	memset(src + 6, 'b', 27);
+
+	ret = lz4_decompress(src, &src_len, dest, 32);
+	if (ret || src_len != 33 || memcmp(dest, "aaaaab", 6)) {
+		pr_err("bad offset: valid block rejected\n");
+		return -EINVAL;
+	}
+
+	src[2] = 0x02;		/* offset 2, one byte behind dest */
+	ret = lz4_decompress(src, &src_len, dest, 32);
+	if (ret != -1) {
+		pr_err("bad offset: match behind dest accepted\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int __init test_lz4_init(void)
+{
+	struct lz4_test_buf b;
+	enum corpus_type type;
+	int i, ret = -ENOMEM;
+
+	b.src = vmalloc(TEST_LEN);
+	b.dst = vmalloc(2 * TEST_LEN);
+	b.out = vmalloc(TEST_LEN);
+	b.clen = kcalloc(TEST_PAGES, sizeof(*b.clen), GFP_KERNEL);
+	b.wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	if (!b.src || !b.dst || !b.out || !b.clen || !b.wrkmem)
+		goto out;
+
+	pr_info("%u iterations over %d pages per corpus\n", iterations,
+		TEST_PAGES);
+
+	ret = test_lz4_bad_offset(&b);
+	if (ret)
+		goto out;
+
+	for (type = 0; type < CORPUS_MAX; type++) {
+		fill_corpus(b.src, TEST_LEN, type);
+
+		for (i = 0; i < ARRAY_SIZE(accel_levels); i++) {
+			ret = test_lz4_block(&b, type, accel_levels[i]);
+			if (ret)
+				goto out;
+			cond_resched();
+		}
+
+		ret = test_lz4_stream(&b, type);
+		if (ret)
+			goto out;
+	}
+
+	pr_info("all tests passed\n");
+out:
+	vfree(b.wrkmem);
+	kfree(b.clen);
+	vfree(b.out);
+	vfree(b.dst);
+	vfree(b.src);
+	return ret;
+}
+
+static void __exit test_lz4_exit(void)
+{
+}
+
+module_init(test_lz4_init);
+module_exit(test_lz4_exit);
+
+MODULE_DESCRIPTION("LZ4 test and benchmark module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,229 @@
+/*
+ * Test and benchmark module for LZO1X and LZO-RLE
+ *
+ * Runs both bitstream versions over page corpora resembling what zram
+ * receives from swap (zero-filled, sparse, partially zeroed, text and
+ * incompressible pages), checks that every page round-trips through
+ * lzo1x_decompress_safe() and prints compressed size and MB/s for each.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/lzo.h>
+
+static unsigned int iterations = 2000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of times each page is processed");
+
+#define TEST_PAGES	16
+#define TEST_LEN	(TEST_PAGES * PAGE_SIZE)
+#define TEST_DST_STRIDE	lzo1x_worst_compress(PAGE_SIZE)
+
+typedef int (*lzo_compress_t)(const unsigned char *src, size_t src_len,
+			      unsigned char *dst, size_t *dst_len,
+			      void *wrkmem);
+
+static const struct {
+	const char *name;
+	lzo_compress_t compress;
+} lzo_variants[] = {
+	{ "lzo",	lzo1x_1_compress },
+	{ "lzo-rle",	lzorle1x_1_compress },
+};
+
+enum corpus_type {
+	CORPUS_ZERO,
+	CORPUS_SPARSE,
+	CORPUS_HALF_ZERO,
+	CORPUS_TEXT,
+	CORPUS_RANDOM,
+	CORPUS_MAX,
+};
+
+static const char * const corpus_name[CORPUS_MAX] = {
+	[CORPUS_ZERO]		= "zero",
+	[CORPUS_SPARSE]		= "sparse",
+	[CORPUS_HALF_ZERO]	= "half-zero",
+	[CORPUS_TEXT]		= "text",
+	[CORPUS_RANDOM]		= "random",
+};
+
+struct lzo_test_buf {
+	u8 *src;
+	u8 *dst;
+	u8 *out;
+	size_t *clen;
+	void *wrkmem;
+};
+
+static void fill_corpus(u8 *buf, size_t len, enum corpus_type type)
+{
+	static const char words[] =
+		"ptr = kmalloc(size, GFP_KERNEL); if (!ptr) return -ENOMEM;\n"
+		"<html><body class=\"main\">hello</body></html> 3.14159 ";
+	size_t i;
+	u32 r;
+
+	switch (type) {
+	case CORPUS_ZERO:
+		memset(buf, 0, len);
+		break;
+	case CORPUS_SPARSE:
+		/* pointers and counters scattered through zeroed memory */
+		memset(buf, 0, len);
+		for (i = 0; i < len; i += 64) {
+			r = prandom_u32();
+			if (r & 1)
+				memcpy(buf + i + (r >> 28) * 4, &r, sizeof(r));
+		}
+		break;
+	case CORPUS_HALF_ZERO:
+		/* live data in the first half, untouched tail */
+		for (i = 0; i < len; i += PAGE_SIZE) {
+			prandom_bytes(buf + i, PAGE_SIZE / 2);
+			memset(buf + i + PAGE_SIZE / 2, 0, PAGE_SIZE / 2);
+		}
+		break;
+	case CORPUS_TEXT:
+		for (i = 0; i < len; i++) {
+			r = prandom_u32();
+			buf[i] = (r % 8) ? words[i % (sizeof(words) - 1)] :
+					   words[r % (sizeof(words) - 1)];
+		}
+		break;
+	case CORPUS_RANDOM:
+	default:
+		prandom_bytes(buf, len);
+		break;
+	}
+}
+
+static u64 mb_per_sec(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	return div64_u64(bytes * 1000, ns);
+}
+
+static int test_lzo_variant(struct lzo_test_buf *b, enum corpus_type type,
+			    int v)
+{
+	ktime_t start;
+	s64 cns, dns;
+	u64 total, clen_total = 0;
+	unsigned int it;
+	int i, ret;
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t dst_len;
+
+			ret = lzo_variants[v].compress(b->src + i * PAGE_SIZE,
+					PAGE_SIZE, b->dst + i * TEST_DST_STRIDE,
+					&dst_len, b->wrkmem);
+			if (ret != LZO_E_OK) {
+				pr_err("%s/%s: compression failed (%d)\n",
+				       lzo_variants[v].name, corpus_name[type],
+				       ret);
+				return -EINVAL;
+			}
+			b->clen[i] = dst_len;
+		}
+	}
+	cns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < TEST_PAGES; i++) {
+			size_t out_len = PAGE_SIZE;
+
+			ret = lzo1x_decompress_safe(b->dst + i * TEST_DST_STRIDE,
+					b->clen[i], b->out + i * PAGE_SIZE,
+					&out_len);
+			if (ret != LZO_E_OK || out_len != PAGE_SIZE) {
+				pr_err("%s/%s: decompression failed (%d)\n",
+				       lzo_variants[v].name, corpus_name[type],
+				       ret);
+				return -EINVAL;
+			}
+		}
+	}
+	dns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (memcmp(b->src, b->out, TEST_LEN)) {
+		pr_err("%s/%s: round trip mismatch\n", lzo_variants[v].name,
+		       corpus_name[type]);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < TEST_PAGES; i++)
+		clen_total += b->clen[i];
+	total = (u64)TEST_LEN * iterations;
+
+	pr_info("%-9s %-7s: %5llu bytes/page  comp %5llu MB/s  decomp %5llu MB/s\n",
+		corpus_name[type], lzo_variants[v].name,
+		div64_u64(clen_total, TEST_PAGES),
+		mb_per_sec(total, cns), mb_per_sec(total, dns));
+	return 0;
+}
+
+static int __init test_lzo_init(void)
+{
+	struct lzo_test_buf b;
+	enum corpus_type type;
+	int v, ret = -ENOMEM;
+
+	b.src = vmalloc(TEST_LEN);
+	b.dst = vmalloc(TEST_PAGES * TEST_DST_STRIDE);
+	b.out = vmalloc(TEST_LEN);
+	b.clen = kcalloc(TEST_PAGES, sizeof(*b.clen), GFP_KERNEL);
+	b.wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	if (!b.src || !b.dst || !b.out || !b.clen || !b.wrkmem)
+		goto out;
+
+	pr_info("%u iterations over %d pages per corpus\n", iterations,
+		TEST_PAGES);
+
+	for (type = 0; type < CORPUS_MAX; type++) {
+		fill_corpus(b.src, TEST_LEN, type);
+
+		for (v = 0; v < ARRAY_SIZE(lzo_variants); v++) {
+			ret = test_lzo_variant(&b, type, v);
+			if (ret)
+				goto out;
+			cond_resched();
+		}
+	}
+
+	pr_info("all tests passed\n");
+out:
+	vfree(b.wrkmem);
+	kfree(b.clen);
+	vfree(b.out);
+	vfree(b.dst);
+	vfree(b.src);
+	return ret;
+}
+
+static void __exit test_lzo_exit(void)
+{
+}
+
+module_init(test_lzo_init);
+module_exit(test_lzo_exit);
+
+MODULE_DESCRIPTION("LZO/LZO-RLE test and benchmark module");
+MODULE_LICENSE("GPL");
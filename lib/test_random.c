@@ -0,0 +1,275 @@
+/*
+ * Benchmark module for the kernel random number interfaces
+ *
+ * Checks the ChaCha20 block function against the RFC 7539 test vector,
+ * then prints bytes/s and per-call latency of get_random_bytes() for a
+ * few request sizes, of the get_random_u32()/get_random_u64() words and
+ * of the mix of words a fork+exec draws, first on one CPU and then with
+ * every online CPU generating at once.  Loading
+ * it on kernels before and after a change to drivers/char/random.c
+ * gives directly comparable numbers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <crypto/chacha20.h>
+
+static unsigned int iterations = 20000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of calls timed per test and CPU");
+
+#define TEST_BUF_SIZE	4096
+
+/*
+ * A fork+exec draws a long for the stack canary and the mmap base and an
+ * int each for the stack and brk offsets; OP_FORK replays that mix.
+ */
+#define FORK_RANDOM_BYTES	(2 * sizeof(unsigned long) + \
+				 2 * sizeof(unsigned int))
+
+enum test_random_op {
+	OP_BYTES,
+	OP_INT,
+	OP_LONG,
+	OP_U32,
+	OP_U64,
+	OP_FORK,
+};
+
+struct test_random_case {
+	const char *name;
+	enum test_random_op op;
+	int len;
+};
+
+static const struct test_random_case cases[] = {
+	{ "bytes",	OP_BYTES,	16 },
+	{ "bytes",	OP_BYTES,	64 },
+	{ "bytes",	OP_BYTES,	512 },
+	{ "bytes",	OP_BYTES,	TEST_BUF_SIZE },
+	{ "int",	OP_INT,		sizeof(unsigned int) },
+	{ "long",	OP_LONG,	sizeof(unsigned long) },
+	{ "u32",	OP_U32,		sizeof(u32) },
+	{ "u64",	OP_U64,		sizeof(u64) },
+	{ "fork",	OP_FORK,	FORK_RANDOM_BYTES },
+};
+
+/* RFC 7539 section 2.3.2 */
+static const u32 chacha20_tv_state[16] = {
+	0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+	0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c,
+	0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c,
+	0x00000001, 0x09000000, 0x4a000000, 0x00000000,
+};
+
+static const u8 chacha20_tv_out[CHACHA20_BLOCK_SIZE] = {
+	0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15,
+	0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+	0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03,
+	0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+	0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09,
+	0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+	0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9,
+	0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e,
+};
+
+static int test_chacha20(void)
+{
+	u32 state[16];
+	u8 out[CHACHA20_BLOCK_SIZE];
+
+	memcpy(state, chacha20_tv_state, sizeof(state));
+	chacha20_block(state, out);
+
+	if (memcmp(out, chacha20_tv_out, sizeof(out)) || state[12] != 2) {
+		pr_err("chacha20_block does not match RFC 7539\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Run one case @iterations times and return the elapsed nanoseconds. */
+static u64 run_case(const struct test_random_case *c, void *buf)
+{
+	unsigned long sink = 0;
+	ktime_t start;
+	unsigned int i;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		switch (c->op) {
+		case OP_BYTES:
+			get_random_bytes(buf, c->len);
+			break;
+		case OP_INT:
+			sink += get_random_int();
+			break;
+		case OP_LONG:
+			sink += get_random_long();
+			break;
+		case OP_U32:
+			sink += get_random_u32();
+			break;
+		case OP_U64:
+			sink += get_random_u64();
+			break;
+		case OP_FORK:
+			sink += get_random_long();
+			sink += get_random_long();
+			sink += get_random_int();
+			sink += get_random_int();
+			break;
+		}
+	}
+	*(unsigned long *)buf = sink;
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void report(const char *mode, const struct test_random_case *c,
+		   unsigned int threads, u64 ns)
+{
+	u64 calls = (u64)iterations * threads;
+	u64 bytes = calls * c->len;
+
+	if (!ns)
+		ns = 1;
+	pr_info("%-8s %-5s %4d bytes: %6llu MB/s  %6llu ns/call\n",
+		mode, c->name, c->len,
+		div64_u64(bytes * NSEC_PER_SEC >> 20, ns),
+		div64_u64(ns * threads, calls));
+}
+
+struct test_random_thread {
+	const struct test_random_case *c;
+	atomic_t *running;
+	struct completion *done;
+	void *buf;
+};
+
+static int test_random_thread(void *data)
+{
+	struct test_random_thread *t = data;
+
+	run_case(t->c, t->buf);
+	if (atomic_dec_and_test(t->running))
+		complete(t->done);
+	return 0;
+}
+
+/* Time @c with one bound thread per online CPU running concurrently. */
+static int run_parallel(const struct test_random_case *c)
+{
+	struct test_random_thread *t;
+	struct task_struct **tasks;
+	struct completion done;
+	atomic_t running;
+	unsigned int n = 0, i;
+	ktime_t start;
+	int cpu, ret = 0;
+	u64 ns;
+
+	t = kcalloc(nr_cpu_ids, sizeof(*t), GFP_KERNEL);
+	tasks = kcalloc(nr_cpu_ids, sizeof(*tasks), GFP_KERNEL);
+	if (!t || !tasks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	init_completion(&done);
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		t[n].c = c;
+		t[n].running = &running;
+		t[n].done = &done;
+		t[n].buf = kmalloc(TEST_BUF_SIZE, GFP_KERNEL);
+		if (!t[n].buf)
+			break;
+		tasks[n] = kthread_create(test_random_thread, &t[n],
+					  "test_random/%d", cpu);
+		if (IS_ERR(tasks[n])) {
+			kfree(t[n].buf);
+			break;
+		}
+		kthread_bind(tasks[n], cpu);
+		n++;
+	}
+	put_online_cpus();
+
+	if (!n) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	atomic_set(&running, n);
+	start = ktime_get();
+	for (i = 0; i < n; i++)
+		wake_up_process(tasks[i]);
+	wait_for_completion(&done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	report("parallel", c, n, ns);
+
+	for (i = 0; i < n; i++)
+		kfree(t[i].buf);
+out:
+	kfree(tasks);
+	kfree(t);
+	return ret;
+}
+
+static int __init test_random_init(void)
+{
+	void *buf;
+	int i, ret;
+
+	ret = test_chacha20();
+	if (ret)
+		return ret;
+
+	buf = kmalloc(TEST_BUF_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	pr_info("%u calls per test and CPU, %u CPUs online\n", iterations,
+		num_online_cpus());
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		report("single", &cases[i], 1, run_case(&cases[i], buf));
+		cond_resched();
+	}
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		ret = run_parallel(&cases[i]);
+		if (ret)
+			break;
+	}
+
+	kfree(buf);
+	return ret;
+}
+
+static void __exit test_random_exit(void)
+{
+}
+
+module_init(test_random_init);
+module_exit(test_random_exit);
+
+MODULE_DESCRIPTION("get_random_bytes/get_random_u32 benchmark module");
+MODULE_LICENSE("GPL");
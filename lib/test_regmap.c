@@ -0,0 +1,367 @@
+/*
+ * Test module for the regmap register cache
+ *
+ * Puts an MMIO regmap with an rbtree cache on top of a plain memory
+ * buffer and checks that cached, volatile and coalesced accesses reach
+ * the right words, that lockless cache reads stay consistent while
+ * another thread grows and drops the cache, and then prints the cost of
+ * a cached read on one CPU and on every online CPU at once.  The map is
+ * kept until the module is removed, so its counters can be read from
+ * regmap/test_regmap/stats in debugfs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/device.h>
+#include <linux/regmap.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of reads timed per test and CPU");
+
+#define TEST_NUM_REGS		256
+#define TEST_REG(i)		((i) * 4)
+#define TEST_FIRST_VOLATILE	TEST_REG(192)
+
+/* Values carry their own register number so readers can check them. */
+#define TEST_VAL(reg, gen)	(((reg) << 16) | ((gen) & 0xffff))
+
+static struct device *test_dev;
+static struct regmap *test_map;
+static u32 *test_regs;
+
+static bool test_volatile_reg(struct device *dev, unsigned int reg)
+{
+	return reg >= TEST_FIRST_VOLATILE;
+}
+
+static const struct regmap_config test_regmap_config = {
+	.reg_bits = 32,
+	.val_bits = 32,
+	.reg_stride = 4,
+	.max_register = TEST_REG(TEST_NUM_REGS - 1),
+	.volatile_reg = test_volatile_reg,
+	.cache_type = REGCACHE_RBTREE,
+};
+
+static int check_reg(unsigned int reg, unsigned int expect)
+{
+	unsigned int val;
+	int ret;
+
+	ret = regmap_read(test_map, reg, &val);
+	if (ret) {
+		pr_err("reading %#x failed: %d\n", reg, ret);
+		return ret;
+	}
+	if (val != expect || test_regs[reg / 4] != expect) {
+		pr_err("%#x: read %#x, memory %#x, expected %#x\n", reg, val,
+		       test_regs[reg / 4], expect);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Fill the cached registers out of order so blocks have to be merged. */
+static int test_cache(void)
+{
+	unsigned int i, reg;
+	int ret;
+
+	for (i = 0; i < TEST_FIRST_VOLATILE / 4; i++) {
+		reg = TEST_REG((i * 37) % (TEST_FIRST_VOLATILE / 4));
+		ret = regmap_write(test_map, reg, TEST_VAL(reg, 1));
+		if (ret)
+			return ret;
+	}
+
+	for (reg = 0; reg < TEST_FIRST_VOLATILE; reg += 4) {
+		ret = check_reg(reg, TEST_VAL(reg, 1));
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Change memory behind the cache: only the volatile register notices. */
+static int test_volatile(void)
+{
+	unsigned int cached = TEST_REG(3), vol = TEST_FIRST_VOLATILE;
+	unsigned int val;
+	int ret;
+
+	test_regs[vol / 4] = TEST_VAL(vol, 7);
+	ret = check_reg(vol, TEST_VAL(vol, 7));
+	if (ret)
+		return ret;
+
+	test_regs[cached / 4] = TEST_VAL(cached, 7);
+	ret = regmap_read(test_map, cached, &val);
+	test_regs[cached / 4] = TEST_VAL(cached, 1);
+	if (ret)
+		return ret;
+	if (val != TEST_VAL(cached, 1)) {
+		pr_err("cached %#x read %#x from memory\n", cached, val);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Two runs of consecutive registers with a gap, written as one sequence. */
+static int test_coalesce(void)
+{
+	struct reg_default seq[24];
+	unsigned int i, reg;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(seq); i++) {
+		reg = TEST_REG(64 + i + (i >= 16 ? 8 : 0));
+		seq[i].reg = reg;
+		seq[i].def = TEST_VAL(reg, 2);
+	}
+
+	ret = regmap_multi_reg_write(test_map, seq, ARRAY_SIZE(seq));
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(seq); i++) {
+		ret = check_reg(seq[i].reg, seq[i].def);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+struct test_regmap_thread {
+	atomic_t *running;
+	atomic_t *stop;
+	struct completion *done;
+	atomic_t errors;
+	bool timed;
+	u64 ns;
+};
+
+/* Read the cached registers, checking every value for its own number. */
+static int test_reader(void *data)
+{
+	struct test_regmap_thread *t = data;
+	unsigned int i, reg, val;
+	ktime_t start;
+
+	start = ktime_get();
+	for (i = 0; t->timed ? i < iterations : !atomic_read(t->stop); i++) {
+		reg = TEST_REG(i % (TEST_FIRST_VOLATILE / 4));
+		if (regmap_read(test_map, reg, &val) || val >> 16 != reg)
+			atomic_inc(&t->errors);
+		if (!t->timed && !(i % 1024))
+			cond_resched();
+	}
+	t->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(t->running))
+		complete(t->done);
+	return 0;
+}
+
+/* Rewrite the cached registers and drop parts of the cache under readers. */
+static void test_writer(unsigned int rounds)
+{
+	unsigned int gen, reg;
+
+	for (gen = 3; gen < rounds + 3; gen++) {
+		if (gen % 4 == 0)
+			regcache_drop_region(test_map, 0,
+					     TEST_FIRST_VOLATILE - 4);
+		for (reg = 0; reg < TEST_FIRST_VOLATILE; reg += 4)
+			regmap_write(test_map, reg, TEST_VAL(reg, gen));
+		cond_resched();
+	}
+}
+
+/*
+ * Run one reader per online CPU.  Timed runs stop after @iterations
+ * reads each; untimed runs go on until the writer has finished.
+ */
+static int run_readers(bool timed, u64 *ns, unsigned int *threads)
+{
+	struct test_regmap_thread *t;
+	struct task_struct **tasks;
+	struct completion done;
+	atomic_t running, stop;
+	unsigned int n = 0, i;
+	int cpu, ret = 0;
+
+	t = kcalloc(nr_cpu_ids, sizeof(*t), GFP_KERNEL);
+	tasks = kcalloc(nr_cpu_ids, sizeof(*tasks), GFP_KERNEL);
+	if (!t || !tasks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	init_completion(&done);
+	atomic_set(&stop, 0);
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		t[n].running = &running;
+		t[n].stop = &stop;
+		t[n].done = &done;
+		t[n].timed = timed;
+		tasks[n] = kthread_create(test_reader, &t[n],
+					  "test_regmap/%d", cpu);
+		if (IS_ERR(tasks[n]))
+			break;
+		kthread_bind(tasks[n], cpu);
+		n++;
+	}
+	put_online_cpus();
+
+	if (!n) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	atomic_set(&running, n);
+	for (i = 0; i < n; i++)
+		wake_up_process(tasks[i]);
+
+	if (!timed) {
+		test_writer(256);
+		atomic_set(&stop, 1);
+	}
+	wait_for_completion(&done);
+
+	*ns = 0;
+	for (i = 0; i < n; i++) {
+		*ns = max(*ns, t[i].ns);
+		if (atomic_read(&t[i].errors)) {
+			pr_err("reader %u saw %d bad values\n", i,
+			       atomic_read(&t[i].errors));
+			ret = -EINVAL;
+		}
+	}
+	*threads = n;
+out:
+	kfree(tasks);
+	kfree(t);
+	return ret;
+}
+
+static u64 time_reads(unsigned int reg)
+{
+	unsigned int i, val;
+	ktime_t start;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		regmap_read(test_map, reg, &val);
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void report(const char *what, unsigned int threads, u64 ns)
+{
+	u64 calls = (u64)iterations * threads;
+
+	pr_info("%-16s %3u threads: %6llu ns/read %8llu kreads/s\n", what,
+		threads, div64_u64(ns, iterations),
+		div64_u64(calls * (NSEC_PER_SEC / 1000), ns ? ns : 1));
+}
+
+static int test_regmap_run(void)
+{
+	unsigned int threads;
+	u64 ns;
+	int ret;
+
+	ret = test_cache();
+	if (!ret)
+		ret = test_volatile();
+	if (!ret)
+		ret = test_coalesce();
+	if (!ret)
+		ret = run_readers(false, &ns, &threads);
+	if (ret)
+		return ret;
+
+	/* After the writer's last round every cached value is current. */
+	ret = check_reg(TEST_REG(5), TEST_VAL(TEST_REG(5), 258));
+	if (ret)
+		return ret;
+
+	report("cached", 1, time_reads(TEST_REG(5)));
+	report("volatile", 1, time_reads(TEST_FIRST_VOLATILE));
+
+	ret = run_readers(true, &ns, &threads);
+	if (ret)
+		return ret;
+	report("cached parallel", threads, ns);
+
+	return 0;
+}
+
+static int __init test_regmap_init(void)
+{
+	int ret;
+
+	test_regs = kzalloc(TEST_NUM_REGS * sizeof(*test_regs), GFP_KERNEL);
+	if (!test_regs)
+		return -ENOMEM;
+
+	test_dev = root_device_register("test_regmap");
+	if (IS_ERR(test_dev)) {
+		ret = PTR_ERR(test_dev);
+		goto err_regs;
+	}
+
+	test_map = regmap_init_mmio(test_dev, (void __force __iomem *)test_regs,
+				    &test_regmap_config);
+	if (IS_ERR(test_map)) {
+		ret = PTR_ERR(test_map);
+		goto err_dev;
+	}
+
+	ret = test_regmap_run();
+	if (ret) {
+		pr_err("failed: %d\n", ret);
+		goto err_map;
+	}
+
+	pr_info("all tests passed\n");
+	return 0;
+
+err_map:
+	regmap_exit(test_map);
+err_dev:
+	root_device_unregister(test_dev);
+err_regs:
+	kfree(test_regs);
+	return ret;
+}
+
+static void __exit test_regmap_exit(void)
+{
+	regmap_exit(test_map);
+	root_device_unregister(test_dev);
+	kfree(test_regs);
+}
+
+module_init(test_regmap_init);
+module_exit(test_regmap_exit);
+
+MODULE_DESCRIPTION("regmap cache test and benchmark module");
+MODULE_LICENSE("GPL");
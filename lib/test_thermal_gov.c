@@ -0,0 +1,327 @@
+/*
+ * Simulation module for thermal governors
+ *
+ * Registers an emulated thermal zone whose temperature comes from a first
+ * order thermal model instead of a sensor, and a cooling device standing
+ * for a CPU cluster with a few frequency levels.  Each configuration runs
+ * the same load script in simulated time: at every step the zone is
+ * updated, so its governor picks a cooling state, and the model is advanced
+ * by one polling period with the power of that state.  Each configuration
+ * reports:
+ *
+ *  - overshoot: the highest temperature above the control trip;
+ *  - above: the time spent above the control trip;
+ *  - changes and reversals: how often the cooling state changed, and how
+ *    often it changed direction, a measure of oscillation;
+ *  - perf: the work done, in percent of what the load asked for.
+ *
+ * The configurations are step_wise, the power allocator's PID controller
+ * and the power allocator with its predictive thermal model.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/thermal.h>
+#include <linux/math64.h>
+
+static int horizon = 10;
+module_param(horizon, int, 0444);
+MODULE_PARM_DESC(horizon, "Prediction horizon of the predictive run, in periods");
+
+/* Simulated polling period */
+#define PERIOD_MS	100
+/* Keep the core's own passive polling out of the simulation */
+#define PASSIVE_DELAY_MS	(3600 * MSEC_PER_SEC)
+
+/* The zone: 20C/W to ambient with a time constant of 10s */
+#define AMBIENT_TEMP	25000
+#define START_TEMP	45000
+#define RESISTANCE	20		/* millicelsius per mW */
+#define TAU_MS		10000
+#define SWITCH_ON_TEMP	65000
+#define CONTROL_TEMP	75000
+/* Holds the zone at CONTROL_TEMP */
+#define SUSTAINABLE_POWER ((CONTROL_TEMP - AMBIENT_TEMP) / RESISTANCE)
+
+/* Cooling states, fastest first; power goes with the cube of frequency */
+static const unsigned int level_mhz[] = {
+	2000, 1800, 1600, 1400, 1200, 1000, 800, 600, 400,
+};
+static const u32 level_mw[] = {
+	5000, 3645, 2560, 1715, 1080, 625, 320, 135, 40,
+};
+#define NR_LEVELS	ARRAY_SIZE(level_mhz)
+
+struct load_step {
+	unsigned int sec;
+	unsigned int load_pct;
+};
+
+/* Sustained load with a lighter spell, as with a game and its menus */
+static const struct load_step load_script[] = {
+	{ 60, 100 }, { 20, 30 }, { 60, 100 }, { 20, 60 },
+};
+
+struct test_config {
+	const char *governor;
+	bool predict;
+};
+
+static const struct test_config configs[] = {
+	{ "step_wise", false },
+	{ "power_allocator", false },
+	{ "power_allocator", true },
+};
+
+struct sim_result {
+	long max_temp;
+	unsigned int above_ms;
+	unsigned int changes;
+	unsigned int reversals;
+	u64 work;
+	u64 asked;
+};
+
+static struct {
+	long temp;
+	unsigned long state;
+	unsigned int load_pct;
+} sim;
+
+static struct thermal_cooling_device *test_cdev;
+
+static int test_get_temp(struct thermal_zone_device *tz, unsigned long *temp)
+{
+	*temp = sim.temp;
+	return 0;
+}
+
+static int test_get_trip_type(struct thermal_zone_device *tz, int trip,
+			      enum thermal_trip_type *type)
+{
+	*type = THERMAL_TRIP_PASSIVE;
+	return 0;
+}
+
+static int test_get_trip_temp(struct thermal_zone_device *tz, int trip,
+			      unsigned long *temp)
+{
+	*temp = trip ? CONTROL_TEMP : SWITCH_ON_TEMP;
+	return 0;
+}
+
+static int test_bind(struct thermal_zone_device *tz,
+		     struct thermal_cooling_device *cdev)
+{
+	int trip, ret;
+
+	if (cdev != test_cdev)
+		return 0;
+	for (trip = 0; trip < 2; trip++) {
+		ret = thermal_zone_bind_cooling_device(tz, trip, cdev,
+						       THERMAL_NO_LIMIT,
+						       THERMAL_NO_LIMIT,
+						       THERMAL_WEIGHT_DEFAULT);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int test_unbind(struct thermal_zone_device *tz,
+		       struct thermal_cooling_device *cdev)
+{
+	int trip;
+
+	if (cdev != test_cdev)
+		return 0;
+	for (trip = 0; trip < 2; trip++)
+		thermal_zone_unbind_cooling_device(tz, trip, cdev);
+	return 0;
+}
+
+static struct thermal_zone_device_ops test_tz_ops = {
+	.bind = test_bind,
+	.unbind = test_unbind,
+	.get_temp = test_get_temp,
+	.get_trip_type = test_get_trip_type,
+	.get_trip_temp = test_get_trip_temp,
+};
+
+static int test_get_max_state(struct thermal_cooling_device *cdev,
+			      unsigned long *state)
+{
+	*state = NR_LEVELS - 1;
+	return 0;
+}
+
+static int test_get_cur_state(struct thermal_cooling_device *cdev,
+			      unsigned long *state)
+{
+	*state = sim.state;
+	return 0;
+}
+
+static int test_set_cur_state(struct thermal_cooling_device *cdev,
+			      unsigned long state)
+{
+	if (state >= NR_LEVELS)
+		return -EINVAL;
+	sim.state = state;
+	return 0;
+}
+
+/* Like the cpufreq cooling device: the power at the current level */
+static int test_get_requested_power(struct thermal_cooling_device *cdev,
+				    struct thermal_zone_device *tz, u32 *power)
+{
+	*power = level_mw[sim.state] * sim.load_pct / 100;
+	return 0;
+}
+
+static int test_state2power(struct thermal_cooling_device *cdev,
+			    struct thermal_zone_device *tz,
+			    unsigned long state, u32 *power)
+{
+	if (state >= NR_LEVELS)
+		return -EINVAL;
+	*power = level_mw[state];
+	return 0;
+}
+
+static int test_power2state(struct thermal_cooling_device *cdev,
+			    struct thermal_zone_device *tz, u32 power,
+			    unsigned long *state)
+{
+	u32 normalised = power * 100 / max(sim.load_pct, 1U);
+	unsigned long i;
+
+	for (i = 0; i < NR_LEVELS - 1; i++)
+		if (level_mw[i] <= normalised)
+			break;
+	*state = i;
+	return 0;
+}
+
+static const struct thermal_cooling_device_ops test_cdev_ops = {
+	.get_max_state = test_get_max_state,
+	.get_cur_state = test_get_cur_state,
+	.set_cur_state = test_set_cur_state,
+	.get_requested_power = test_get_requested_power,
+	.state2power = test_state2power,
+	.power2state = test_power2state,
+};
+
+/* Advance the zone by one period at the power of the current state */
+static void sim_step(void)
+{
+	s64 power = level_mw[sim.state] * sim.load_pct / 100;
+	s64 target = AMBIENT_TEMP + RESISTANCE * power;
+
+	sim.temp += div_s64((target - sim.temp) * PERIOD_MS, TAU_MS);
+}
+
+static int run_config(const struct test_config *c)
+{
+	struct thermal_zone_params tzp = {
+		.no_hwmon = true,
+		.sustainable_power = SUSTAINABLE_POWER,
+		.prediction_horizon = c->predict ? horizon : 0,
+	};
+	struct thermal_zone_device *tz;
+	struct sim_result res = { .max_temp = 0 };
+	unsigned long prev_state;
+	int dir = 0, new_dir;
+	unsigned int i, t;
+
+	strlcpy(tzp.governor_name, c->governor, sizeof(tzp.governor_name));
+	sim.temp = START_TEMP;
+	sim.state = 0;
+	sim.load_pct = load_script[0].load_pct;
+
+	tz = thermal_zone_device_register("test_thermal", 2, 0, NULL,
+					  &test_tz_ops, &tzp,
+					  PASSIVE_DELAY_MS, 0);
+	if (IS_ERR(tz))
+		return PTR_ERR(tz);
+	if (!tz->governor || strcmp(tz->governor->name, c->governor)) {
+		pr_err("governor %s not available\n", c->governor);
+		thermal_zone_device_unregister(tz);
+		return -ENODEV;
+	}
+
+	prev_state = sim.state;
+	for (i = 0; i < ARRAY_SIZE(load_script); i++) {
+		sim.load_pct = load_script[i].load_pct;
+
+		for (t = 0; t < load_script[i].sec * MSEC_PER_SEC;
+		     t += PERIOD_MS) {
+			thermal_zone_device_update(tz);
+
+			if (sim.state != prev_state) {
+				new_dir = sim.state > prev_state ? 1 : -1;
+				if (dir && new_dir != dir)
+					res.reversals++;
+				dir = new_dir;
+				res.changes++;
+				prev_state = sim.state;
+			}
+
+			sim_step();
+
+			res.max_temp = max(res.max_temp, sim.temp);
+			if (sim.temp > CONTROL_TEMP)
+				res.above_ms += PERIOD_MS;
+			res.work += level_mhz[sim.state] * sim.load_pct;
+			res.asked += level_mhz[0] * sim.load_pct;
+		}
+	}
+
+	thermal_zone_device_unregister(tz);
+
+	pr_info("%-15s %-10s overshoot %5ld mC, above %6u ms, changes %4u, reversals %4u, perf %3llu%%\n",
+		c->governor, c->predict ? "predictive" : "pid",
+		max(res.max_temp - CONTROL_TEMP, 0L), res.above_ms,
+		res.changes, res.reversals,
+		div64_u64(res.work * 100, res.asked));
+	return 0;
+}
+
+static int __init test_thermal_gov_init(void)
+{
+	int i, ret = 0;
+
+	if (horizon <= 0)
+		return -EINVAL;
+
+	test_cdev = thermal_cooling_device_register("test_thermal", NULL,
+						    &test_cdev_ops);
+	if (IS_ERR(test_cdev))
+		return PTR_ERR(test_cdev);
+
+	for (i = 0; i < ARRAY_SIZE(configs); i++) {
+		ret = run_config(&configs[i]);
+		if (ret)
+			break;
+	}
+
+	thermal_cooling_device_unregister(test_cdev);
+	return ret;
+}
+
+static void __exit test_thermal_gov_exit(void)
+{
+}
+
+module_init(test_thermal_gov_init);
+module_exit(test_thermal_gov_exit);
+
+MODULE_DESCRIPTION("thermal governor simulation module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,677 @@
+/*
+ * Throughput test for batched gadget endpoint queuing
+ *
+ * Binds a composite gadget with one bulk IN endpoint to the first free
+ * UDC, normally dummy_hcd, together with a host side driver for it, so the
+ * data loops back through the emulated bus.  The gadget streams a fixed
+ * pattern while the host reads it with several URBs in flight and checks
+ * every byte.  Each mode moves the same amount of data:
+ *
+ *  - single: one usb_ep_queue() per request, each requeued from its own
+ *    completion;
+ *  - batch: the requests are queued with usb_ep_queue_list(), completed
+ *    through the endpoint's complete_list() and requeued as a chain;
+ *  - batch-sg: as batch, with each request's buffer described by a
+ *    scatterlist of page sized pieces instead of one buffer.
+ *
+ * Each mode reports its throughput, the number of completion calls and
+ * the average number of requests each call gave back.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/scatterlist.h>
+#include <linux/usb.h>
+#include <linux/usb/composite.h>
+
+#define NAME		"test_udc_batch"
+
+/* Arbitrary; nothing else claims it */
+#define UB_VENDOR	0x1d6b
+#define UB_PRODUCT	0x01fb
+
+#define UB_MAX_REQS	64
+#define UB_MAX_URBS	64
+#define UB_MAX_SGS	16
+/* Requests end on a packet boundary at every speed */
+#define UB_LEN_ALIGN	1024
+
+static unsigned int total_mb = 64;
+module_param(total_mb, uint, 0444);
+MODULE_PARM_DESC(total_mb, "Data moved by each mode, in MiB");
+
+static unsigned int req_len = 16384;
+module_param(req_len, uint, 0444);
+MODULE_PARM_DESC(req_len, "Bytes per request and per URB");
+
+static unsigned int nr_reqs = 16;
+module_param(nr_reqs, uint, 0444);
+MODULE_PARM_DESC(nr_reqs, "Requests kept queued on the gadget side");
+
+static unsigned int nr_urbs = 8;
+module_param(nr_urbs, uint, 0444);
+MODULE_PARM_DESC(nr_urbs, "URBs kept in flight on the host side");
+
+enum ub_mode {
+	UB_SINGLE,
+	UB_BATCH,
+	UB_BATCH_SG,
+	UB_NR_MODES,
+};
+
+static const char * const ub_mode_name[] = {
+	[UB_SINGLE]	= "single",
+	[UB_BATCH]	= "batch",
+	[UB_BATCH_SG]	= "batch-sg",
+};
+
+/* The byte at offset i of every request and URB */
+static u8 *ub_pattern;
+
+/*-------------------------------------------------------------------------*/
+
+/* Gadget side */
+
+static struct {
+	struct usb_composite_dev *cdev;
+	struct usb_ep		*ep;
+	bool			enabled;
+
+	struct usb_request	*reqs[UB_MAX_REQS];
+	struct scatterlist	sg[UB_MAX_REQS][UB_MAX_SGS];
+	unsigned int		nr_sgs;
+
+	bool			running;
+	atomic_t		idle;
+	atomic_t		calls;
+	atomic_t		done;
+	wait_queue_head_t	wait;
+} gad;
+
+static struct usb_interface_descriptor ub_intf = {
+	.bLength		= sizeof(ub_intf),
+	.bDescriptorType	= USB_DT_INTERFACE,
+	.bNumEndpoints		= 1,
+	.bInterfaceClass	= USB_CLASS_VENDOR_SPEC,
+};
+
+static struct usb_endpoint_descriptor ub_fs_in_desc = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+	.bEndpointAddress	= USB_DIR_IN,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_endpoint_descriptor ub_hs_in_desc = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= cpu_to_le16(512),
+};
+
+static struct usb_endpoint_descriptor ub_ss_in_desc = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= cpu_to_le16(1024),
+};
+
+static struct usb_ss_ep_comp_descriptor ub_ss_comp_desc = {
+	.bLength		= sizeof(ub_ss_comp_desc),
+	.bDescriptorType	= USB_DT_SS_ENDPOINT_COMP,
+};
+
+static struct usb_descriptor_header *ub_fs_descs[] = {
+	(struct usb_descriptor_header *)&ub_intf,
+	(struct usb_descriptor_header *)&ub_fs_in_desc,
+	NULL,
+};
+
+static struct usb_descriptor_header *ub_hs_descs[] = {
+	(struct usb_descriptor_header *)&ub_intf,
+	(struct usb_descriptor_header *)&ub_hs_in_desc,
+	NULL,
+};
+
+static struct usb_descriptor_header *ub_ss_descs[] = {
+	(struct usb_descriptor_header *)&ub_intf,
+	(struct usb_descriptor_header *)&ub_ss_in_desc,
+	(struct usb_descriptor_header *)&ub_ss_comp_desc,
+	NULL,
+};
+
+static struct usb_function ub_func;
+
+static void ub_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	atomic_inc(&gad.calls);
+	atomic_inc(&gad.done);
+
+	if (!req->status && ACCESS_ONCE(gad.running) &&
+	    !usb_ep_queue(ep, req, GFP_ATOMIC))
+		return;
+
+	atomic_inc(&gad.idle);
+	wake_up(&gad.wait);
+}
+
+static void ub_complete_list(struct usb_ep *ep, struct list_head *reqs)
+{
+	struct usb_request *req, *tmp;
+	int idle = 0;
+
+	atomic_inc(&gad.calls);
+
+	list_for_each_entry_safe(req, tmp, reqs, list) {
+		atomic_inc(&gad.done);
+		if (req->status || !ACCESS_ONCE(gad.running)) {
+			list_del_init(&req->list);
+			idle++;
+		}
+	}
+
+	if (!list_empty(reqs) && usb_ep_queue_list(ep, reqs, GFP_ATOMIC)) {
+		list_for_each_entry_safe(req, tmp, reqs, list) {
+			list_del_init(&req->list);
+			idle++;
+		}
+	}
+
+	if (idle) {
+		atomic_add(idle, &gad.idle);
+		wake_up(&gad.wait);
+	}
+}
+
+static int ub_enable(void)
+{
+	int ret;
+
+	ret = config_ep_by_speed(gad.cdev->gadget, &ub_func, gad.ep);
+	if (ret)
+		return ret;
+	ret = usb_ep_enable(gad.ep);
+	if (ret)
+		return ret;
+	gad.ep->driver_data = gad.cdev;
+	gad.enabled = true;
+	return 0;
+}
+
+static void ub_disable(void)
+{
+	if (gad.enabled) {
+		usb_ep_disable(gad.ep);
+		gad.enabled = false;
+	}
+}
+
+static int ub_gadget_start(enum ub_mode mode)
+{
+	struct usb_request *req;
+	LIST_HEAD(chain);
+	unsigned int i;
+	int ret = 0;
+
+	atomic_set(&gad.idle, 0);
+	atomic_set(&gad.calls, 0);
+	atomic_set(&gad.done, 0);
+	gad.ep->complete_list = mode == UB_SINGLE ? NULL : ub_complete_list;
+	gad.running = true;
+
+	for (i = 0; i < nr_reqs; i++) {
+		req = gad.reqs[i];
+		req->length = req_len;
+		req->complete = ub_complete;
+		if (mode == UB_BATCH_SG) {
+			req->sg = gad.sg[i];
+			req->num_sgs = gad.nr_sgs;
+		} else {
+			req->sg = NULL;
+			req->num_sgs = 0;
+		}
+
+		if (mode == UB_SINGLE) {
+			ret = usb_ep_queue(gad.ep, req, GFP_KERNEL);
+			if (ret) {
+				atomic_add(nr_reqs - i, &gad.idle);
+				break;
+			}
+		} else {
+			list_add_tail(&req->list, &chain);
+		}
+	}
+
+	if (!list_empty(&chain)) {
+		ret = usb_ep_queue_list(gad.ep, &chain, GFP_KERNEL);
+		while (!list_empty(&chain)) {
+			list_del_init(chain.next);
+			atomic_inc(&gad.idle);
+		}
+	}
+	return ret;
+}
+
+/* Disabling the endpoint gives back whatever is still queued */
+static int ub_gadget_stop(void)
+{
+	gad.running = false;
+	ub_disable();
+	if (!wait_event_timeout(gad.wait,
+				atomic_read(&gad.idle) == nr_reqs, 5 * HZ))
+		return -ETIMEDOUT;
+
+	gad.ep->complete_list = NULL;
+	return ub_enable();
+}
+
+static int ub_func_bind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct usb_composite_dev *cdev = c->cdev;
+	int id;
+
+	id = usb_interface_id(c, f);
+	if (id < 0)
+		return id;
+	ub_intf.bInterfaceNumber = id;
+
+	gad.ep = usb_ep_autoconfig(cdev->gadget, &ub_fs_in_desc);
+	if (!gad.ep)
+		return -ENODEV;
+	gad.ep->driver_data = cdev;
+
+	ub_hs_in_desc.bEndpointAddress = ub_fs_in_desc.bEndpointAddress;
+	ub_ss_in_desc.bEndpointAddress = ub_fs_in_desc.bEndpointAddress;
+
+	return usb_assign_descriptors(f, ub_fs_descs, ub_hs_descs,
+				      ub_ss_descs);
+}
+
+static void ub_func_unbind(struct usb_configuration *c,
+			   struct usb_function *f)
+{
+	usb_free_all_descriptors(f);
+}
+
+static int ub_func_set_alt(struct usb_function *f, unsigned intf,
+			   unsigned alt)
+{
+	ub_disable();
+	return ub_enable();
+}
+
+static void ub_func_disable(struct usb_function *f)
+{
+	gad.running = false;
+	ub_disable();
+}
+
+static struct usb_function ub_func = {
+	.name		= NAME,
+	.bind		= ub_func_bind,
+	.unbind		= ub_func_unbind,
+	.set_alt	= ub_func_set_alt,
+	.disable	= ub_func_disable,
+};
+
+static int ub_config_bind(struct usb_configuration *c)
+{
+	return usb_add_function(c, &ub_func);
+}
+
+static struct usb_configuration ub_config = {
+	.label			= NAME,
+	.bConfigurationValue	= 1,
+	.bmAttributes		= USB_CONFIG_ATT_SELFPOWER,
+};
+
+static struct usb_device_descriptor ub_device_desc = {
+	.bLength		= sizeof(ub_device_desc),
+	.bDescriptorType	= USB_DT_DEVICE,
+	.bcdUSB			= cpu_to_le16(0x0200),
+	.bDeviceClass		= USB_CLASS_VENDOR_SPEC,
+	.idVendor		= cpu_to_le16(UB_VENDOR),
+	.idProduct		= cpu_to_le16(UB_PRODUCT),
+	.bNumConfigurations	= 1,
+};
+
+static int ub_bind(struct usb_composite_dev *cdev)
+{
+	gad.cdev = cdev;
+	return usb_add_config(cdev, &ub_config, ub_config_bind);
+}
+
+static int ub_unbind(struct usb_composite_dev *cdev)
+{
+	return 0;
+}
+
+static struct usb_composite_driver ub_driver = {
+	.name		= NAME,
+	.dev		= &ub_device_desc,
+	.max_speed	= USB_SPEED_SUPER,
+	.bind		= ub_bind,
+	.unbind		= ub_unbind,
+};
+
+static int ub_gadget_alloc(void)
+{
+	struct usb_request *req;
+	unsigned int i, j, len;
+
+	gad.nr_sgs = DIV_ROUND_UP(req_len, PAGE_SIZE);
+	for (i = 0; i < nr_reqs; i++) {
+		req = usb_ep_alloc_request(gad.ep, GFP_KERNEL);
+		if (!req)
+			return -ENOMEM;
+		gad.reqs[i] = req;
+
+		req->buf = kmemdup(ub_pattern, req_len, GFP_KERNEL);
+		if (!req->buf)
+			return -ENOMEM;
+
+		sg_init_table(gad.sg[i], gad.nr_sgs);
+		for (j = 0; j < gad.nr_sgs; j++) {
+			len = min_t(unsigned int, PAGE_SIZE,
+				    req_len - j * PAGE_SIZE);
+			sg_set_buf(&gad.sg[i][j], req->buf + j * PAGE_SIZE,
+				   len);
+		}
+	}
+	return 0;
+}
+
+static void ub_gadget_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_reqs; i++) {
+		if (!gad.reqs[i])
+			continue;
+		kfree(gad.reqs[i]->buf);
+		usb_ep_free_request(gad.ep, gad.reqs[i]);
+		gad.reqs[i] = NULL;
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* Host side */
+
+static struct {
+	struct usb_device	*udev;
+	unsigned int		pipe;
+	struct urb		*urbs[UB_MAX_URBS];
+
+	spinlock_t		lock;
+	unsigned long		to_submit;
+	unsigned int		inflight;
+	unsigned long		bad;
+	int			status;
+	struct completion	done;
+} host;
+
+static DECLARE_COMPLETION(ub_probed);
+
+static void ub_urb_complete(struct urb *urb)
+{
+	unsigned long flags;
+	bool resubmit = false;
+	int ret;
+
+	spin_lock_irqsave(&host.lock, flags);
+	if (urb->status || urb->actual_length != req_len) {
+		if (!host.status)
+			host.status = urb->status ? : -EREMOTEIO;
+	} else if (memcmp(urb->transfer_buffer, ub_pattern, req_len)) {
+		host.bad++;
+	}
+
+	if (!host.status && host.to_submit) {
+		host.to_submit--;
+		resubmit = true;
+	} else if (!--host.inflight) {
+		complete(&host.done);
+	}
+	spin_unlock_irqrestore(&host.lock, flags);
+
+	if (!resubmit)
+		return;
+
+	ret = usb_submit_urb(urb, GFP_ATOMIC);
+	if (ret) {
+		spin_lock_irqsave(&host.lock, flags);
+		if (!host.status)
+			host.status = ret;
+		if (!--host.inflight)
+			complete(&host.done);
+		spin_unlock_irqrestore(&host.lock, flags);
+	}
+}
+
+/* Reads total_mb MiB; returns how long it took, in ns, or an error */
+static s64 ub_host_run(void)
+{
+	unsigned long flags;
+	unsigned int i;
+	ktime_t start;
+	int ret;
+
+	reinit_completion(&host.done);
+	host.to_submit = ((unsigned long)total_mb << 20) / req_len;
+	host.inflight = 0;
+	host.bad = 0;
+	host.status = 0;
+
+	start = ktime_get();
+	spin_lock_irqsave(&host.lock, flags);
+	for (i = 0; i < nr_urbs && host.to_submit; i++) {
+		host.to_submit--;
+		host.inflight++;
+		usb_fill_bulk_urb(host.urbs[i], host.udev, host.pipe,
+				  host.urbs[i]->transfer_buffer, req_len,
+				  ub_urb_complete, NULL);
+		ret = usb_submit_urb(host.urbs[i], GFP_ATOMIC);
+		if (ret) {
+			host.inflight--;
+			host.status = ret;
+			break;
+		}
+	}
+	if (!host.inflight)
+		complete(&host.done);
+	spin_unlock_irqrestore(&host.lock, flags);
+
+	if (!wait_for_completion_timeout(&host.done, 60 * HZ)) {
+		for (i = 0; i < nr_urbs; i++)
+			usb_kill_urb(host.urbs[i]);
+		return -ETIMEDOUT;
+	}
+	if (host.status)
+		return host.status;
+	if (host.bad) {
+		pr_err("%lu transfers with bad data\n", host.bad);
+		return -EIO;
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int ub_host_alloc(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_urbs; i++) {
+		host.urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
+		if (!host.urbs[i])
+			return -ENOMEM;
+		host.urbs[i]->transfer_buffer = kmalloc(req_len, GFP_KERNEL);
+		if (!host.urbs[i]->transfer_buffer)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void ub_host_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_urbs; i++) {
+		if (!host.urbs[i])
+			continue;
+		kfree(host.urbs[i]->transfer_buffer);
+		usb_free_urb(host.urbs[i]);
+		host.urbs[i] = NULL;
+	}
+}
+
+static int ub_probe(struct usb_interface *intf,
+		    const struct usb_device_id *id)
+{
+	struct usb_host_interface *alt = intf->cur_altsetting;
+	struct usb_endpoint_descriptor *desc;
+
+	if (alt->desc.bNumEndpoints != 1)
+		return -ENODEV;
+	desc = &alt->endpoint[0].desc;
+	if (!usb_endpoint_is_bulk_in(desc))
+		return -ENODEV;
+
+	host.udev = usb_get_dev(interface_to_usbdev(intf));
+	host.pipe = usb_rcvbulkpipe(host.udev, usb_endpoint_num(desc));
+	complete(&ub_probed);
+	return 0;
+}
+
+static void ub_disconnect(struct usb_interface *intf)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_urbs; i++)
+		if (host.urbs[i])
+			usb_kill_urb(host.urbs[i]);
+	usb_put_dev(host.udev);
+	host.udev = NULL;
+}
+
+static const struct usb_device_id ub_ids[] = {
+	{ USB_DEVICE(UB_VENDOR, UB_PRODUCT) },
+	{ }
+};
+
+static struct usb_driver ub_host_driver = {
+	.name		= NAME,
+	.id_table	= ub_ids,
+	.probe		= ub_probe,
+	.disconnect	= ub_disconnect,
+};
+
+/*-------------------------------------------------------------------------*/
+
+static int ub_run_mode(enum ub_mode mode)
+{
+	unsigned int calls, done;
+	s64 ns;
+	int ret;
+
+	if (!gad.enabled)
+		return -ENOTCONN;
+
+	ret = ub_gadget_start(mode);
+	ns = ret ? ret : ub_host_run();
+	ret = ub_gadget_stop();
+	if (ns < 0)
+		return ns;
+	if (ret)
+		return ret;
+
+	calls = atomic_read(&gad.calls);
+	done = atomic_read(&gad.done);
+	pr_info("%-8s %5llu MB/s, %u requests in %u completion calls, %u.%02u per call\n",
+		ub_mode_name[mode],
+		div64_u64(((u64)total_mb << 20) * NSEC_PER_USEC, ns ? : 1),
+		done, calls, calls ? done / calls : 0,
+		calls ? done * 100 / calls % 100 : 0);
+	return 0;
+}
+
+static int __init test_udc_batch_init(void)
+{
+	enum ub_mode mode;
+	unsigned int i;
+	int ret;
+
+	if (!req_len || req_len % UB_LEN_ALIGN ||
+	    req_len > UB_MAX_SGS * PAGE_SIZE || !nr_reqs ||
+	    nr_reqs > UB_MAX_REQS || !nr_urbs || nr_urbs > UB_MAX_URBS ||
+	    !total_mb)
+		return -EINVAL;
+
+	ub_pattern = kmalloc(req_len, GFP_KERNEL);
+	if (!ub_pattern)
+		return -ENOMEM;
+	for (i = 0; i < req_len; i++)
+		ub_pattern[i] = i % 251;
+	spin_lock_init(&host.lock);
+	init_completion(&host.done);
+	init_waitqueue_head(&gad.wait);
+
+	ret = usb_register(&ub_host_driver);
+	if (ret)
+		goto out_pattern;
+	ret = usb_composite_probe(&ub_driver);
+	if (ret)
+		goto out_host;
+
+	if (!wait_for_completion_timeout(&ub_probed, 10 * HZ)) {
+		pr_err("host side never saw the gadget\n");
+		ret = -ENODEV;
+		goto out_gadget;
+	}
+
+	ret = ub_gadget_alloc();
+	if (!ret)
+		ret = ub_host_alloc();
+	for (mode = 0; !ret && mode < UB_NR_MODES; mode++) {
+		ret = ub_run_mode(mode);
+		if (ret)
+			pr_err("%s: %d\n", ub_mode_name[mode], ret);
+	}
+
+	ub_gadget_free();
+out_gadget:
+	usb_composite_unregister(&ub_driver);
+out_host:
+	usb_deregister(&ub_host_driver);
+	ub_host_free();
+out_pattern:
+	kfree(ub_pattern);
+
+	if (ret) {
+		pr_err("failed: %d\n", ret);
+		return ret;
+	}
+	pr_info("all tests passed\n");
+	return 0;
+}
+
+static void __exit test_udc_batch_exit(void)
+{
+}
+
+module_init(test_udc_batch_init);
+module_exit(test_udc_batch_exit);
+
+MODULE_DESCRIPTION("Batched gadget endpoint queuing throughput test");
+MODULE_LICENSE("GPL");
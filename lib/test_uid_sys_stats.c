@@ -0,0 +1,366 @@
+/*
+ * Test module for the per-UID CPU time and I/O counters
+ *
+ * Starts a few kthreads under each of @nr_uids test UIDs that alternate
+ * spinning, reading a proc file and sleeping, then parks them and checks
+ * /proc/uid_cputime/show_uid_stat and /proc/uid_io/stats against a scan of
+ * the threads' own counters, the way those files used to be computed.  It
+ * checks them again after the threads exited, and prints the time taken by
+ * both reads next to the time of one walk over every thread.  The test
+ * UIDs are removed again at the end.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cred.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/uidgid.h>
+
+static unsigned int nr_uids = 8;
+module_param(nr_uids, uint, 0444);
+MODULE_PARM_DESC(nr_uids, "Number of test UIDs");
+
+static unsigned int threads_per_uid = 4;
+module_param(threads_per_uid, uint, 0444);
+MODULE_PARM_DESC(threads_per_uid, "Threads started under each test UID");
+
+static unsigned int first_uid = 110000;
+module_param(first_uid, uint, 0444);
+MODULE_PARM_DESC(first_uid, "First UID of the range, left unused otherwise");
+
+static unsigned int rounds = 20;
+module_param(rounds, uint, 0444);
+MODULE_PARM_DESC(rounds, "Spin, read and sleep rounds per thread");
+
+#define CPUTIME_PATH	"/proc/uid_cputime/show_uid_stat"
+#define REMOVE_PATH	"/proc/uid_cputime/remove_uid_range"
+#define IO_PATH		"/proc/uid_io/stats"
+#define READ_PATH	"/proc/version"
+#define PROC_BUF_SIZE	(1024 * 1024)
+
+struct test_uid_thread {
+	uid_t uid;
+	struct task_struct *task;
+	atomic_t *working;
+	struct completion *worked;
+	struct completion *release;
+	int ret;
+};
+
+/* Per-UID totals, from the proc files or from the scan */
+struct test_uid_totals {
+	u64 cpu_us;
+	u64 rchar;
+};
+
+static int test_uid_thread(void *data)
+{
+	struct test_uid_thread *t = data;
+	struct cred *cred;
+	struct file *file;
+	char buf[128];
+	unsigned int i;
+	u64 end;
+
+	cred = prepare_creds();
+	if (!cred) {
+		t->ret = -ENOMEM;
+		goto out;
+	}
+	cred->uid = cred->euid = cred->suid = cred->fsuid =
+		make_kuid(&init_user_ns, t->uid);
+	commit_creds(cred);
+
+	file = filp_open(READ_PATH, O_RDONLY, 0);
+	if (IS_ERR(file)) {
+		t->ret = PTR_ERR(file);
+		goto out;
+	}
+
+	for (i = 0; i < rounds; i++) {
+		end = get_jiffies_64() + 1;
+		while (time_before_eq64(get_jiffies_64(), end))
+			cpu_relax();
+		kernel_read(file, 0, buf, sizeof(buf));
+		usleep_range(500, 1000);
+	}
+
+	/* Run across one more tick, which charges the last read */
+	end = get_jiffies_64() + 1;
+	while (time_before_eq64(get_jiffies_64(), end))
+		cpu_relax();
+	filp_close(file, NULL);
+out:
+	/* Blocked until released, so all of it has been charged */
+	if (atomic_dec_and_test(t->working))
+		complete(t->worked);
+	wait_for_completion(t->release);
+	return 0;
+}
+
+static int read_file(const char *path, char *buf, size_t size, u64 *us)
+{
+	struct file *file;
+	size_t len = 0;
+	ktime_t start;
+	int ret;
+
+	file = filp_open(path, O_RDONLY, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	start = ktime_get();
+	do {
+		ret = kernel_read(file, len, buf + len, size - 1 - len);
+		if (ret > 0)
+			len += ret;
+	} while (ret > 0 && len < size - 1);
+	*us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	filp_close(file, NULL);
+	buf[len] = '\0';
+	return ret < 0 ? ret : 0;
+}
+
+static struct test_uid_totals *test_uid(struct test_uid_totals *totals,
+					unsigned long uid)
+{
+	if (uid < first_uid || uid - first_uid >= nr_uids)
+		return NULL;
+	return &totals[uid - first_uid];
+}
+
+/* Fill @totals from the two proc files */
+static int read_totals(struct test_uid_totals *totals, char *buf, bool report)
+{
+	struct test_uid_totals *tot;
+	unsigned long long utime, stime, rchar;
+	unsigned long uid;
+	u64 cpu_us, io_us;
+	char *line, *p;
+	int ret;
+
+	memset(totals, 0, nr_uids * sizeof(*totals));
+
+	ret = read_file(CPUTIME_PATH, buf, PROC_BUF_SIZE, &cpu_us);
+	if (ret)
+		return ret;
+	for (p = buf; (line = strsep(&p, "\n")) != NULL;) {
+		if (sscanf(line, "%lu: %llu %llu", &uid, &utime, &stime) != 3)
+			continue;
+		tot = test_uid(totals, uid);
+		if (tot)
+			tot->cpu_us = utime + stime;
+	}
+
+	ret = read_file(IO_PATH, buf, PROC_BUF_SIZE, &io_us);
+	if (ret)
+		return ret;
+	for (p = buf; (line = strsep(&p, "\n")) != NULL;) {
+		if (sscanf(line, "%lu %llu", &uid, &rchar) != 2)
+			continue;
+		tot = test_uid(totals, uid);
+		if (tot)
+			tot->rchar = rchar;
+	}
+
+	if (report)
+		pr_info("read %s in %llu us, %s in %llu us\n", CPUTIME_PATH,
+			cpu_us, IO_PATH, io_us);
+	return 0;
+}
+
+/* What the old readers computed for the test UIDs, from the threads */
+static void scan_totals(struct test_uid_totals *totals,
+			struct test_uid_thread *t, unsigned int n)
+{
+	struct test_uid_totals *tot;
+	unsigned int i;
+
+	memset(totals, 0, nr_uids * sizeof(*totals));
+	for (i = 0; i < n; i++) {
+		tot = test_uid(totals, t[i].uid);
+		tot->cpu_us += div_u64(t[i].task->se.sum_exec_runtime,
+				       NSEC_PER_USEC);
+		tot->rchar += t[i].task->ioac.rchar;
+	}
+}
+
+/* Time one walk over every thread, the cost the old readers paid */
+static void time_scan(void)
+{
+	struct task_struct *task, *temp;
+	unsigned long threads = 0;
+	cputime_t utime, stime;
+	ktime_t start;
+
+	start = ktime_get();
+	rcu_read_lock();
+	do_each_thread(temp, task) {
+		task_cputime_adjusted(task, &utime, &stime);
+		threads++;
+	} while_each_thread(temp, task);
+	rcu_read_unlock();
+
+	pr_info("walked %lu threads in %lld us\n", threads,
+		ktime_to_us(ktime_sub(ktime_get(), start)));
+}
+
+static int compare_totals(const char *when, struct test_uid_totals *got,
+			  struct test_uid_totals *want)
+{
+	/* Rounding, time before the UID change and since the last tick */
+	u64 slack = (u64)(threads_per_uid + 2) * jiffies_to_usecs(1);
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < nr_uids; i++) {
+		if (got[i].rchar != want[i].rchar ||
+		    got[i].cpu_us + slack < want[i].cpu_us ||
+		    got[i].cpu_us > want[i].cpu_us + slack) {
+			pr_err("%s: uid %u: cpu %llu us rchar %llu, scan %llu us rchar %llu\n",
+			       when, first_uid + i, got[i].cpu_us,
+			       got[i].rchar, want[i].cpu_us, want[i].rchar);
+			ret = -EINVAL;
+		}
+	}
+	return ret;
+}
+
+static int test_uid_sys_stats_run(struct test_uid_totals *got,
+				  struct test_uid_totals *want, char *buf)
+{
+	struct completion worked, release;
+	struct test_uid_thread *t;
+	atomic_t working;
+	unsigned int n = 0, i, nr = nr_uids * threads_per_uid;
+	int ret = 0;
+
+	t = kcalloc(nr, sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+
+	init_completion(&worked);
+	init_completion(&release);
+	atomic_set(&working, nr);
+	for (n = 0; n < nr; n++) {
+		t[n].uid = first_uid + n / threads_per_uid;
+		t[n].working = &working;
+		t[n].worked = &worked;
+		t[n].release = &release;
+		t[n].task = kthread_run(test_uid_thread, &t[n], "test_uid/%u",
+					n);
+		if (IS_ERR(t[n].task)) {
+			ret = PTR_ERR(t[n].task);
+			break;
+		}
+		get_task_struct(t[n].task);
+	}
+
+	/* Account for the threads that never started */
+	if (n < nr && atomic_sub_and_test(nr - n, &working))
+		complete(&worked);
+	wait_for_completion(&worked);
+
+	for (i = 0; i < n && !ret; i++)
+		ret = t[i].ret;
+	if (ret)
+		goto out;
+
+	/* Still alive, charged up to their last tick */
+	scan_totals(want, t, n);
+	ret = read_totals(got, buf, true);
+	if (!ret)
+		ret = compare_totals("parked", got, want);
+	time_scan();
+
+out:
+	complete_all(&release);
+	for (i = 0; i < n; i++) {
+		kthread_stop(t[i].task);
+		put_task_struct(t[i].task);
+	}
+	kfree(t);
+	if (ret)
+		return ret;
+
+	/* What the ticks charged is not charged again at exit */
+	ret = read_totals(got, buf, false);
+	if (!ret)
+		ret = compare_totals("exited", got, want);
+	return ret;
+}
+
+static void remove_test_uids(void)
+{
+	struct file *file;
+	char range[32];
+	int len;
+
+	file = filp_open(REMOVE_PATH, O_WRONLY, 0);
+	if (IS_ERR(file))
+		return;
+	len = snprintf(range, sizeof(range), "%u-%u", first_uid,
+		       first_uid + nr_uids - 1);
+	kernel_write(file, range, len, 0);
+	filp_close(file, NULL);
+}
+
+static int __init test_uid_sys_stats_init(void)
+{
+	struct test_uid_totals *got, *want;
+	char *buf;
+	int ret;
+
+	if (!nr_uids || !threads_per_uid)
+		return -EINVAL;
+
+	got = kcalloc(nr_uids, sizeof(*got), GFP_KERNEL);
+	want = kcalloc(nr_uids, sizeof(*want), GFP_KERNEL);
+	buf = vmalloc(PROC_BUF_SIZE);
+	if (!got || !want || !buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = test_uid_sys_stats_run(got, want, buf);
+	remove_test_uids();
+out:
+	vfree(buf);
+	kfree(want);
+	kfree(got);
+
+	if (ret) {
+		pr_err("failed: %d\n", ret);
+		return ret;
+	}
+	pr_info("all tests passed\n");
+	return 0;
+}
+
+static void __exit test_uid_sys_stats_exit(void)
+{
+}
+
+module_init(test_uid_sys_stats_init);
+module_exit(test_uid_sys_stats_exit);
+
+MODULE_DESCRIPTION("per-UID cputime and I/O counters test module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,326 @@
+/*
+ * Benchmark module for /proc/uid_time_in_state
+ *
+ * Charges CPU time to @nr_uids UIDs starting at @first_uid by having one
+ * bound kthread per online CPU switch its credentials through the range and
+ * spin for a jiffy under each UID.  It then checks that the binary export
+ * lists every one of them with some time, and prints how long it takes to
+ * read the text file, a full binary snapshot, an incremental snapshot with
+ * nothing changed and one after a few UIDs ran again.  The UIDs are removed
+ * from the table when the module is loaded, so it can be loaded repeatedly.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cpufreq.h>
+#include <linux/cred.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/uidgid.h>
+#include <uapi/linux/cpufreq_stats.h>
+
+static unsigned int nr_uids = 2000;
+module_param(nr_uids, uint, 0444);
+MODULE_PARM_DESC(nr_uids, "Number of UIDs to charge time to");
+
+static unsigned int first_uid = 100000;
+module_param(first_uid, uint, 0444);
+MODULE_PARM_DESC(first_uid, "First UID of the range, left unused otherwise");
+
+/* UIDs charged again before the last incremental read */
+#define TOUCHED_UIDS	16
+
+#define TEXT_PATH	"/proc/uid_time_in_state"
+#define BIN_PATH	"/proc/uid_time_in_state_bin"
+#define READ_CHUNK	(64 * 1024)
+
+struct test_uid_thread {
+	unsigned int first, count;
+	atomic_t *running;
+	struct completion *done;
+	int ret;
+};
+
+/* Run on the CPU as @uid until the tick has had a chance to charge it */
+static int run_as(uid_t uid)
+{
+	struct cred *cred;
+	u64 end;
+
+	cred = prepare_creds();
+	if (!cred)
+		return -ENOMEM;
+	cred->uid = cred->euid = cred->suid = cred->fsuid =
+		make_kuid(&init_user_ns, uid);
+	commit_creds(cred);
+
+	end = get_jiffies_64() + 2;
+	while (time_before64(get_jiffies_64(), end))
+		cpu_relax();
+	cond_resched();
+	return 0;
+}
+
+static int test_uid_thread(void *data)
+{
+	struct test_uid_thread *t = data;
+	unsigned int i;
+
+	for (i = 0; i < t->count && !t->ret; i++)
+		t->ret = run_as(first_uid + t->first + i);
+
+	if (atomic_dec_and_test(t->running))
+		complete(t->done);
+	return 0;
+}
+
+/* Charge UIDs first_uid + [0, @count) from one thread per online CPU */
+static int charge_uids(unsigned int count)
+{
+	struct test_uid_thread *t;
+	struct task_struct **tasks;
+	struct completion done;
+	atomic_t running;
+	unsigned int n = 0, i, per_thread, first = 0;
+	int cpu, ret = 0;
+
+	t = kcalloc(nr_cpu_ids, sizeof(*t), GFP_KERNEL);
+	tasks = kcalloc(nr_cpu_ids, sizeof(*tasks), GFP_KERNEL);
+	if (!t || !tasks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	init_completion(&done);
+	per_thread = DIV_ROUND_UP(count, num_online_cpus());
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		if (first >= count)
+			break;
+		t[n].first = first;
+		t[n].count = min(per_thread, count - first);
+		t[n].running = &running;
+		t[n].done = &done;
+		tasks[n] = kthread_create(test_uid_thread, &t[n],
+					  "test_uid/%d", cpu);
+		if (IS_ERR(tasks[n]))
+			break;
+		kthread_bind(tasks[n], cpu);
+		first += t[n].count;
+		n++;
+	}
+	put_online_cpus();
+
+	if (!n) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* Could not start enough threads: let those created exit at once */
+	if (first < count)
+		for (i = 0; i < n; i++)
+			t[i].ret = -ENOMEM;
+
+	atomic_set(&running, n);
+	for (i = 0; i < n; i++)
+		wake_up_process(tasks[i]);
+	wait_for_completion(&done);
+
+	for (i = 0; i < n; i++)
+		if (t[i].ret)
+			ret = t[i].ret;
+out:
+	kfree(tasks);
+	kfree(t);
+	return ret;
+}
+
+/* Read @file from offset 0 to the end and return the number of bytes */
+static ssize_t read_all(struct file *file, void *buf, size_t size)
+{
+	size_t len = 0;
+	int ret;
+
+	do {
+		ret = kernel_read(file, len, buf + len,
+				  min_t(size_t, READ_CHUNK, size - len));
+		if (ret < 0)
+			return ret;
+		len += ret;
+	} while (ret && len < size);
+
+	return len;
+}
+
+static ssize_t timed_read(struct file *file, void *buf, size_t size,
+			  const char *what)
+{
+	ssize_t len;
+	ktime_t start;
+
+	start = ktime_get();
+	len = read_all(file, buf, size);
+	if (len >= 0)
+		pr_info("%-22s %8zd bytes %8lld us\n", what, len,
+			ktime_to_us(ktime_sub(ktime_get(), start)));
+	return len;
+}
+
+/* Number of records in @buf for UIDs of the test range with some time */
+static unsigned int count_test_uids(void *buf, size_t len, bool *full)
+{
+	struct uid_time_in_state_header *hdr = buf;
+	struct uid_time_in_state_record *rec;
+	unsigned int i, j, found = 0;
+	size_t rec_size;
+	u64 sum;
+
+	if (len < sizeof(*hdr) || hdr->version != UID_TIME_IN_STATE_VERSION)
+		return 0;
+
+	*full = hdr->flags & UID_TIME_IN_STATE_FULL;
+	rec_size = sizeof(*rec) + hdr->nr_freqs * sizeof(rec->time[0]);
+	rec = buf + sizeof(*hdr) + hdr->nr_freqs * sizeof(u32);
+
+	for (i = 0; i < hdr->nr_uids; i++) {
+		if ((void *)rec + rec_size > buf + len)
+			break;
+		if (rec->uid >= first_uid && rec->uid - first_uid < nr_uids) {
+			for (sum = 0, j = 0; j < hdr->nr_freqs; j++)
+				sum += rec->time[j];
+			if (sum)
+				found++;
+		}
+		rec = (void *)rec + rec_size;
+	}
+	return found;
+}
+
+static int test_uid_time_in_state_run(void *buf, size_t size)
+{
+	struct file *text, *bin;
+	unsigned int found;
+	bool full = false;
+	ssize_t len;
+	ktime_t start;
+	int ret;
+
+	start = ktime_get();
+	ret = charge_uids(nr_uids);
+	if (ret)
+		return ret;
+	pr_info("charged %u UIDs on %u CPUs in %lld ms\n", nr_uids,
+		num_online_cpus(),
+		ktime_to_ms(ktime_sub(ktime_get(), start)));
+
+	text = filp_open(TEXT_PATH, O_RDONLY, 0);
+	if (IS_ERR(text))
+		return PTR_ERR(text);
+	bin = filp_open(BIN_PATH, O_RDONLY, 0);
+	if (IS_ERR(bin)) {
+		ret = PTR_ERR(bin);
+		goto out_text;
+	}
+
+	len = timed_read(text, buf, size, "text");
+	if (len < 0) {
+		ret = len;
+		goto out;
+	}
+
+	/* Keep charges of the last jiffy out of the incremental reads */
+	schedule_timeout_uninterruptible(2);
+	len = timed_read(bin, buf, size, "binary full");
+	if (len < 0) {
+		ret = len;
+		goto out;
+	}
+	found = count_test_uids(buf, len, &full);
+	if (!full || found != nr_uids) {
+		pr_err("full snapshot has %u of %u UIDs\n", found, nr_uids);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	len = timed_read(bin, buf, size, "binary unchanged");
+	if (len < 0) {
+		ret = len;
+		goto out;
+	}
+	found = count_test_uids(buf, len, &full);
+	if (full || found) {
+		pr_err("unchanged snapshot has %u test UIDs\n", found);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = charge_uids(min_t(unsigned int, TOUCHED_UIDS, nr_uids));
+	if (ret)
+		goto out;
+	len = timed_read(bin, buf, size, "binary incremental");
+	if (len < 0) {
+		ret = len;
+		goto out;
+	}
+	found = count_test_uids(buf, len, &full);
+	if (found < min_t(unsigned int, TOUCHED_UIDS, nr_uids)) {
+		pr_err("incremental snapshot has %u test UIDs\n", found);
+		ret = -EINVAL;
+	}
+out:
+	filp_close(bin, NULL);
+out_text:
+	filp_close(text, NULL);
+	return ret;
+}
+
+static int __init test_uid_time_in_state_init(void)
+{
+	size_t size;
+	void *buf;
+	int ret;
+
+	if (!nr_uids || first_uid + nr_uids - 1 < first_uid)
+		return -EINVAL;
+
+	/* Enough for the text file with a few hundred frequencies per UID */
+	size = (size_t)(nr_uids + 1024) * 4096;
+	buf = vmalloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = test_uid_time_in_state_run(buf, size);
+	cpufreq_task_stats_remove_uids(first_uid, first_uid + nr_uids - 1);
+	vfree(buf);
+
+	if (ret) {
+		pr_err("failed: %d\n", ret);
+		return ret;
+	}
+	pr_info("all tests passed\n");
+	return 0;
+}
+
+static void __exit test_uid_time_in_state_exit(void)
+{
+}
+
+module_init(test_uid_time_in_state_init);
+module_exit(test_uid_time_in_state_exit);
+
+MODULE_DESCRIPTION("per-UID cpufreq time_in_state export benchmark module");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,346 @@
+/*
+ * Block-parallel .xz decoder
+ *
+ * A Stream made of several Blocks (as written by "xz -T" or
+ * "xz --block-size") can be decoded one Block per CPU: every Block starts
+ * with an LZMA2 dictionary reset and the Index at the end of the Stream
+ * gives the compressed and uncompressed size of each of them. This file
+ * walks the Index to locate the Blocks in the input and output buffers
+ * and then hands them out to a set of single-call decoders running on
+ * the unbound workqueue.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+
+#include "xz_private.h"
+#include "xz_stream.h"
+
+/* Location of one Block in the input and output buffers */
+struct xz_dec_mt_block {
+	size_t in_start;
+	size_t in_size;
+	vli_type unpadded;
+	size_t out_start;
+	size_t out_size;
+};
+
+/* What dec_stream_index() found in the Stream Header, Index and Footer */
+struct xz_dec_mt_index {
+	enum xz_check check_type;
+	uint32_t count;
+	size_t out_size;
+};
+
+/* State shared by all the threads decoding one Stream */
+struct xz_dec_mt {
+	const uint8_t *in;
+	uint8_t *out;
+	struct xz_dec_mt_block *blocks;
+	uint32_t count;
+	enum xz_check check_type;
+
+	/* Next Block to be decoded */
+	atomic_t next;
+
+	/* First error seen by any thread, XZ_OK while there is none */
+	atomic_t ret;
+};
+
+struct xz_dec_mt_worker {
+	struct work_struct work;
+	struct xz_dec_mt *mt;
+	struct xz_dec *s;
+};
+
+/* Decode a variable-length integer from a buffer holding all of it */
+static bool dec_vli_buf(const uint8_t *in, size_t *pos, size_t size,
+			vli_type *vli)
+{
+	unsigned int shift = 0;
+	uint8_t byte;
+
+	*vli = 0;
+	while (*pos < size) {
+		byte = in[(*pos)++];
+		*vli |= (vli_type)(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+			return byte != 0 || shift == 0;
+
+		shift += 7;
+		if (shift == 7 * VLI_BYTES_MAX)
+			return false;
+	}
+
+	return false;
+}
+
+/*
+ * Validate the Stream Header, Stream Footer and Index of the Stream that
+ * occupies in[0..in_size), optionally followed by Stream Padding, and
+ * fill blocks[] if it is not NULL. XZ_FORMAT_ERROR means that the buffer
+ * does not hold exactly one Stream, which callers take as a hint to use
+ * the sequential decoder instead.
+ */
+static enum xz_ret dec_stream_index(const uint8_t *in, size_t in_size,
+				    struct xz_dec_mt_index *idx,
+				    struct xz_dec_mt_block *blocks)
+{
+	const uint8_t *footer;
+	size_t end = in_size;
+	size_t index_start;
+	size_t pos;
+	size_t in_pos = STREAM_HEADER_SIZE;
+	size_t out_pos = 0;
+	vli_type count;
+	vli_type unpadded;
+	vli_type uncompressed;
+	uint32_t i;
+
+	/* Stream Padding is a multiple of four null bytes. */
+	while (end >= 4 && get_unaligned_le32(in + end - 4) == 0)
+		end -= 4;
+
+	if (end < 2 * STREAM_HEADER_SIZE || (end & 3))
+		return XZ_FORMAT_ERROR;
+
+	if (!memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE))
+		return XZ_FORMAT_ERROR;
+
+	if (xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+			!= get_unaligned_le32(in + HEADER_MAGIC_SIZE + 2))
+		return XZ_DATA_ERROR;
+
+	if (in[HEADER_MAGIC_SIZE] != 0
+			|| in[HEADER_MAGIC_SIZE + 1] > XZ_CHECK_CRC32)
+		return XZ_OPTIONS_ERROR;
+
+	idx->check_type = in[HEADER_MAGIC_SIZE + 1];
+
+	footer = in + end - STREAM_HEADER_SIZE;
+	if (!memeq(footer + 10, FOOTER_MAGIC, FOOTER_MAGIC_SIZE))
+		return XZ_FORMAT_ERROR;
+
+	if (xz_crc32(footer + 4, 6, 0) != get_unaligned_le32(footer))
+		return XZ_DATA_ERROR;
+
+	if (footer[8] != 0 || footer[9] != idx->check_type)
+		return XZ_DATA_ERROR;
+
+	/* Backward Size is the size of the Index in multiples of four. */
+	pos = ((size_t)get_unaligned_le32(footer + 4) + 1) * 4;
+	if (pos > end - 2 * STREAM_HEADER_SIZE)
+		return XZ_FORMAT_ERROR;
+
+	index_start = end - STREAM_HEADER_SIZE - pos;
+	pos = index_start;
+
+	if (in[pos++] != 0x00)
+		return XZ_DATA_ERROR;
+
+	end -= STREAM_HEADER_SIZE;
+	if (!dec_vli_buf(in, &pos, end, &count))
+		return XZ_DATA_ERROR;
+
+	/* Every Record takes at least two bytes. */
+	if (count > (end - pos) / 2)
+		return XZ_DATA_ERROR;
+
+	if (count > min_t(size_t, INT_MAX,
+			  SIZE_MAX / sizeof(struct xz_dec_mt_block)))
+		return XZ_MEMLIMIT_ERROR;
+
+	for (i = 0; i < count; ++i) {
+		if (!dec_vli_buf(in, &pos, end, &unpadded)
+				|| !dec_vli_buf(in, &pos, end, &uncompressed))
+			return XZ_DATA_ERROR;
+
+		if (unpadded == 0 || unpadded > index_start - in_pos)
+			return XZ_DATA_ERROR;
+
+		if (uncompressed > SIZE_MAX - out_pos)
+			return XZ_MEMLIMIT_ERROR;
+
+		if (blocks != NULL) {
+			blocks[i].in_start = in_pos;
+			blocks[i].in_size = ALIGN(unpadded, 4);
+			blocks[i].unpadded = unpadded;
+			blocks[i].out_start = out_pos;
+			blocks[i].out_size = uncompressed;
+		}
+
+		in_pos += ALIGN(unpadded, 4);
+		out_pos += uncompressed;
+		if (in_pos > index_start)
+			return XZ_DATA_ERROR;
+	}
+
+	/* The Blocks have to fill the gap between the headers exactly. */
+	if (in_pos != index_start)
+		return XZ_DATA_ERROR;
+
+	while ((pos - index_start) & 3) {
+		if (pos >= end || in[pos++] != 0x00)
+			return XZ_DATA_ERROR;
+	}
+
+	if (pos + 4 != end
+			|| xz_crc32(in + index_start, pos - index_start, 0)
+				!= get_unaligned_le32(in + pos))
+		return XZ_DATA_ERROR;
+
+	idx->count = count;
+	idx->out_size = out_pos;
+	return XZ_OK;
+}
+
+/* Decode Blocks until there are none left or some thread has failed. */
+static void xz_dec_mt_decode(struct xz_dec_mt *mt, struct xz_dec *s)
+{
+	const struct xz_dec_mt_block *blk;
+	struct xz_buf b;
+	vli_type unpadded;
+	enum xz_ret ret;
+	unsigned int i;
+
+	while (atomic_read(&mt->ret) == XZ_OK) {
+		i = atomic_inc_return(&mt->next) - 1;
+		if (i >= mt->count)
+			break;
+
+		blk = &mt->blocks[i];
+		b.in = mt->in + blk->in_start;
+		b.in_pos = 0;
+		b.in_size = blk->in_size;
+		b.out = mt->out + blk->out_start;
+		b.out_pos = 0;
+		b.out_size = blk->out_size;
+
+		ret = xz_dec_block_single(s, &b, mt->check_type, &unpadded);
+		if (ret == XZ_STREAM_END && (b.in_pos != b.in_size
+				|| b.out_pos != b.out_size
+				|| unpadded != blk->unpadded))
+			ret = XZ_DATA_ERROR;
+
+		if (ret != XZ_STREAM_END) {
+			atomic_cmpxchg(&mt->ret, XZ_OK, ret);
+			break;
+		}
+
+		cond_resched();
+	}
+}
+
+static void xz_dec_mt_work(struct work_struct *work)
+{
+	struct xz_dec_mt_worker *w =
+			container_of(work, struct xz_dec_mt_worker, work);
+
+	xz_dec_mt_decode(w->mt, w->s);
+}
+
+XZ_EXTERN enum xz_ret xz_dec_mt_probe(const uint8_t *in, size_t in_size,
+				      uint64_t *out_size, uint32_t *blocks)
+{
+	struct xz_dec_mt_index idx;
+	enum xz_ret ret;
+
+	ret = dec_stream_index(in, in_size, &idx, NULL);
+	if (ret != XZ_OK)
+		return ret;
+
+	*out_size = idx.out_size;
+	*blocks = idx.count;
+	return XZ_OK;
+}
+
+XZ_EXTERN enum xz_ret xz_dec_mt_run(struct xz_buf *b, unsigned int threads)
+{
+	struct xz_dec_mt_worker *workers;
+	struct xz_dec_mt_index idx;
+	struct xz_dec_mt mt;
+	unsigned int n;
+	unsigned int i;
+	enum xz_ret ret;
+
+	ret = dec_stream_index(b->in + b->in_pos, b->in_size - b->in_pos,
+			       &idx, NULL);
+	if (ret != XZ_OK)
+		return ret;
+
+	if (idx.out_size > b->out_size - b->out_pos)
+		return XZ_BUF_ERROR;
+
+	if (idx.count == 0)
+		goto done;
+
+	if (threads == 0)
+		threads = num_online_cpus();
+	threads = min_t(unsigned int, threads, idx.count);
+
+	mt.blocks = vmalloc(idx.count * sizeof(*mt.blocks));
+	if (mt.blocks == NULL)
+		return XZ_MEM_ERROR;
+
+	workers = kcalloc(threads, sizeof(*workers), GFP_KERNEL);
+	if (workers == NULL) {
+		vfree(mt.blocks);
+		return XZ_MEM_ERROR;
+	}
+
+	dec_stream_index(b->in + b->in_pos, b->in_size - b->in_pos,
+			 &idx, mt.blocks);
+	mt.in = b->in + b->in_pos;
+	mt.out = b->out + b->out_pos;
+	mt.count = idx.count;
+	mt.check_type = idx.check_type;
+	atomic_set(&mt.next, 0);
+	atomic_set(&mt.ret, XZ_OK);
+
+	/* Settle for fewer threads if not all decoders can be allocated. */
+	for (n = 0; n < threads; ++n) {
+		workers[n].mt = &mt;
+		workers[n].s = xz_dec_init(XZ_SINGLE, 0);
+		if (workers[n].s == NULL)
+			break;
+	}
+
+	if (n == 0) {
+		ret = XZ_MEM_ERROR;
+		goto out;
+	}
+
+	for (i = 1; i < n; ++i) {
+		INIT_WORK(&workers[i].work, xz_dec_mt_work);
+		queue_work(system_unbound_wq, &workers[i].work);
+	}
+
+	/* The calling thread takes its share of the Blocks too. */
+	xz_dec_mt_decode(&mt, workers[0].s);
+
+	for (i = 1; i < n; ++i)
+		flush_work(&workers[i].work);
+
+	ret = atomic_read(&mt.ret);
+
+out:
+	for (i = 0; i < n; ++i)
+		xz_dec_end(workers[i].s);
+	kfree(workers);
+	vfree(mt.blocks);
+
+	if (ret != XZ_OK)
+		return ret;
+
+done:
+	b->in_pos = b->in_size;
+	b->out_pos += idx.out_size;
+	return XZ_STREAM_END;
+}
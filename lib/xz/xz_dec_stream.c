@@ -57,6 +57,12 @@ struct xz_dec {
 	 */
 	bool allow_buf_error;
 
+	/*
+	 * True if dec_main() has been asked by xz_dec_block_single() to
+	 * stop after the Check field of one Block.
+	 */
+	bool single_block;
+
 	/* Information stored in Block Header */
 	struct {
 		/*
@@ -590,6 +596,9 @@ static enum xz_ret dec_main(struct xz_dec *s, struct xz_buf *b)
 
 			/* See if this is the beginning of the Index field. */
 			if (b->in[b->in_pos] == 0) {
+				if (s->single_block)
+					return XZ_DATA_ERROR;
+
 				s->in_start = b->in_pos++;
 				s->sequence = SEQ_INDEX;
 				break;
@@ -656,6 +665,9 @@ static enum xz_ret dec_main(struct xz_dec *s, struct xz_buf *b)
 #endif
 
 			s->sequence = SEQ_BLOCK_START;
+			if (s->single_block)
+				return XZ_STREAM_END;
+
 			break;
 
 		case SEQ_INDEX:
@@ -767,6 +779,43 @@ XZ_EXTERN enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b)
 	return ret;
 }
 
+#ifdef XZ_DEC_SINGLE
+/*
+ * Decode exactly one Block in single-call mode. Unlike xz_dec_run(), the
+ * input starts at a Block Header instead of a Stream Header, so the Check
+ * type has to be given by the caller. This lets the Blocks of one Stream
+ * be decoded independently of each other, see xz_dec_mt.c.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_single(struct xz_dec *s, struct xz_buf *b,
+					  enum xz_check check_type,
+					  vli_type *unpadded)
+{
+	size_t in_start = b->in_pos;
+	size_t out_start = b->out_pos;
+	enum xz_ret ret;
+
+	if (!DEC_IS_SINGLE(s->mode))
+		return XZ_OPTIONS_ERROR;
+
+	xz_dec_reset(s);
+	s->check_type = check_type;
+	s->sequence = SEQ_BLOCK_START;
+	s->single_block = true;
+
+	ret = dec_main(s, b);
+	if (ret == XZ_OK)
+		ret = b->in_pos == b->in_size ? XZ_DATA_ERROR : XZ_BUF_ERROR;
+
+	if (ret != XZ_STREAM_END) {
+		b->in_pos = in_start;
+		b->out_pos = out_start;
+	}
+
+	*unpadded = s->block.hash.unpadded;
+	return ret;
+}
+#endif
+
 XZ_EXTERN struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max)
 {
 	struct xz_dec *s = kmalloc(sizeof(*s), GFP_KERNEL);
@@ -801,6 +850,7 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s)
 {
 	s->sequence = SEQ_STREAM_HEADER;
 	s->allow_buf_error = false;
+	s->single_block = false;
 	s->pos = 0;
 	s->crc32 = 0;
 	memzero(&s->block, sizeof(s->block));
@@ -13,6 +13,12 @@
 #include <linux/uaccess.h>
 #include <linux/crc32.h>
 #include <linux/xz.h>
+#ifdef CONFIG_XZ_DEC_MT
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#endif
 
 /* Maximum supported dictionary size */
 #define DICT_MAX (1 << 20)
@@ -61,6 +67,131 @@ static struct xz_buf buffers = {
  */
 static uint32_t crc;
 
+#ifdef CONFIG_XZ_DEC_MT
+/*
+ * Largest file that is kept in memory for the block-parallel decoder
+ * benchmark. Bigger files are only decoded sequentially.
+ */
+static unsigned long mt_max_input = 64 << 20;
+module_param(mt_max_input, ulong, 0644);
+MODULE_PARM_DESC(mt_max_input, "Largest input to benchmark with xz_dec_mt_run()");
+
+/* Copy of the whole input for xz_dec_mt_run() */
+static uint8_t *mt_in;
+static size_t mt_in_size;
+static size_t mt_in_alloc;
+static bool mt_in_skip;
+
+static void xz_dec_test_mt_reset(void)
+{
+	vfree(mt_in);
+	mt_in = NULL;
+	mt_in_size = 0;
+	mt_in_alloc = 0;
+	mt_in_skip = false;
+}
+
+/* Append to mt_in, giving up on the benchmark if the file is too big. */
+static void xz_dec_test_mt_append(const uint8_t *buf, size_t size)
+{
+	uint8_t *tmp;
+	size_t alloc;
+
+	if (mt_in_skip)
+		return;
+
+	if (mt_in_size + size > mt_in_alloc) {
+		alloc = max(mt_in_alloc * 2, mt_in_size + size);
+		alloc = min_t(size_t, alloc, mt_max_input);
+		tmp = mt_in_size + size > alloc ? NULL : vmalloc(alloc);
+		if (tmp == NULL) {
+			xz_dec_test_mt_reset();
+			mt_in_skip = true;
+			return;
+		}
+
+		if (mt_in != NULL)
+			memcpy(tmp, mt_in, mt_in_size);
+		vfree(mt_in);
+		mt_in = tmp;
+		mt_in_alloc = alloc;
+	}
+
+	memcpy(mt_in + mt_in_size, buf, size);
+	mt_in_size += size;
+}
+
+/*
+ * Decode the Stream again with xz_dec_mt_run() using 1, 2, 4, ... threads
+ * up to the number of online CPUs, check the output against the CRC32 of
+ * the sequential run and print the throughput of each.
+ */
+static void xz_dec_test_mt(size_t in_size)
+{
+	unsigned int threads;
+	unsigned int max_threads = num_online_cpus();
+	struct xz_buf b;
+	uint64_t out_size;
+	uint32_t blocks;
+	uint32_t mt_crc;
+	enum xz_ret mt_ret;
+	uint8_t *out;
+	s64 ns;
+
+	if (mt_in == NULL)
+		return;
+
+	mt_ret = xz_dec_mt_probe(mt_in, in_size, &out_size, &blocks);
+	if (mt_ret != XZ_OK) {
+		printk(KERN_INFO DEVICE_NAME ": xz_dec_mt_probe() "
+				"returned %d\n", mt_ret);
+		return;
+	}
+
+	out = vmalloc(max_t(uint64_t, out_size, 1));
+	if (out == NULL)
+		return;
+
+	printk(KERN_INFO DEVICE_NAME ": %u Blocks, %llu bytes "
+			"uncompressed\n", blocks, out_size);
+
+	for (threads = 1; ; threads = min(threads * 2, max_threads)) {
+		b.in = mt_in;
+		b.in_pos = 0;
+		b.in_size = in_size;
+		b.out = out;
+		b.out_pos = 0;
+		b.out_size = out_size;
+
+		ns = ktime_to_ns(ktime_get());
+		mt_ret = xz_dec_mt_run(&b, threads);
+		ns = ktime_to_ns(ktime_get()) - ns;
+
+		if (mt_ret != XZ_STREAM_END) {
+			printk(KERN_INFO DEVICE_NAME ": %u threads: "
+					"xz_dec_mt_run() returned %d\n",
+					threads, mt_ret);
+			break;
+		}
+
+		mt_crc = ~crc32(0xFFFFFFFF, out, b.out_pos);
+		printk(KERN_INFO DEVICE_NAME ": %u threads: %llu MB/s%s\n",
+				threads,
+				ns > 0 ? div64_u64(out_size * 1000, ns) : 0,
+				mt_crc == ~crc ? "" : ", CRC32 MISMATCH");
+
+		if (threads == max_threads)
+			break;
+	}
+
+	vfree(out);
+}
+#else
+static inline void xz_dec_test_mt_reset(void) {}
+static inline void xz_dec_test_mt_append(const uint8_t *buf, size_t size) {}
+static inline void xz_dec_test_mt(size_t in_size) {}
+#endif
+
 static int xz_dec_test_open(struct inode *i, struct file *f)
 {
 	if (device_is_open)
@@ -76,6 +207,8 @@ static int xz_dec_test_open(struct inode *i, struct file *f)
 	buffers.in_size = 0;
 	buffers.out_pos = 0;
 
+	xz_dec_test_mt_reset();
+
 	printk(KERN_INFO DEVICE_NAME ": opened\n");
 	return 0;
 }
@@ -87,6 +220,8 @@ static int xz_dec_test_release(struct inode *i, struct file *f)
 	if (ret == XZ_OK)
 		printk(KERN_INFO DEVICE_NAME ": input was truncated\n");
 
+	xz_dec_test_mt_reset();
+
 	printk(KERN_INFO DEVICE_NAME ": closed\n");
 	return 0;
 }
@@ -98,6 +233,10 @@ static int xz_dec_test_release(struct inode *i, struct file *f)
  *
  * The .xz file must have exactly one Stream and no Stream Padding. The data
  * after the first Stream is considered to be garbage.
+ *
+ * With CONFIG_XZ_DEC_MT, the input is also kept in memory and, once the
+ * Stream has been decoded, decoded again block-parallel to report the
+ * throughput for an increasing number of threads.
  */
 static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 				 size_t size, loff_t *pos)
@@ -125,6 +264,8 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 			if (copy_from_user(buffer_in, buf, buffers.in_size))
 				return -EFAULT;
 
+			xz_dec_test_mt_append(buffer_in, buffers.in_size);
+
 			buf += buffers.in_size;
 			remaining -= buffers.in_size;
 		}
@@ -142,6 +283,7 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 	case XZ_STREAM_END:
 		printk(KERN_INFO DEVICE_NAME ": XZ_STREAM_END, "
 				"CRC32 = 0x%08X\n", ~crc);
+		xz_dec_test_mt(mt_in_size - (buffers.in_size - buffers.in_pos));
 		return size - remaining - (buffers.in_size - buffers.in_pos);
 
 	case XZ_MEMLIMIT_ERROR:
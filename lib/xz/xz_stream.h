@@ -59,4 +59,13 @@ enum xz_check {
 /* Maximum possible Check ID */
 #define XZ_CHECK_MAX 15
 
+/*
+ * Decode one Block, starting at its Block Header, into b->out using a
+ * decoder allocated with XZ_SINGLE. The Unpadded Size of the Block is
+ * stored in *unpadded so that it can be compared against the Index.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_single(struct xz_dec *s, struct xz_buf *b,
+					  enum xz_check check_type,
+					  vli_type *unpadded);
+
 #endif
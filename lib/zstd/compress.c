@@ -0,0 +1,1225 @@
+/*
+ * Zstandard compressor for the Linux kernel
+ *
+ * Produces single-segment Zstandard frames (RFC 8878) with the content
+ * size in the header and no checksum, readable by any conforming
+ * decoder. The parser is a hash chain match finder whose depth and lazy
+ * evaluation grow with the compression level; literals are Huffman
+ * coded and sequences use the predefined, RLE or per-block FSE tables,
+ * whichever suits the block.
+ *
+ * All tables live in the caller's workspace and are sized from the level
+ * and the largest input, so compressing 4KB pages needs only a few tens
+ * of KB (see zstd_compress_workspace_size()).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/bitops.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+#include "zstd_internal.h"
+
+/*
+ * Blocks are kept smaller than the format allows so that the sequence
+ * store stays small; the cost is 3 bytes of block header per 32KB.
+ */
+#define ZSTD_CBLOCK_SIZE	(32 * 1024)
+#define ZSTD_MIN_MATCH		4
+#define ZSTD_MAX_SEQS(block)	((block) / ZSTD_MIN_MATCH + 1)
+
+/* Below these sizes the entropy headers cost more than they save */
+#define ZSTD_MIN_HUF_LITERALS	64
+#define ZSTD_MIN_FSE_SEQS	64
+
+struct zstd_level_params {
+	u8 hash_log;
+	u8 chain_log;	/* 0: no chain, only the hash head is tried */
+	u8 search_log;	/* log2 of the candidates tried per position */
+	u8 lazy;	/* following positions tried before taking a match */
+};
+
+static const struct zstd_level_params zstd_levels[ZSTD_MAX_CLEVEL + 1] = {
+	[1] = { 14,  0, 0, 0 },
+	[2] = { 15, 15, 1, 0 },
+	[3] = { 15, 15, 2, 1 },
+	[4] = { 16, 16, 3, 1 },
+	[5] = { 16, 16, 4, 1 },
+	[6] = { 17, 17, 5, 1 },
+	[7] = { 17, 17, 6, 2 },
+	[8] = { 17, 17, 7, 2 },
+	[9] = { 17, 17, 8, 2 },
+};
+
+struct zstd_seq {
+	u32 lit_len;
+	u32 match_len;
+	u32 offset;	/* offset value: repeat code 1-3 or offset + 3 */
+};
+
+struct zstd_fse_ctable {
+	u16 state[1 << ZSTD_LL_MAX_LOG];
+	struct {
+		s32 delta_find_state;
+		u32 delta_nb_bits;
+	} tt[ZSTD_FSE_MAX_SYMBOL + 1];
+	u32 log;
+};
+
+struct zstd_cctx {
+	const u8 *base;
+	u32 hash_log;
+	u32 chain_log;
+	u32 attempts;
+	u32 lazy;
+	u32 *hash;
+	u32 *chain;
+	struct zstd_seq *seqs;
+	u8 *ll_code;
+	u8 *ml_code;
+	u8 *of_code;
+	u8 *literals;
+	u32 nb_seq;
+	u32 lit_len;
+	u32 rep[ZSTD_REP_NUM];
+	struct zstd_fse_ctable ll_ct, ml_ct, of_ct;
+	u16 huf_code[ZSTD_HUF_MAX_SYMBOL + 1];
+	u8 huf_len[ZSTD_HUF_MAX_SYMBOL + 1];
+};
+
+static const u8 zstd_ll_code_table[64] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+};
+
+static const u8 zstd_ml_code_table[128] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+	32, 32, 33, 33, 34, 34, 35, 35, 36, 36, 36, 36, 37, 37, 37, 37,
+	38, 38, 38, 38, 38, 38, 38, 38, 39, 39, 39, 39, 39, 39, 39, 39,
+	40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+	41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+	42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+};
+
+static inline u32 zstd_ll_code(u32 ll)
+{
+	return ll < 64 ? zstd_ll_code_table[ll] : zstd_highbit32(ll) + 19;
+}
+
+/* 'mlb' is the match length minus ZSTD_MINMATCH */
+static inline u32 zstd_ml_code(u32 mlb)
+{
+	return mlb < 128 ? zstd_ml_code_table[mlb] : zstd_highbit32(mlb) + 36;
+}
+
+/*
+ * Forward bit writer for the backward-read streams: bits are appended
+ * LSB first and the decoder starts from the closing marker bit.
+ */
+struct zstd_bitout {
+	u64 bits;
+	unsigned int nb;
+	u8 *ptr;
+	u8 *start;
+	u8 *end;
+};
+
+static void zstd_bitout_init(struct zstd_bitout *b, u8 *dst, size_t cap)
+{
+	b->bits = 0;
+	b->nb = 0;
+	b->ptr = b->start = dst;
+	b->end = dst + cap;
+}
+
+static __always_inline void zstd_bitout_add(struct zstd_bitout *b, u64 val,
+					    unsigned int nb)
+{
+	b->bits |= (val & ((1ULL << nb) - 1)) << b->nb;
+	b->nb += nb;
+}
+
+static __always_inline void zstd_bitout_flush(struct zstd_bitout *b)
+{
+	unsigned int bytes = b->nb >> 3;
+
+	if (likely(b->end - b->ptr >= 8)) {
+		put_unaligned_le64(b->bits, b->ptr);
+	} else {
+		unsigned int i;
+
+		/* out of room: keep ptr pinned past the end to flag it */
+		if (b->ptr + bytes > b->end) {
+			b->ptr = b->end + 1;
+			b->nb = 0;
+			b->bits = 0;
+			return;
+		}
+		for (i = 0; i < bytes; i++)
+			b->ptr[i] = b->bits >> (8 * i);
+	}
+	b->ptr += bytes;
+	b->bits = bytes == 8 ? 0 : b->bits >> (8 * bytes);
+	b->nb &= 7;
+}
+
+/* Returns the stream size, or 0 if it did not fit */
+static size_t zstd_bitout_close(struct zstd_bitout *b)
+{
+	zstd_bitout_add(b, 1, 1);
+	zstd_bitout_flush(b);
+	if (b->ptr > b->end)
+		return 0;
+	if (b->nb) {
+		if (b->ptr >= b->end)
+			return 0;
+		*b->ptr++ = b->bits;
+	}
+	return b->ptr - b->start;
+}
+
+/*
+ * Normalize a histogram to a sum of 1 << log, keeping every present
+ * symbol at least 1. With 'cap_half' no symbol may exceed half the
+ * table, so every state transition costs at least one bit.
+ */
+static void zstd_normalize(s16 *norm, const u32 *count, u32 max_symbol,
+			   u32 total, u32 log, bool cap_half)
+{
+	int size = 1 << log, sum = 0, largest = 0;
+	u32 s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (!count[s]) {
+			norm[s] = 0;
+			continue;
+		}
+		norm[s] = ((count[s] << log) + total / 2) / total;
+		if (!norm[s])
+			norm[s] = 1;
+		sum += norm[s];
+		if (norm[s] > norm[largest])
+			largest = s;
+	}
+
+	norm[largest] += size - sum;
+	while (norm[largest] < 1) {
+		/* rounding gave too much to the small symbols */
+		u32 victim = largest;
+
+		for (s = 0; s <= max_symbol; s++)
+			if (s != largest && norm[s] > 1 &&
+			    (victim == largest || norm[s] > norm[victim]))
+				victim = s;
+		norm[victim]--;
+		norm[largest]++;
+	}
+
+	if (cap_half && norm[largest] > size / 2) {
+		u32 second = largest;
+
+		for (s = 0; s <= max_symbol; s++)
+			if (s != largest && norm[s] &&
+			    (second == largest || norm[s] > norm[second]))
+				second = s;
+		norm[second] += norm[largest] - size / 2;
+		norm[largest] = size / 2;
+	}
+}
+
+/* Write an FSE table description, the inverse of the decoder's reader */
+static int zstd_write_ncount(u8 *dst, size_t cap, const s16 *norm,
+			     u32 max_symbol, u32 log)
+{
+	int size = 1 << log, remaining = size + 1, threshold = size;
+	u32 nb_bits = log + 1, bits = 0, symbol = 0;
+	unsigned int bitpos = 0;
+	bool prev0 = false;
+	u8 *op = dst, *oend = dst + cap;
+
+#define NCOUNT_FLUSH() do {						\
+	while (bitpos >= 8) {						\
+		if (op >= oend)						\
+			return -ENOSPC;					\
+		*op++ = bits;						\
+		bits >>= 8;						\
+		bitpos -= 8;						\
+	}								\
+} while (0)
+
+	bits = log - ZSTD_FSE_MIN_LOG;
+	bitpos = 4;
+
+	while (symbol <= max_symbol && remaining > 1) {
+		int max, count;
+
+		if (prev0) {
+			u32 start = symbol;
+
+			while (!norm[symbol])
+				symbol++;
+			while (symbol >= start + 3) {
+				start += 3;
+				bits |= 3 << bitpos;
+				bitpos += 2;
+				NCOUNT_FLUSH();
+			}
+			bits |= (symbol - start) << bitpos;
+			bitpos += 2;
+			NCOUNT_FLUSH();
+		}
+
+		count = norm[symbol++];
+		max = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= threshold)
+			count += max;
+		bits |= count << bitpos;
+		bitpos += nb_bits;
+		bitpos -= count < max;
+		prev0 = count == 1;
+		while (remaining < threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+		NCOUNT_FLUSH();
+	}
+#undef NCOUNT_FLUSH
+
+	if (bitpos) {
+		if (op >= oend)
+			return -ENOSPC;
+		*op++ = bits;
+	}
+	return op - dst;
+}
+
+static void zstd_build_ctable(struct zstd_fse_ctable *ct, const s16 *norm,
+			      u32 max_symbol, u32 log)
+{
+	u8 symbols[1 << ZSTD_LL_MAX_LOG];
+	u16 cumul[ZSTD_FSE_MAX_SYMBOL + 2];
+	u32 size = 1 << log, high = size - 1, mask = size - 1;
+	u32 step = zstd_fse_step(size), pos = 0, s, u;
+	int total = 0, i;
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			cumul[s + 1] = cumul[s] + 1;
+			symbols[high--] = s;
+		} else {
+			cumul[s + 1] = cumul[s] + norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			symbols[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+
+	for (u = 0; u < size; u++)
+		ct->state[cumul[symbols[u]]++] = size + u;
+
+	for (s = 0; s <= max_symbol; s++) {
+		switch (norm[s]) {
+		case 0:
+			ct->tt[s].delta_nb_bits = ((log + 1) << 16) - size;
+			break;
+		case -1:
+		case 1:
+			ct->tt[s].delta_nb_bits = (log << 16) - size;
+			ct->tt[s].delta_find_state = total - 1;
+			total++;
+			break;
+		default: {
+			u32 max_bits = log - zstd_highbit32(norm[s] - 1);
+
+			ct->tt[s].delta_nb_bits = (max_bits << 16) -
+						  (norm[s] << max_bits);
+			ct->tt[s].delta_find_state = total - norm[s];
+			total += norm[s];
+		}
+		}
+	}
+	ct->log = log;
+}
+
+/* A zero-bit table for RLE mode: every transition emits nothing */
+static void zstd_build_ctable_rle(struct zstd_fse_ctable *ct, u32 symbol)
+{
+	ct->state[0] = 0;
+	ct->tt[symbol].delta_nb_bits = 0;
+	ct->tt[symbol].delta_find_state = 0;
+	ct->log = 0;
+}
+
+static __always_inline u32 zstd_fse_init_state(const struct zstd_fse_ctable *ct,
+					       u32 symbol)
+{
+	u32 nb = (ct->tt[symbol].delta_nb_bits + (1 << 15)) >> 16;
+	u32 value = (nb << 16) - ct->tt[symbol].delta_nb_bits;
+
+	return ct->state[(value >> nb) + ct->tt[symbol].delta_find_state];
+}
+
+static __always_inline void zstd_fse_encode(struct zstd_bitout *b,
+					    const struct zstd_fse_ctable *ct,
+					    u32 *state, u32 symbol)
+{
+	u32 nb = (*state + ct->tt[symbol].delta_nb_bits) >> 16;
+
+	zstd_bitout_add(b, *state, nb);
+	*state = ct->state[(*state >> nb) + ct->tt[symbol].delta_find_state];
+}
+
+static u32 zstd_count(const u8 *ip, const u8 *match, const u8 *iend)
+{
+	const u8 *start = ip;
+
+#if defined(CONFIG_64BIT) && defined(__LITTLE_ENDIAN)
+	while (iend - ip >= 8) {
+		u64 diff = get_unaligned((const u64 *)ip) ^
+			   get_unaligned((const u64 *)match);
+
+		if (diff)
+			return ip - start + (__ffs64(diff) >> 3);
+		ip += 8;
+		match += 8;
+	}
+#endif
+	while (ip < iend && *ip == *match) {
+		ip++;
+		match++;
+	}
+	return ip - start;
+}
+
+static __always_inline u32 zstd_hash4(const u8 *p, u32 log)
+{
+	return (get_unaligned((const u32 *)p) * 2654435761U) >> (32 - log);
+}
+
+static __always_inline void zstd_insert(struct zstd_cctx *cctx, u32 pos)
+{
+	u32 h = zstd_hash4(cctx->base + pos, cctx->hash_log);
+
+	if (cctx->chain_log)
+		cctx->chain[pos & ((1 << cctx->chain_log) - 1)] = cctx->hash[h];
+	cctx->hash[h] = pos;
+}
+
+/*
+ * Insert 'pos' and return the longest match for it, or 0. 'rep' is the
+ * repeat offset to try first, 0 if repeats are not usable here.
+ */
+static u32 zstd_find_match(struct zstd_cctx *cctx, u32 pos, const u8 *iend,
+			   u32 rep, u32 *offset)
+{
+	const u8 *base = cctx->base, *ip = base + pos;
+	u32 h = zstd_hash4(ip, cctx->hash_log);
+	u32 cand = cctx->hash[h], best = 0, attempts = cctx->attempts;
+	u32 chain_mask = (1 << cctx->chain_log) - 1;
+	u32 max_dist = cctx->chain_log ? chain_mask : ~0U;
+
+	if (cctx->chain_log)
+		cctx->chain[pos & chain_mask] = cand;
+	cctx->hash[h] = pos;
+
+	if (rep && rep <= pos &&
+	    get_unaligned((const u32 *)ip) ==
+	    get_unaligned((const u32 *)(ip - rep))) {
+		best = ZSTD_MIN_MATCH + zstd_count(ip + ZSTD_MIN_MATCH,
+						   ip + ZSTD_MIN_MATCH - rep,
+						   iend);
+		*offset = rep;
+		if (ip + best == iend)
+			return best;
+	}
+
+	while (attempts-- && cand < pos && pos - cand <= max_dist) {
+		const u8 *match = base + cand;
+		u32 next;
+
+		if (match[best] == ip[best] &&
+		    get_unaligned((const u32 *)match) ==
+		    get_unaligned((const u32 *)ip)) {
+			u32 len = ZSTD_MIN_MATCH +
+				  zstd_count(ip + ZSTD_MIN_MATCH,
+					     match + ZSTD_MIN_MATCH, iend);
+
+			if (len > best) {
+				best = len;
+				*offset = pos - cand;
+				if (ip + len == iend)
+					break;
+			}
+		}
+		if (!cctx->chain_log)
+			break;
+		next = cctx->chain[cand & chain_mask];
+		if (next >= cand)
+			break;
+		cand = next;
+	}
+
+	return best >= ZSTD_MIN_MATCH ? best : 0;
+}
+
+/*
+ * Record a sequence and update the repeat offsets the way the decoder
+ * will, picking a repeat code whenever the offset allows one.
+ */
+static void zstd_store_seq(struct zstd_cctx *cctx, const u8 *lit, u32 ll,
+			   u32 offset, u32 ml)
+{
+	struct zstd_seq *seq = &cctx->seqs[cctx->nb_seq++];
+	u32 *rep = cctx->rep, value;
+
+	memcpy(cctx->literals + cctx->lit_len, lit, ll);
+	cctx->lit_len += ll;
+
+	/* with no literals the repeat codes shift by one, see RFC 8878 */
+	if (ll && offset == rep[0]) {
+		value = 1;
+	} else if (offset == rep[1]) {
+		value = ll ? 2 : 1;
+		rep[1] = rep[0];
+		rep[0] = offset;
+	} else {
+		if (offset == rep[2])
+			value = ll ? 3 : 2;
+		else if (!ll && offset == rep[0] - 1)
+			value = 3;
+		else
+			value = offset + ZSTD_REP_NUM;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+	}
+
+	seq->lit_len = ll;
+	seq->match_len = ml;
+	seq->offset = value;
+}
+
+/* Parse [start, end) of the input into the sequence store */
+static void zstd_parse_block(struct zstd_cctx *cctx, u32 start, u32 end)
+{
+	const u8 *base = cctx->base, *iend = base + end;
+	u32 pos = start, anchor = start, inserted;
+	u32 limit = end >= 8 ? end - 8 : 0;
+	u32 skip_shift = cctx->chain_log ? 8 : 6;
+
+	cctx->nb_seq = 0;
+	cctx->lit_len = 0;
+
+	while (pos < limit) {
+		u32 offset = 0, len, i;
+
+		len = zstd_find_match(cctx, pos, iend,
+				      pos > anchor ? cctx->rep[0] : 0, &offset);
+		inserted = pos;
+		if (!len) {
+			pos += 1 + ((pos - anchor) >> skip_shift);
+			continue;
+		}
+
+		/* lazy evaluation: does waiting a byte give a longer match? */
+		for (i = 0; i < cctx->lazy && pos + 1 < limit; i++) {
+			u32 offset2 = 0;
+			u32 len2 = zstd_find_match(cctx, pos + 1, iend,
+						   cctx->rep[0], &offset2);
+
+			inserted = pos + 1;
+			if (len2 <= len)
+				break;
+			pos++;
+			len = len2;
+			offset = offset2;
+		}
+
+		/* extend backwards into the pending literals */
+		while (pos > anchor && pos > offset &&
+		       base[pos - 1] == base[pos - 1 - offset]) {
+			pos--;
+			len++;
+		}
+
+		zstd_store_seq(cctx, base + anchor, pos - anchor, offset, len);
+
+		if (cctx->chain_log) {
+			u32 p = inserted + 1, stop = min(pos + len, limit);
+
+			for (; p < stop; p++)
+				zstd_insert(cctx, p);
+		} else if (pos + len - 2 < limit) {
+			zstd_insert(cctx, pos + len - 2);
+		}
+		pos += len;
+		anchor = pos;
+	}
+
+	memcpy(cctx->literals + cctx->lit_len, base + anchor, end - anchor);
+	cctx->lit_len += end - anchor;
+}
+
+/*
+ * Compute length-limited Huffman code lengths. Counts are flattened
+ * until the optimal tree fits in ZSTD_HUF_MAX_BITS, which keeps the
+ * code complete as the format requires. Returns the longest length.
+ */
+static u32 zstd_huf_lengths(u8 *lengths, const u32 *count, u32 max_symbol)
+{
+	u32 weight[2 * (ZSTD_HUF_MAX_SYMBOL + 1)];
+	u16 parent[2 * (ZSTD_HUF_MAX_SYMBOL + 1)];
+	u8 depth[2 * (ZSTD_HUF_MAX_SYMBOL + 1)];
+	u8 sym[ZSTD_HUF_MAX_SYMBOL + 1];
+	u32 n = 0, i, j, k, max_bits, s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		lengths[s] = 0;
+		if (!count[s])
+			continue;
+		/* insertion sort by count, ascending */
+		for (i = n; i > 0 && weight[i - 1] > count[s]; i--) {
+			weight[i] = weight[i - 1];
+			sym[i] = sym[i - 1];
+		}
+		weight[i] = count[s];
+		sym[i] = s;
+		n++;
+	}
+
+	for (;;) {
+		/* two-queue construction: leaves 0..n-1, internal nodes n.. */
+		i = 0;
+		j = n;
+		for (k = n; k < 2 * n - 1; k++) {
+			u32 a, b;
+
+			a = (i < n && (j >= k || weight[i] <= weight[j])) ?
+			    i++ : j++;
+			b = (i < n && (j >= k || weight[i] <= weight[j])) ?
+			    i++ : j++;
+			weight[k] = weight[a] + weight[b];
+			parent[a] = parent[b] = k;
+		}
+
+		depth[2 * n - 2] = 0;
+		max_bits = 0;
+		for (k = 2 * n - 2; k-- > 0;) {
+			depth[k] = depth[parent[k]] + 1;
+			if (k < n && depth[k] > max_bits)
+				max_bits = depth[k];
+		}
+		if (max_bits <= ZSTD_HUF_MAX_BITS)
+			break;
+
+		for (i = 0; i < n; i++)
+			weight[i] = (weight[i] + 1) >> 1;
+	}
+
+	for (i = 0; i < n; i++)
+		lengths[sym[i]] = depth[i];
+	return max_bits;
+}
+
+/* Encode the Huffman weights with FSE; returns bytes written or <= 0 */
+static int zstd_huf_compress_weights(u8 *dst, size_t cap, const u8 *weights,
+				     u32 nw)
+{
+	u32 count[ZSTD_HUF_MAX_BITS + 1] = { 0 };
+	s16 norm[ZSTD_HUF_MAX_BITS + 1];
+	struct zstd_fse_ctable ct;
+	struct zstd_bitout b;
+	u32 max_symbol = 0, s1, s2, i;
+	int hdr;
+
+	for (i = 0; i < nw; i++) {
+		count[weights[i]]++;
+		if (weights[i] > max_symbol)
+			max_symbol = weights[i];
+	}
+	for (i = 0; i <= max_symbol; i++)
+		if (count[i] == nw)
+			return 0;
+
+	zstd_normalize(norm, count, max_symbol, nw, ZSTD_HUF_WEIGHT_LOG, true);
+	hdr = zstd_write_ncount(dst, cap, norm, max_symbol,
+				ZSTD_HUF_WEIGHT_LOG);
+	if (hdr < 0)
+		return 0;
+	zstd_build_ctable(&ct, norm, max_symbol, ZSTD_HUF_WEIGHT_LOG);
+
+	/* two interleaved states, the first weight ends up in state 1 */
+	zstd_bitout_init(&b, dst + hdr, cap - hdr);
+	i = nw;
+	if (nw & 1) {
+		s1 = zstd_fse_init_state(&ct, weights[--i]);
+		s2 = zstd_fse_init_state(&ct, weights[--i]);
+		zstd_fse_encode(&b, &ct, &s1, weights[--i]);
+	} else {
+		s2 = zstd_fse_init_state(&ct, weights[--i]);
+		s1 = zstd_fse_init_state(&ct, weights[--i]);
+	}
+	while (i) {
+		zstd_fse_encode(&b, &ct, &s2, weights[--i]);
+		zstd_fse_encode(&b, &ct, &s1, weights[--i]);
+		zstd_bitout_flush(&b);
+	}
+	zstd_bitout_add(&b, s2, ct.log);
+	zstd_bitout_add(&b, s1, ct.log);
+	i = zstd_bitout_close(&b);
+	return i ? hdr + i : 0;
+}
+
+/* Write the Huffman tree description; returns bytes written or <= 0 */
+static int zstd_huf_write_tree(struct zstd_cctx *cctx, u8 *dst, size_t cap,
+			       u32 max_symbol, u32 max_bits)
+{
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	u32 s;
+	int ret;
+
+	for (s = 0; s < max_symbol; s++)
+		weights[s] = cctx->huf_len[s] ?
+			     max_bits + 1 - cctx->huf_len[s] : 0;
+
+	if (max_symbol > 128) {
+		if (cap < 2)
+			return 0;
+		ret = zstd_huf_compress_weights(dst + 1, min_t(size_t, cap - 1,
+								127),
+						weights, max_symbol);
+		if (ret <= 0)
+			return 0;
+		dst[0] = ret;
+		return ret + 1;
+	}
+
+	if (cap < 1 + (max_symbol + 1) / 2)
+		return 0;
+	dst[0] = 127 + max_symbol;
+	for (s = 0; s < max_symbol; s += 2)
+		dst[1 + s / 2] = (weights[s] << 4) |
+				 (s + 1 < max_symbol ? weights[s + 1] : 0);
+	return 1 + (max_symbol + 1) / 2;
+}
+
+static size_t zstd_huf_stream(const struct zstd_cctx *cctx, u8 *dst,
+			      size_t cap, const u8 *src, size_t len)
+{
+	struct zstd_bitout b;
+	size_t i = len;
+
+	zstd_bitout_init(&b, dst, cap);
+	/* the decoder reads the stream backwards: emit the last symbol first */
+	while (i >= 4) {
+		u8 c;
+
+		c = src[--i];
+		zstd_bitout_add(&b, cctx->huf_code[c], cctx->huf_len[c]);
+		c = src[--i];
+		zstd_bitout_add(&b, cctx->huf_code[c], cctx->huf_len[c]);
+		c = src[--i];
+		zstd_bitout_add(&b, cctx->huf_code[c], cctx->huf_len[c]);
+		c = src[--i];
+		zstd_bitout_add(&b, cctx->huf_code[c], cctx->huf_len[c]);
+		zstd_bitout_flush(&b);
+	}
+	while (i) {
+		u8 c = src[--i];
+
+		zstd_bitout_add(&b, cctx->huf_code[c], cctx->huf_len[c]);
+	}
+	zstd_bitout_flush(&b);
+	return zstd_bitout_close(&b);
+}
+
+static size_t zstd_write_raw_literals(u8 *dst, size_t cap, const u8 *lit,
+				      u32 len)
+{
+	size_t hdr = len < 32 ? 1 : len < 4096 ? 2 : 3;
+
+	if (cap < hdr + len)
+		return 0;
+	if (hdr == 1)
+		dst[0] = ZSTD_LIT_RAW | (len << 3);
+	else if (hdr == 2)
+		put_unaligned_le16(ZSTD_LIT_RAW | (1 << 2) | (len << 4), dst);
+	else {
+		put_unaligned_le16(ZSTD_LIT_RAW | (3 << 2) | (len << 4), dst);
+		dst[2] = len >> 12;
+	}
+	memcpy(dst + hdr, lit, len);
+	return hdr + len;
+}
+
+/* Returns the literals section size, or 0 if it does not fit */
+static size_t zstd_write_literals(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	const u8 *lit = cctx->literals;
+	u32 len = cctx->lit_len, count[ZSTD_HUF_MAX_SYMBOL + 1] = { 0 };
+	u32 rank_start[ZSTD_HUF_MAX_BITS + 2] = { 0 };
+	u32 max_symbol = 0, max_bits, hdr, seg, i, s;
+	size_t tree, csize, l1, l2, l3, l4;
+	bool single;
+	u8 *op;
+
+	if (len < ZSTD_MIN_HUF_LITERALS)
+		return zstd_write_raw_literals(dst, cap, lit, len);
+
+	for (i = 0; i < len; i++)
+		count[lit[i]]++;
+	for (s = 0; s <= ZSTD_HUF_MAX_SYMBOL; s++) {
+		if (count[s] == len) {
+			/* a single repeated byte */
+			hdr = len < 32 ? 1 : len < 4096 ? 2 : 3;
+			if (cap < hdr + 1)
+				return 0;
+			if (hdr == 1)
+				dst[0] = ZSTD_LIT_RLE | (len << 3);
+			else if (hdr == 2)
+				put_unaligned_le16(ZSTD_LIT_RLE | (1 << 2) |
+						   (len << 4), dst);
+			else {
+				put_unaligned_le16(ZSTD_LIT_RLE | (3 << 2) |
+						   (len << 4), dst);
+				dst[2] = len >> 12;
+			}
+			dst[hdr] = s;
+			return hdr + 1;
+		}
+		if (count[s])
+			max_symbol = s;
+	}
+
+	max_bits = zstd_huf_lengths(cctx->huf_len, count, max_symbol);
+
+	/* canonical codes, matching the decoder's table layout */
+	for (s = 0; s <= max_symbol; s++)
+		if (cctx->huf_len[s])
+			rank_start[max_bits + 1 - cctx->huf_len[s]]++;
+	for (i = 1, seg = 0; i <= max_bits; i++) {
+		u32 n = rank_start[i];
+
+		rank_start[i] = seg;
+		seg += n << (i - 1);
+	}
+	for (s = 0; s <= max_symbol; s++) {
+		u32 w;
+
+		if (!cctx->huf_len[s])
+			continue;
+		w = max_bits + 1 - cctx->huf_len[s];
+		cctx->huf_code[s] = rank_start[w] >> (w - 1);
+		rank_start[w] += 1 << (w - 1);
+	}
+
+	single = len < 256;
+	hdr = single || len < 1024 ? 3 : len < 16384 ? 4 : 5;
+	if (cap <= hdr)
+		return zstd_write_raw_literals(dst, cap, lit, len);
+	op = dst + hdr;
+
+	tree = zstd_huf_write_tree(cctx, op, cap - hdr, max_symbol, max_bits);
+	if (!tree)
+		return zstd_write_raw_literals(dst, cap, lit, len);
+	op += tree;
+
+	if (single) {
+		csize = zstd_huf_stream(cctx, op, dst + cap - op, lit, len);
+		if (!csize)
+			return zstd_write_raw_literals(dst, cap, lit, len);
+		op += csize;
+	} else {
+		if (dst + cap - op < 6)
+			return zstd_write_raw_literals(dst, cap, lit, len);
+		seg = (len + 3) / 4;
+		op += 6;
+		l1 = zstd_huf_stream(cctx, op, dst + cap - op, lit, seg);
+		op += l1;
+		l2 = zstd_huf_stream(cctx, op, dst + cap - op, lit + seg, seg);
+		op += l2;
+		l3 = zstd_huf_stream(cctx, op, dst + cap - op,
+				     lit + 2 * seg, seg);
+		op += l3;
+		l4 = zstd_huf_stream(cctx, op, dst + cap - op,
+				     lit + 3 * seg, len - 3 * seg);
+		op += l4;
+		if (!l1 || !l2 || !l3 || !l4 || l1 > 0xffff || l2 > 0xffff ||
+		    l3 > 0xffff)
+			return zstd_write_raw_literals(dst, cap, lit, len);
+		put_unaligned_le16(l1, dst + hdr + tree);
+		put_unaligned_le16(l2, dst + hdr + tree + 2);
+		put_unaligned_le16(l3, dst + hdr + tree + 4);
+	}
+
+	csize = op - dst - hdr;
+	if (csize + hdr >= len + (len < 4096 ? 2 : 3) ||
+	    (hdr == 3 && csize >= 1024) || (hdr == 4 && csize >= 16384))
+		return zstd_write_raw_literals(dst, cap, lit, len);
+
+	if (hdr == 3) {
+		u32 lhc = ZSTD_LIT_COMPRESSED | ((single ? 0 : 1) << 2) |
+			  (len << 4) | (csize << 14);
+
+		dst[0] = lhc;
+		dst[1] = lhc >> 8;
+		dst[2] = lhc >> 16;
+	} else if (hdr == 4) {
+		put_unaligned_le32(ZSTD_LIT_COMPRESSED | (2 << 2) |
+				   (len << 4) | (csize << 18), dst);
+	} else {
+		put_unaligned_le32(ZSTD_LIT_COMPRESSED | (3 << 2) |
+				   (len << 4) | (csize << 22), dst);
+		dst[4] = csize >> 10;
+	}
+	return op - dst;
+}
+
+/*
+ * Pick the encoding of one sequence symbol type and build its table.
+ * Returns the mode, writes any table description at *opp.
+ */
+static int zstd_select_table(struct zstd_fse_ctable *ct, const u8 *codes,
+			     u32 nb_seq, u32 max_symbol, u32 max_log,
+			     const s16 *default_norm, u32 default_max,
+			     u32 default_log, u8 **opp, u8 *oend)
+{
+	u32 count[ZSTD_FSE_MAX_SYMBOL + 1] = { 0 };
+	s16 norm[ZSTD_FSE_MAX_SYMBOL + 1];
+	u32 i, max = 0, log, min_log;
+	int ret;
+
+	for (i = 0; i < nb_seq; i++) {
+		count[codes[i]]++;
+		if (codes[i] > max)
+			max = codes[i];
+	}
+
+	if (count[max] == nb_seq && nb_seq > 2) {
+		if (*opp >= oend)
+			return -ENOSPC;
+		*(*opp)++ = max;
+		zstd_build_ctable_rle(ct, max);
+		return ZSTD_SEQ_RLE;
+	}
+
+	if (nb_seq < ZSTD_MIN_FSE_SEQS && max <= default_max) {
+		zstd_build_ctable(ct, default_norm, default_max, default_log);
+		return ZSTD_SEQ_PREDEFINED;
+	}
+
+	log = zstd_highbit32(nb_seq) > 2 ? zstd_highbit32(nb_seq) - 2 : 0;
+	min_log = max_t(u32, ZSTD_FSE_MIN_LOG, zstd_highbit32(max) + 2);
+	log = clamp(log, min_log, max_log);
+
+	zstd_normalize(norm, count, max, nb_seq, log, false);
+	ret = zstd_write_ncount(*opp, oend - *opp, norm, max, log);
+	if (ret < 0)
+		return ret;
+	*opp += ret;
+	zstd_build_ctable(ct, norm, max, log);
+	return ZSTD_SEQ_FSE;
+}
+
+/* Returns the sequences section size, or 0 if it does not fit */
+static size_t zstd_write_sequences(struct zstd_cctx *cctx, u8 *dst,
+				   size_t cap)
+{
+	const struct zstd_seq *seqs = cctx->seqs;
+	u32 nb_seq = cctx->nb_seq, ll_state, ml_state, of_state, i;
+	u8 *op = dst, *oend = dst + cap, *modes;
+	struct zstd_bitout b;
+	int ll_mode, of_mode, ml_mode;
+	size_t len;
+
+	if (cap < 4)
+		return 0;
+	if (nb_seq < 128) {
+		*op++ = nb_seq;
+	} else if (nb_seq < 0x7f00) {
+		*op++ = (nb_seq >> 8) + 128;
+		*op++ = nb_seq;
+	} else {
+		*op++ = 255;
+		put_unaligned_le16(nb_seq - 0x7f00, op);
+		op += 2;
+	}
+	if (!nb_seq)
+		return op - dst;
+
+	for (i = 0; i < nb_seq; i++) {
+		cctx->ll_code[i] = zstd_ll_code(seqs[i].lit_len);
+		cctx->ml_code[i] = zstd_ml_code(seqs[i].match_len -
+						ZSTD_MINMATCH);
+		cctx->of_code[i] = zstd_highbit32(seqs[i].offset);
+	}
+
+	modes = op++;
+	ll_mode = zstd_select_table(&cctx->ll_ct, cctx->ll_code, nb_seq,
+			ZSTD_LL_MAX_SYMBOL, ZSTD_LL_MAX_LOG,
+			zstd_ll_default_norm, ZSTD_LL_MAX_SYMBOL,
+			ZSTD_LL_DEFAULT_LOG, &op, oend);
+	if (ll_mode < 0)
+		return 0;
+	of_mode = zstd_select_table(&cctx->of_ct, cctx->of_code, nb_seq,
+			ZSTD_OF_MAX_SYMBOL, ZSTD_OF_MAX_LOG,
+			zstd_of_default_norm, ZSTD_OF_DEFAULT_MAX,
+			ZSTD_OF_DEFAULT_LOG, &op, oend);
+	if (of_mode < 0)
+		return 0;
+	ml_mode = zstd_select_table(&cctx->ml_ct, cctx->ml_code, nb_seq,
+			ZSTD_ML_MAX_SYMBOL, ZSTD_ML_MAX_LOG,
+			zstd_ml_default_norm, ZSTD_ML_MAX_SYMBOL,
+			ZSTD_ML_DEFAULT_LOG, &op, oend);
+	if (ml_mode < 0)
+		return 0;
+	*modes = (ll_mode << 6) | (of_mode << 4) | (ml_mode << 2);
+
+	/*
+	 * Sequences are written last to first, so that the decoder reads
+	 * offset, match and literal extra bits and then the LL, ML, OF
+	 * state updates of each sequence in order.
+	 */
+	zstd_bitout_init(&b, op, oend - op);
+	i = nb_seq - 1;
+	ml_state = zstd_fse_init_state(&cctx->ml_ct, cctx->ml_code[i]);
+	of_state = zstd_fse_init_state(&cctx->of_ct, cctx->of_code[i]);
+	ll_state = zstd_fse_init_state(&cctx->ll_ct, cctx->ll_code[i]);
+	zstd_bitout_add(&b, seqs[i].lit_len, zstd_ll_bits[cctx->ll_code[i]]);
+	zstd_bitout_add(&b, seqs[i].match_len - ZSTD_MINMATCH,
+			zstd_ml_bits[cctx->ml_code[i]]);
+	zstd_bitout_flush(&b);
+	zstd_bitout_add(&b, seqs[i].offset, cctx->of_code[i]);
+	zstd_bitout_flush(&b);
+
+	while (i-- > 0) {
+		u32 llc = cctx->ll_code[i], mlc = cctx->ml_code[i];
+		u32 ofc = cctx->of_code[i];
+
+		zstd_fse_encode(&b, &cctx->of_ct, &of_state, ofc);
+		zstd_fse_encode(&b, &cctx->ml_ct, &ml_state, mlc);
+		zstd_fse_encode(&b, &cctx->ll_ct, &ll_state, llc);
+		zstd_bitout_flush(&b);
+		zstd_bitout_add(&b, seqs[i].lit_len, zstd_ll_bits[llc]);
+		zstd_bitout_add(&b, seqs[i].match_len - ZSTD_MINMATCH,
+				zstd_ml_bits[mlc]);
+		zstd_bitout_flush(&b);
+		zstd_bitout_add(&b, seqs[i].offset, ofc);
+		zstd_bitout_flush(&b);
+	}
+
+	zstd_bitout_add(&b, ml_state, cctx->ml_ct.log);
+	zstd_bitout_add(&b, of_state, cctx->of_ct.log);
+	zstd_bitout_add(&b, ll_state, cctx->ll_ct.log);
+	len = zstd_bitout_close(&b);
+	if (!len)
+		return 0;
+	return op + len - dst;
+}
+
+/* Returns the compressed block size, or 0 to store the block raw */
+static size_t zstd_compress_block(struct zstd_cctx *cctx, u8 *dst,
+				  size_t cap, u32 start, u32 end)
+{
+	size_t lit, seq;
+
+	zstd_parse_block(cctx, start, end);
+
+	lit = zstd_write_literals(cctx, dst, cap);
+	if (!lit)
+		return 0;
+	seq = zstd_write_sequences(cctx, dst + lit, cap - lit);
+	if (!seq)
+		return 0;
+	return lit + seq;
+}
+
+static struct zstd_level_params zstd_get_params(int level, size_t src_len)
+{
+	struct zstd_level_params p;
+	u32 log = src_len > 1 ? zstd_highbit32(src_len - 1) + 1 : 1;
+
+	if (!level)
+		level = ZSTD_DEFAULT_CLEVEL;
+	level = clamp(level, ZSTD_MIN_CLEVEL, ZSTD_MAX_CLEVEL);
+	p = zstd_levels[level];
+
+	/* no point in tables wider than the input */
+	log = max_t(u32, log, 6);
+	p.hash_log = min_t(u32, p.hash_log, log);
+	if (p.chain_log)
+		p.chain_log = min_t(u32, p.chain_log, log);
+	return p;
+}
+
+static size_t zstd_block_size(size_t src_len)
+{
+	return clamp_t(size_t, src_len, 1, ZSTD_CBLOCK_SIZE);
+}
+
+static size_t zstd_workspace_size(const struct zstd_level_params *p,
+				  size_t src_len)
+{
+	size_t block = zstd_block_size(src_len);
+	size_t seqs = ZSTD_MAX_SEQS(block);
+
+	return sizeof(struct zstd_cctx) +
+	       (sizeof(u32) << p->hash_log) +
+	       (p->chain_log ? sizeof(u32) << p->chain_log : 0) +
+	       seqs * sizeof(struct zstd_seq) + 3 * seqs + block;
+}
+
+size_t zstd_compress_workspace_size(int level, size_t src_len)
+{
+	struct zstd_level_params p = zstd_get_params(level, src_len);
+
+	return zstd_workspace_size(&p, src_len);
+}
+EXPORT_SYMBOL(zstd_compress_workspace_size);
+
+static size_t zstd_write_frame_header(u8 *dst, size_t src_len)
+{
+	u8 *op = dst;
+
+	put_unaligned_le32(ZSTD_MAGIC, op);
+	op += 4;
+	if (src_len < 256) {
+		*op++ = 0x20;
+		*op++ = src_len;
+	} else if (src_len < 65536 + 256) {
+		*op++ = 0x20 | (1 << 6);
+		put_unaligned_le16(src_len - 256, op);
+		op += 2;
+	} else if (src_len <= 0xffffffffULL) {
+		*op++ = 0x20 | (2 << 6);
+		put_unaligned_le32(src_len, op);
+		op += 4;
+	} else {
+		*op++ = 0x20 | (3 << 6);
+		put_unaligned_le64(src_len, op);
+		op += 8;
+	}
+	return op - dst;
+}
+
+static bool zstd_is_rle(const u8 *p, size_t len)
+{
+	size_t i;
+
+	for (i = 1; i < len; i++)
+		if (p[i] != p[0])
+			return false;
+	return true;
+}
+
+int zstd_compress(const unsigned char *src, size_t src_len,
+		  unsigned char *dst, size_t *dst_len,
+		  void *wrkmem, size_t wrkmem_size, int level)
+{
+	struct zstd_level_params p = zstd_get_params(level, src_len);
+	struct zstd_cctx *cctx = wrkmem;
+	size_t block = zstd_block_size(src_len), seqs = ZSTD_MAX_SEQS(block);
+	u8 *op = dst, *oend = dst + *dst_len, *ws;
+	size_t pos = 0;
+
+	if (wrkmem_size < zstd_workspace_size(&p, src_len))
+		return -EINVAL;
+	if (*dst_len < ZSTD_FRAME_HEADER_MAX)
+		return -ENOSPC;
+
+	ws = (u8 *)(cctx + 1);
+	cctx->base = src;
+	cctx->hash_log = p.hash_log;
+	cctx->chain_log = p.chain_log;
+	cctx->attempts = 1 << p.search_log;
+	cctx->lazy = p.lazy;
+	cctx->hash = (u32 *)ws;
+	ws += sizeof(u32) << p.hash_log;
+	cctx->chain = (u32 *)ws;
+	if (p.chain_log)
+		ws += sizeof(u32) << p.chain_log;
+	cctx->seqs = (struct zstd_seq *)ws;
+	ws += seqs * sizeof(struct zstd_seq);
+	cctx->literals = ws;
+	ws += block;
+	cctx->ll_code = ws;
+	cctx->ml_code = ws + seqs;
+	cctx->of_code = ws + 2 * seqs;
+	cctx->rep[0] = 1;
+	cctx->rep[1] = 4;
+	cctx->rep[2] = 8;
+	memset(cctx->hash, 0, sizeof(u32) << p.hash_log);
+
+	op += zstd_write_frame_header(op, src_len);
+
+	do {
+		size_t len = min_t(size_t, src_len - pos, ZSTD_CBLOCK_SIZE);
+		bool last = pos + len == src_len;
+		u32 saved_rep[ZSTD_REP_NUM];
+		size_t csize = 0;
+		u32 bh;
+
+		if (oend - op < ZSTD_BLOCK_HEADER_SIZE + 1)
+			return -ENOSPC;
+
+		if (len > 1 && zstd_is_rle(src + pos, len)) {
+			bh = last | (ZSTD_BLOCK_RLE << 1) | (len << 3);
+			op[3] = src[pos];
+			csize = 1;
+		} else {
+			memcpy(saved_rep, cctx->rep, sizeof(saved_rep));
+			if (len >= ZSTD_MIN_MATCH + 8)
+				csize = zstd_compress_block(cctx,
+						op + ZSTD_BLOCK_HEADER_SIZE,
+						min_t(size_t, len - 1,
+						      oend - op -
+						      ZSTD_BLOCK_HEADER_SIZE),
+						pos, pos + len);
+			if (csize) {
+				bh = last | (ZSTD_BLOCK_COMPRESSED << 1) |
+				     (csize << 3);
+			} else {
+				/* the decoder never saw these offsets */
+				memcpy(cctx->rep, saved_rep, sizeof(saved_rep));
+				if (oend - op < ZSTD_BLOCK_HEADER_SIZE + len)
+					return -ENOSPC;
+				bh = last | (ZSTD_BLOCK_RAW << 1) | (len << 3);
+				memcpy(op + ZSTD_BLOCK_HEADER_SIZE, src + pos,
+				       len);
+				csize = len;
+			}
+		}
+
+		op[0] = bh;
+		op[1] = bh >> 8;
+		op[2] = bh >> 16;
+		op += ZSTD_BLOCK_HEADER_SIZE + csize;
+		pos += len;
+	} while (pos < src_len);
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(zstd_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Compressor");
@@ -0,0 +1,1079 @@
+/*
+ * Zstandard decompressor for the Linux kernel
+ *
+ * Decodes complete Zstandard frames (RFC 8878) straight into the caller's
+ * buffer. Everything the format can refer back to lives in 'dst', so the
+ * only working memory is the entropy tables and a literals buffer no
+ * larger than one block, see zstd_decompress_workspace_size().
+ *
+ * Every read from 'src' and write to 'dst' is bounds checked, and all
+ * entropy-coded streams must be consumed exactly, so corrupted input is
+ * reported as -EBADMSG rather than producing garbage.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/bitops.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+#include "zstd_internal.h"
+
+/* Slack after the literals so that short literal runs can be over-copied */
+#define ZSTD_LIT_PAD		16
+#define ZSTD_WILDCOPY		16
+
+struct zstd_fse_entry {
+	u16 new_state;
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_huf_entry {
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_fse_table {
+	struct zstd_fse_entry *entries;
+	u32 log;
+	bool valid;	/* usable by ZSTD_SEQ_REPEAT */
+};
+
+struct zstd_dctx {
+	struct zstd_huf_entry huf[1 << ZSTD_HUF_MAX_BITS];
+	struct zstd_fse_entry ll_entries[1 << ZSTD_LL_MAX_LOG];
+	struct zstd_fse_entry of_entries[1 << ZSTD_OF_MAX_LOG];
+	struct zstd_fse_entry ml_entries[1 << ZSTD_ML_MAX_LOG];
+	struct zstd_fse_table ll, of, ml;
+	u32 huf_log;
+	bool huf_valid;
+	u32 rep[ZSTD_REP_NUM];
+	size_t lit_cap;
+	u8 literals[];
+};
+
+/*
+ * Backward bit reader, shared by the Huffman and FSE decoders. The
+ * stream is read from its last byte towards its first; the highest set
+ * bit of the last byte marks where the payload starts.
+ */
+struct zstd_bitin {
+	u64 bits;
+	unsigned int consumed;
+	const u8 *ptr;
+	const u8 *start;
+};
+
+enum zstd_bitin_status {
+	ZSTD_BITIN_UNFINISHED,
+	ZSTD_BITIN_END_OF_BUFFER,
+	ZSTD_BITIN_COMPLETED,
+	ZSTD_BITIN_OVERFLOW,
+};
+
+static int zstd_bitin_init(struct zstd_bitin *b, const u8 *src, size_t len)
+{
+	u8 last;
+	size_t i;
+
+	if (len < 1)
+		return -EBADMSG;
+	last = src[len - 1];
+	if (!last)
+		return -EBADMSG;
+
+	b->start = src;
+	if (len >= sizeof(b->bits)) {
+		b->ptr = src + len - sizeof(b->bits);
+		b->bits = get_unaligned_le64(b->ptr);
+		b->consumed = 8 - zstd_highbit32(last);
+	} else {
+		b->ptr = src;
+		b->bits = 0;
+		for (i = 0; i < len; i++)
+			b->bits |= (u64)src[i] << (8 * i);
+		b->consumed = 8 - zstd_highbit32(last) +
+			      (sizeof(b->bits) - len) * 8;
+	}
+	return 0;
+}
+
+static __always_inline u64 zstd_bitin_look(const struct zstd_bitin *b,
+					   unsigned int nb)
+{
+	return ((b->bits << (b->consumed & 63)) >> 1) >> ((63 - nb) & 63);
+}
+
+static __always_inline u64 zstd_bitin_read(struct zstd_bitin *b,
+					   unsigned int nb)
+{
+	u64 val = zstd_bitin_look(b, nb);
+
+	b->consumed += nb;
+	return val;
+}
+
+static __always_inline enum zstd_bitin_status
+zstd_bitin_reload(struct zstd_bitin *b)
+{
+	enum zstd_bitin_status status = ZSTD_BITIN_UNFINISHED;
+	unsigned int nb;
+
+	if (unlikely(b->consumed > sizeof(b->bits) * 8))
+		return ZSTD_BITIN_OVERFLOW;
+
+	if (likely(b->ptr >= b->start + sizeof(b->bits))) {
+		b->ptr -= b->consumed >> 3;
+		b->consumed &= 7;
+		b->bits = get_unaligned_le64(b->ptr);
+		return ZSTD_BITIN_UNFINISHED;
+	}
+
+	if (b->ptr == b->start)
+		return b->consumed < sizeof(b->bits) * 8 ?
+			ZSTD_BITIN_END_OF_BUFFER : ZSTD_BITIN_COMPLETED;
+
+	nb = b->consumed >> 3;
+	if (b->ptr - nb < b->start) {
+		nb = b->ptr - b->start;
+		status = ZSTD_BITIN_END_OF_BUFFER;
+	}
+	b->ptr -= nb;
+	b->consumed -= nb * 8;
+	b->bits = get_unaligned_le64(b->ptr);
+	return status;
+}
+
+/* True if every bit of the stream has been consumed, and no more */
+static bool zstd_bitin_finished(struct zstd_bitin *b)
+{
+	zstd_bitin_reload(b);
+	return b->ptr == b->start && b->consumed == sizeof(b->bits) * 8;
+}
+
+/*
+ * Read an FSE table description (RFC 8878 4.1.1) into norm[]. Returns
+ * the number of bytes used, or -EBADMSG. *max_symbol is the largest
+ * symbol allowed on entry and the largest symbol described on return.
+ */
+static int zstd_read_ncount(s16 *norm, u32 *max_symbol, u32 *log,
+			    u32 max_log, const u8 *src, size_t len)
+{
+	size_t pos = 0, limit = len * 8;
+	u32 symbol = 0, nb_bits;
+	int remaining, threshold;
+	bool prev0 = false;
+
+#define NCOUNT_PEEK(nb) ({						\
+	u32 __v = 0, __i;						\
+	for (__i = 0; __i < (nb); __i++) {				\
+		size_t __p = pos + __i;					\
+		if (__p < limit)					\
+			__v |= ((src[__p >> 3] >> (__p & 7)) & 1) << __i; \
+	}								\
+	__v;								\
+})
+
+	if (len < 1)
+		return -EBADMSG;
+
+	*log = (src[0] & 0xf) + ZSTD_FSE_MIN_LOG;
+	pos = 4;
+	if (*log > max_log)
+		return -EBADMSG;
+
+	remaining = (1 << *log) + 1;
+	threshold = 1 << *log;
+	nb_bits = *log + 1;
+
+	while (remaining > 1 && symbol <= *max_symbol) {
+		int max, count;
+		u32 val;
+
+		if (prev0) {
+			u32 n = symbol, r;
+
+			do {
+				r = NCOUNT_PEEK(2);
+				pos += 2;
+				n += r;
+			} while (r == 3 && pos <= limit);
+			if (n > *max_symbol)
+				return -EBADMSG;
+			while (symbol < n)
+				norm[symbol++] = 0;
+		}
+
+		max = (2 * threshold - 1) - remaining;
+		val = NCOUNT_PEEK(nb_bits);
+		if ((int)(val & (threshold - 1)) < max) {
+			count = val & (threshold - 1);
+			pos += nb_bits - 1;
+		} else {
+			count = val & (2 * threshold - 1);
+			if (count >= threshold)
+				count -= max;
+			pos += nb_bits;
+		}
+		count--;
+		remaining -= count < 0 ? -count : count;
+		norm[symbol++] = count;
+		prev0 = !count;
+		while (remaining < threshold && threshold > 1) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+		if (pos > limit)
+			return -EBADMSG;
+	}
+#undef NCOUNT_PEEK
+
+	if (remaining != 1 || pos > limit)
+		return -EBADMSG;
+
+	*max_symbol = symbol - 1;
+	return (pos + 7) >> 3;
+}
+
+static int zstd_build_fse(struct zstd_fse_entry *dt, const s16 *norm,
+			  u32 max_symbol, u32 log)
+{
+	u16 next[ZSTD_FSE_MAX_SYMBOL + 1];
+	u32 size = 1 << log, high = size - 1, mask = size - 1;
+	u32 step = zstd_fse_step(size), pos = 0, s, u;
+	int i;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			dt[high--].symbol = s;
+			next[s] = 1;
+		} else {
+			next[s] = norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			dt[pos].symbol = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+	if (pos != 0)
+		return -EBADMSG;
+
+	for (u = 0; u < size; u++) {
+		u32 state = next[dt[u].symbol]++;
+		u32 nb = log - zstd_highbit32(state);
+
+		dt[u].nb_bits = nb;
+		dt[u].new_state = (state << nb) - size;
+	}
+	return 0;
+}
+
+/*
+ * Decode the FSE-compressed Huffman weights. Two interleaved states are
+ * used and decoding stops once a state update runs past the stream.
+ */
+static int zstd_decode_weights(u8 *weights, const u8 *src, size_t len)
+{
+	struct zstd_fse_entry dt[1 << ZSTD_HUF_WEIGHT_LOG];
+	s16 norm[ZSTD_HUF_MAX_BITS + 2];
+	u32 max_symbol = ZSTD_HUF_MAX_BITS + 1, log, s1, s2;
+	struct zstd_bitin b;
+	int hdr, n = 0;
+
+	hdr = zstd_read_ncount(norm, &max_symbol, &log, ZSTD_HUF_WEIGHT_LOG,
+			       src, len);
+	if (hdr < 0)
+		return hdr;
+	if (zstd_build_fse(dt, norm, max_symbol, log))
+		return -EBADMSG;
+	if (zstd_bitin_init(&b, src + hdr, len - hdr))
+		return -EBADMSG;
+
+	s1 = zstd_bitin_read(&b, log);
+	s2 = zstd_bitin_read(&b, log);
+	zstd_bitin_reload(&b);
+
+	for (;;) {
+		if (n > ZSTD_HUF_MAX_SYMBOL - 2)
+			return -EBADMSG;
+		weights[n++] = dt[s1].symbol;
+		s1 = dt[s1].new_state + zstd_bitin_read(&b, dt[s1].nb_bits);
+		if (zstd_bitin_reload(&b) == ZSTD_BITIN_OVERFLOW) {
+			weights[n++] = dt[s2].symbol;
+			break;
+		}
+
+		if (n > ZSTD_HUF_MAX_SYMBOL - 2)
+			return -EBADMSG;
+		weights[n++] = dt[s2].symbol;
+		s2 = dt[s2].new_state + zstd_bitin_read(&b, dt[s2].nb_bits);
+		if (zstd_bitin_reload(&b) == ZSTD_BITIN_OVERFLOW) {
+			weights[n++] = dt[s1].symbol;
+			break;
+		}
+	}
+	return n;
+}
+
+/* Read a Huffman tree description and build the decoding table */
+static int zstd_read_huf(struct zstd_dctx *dctx, const u8 *src, size_t len)
+{
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	u32 rank_count[ZSTD_HUF_MAX_BITS + 1] = { 0 };
+	u32 rank_start[ZSTD_HUF_MAX_BITS + 1];
+	u32 total = 0, rest, max_bits, next, w, s;
+	int nw, used, i;
+
+	if (len < 1)
+		return -EBADMSG;
+
+	if (src[0] >= 128) {
+		nw = src[0] - 127;
+		used = 1 + (nw + 1) / 2;
+		if (used > len)
+			return -EBADMSG;
+		for (i = 0; i < nw; i++)
+			weights[i] = (i & 1) ? src[1 + i / 2] & 0xf :
+					       src[1 + i / 2] >> 4;
+	} else {
+		used = 1 + src[0];
+		if (used > len)
+			return -EBADMSG;
+		nw = zstd_decode_weights(weights, src + 1, src[0]);
+		if (nw < 0)
+			return nw;
+	}
+
+	for (i = 0; i < nw; i++) {
+		if (weights[i] > ZSTD_HUF_MAX_BITS)
+			return -EBADMSG;
+		rank_count[weights[i]]++;
+		total += (1 << weights[i]) >> 1;
+	}
+	if (!total)
+		return -EBADMSG;
+
+	/* the last weight is implied by completing a power of two */
+	max_bits = zstd_highbit32(total) + 1;
+	if (max_bits > ZSTD_HUF_MAX_BITS)
+		return -EBADMSG;
+	rest = (1 << max_bits) - total;
+	if (rest & (rest - 1))
+		return -EBADMSG;
+	w = zstd_highbit32(rest) + 1;
+	weights[nw++] = w;
+	rank_count[w]++;
+	if (rank_count[1] < 2 || (rank_count[1] & 1))
+		return -EBADMSG;
+
+	next = 0;
+	for (w = 1; w <= max_bits; w++) {
+		rank_start[w] = next;
+		next += rank_count[w] << (w - 1);
+	}
+
+	for (s = 0; s < nw; s++) {
+		u32 len_entries, n;
+
+		w = weights[s];
+		if (!w)
+			continue;
+		len_entries = (1 << w) >> 1;
+		for (n = rank_start[w]; n < rank_start[w] + len_entries; n++) {
+			dctx->huf[n].symbol = s;
+			dctx->huf[n].nb_bits = max_bits + 1 - w;
+		}
+		rank_start[w] += len_entries;
+	}
+
+	dctx->huf_log = max_bits;
+	dctx->huf_valid = true;
+	return used;
+}
+
+static __always_inline u8 zstd_huf_decode(const struct zstd_dctx *dctx,
+					  struct zstd_bitin *b)
+{
+	const struct zstd_huf_entry *e =
+		&dctx->huf[zstd_bitin_look(b, dctx->huf_log)];
+
+	b->consumed += e->nb_bits;
+	return e->symbol;
+}
+
+static int zstd_huf_stream(const struct zstd_dctx *dctx, u8 *out, size_t n,
+			   const u8 *src, size_t len)
+{
+	struct zstd_bitin b;
+	u8 *end = out + n;
+
+	if (zstd_bitin_init(&b, src, len))
+		return -EBADMSG;
+
+	/* 4 symbols of at most 11 bits fit in the 57 bits left by a reload */
+	while (end - out >= 4 &&
+	       zstd_bitin_reload(&b) == ZSTD_BITIN_UNFINISHED) {
+		out[0] = zstd_huf_decode(dctx, &b);
+		out[1] = zstd_huf_decode(dctx, &b);
+		out[2] = zstd_huf_decode(dctx, &b);
+		out[3] = zstd_huf_decode(dctx, &b);
+		out += 4;
+	}
+	while (out < end) {
+		if (zstd_bitin_reload(&b) == ZSTD_BITIN_OVERFLOW)
+			return -EBADMSG;
+		*out++ = zstd_huf_decode(dctx, &b);
+	}
+
+	return zstd_bitin_finished(&b) ? 0 : -EBADMSG;
+}
+
+static int zstd_huf_decompress(const struct zstd_dctx *dctx, u8 *out,
+			       size_t n, const u8 *src, size_t len,
+			       bool four_streams)
+{
+	size_t seg, l1, l2, l3, l4;
+	int ret;
+
+	if (!four_streams)
+		return zstd_huf_stream(dctx, out, n, src, len);
+
+	if (len < 6)
+		return -EBADMSG;
+	l1 = get_unaligned_le16(src);
+	l2 = get_unaligned_le16(src + 2);
+	l3 = get_unaligned_le16(src + 4);
+	if (l1 + l2 + l3 + 6 > len)
+		return -EBADMSG;
+	l4 = len - 6 - l1 - l2 - l3;
+	src += 6;
+
+	seg = (n + 3) / 4;
+	if (3 * seg > n)
+		return -EBADMSG;
+
+	ret = zstd_huf_stream(dctx, out, seg, src, l1);
+	if (!ret)
+		ret = zstd_huf_stream(dctx, out + seg, seg, src + l1, l2);
+	if (!ret)
+		ret = zstd_huf_stream(dctx, out + 2 * seg, seg,
+				      src + l1 + l2, l3);
+	if (!ret)
+		ret = zstd_huf_stream(dctx, out + 3 * seg, n - 3 * seg,
+				      src + l1 + l2 + l3, l4);
+	return ret;
+}
+
+/*
+ * Parse the literals section. On success *lit points at the regenerated
+ * literals (either in dctx->literals or, for raw literals, in 'src') and
+ * the number of bytes used from 'src' is returned.
+ */
+static int zstd_decode_literals(struct zstd_dctx *dctx, const u8 *src,
+				size_t len, size_t out_room,
+				const u8 **lit, size_t *lit_len)
+{
+	u32 type, sf, hdr;
+	size_t regen, csize, used;
+	int ret;
+
+	if (len < 1)
+		return -EBADMSG;
+	type = src[0] & 3;
+	sf = (src[0] >> 2) & 3;
+
+	if (type == ZSTD_LIT_RAW || type == ZSTD_LIT_RLE) {
+		switch (sf) {
+		case 1:
+			hdr = 2;
+			if (len < hdr)
+				return -EBADMSG;
+			regen = (src[0] >> 4) + (src[1] << 4);
+			break;
+		case 3:
+			hdr = 3;
+			if (len < hdr)
+				return -EBADMSG;
+			regen = (src[0] >> 4) + (src[1] << 4) +
+				((u32)src[2] << 12);
+			break;
+		default:
+			hdr = 1;
+			regen = src[0] >> 3;
+			break;
+		}
+		if (regen > out_room)
+			return -ENOSPC;
+
+		if (type == ZSTD_LIT_RAW) {
+			if (hdr + regen > len)
+				return -EBADMSG;
+			*lit = src + hdr;
+			*lit_len = regen;
+			return hdr + regen;
+		}
+
+		if (hdr + 1 > len)
+			return -EBADMSG;
+		if (regen > dctx->lit_cap)
+			return -EINVAL;
+		memset(dctx->literals, src[hdr], regen);
+		*lit = dctx->literals;
+		*lit_len = regen;
+		return hdr + 1;
+	}
+
+	switch (sf) {
+	case 0:
+	case 1:
+		hdr = 3;
+		if (len < hdr)
+			return -EBADMSG;
+		regen = (src[0] >> 4) | ((src[1] & 0x3f) << 4);
+		csize = (src[1] >> 6) | (src[2] << 2);
+		break;
+	case 2:
+		hdr = 4;
+		if (len < hdr)
+			return -EBADMSG;
+		regen = (get_unaligned_le32(src) >> 4) & 0x3fff;
+		csize = get_unaligned_le32(src) >> 18;
+		break;
+	default:
+		hdr = 5;
+		if (len < hdr)
+			return -EBADMSG;
+		regen = (get_unaligned_le32(src) >> 4) & 0x3ffff;
+		csize = (get_unaligned_le32(src) >> 22) | ((u32)src[4] << 10);
+		break;
+	}
+	if (hdr + csize > len)
+		return -EBADMSG;
+	if (regen > out_room)
+		return -ENOSPC;
+	if (regen > dctx->lit_cap)
+		return -EINVAL;
+	used = hdr + csize;
+
+	src += hdr;
+	if (type == ZSTD_LIT_COMPRESSED) {
+		ret = zstd_read_huf(dctx, src, csize);
+		if (ret < 0)
+			return ret;
+		src += ret;
+		csize -= ret;
+	} else if (!dctx->huf_valid) {
+		return -EBADMSG;
+	}
+
+	ret = zstd_huf_decompress(dctx, dctx->literals, regen, src, csize,
+				  sf != 0);
+	if (ret)
+		return ret;
+
+	*lit = dctx->literals;
+	*lit_len = regen;
+	return used;
+}
+
+static int zstd_build_seq_table(struct zstd_fse_table *t, u32 mode,
+				const s16 *default_norm, u32 default_max,
+				u32 default_log, u32 max_symbol, u32 max_log,
+				const u8 *src, size_t len)
+{
+	s16 norm[ZSTD_FSE_MAX_SYMBOL + 1];
+	int used;
+
+	switch (mode) {
+	case ZSTD_SEQ_PREDEFINED:
+		t->log = default_log;
+		t->valid = true;
+		zstd_build_fse(t->entries, default_norm, default_max,
+			       default_log);
+		return 0;
+	case ZSTD_SEQ_RLE:
+		if (len < 1 || src[0] > max_symbol)
+			return -EBADMSG;
+		t->entries[0].symbol = src[0];
+		t->entries[0].nb_bits = 0;
+		t->entries[0].new_state = 0;
+		t->log = 0;
+		t->valid = true;
+		return 1;
+	case ZSTD_SEQ_FSE:
+		used = zstd_read_ncount(norm, &max_symbol, &t->log, max_log,
+				       src, len);
+		if (used < 0)
+			return used;
+		if (zstd_build_fse(t->entries, norm, max_symbol, t->log))
+			return -EBADMSG;
+		t->valid = true;
+		return used;
+	default:
+		return t->valid ? 0 : -EBADMSG;
+	}
+}
+
+/* Copy 'len' bytes in 8-byte steps; may write up to 7 bytes past the end */
+static __always_inline void zstd_wildcopy(u8 *dst, const u8 *src, size_t len)
+{
+	u8 *end = dst + len;
+
+	do {
+		put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+static __always_inline void zstd_copy_match(u8 *op, size_t offset,
+					    size_t len, const u8 *oend)
+{
+	const u8 *match = op - offset;
+	u8 *end = op + len;
+
+	if (offset >= 8 && oend - end >= ZSTD_WILDCOPY) {
+		zstd_wildcopy(op, match, len);
+		return;
+	}
+	while (op < end)
+		*op++ = *match++;
+}
+
+/*
+ * Decode the sequences section and execute it against the literals.
+ * Returns the number of bytes written at 'op'.
+ */
+static ssize_t zstd_decode_sequences(struct zstd_dctx *dctx, const u8 *src,
+				     size_t len, u8 *op, u8 *oend,
+				     const u8 *frame_start, const u8 *lit,
+				     size_t lit_len, const u8 *lit_limit)
+{
+	const u8 *iend = src + len, *lit_end = lit + lit_len;
+	u8 *ostart = op;
+	u32 nb_seq, modes, ll_state, of_state, ml_state;
+	struct zstd_bitin b;
+	int used;
+
+	if (len < 1)
+		return -EBADMSG;
+	nb_seq = *src++;
+	if (nb_seq >= 128) {
+		if (nb_seq == 255) {
+			if (iend - src < 2)
+				return -EBADMSG;
+			nb_seq = get_unaligned_le16(src) + 0x7f00;
+			src += 2;
+		} else {
+			if (iend - src < 1)
+				return -EBADMSG;
+			nb_seq = ((nb_seq - 128) << 8) + *src++;
+		}
+	}
+
+	if (!nb_seq) {
+		if (src != iend)
+			return -EBADMSG;
+		goto last_literals;
+	}
+
+	if (iend - src < 1)
+		return -EBADMSG;
+	modes = *src++;
+	if (modes & 3)
+		return -EBADMSG;
+
+	used = zstd_build_seq_table(&dctx->ll, modes >> 6,
+			zstd_ll_default_norm, ZSTD_LL_MAX_SYMBOL,
+			ZSTD_LL_DEFAULT_LOG, ZSTD_LL_MAX_SYMBOL,
+			ZSTD_LL_MAX_LOG, src, iend - src);
+	if (used < 0)
+		return used;
+	src += used;
+	used = zstd_build_seq_table(&dctx->of, (modes >> 4) & 3,
+			zstd_of_default_norm, ZSTD_OF_DEFAULT_MAX,
+			ZSTD_OF_DEFAULT_LOG, ZSTD_OF_MAX_SYMBOL,
+			ZSTD_OF_MAX_LOG, src, iend - src);
+	if (used < 0)
+		return used;
+	src += used;
+	used = zstd_build_seq_table(&dctx->ml, (modes >> 2) & 3,
+			zstd_ml_default_norm, ZSTD_ML_MAX_SYMBOL,
+			ZSTD_ML_DEFAULT_LOG, ZSTD_ML_MAX_SYMBOL,
+			ZSTD_ML_MAX_LOG, src, iend - src);
+	if (used < 0)
+		return used;
+	src += used;
+
+	if (zstd_bitin_init(&b, src, iend - src))
+		return -EBADMSG;
+	ll_state = zstd_bitin_read(&b, dctx->ll.log);
+	of_state = zstd_bitin_read(&b, dctx->of.log);
+	ml_state = zstd_bitin_read(&b, dctx->ml.log);
+	zstd_bitin_reload(&b);
+
+	while (nb_seq--) {
+		const struct zstd_fse_entry *lle = &dctx->ll.entries[ll_state];
+		const struct zstd_fse_entry *ofe = &dctx->of.entries[of_state];
+		const struct zstd_fse_entry *mle = &dctx->ml.entries[ml_state];
+		u32 of_code = ofe->symbol, offset;
+		size_t ll, ml;
+
+		/* an offset code needs up to 31 extra bits, one reload each */
+		offset = (1U << of_code) + zstd_bitin_read(&b, of_code);
+		zstd_bitin_reload(&b);
+		ml = zstd_ml_base[mle->symbol] +
+		     zstd_bitin_read(&b, zstd_ml_bits[mle->symbol]);
+		ll = zstd_ll_base[lle->symbol] +
+		     zstd_bitin_read(&b, zstd_ll_bits[lle->symbol]);
+		zstd_bitin_reload(&b);
+
+		if (nb_seq) {
+			ll_state = lle->new_state +
+				   zstd_bitin_read(&b, lle->nb_bits);
+			ml_state = mle->new_state +
+				   zstd_bitin_read(&b, mle->nb_bits);
+			of_state = ofe->new_state +
+				   zstd_bitin_read(&b, ofe->nb_bits);
+			if (zstd_bitin_reload(&b) == ZSTD_BITIN_OVERFLOW)
+				return -EBADMSG;
+		}
+
+		if (offset > ZSTD_REP_NUM) {
+			offset -= ZSTD_REP_NUM;
+			dctx->rep[2] = dctx->rep[1];
+			dctx->rep[1] = dctx->rep[0];
+			dctx->rep[0] = offset;
+		} else {
+			/* a zero literal length shifts the repeat index by one */
+			u32 idx = offset - 1 + (ll == 0);
+
+			if (idx == 0) {
+				offset = dctx->rep[0];
+			} else {
+				offset = idx == 3 ? dctx->rep[0] - 1 :
+						    dctx->rep[idx];
+				if (!offset)
+					return -EBADMSG;
+				if (idx != 1)
+					dctx->rep[2] = dctx->rep[1];
+				dctx->rep[1] = dctx->rep[0];
+				dctx->rep[0] = offset;
+			}
+		}
+
+		if (ll > lit_end - lit)
+			return -EBADMSG;
+		if (ll + ml > oend - op)
+			return -ENOSPC;
+
+		if (ll <= ZSTD_WILDCOPY && lit_limit - lit >= ZSTD_WILDCOPY &&
+		    oend - op >= ZSTD_WILDCOPY) {
+			put_unaligned(get_unaligned((const u64 *)lit), (u64 *)op);
+			put_unaligned(get_unaligned((const u64 *)(lit + 8)),
+				      (u64 *)(op + 8));
+		} else {
+			memcpy(op, lit, ll);
+		}
+		op += ll;
+		lit += ll;
+
+		if (offset > op - frame_start)
+			return -EBADMSG;
+		zstd_copy_match(op, offset, ml, oend);
+		op += ml;
+	}
+
+	if (!zstd_bitin_finished(&b))
+		return -EBADMSG;
+
+last_literals:
+	if (lit_end - lit > oend - op)
+		return -ENOSPC;
+	memcpy(op, lit, lit_end - lit);
+	op += lit_end - lit;
+	return op - ostart;
+}
+
+static ssize_t zstd_decode_block(struct zstd_dctx *dctx, const u8 *src,
+				 size_t len, u8 *op, u8 *oend,
+				 const u8 *frame_start)
+{
+	const u8 *lit, *lit_limit;
+	size_t lit_len;
+	int used;
+
+	used = zstd_decode_literals(dctx, src, len, oend - op, &lit, &lit_len);
+	if (used < 0)
+		return used;
+
+	if (lit == dctx->literals)
+		lit_limit = dctx->literals + dctx->lit_cap + ZSTD_LIT_PAD;
+	else
+		lit_limit = src + len;
+
+	return zstd_decode_sequences(dctx, src + used, len - used, op, oend,
+				     frame_start, lit, lit_len, lit_limit);
+}
+
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+static u64 zstd_xxh64_round(u64 acc, u64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = rol64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static u64 zstd_xxh64_merge(u64 acc, u64 val)
+{
+	acc ^= zstd_xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* XXH64 with seed 0, the content checksum of a Zstandard frame */
+static u64 zstd_xxh64(const u8 *p, size_t len)
+{
+	const u8 *end = p + len;
+	u64 h;
+
+	if (len >= 32) {
+		const u8 *limit = end - 32;
+		u64 v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+		u64 v2 = XXH_PRIME64_2;
+		u64 v3 = 0;
+		u64 v4 = -XXH_PRIME64_1;
+
+		do {
+			v1 = zstd_xxh64_round(v1, get_unaligned_le64(p));
+			v2 = zstd_xxh64_round(v2, get_unaligned_le64(p + 8));
+			v3 = zstd_xxh64_round(v3, get_unaligned_le64(p + 16));
+			v4 = zstd_xxh64_round(v4, get_unaligned_le64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rol64(v1, 1) + rol64(v2, 7) + rol64(v3, 12) +
+		    rol64(v4, 18);
+		h = zstd_xxh64_merge(h, v1);
+		h = zstd_xxh64_merge(h, v2);
+		h = zstd_xxh64_merge(h, v3);
+		h = zstd_xxh64_merge(h, v4);
+	} else {
+		h = XXH_PRIME64_5;
+	}
+
+	h += len;
+
+	while (p + 8 <= end) {
+		h ^= zstd_xxh64_round(0, get_unaligned_le64(p));
+		h = rol64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (u64)get_unaligned_le32(p) * XXH_PRIME64_1;
+		h = rol64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p++) * XXH_PRIME64_5;
+		h = rol64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * Decode one frame whose magic number has already been checked.
+ * Returns the number of input bytes used and advances *opp.
+ */
+static ssize_t zstd_decode_frame(struct zstd_dctx *dctx, const u8 *src,
+				 size_t len, u8 **opp, u8 *oend)
+{
+	static const u8 did_size[4] = { 0, 1, 2, 4 };
+	static const u8 fcs_size[4] = { 0, 2, 4, 8 };
+	const u8 *ip = src + 4, *iend = src + len;
+	u8 *op = *opp, *frame_start = *opp;
+	u32 fhd, nd, nf, i;
+	u64 dict_id = 0, content_size = 0;
+	bool single, checksum, last;
+
+	if (iend - ip < 1)
+		return -EBADMSG;
+	fhd = *ip++;
+	single = fhd & 0x20;
+	checksum = fhd & 0x04;
+	if (fhd & 0x08)
+		return -EBADMSG;
+
+	nd = did_size[fhd & 3];
+	nf = fcs_size[fhd >> 6];
+	if (single && !nf)
+		nf = 1;
+	if (iend - ip < !single + nd + nf)
+		return -EBADMSG;
+
+	/* the window only matters to streaming decoders, all of dst is ours */
+	ip += !single;
+
+	for (i = 0; i < nd; i++)
+		dict_id |= (u64)ip[i] << (8 * i);
+	ip += nd;
+	if (dict_id)
+		return -EBADMSG;
+
+	for (i = 0; i < nf; i++)
+		content_size |= (u64)ip[i] << (8 * i);
+	if (nf == 2)
+		content_size += 256;
+	ip += nf;
+	if (nf && content_size > oend - op)
+		return -ENOSPC;
+
+	dctx->rep[0] = 1;
+	dctx->rep[1] = 4;
+	dctx->rep[2] = 8;
+	dctx->huf_valid = false;
+	dctx->ll.valid = dctx->of.valid = dctx->ml.valid = false;
+
+	do {
+		u32 bh, type, bsize;
+		ssize_t ret;
+
+		if (iend - ip < ZSTD_BLOCK_HEADER_SIZE)
+			return -EBADMSG;
+		bh = ip[0] | (ip[1] << 8) | (ip[2] << 16);
+		ip += ZSTD_BLOCK_HEADER_SIZE;
+		last = bh & 1;
+		type = (bh >> 1) & 3;
+		bsize = bh >> 3;
+
+		switch (type) {
+		case ZSTD_BLOCK_RAW:
+			if (bsize > iend - ip)
+				return -EBADMSG;
+			if (bsize > oend - op)
+				return -ENOSPC;
+			memcpy(op, ip, bsize);
+			ip += bsize;
+			op += bsize;
+			break;
+		case ZSTD_BLOCK_RLE:
+			if (iend - ip < 1)
+				return -EBADMSG;
+			if (bsize > oend - op)
+				return -ENOSPC;
+			memset(op, *ip, bsize);
+			ip++;
+			op += bsize;
+			break;
+		case ZSTD_BLOCK_COMPRESSED:
+			if (bsize > iend - ip || bsize > ZSTD_BLOCKSIZE_MAX)
+				return -EBADMSG;
+			ret = zstd_decode_block(dctx, ip, bsize, op, oend,
+						frame_start);
+			if (ret < 0)
+				return ret;
+			ip += bsize;
+			op += ret;
+			break;
+		default:
+			return -EBADMSG;
+		}
+	} while (!last);
+
+	if (nf && op - frame_start != content_size)
+		return -EBADMSG;
+
+	if (checksum) {
+		if (iend - ip < 4)
+			return -EBADMSG;
+		if ((u32)zstd_xxh64(frame_start, op - frame_start) !=
+		    get_unaligned_le32(ip))
+			return -EBADMSG;
+		ip += 4;
+	}
+
+	*opp = op;
+	return ip - src;
+}
+
+size_t zstd_decompress_workspace_size(size_t dst_len)
+{
+	return sizeof(struct zstd_dctx) +
+	       min_t(size_t, dst_len, ZSTD_BLOCKSIZE_MAX) + ZSTD_LIT_PAD;
+}
+EXPORT_SYMBOL(zstd_decompress_workspace_size);
+
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		    unsigned char *dst, size_t *dst_len,
+		    void *wrkmem, size_t wrkmem_size)
+{
+	struct zstd_dctx *dctx = wrkmem;
+	const u8 *ip = src, *iend = src + src_len;
+	u8 *op = dst, *oend = dst + *dst_len;
+
+	if (wrkmem_size < sizeof(*dctx) + ZSTD_LIT_PAD)
+		return -EINVAL;
+	dctx->lit_cap = wrkmem_size - sizeof(*dctx) - ZSTD_LIT_PAD;
+	dctx->ll.entries = dctx->ll_entries;
+	dctx->of.entries = dctx->of_entries;
+	dctx->ml.entries = dctx->ml_entries;
+
+	if (!src_len)
+		return -EBADMSG;
+
+	while (ip < iend) {
+		u32 magic;
+		ssize_t ret;
+
+		if (iend - ip < 4)
+			return -EBADMSG;
+		magic = get_unaligned_le32(ip);
+
+		if ((magic & ZSTD_MAGIC_SKIP_MASK) == ZSTD_MAGIC_SKIPPABLE) {
+			u32 skip;
+
+			if (iend - ip < 8)
+				return -EBADMSG;
+			skip = get_unaligned_le32(ip + 4);
+			if (skip > iend - ip - 8)
+				return -EBADMSG;
+			ip += 8 + skip;
+			continue;
+		}
+		if (magic != ZSTD_MAGIC)
+			return -EBADMSG;
+
+		ret = zstd_decode_frame(dctx, ip, iend - ip, &op, oend);
+		if (ret < 0)
+			return ret;
+		ip += ret;
+	}
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(zstd_decompress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Decompressor");
@@ -0,0 +1,127 @@
+/*
+ * zstd_internal.h -- format constants and tables shared by the Zstandard
+ * compressor and decompressor
+ *
+ * The frame, block and entropy layouts follow RFC 8878. Tables are
+ * static so that lib/zstd/compress.c and lib/zstd/decompress.c can be
+ * built as independent modules.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ZSTD_INTERNAL_H__
+#define __ZSTD_INTERNAL_H__
+
+#include <linux/types.h>
+#include <linux/bitops.h>
+
+#define ZSTD_MAGIC		0xFD2FB528U
+#define ZSTD_MAGIC_SKIPPABLE	0x184D2A50U
+#define ZSTD_MAGIC_SKIP_MASK	0xFFFFFFF0U
+
+#define ZSTD_FRAME_HEADER_MAX	18	/* magic + FHD + WD + dictID + FCS */
+#define ZSTD_BLOCK_HEADER_SIZE	3
+
+enum zstd_block_type {
+	ZSTD_BLOCK_RAW,
+	ZSTD_BLOCK_RLE,
+	ZSTD_BLOCK_COMPRESSED,
+	ZSTD_BLOCK_RESERVED,
+};
+
+enum zstd_lit_type {
+	ZSTD_LIT_RAW,
+	ZSTD_LIT_RLE,
+	ZSTD_LIT_COMPRESSED,
+	ZSTD_LIT_TREELESS,
+};
+
+enum zstd_seq_mode {
+	ZSTD_SEQ_PREDEFINED,
+	ZSTD_SEQ_RLE,
+	ZSTD_SEQ_FSE,
+	ZSTD_SEQ_REPEAT,
+};
+
+#define ZSTD_MINMATCH		3	/* smallest match the format encodes */
+#define ZSTD_REP_NUM		3
+
+/* Huffman literals */
+#define ZSTD_HUF_MAX_BITS	11
+#define ZSTD_HUF_MAX_SYMBOL	255
+#define ZSTD_HUF_WEIGHT_LOG	6	/* accuracy of FSE-compressed weights */
+
+/* FSE-coded sequence symbols */
+#define ZSTD_LL_MAX_SYMBOL	35
+#define ZSTD_ML_MAX_SYMBOL	52
+#define ZSTD_OF_MAX_SYMBOL	31
+#define ZSTD_LL_MAX_LOG		9
+#define ZSTD_ML_MAX_LOG		9
+#define ZSTD_OF_MAX_LOG		8
+#define ZSTD_FSE_MIN_LOG	5
+#define ZSTD_FSE_MAX_SYMBOL	ZSTD_ML_MAX_SYMBOL
+
+#define ZSTD_LL_DEFAULT_LOG	6
+#define ZSTD_ML_DEFAULT_LOG	6
+#define ZSTD_OF_DEFAULT_LOG	5
+
+static const u32 zstd_ll_base[ZSTD_LL_MAX_SYMBOL + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512,
+	1024, 2048, 4096, 8192, 16384, 32768, 65536,
+};
+
+static const u8 zstd_ll_bits[ZSTD_LL_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16,
+};
+
+static const u32 zstd_ml_base[ZSTD_ML_MAX_SYMBOL + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515,
+	1027, 2051, 4099, 8195, 16387, 32771, 65539,
+};
+
+static const u8 zstd_ml_bits[ZSTD_ML_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16,
+};
+
+/* Predefined distributions, -1 marks a "less than 1" probability */
+static const s16 zstd_ll_default_norm[ZSTD_LL_MAX_SYMBOL + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+
+static const s16 zstd_ml_default_norm[ZSTD_ML_MAX_SYMBOL + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+
+#define ZSTD_OF_DEFAULT_MAX	28
+
+static const s16 zstd_of_default_norm[ZSTD_OF_DEFAULT_MAX + 1] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+
+static inline unsigned int zstd_highbit32(u32 val)
+{
+	return fls(val) - 1;
+}
+
+/* Step used to spread symbols over an FSE table, RFC 8878 4.1.1 */
+static inline u32 zstd_fse_step(u32 table_size)
+{
+	return (table_size >> 1) + (table_size >> 3) + 3;
+}
+
+#endif
@@ -1332,7 +1332,7 @@ int p9_client_create_dotl(struct p9_fid *ofid, char *name, u32 flags, u32 mode,
 			(unsigned long long)qid->path,
 			qid->version, iounit);
 
-	ofid->mode = mode;
+	ofid->mode = flags;
 	ofid->iounit = iounit;
 
 free_and_error:
@@ -1584,8 +1584,11 @@ p9_client_read(struct p9_fid *fid, char *data, char __user *udata, u64 offset,
 	if (count < rsize)
 		rsize = count;
 
-	/* Don't bother zerocopy for small IO (< 1024) */
-	if (clnt->trans_mod->zc_request && rsize > 1024) {
+	/*
+	 * Zero copy even small reads: the payload then lands in place
+	 * rather than being copied out of a msize response buffer.
+	 */
+	if (clnt->trans_mod->zc_request && rsize) {
 		char *indata;
 		if (data) {
 			kernel_buf = 1;
@@ -1659,8 +1662,7 @@ p9_client_write(struct p9_fid *fid, char *data, const char __user *udata,
 	if (count < rsize)
 		rsize = count;
 
-	/* Don't bother zerocopy for small IO (< 1024) */
-	if (clnt->trans_mod->zc_request && rsize > 1024) {
+	if (clnt->trans_mod->zc_request && rsize) {
 		char *odata;
 		if (data) {
 			kernel_buf = 1;
@@ -2275,6 +2277,42 @@ error:
 }
 EXPORT_SYMBOL(p9_client_getlock_dotl);
 
+/**
+ * p9_client_invalidate - wait for server side changes
+ * @fid: any fid of the attach
+ * @nqids: number of qids returned
+ * @qids: qids of the objects that changed, to be freed by the caller
+ *
+ * Tinvalidate is a 9P2000.L extension: the server holds the request
+ * until objects the client may have cached change.  Servers without
+ * it answer with an error.
+ */
+int p9_client_invalidate(struct p9_fid *fid, int16_t *nqids,
+			 struct p9_qid **qids)
+{
+	int err;
+	struct p9_client *clnt;
+	struct p9_req_t *req;
+
+	clnt = fid->clnt;
+	p9_debug(P9_DEBUG_9P, ">>> TINVALIDATE fid %d\n", fid->fid);
+
+	req = p9_client_rpc(clnt, P9_TINVALIDATE, "d", fid->fid);
+	if (IS_ERR(req))
+		return PTR_ERR(req);
+
+	err = p9pdu_readf(req->rc, clnt->proto_version, "R", nqids, qids);
+	if (err) {
+		trace_9p_protocol_dump(clnt, req->rc);
+		goto error;
+	}
+	p9_debug(P9_DEBUG_9P, "<<< RINVALIDATE nqid %d\n", *nqids);
+error:
+	p9_free_req(clnt, req);
+	return err;
+}
+EXPORT_SYMBOL(p9_client_invalidate);
+
 int p9_client_readlink(struct p9_fid *fid, char **target)
 {
 	int err;
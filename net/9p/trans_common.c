@@ -14,11 +14,19 @@
 
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/swap.h>
+#include <linux/wait.h>
 #include <net/9p/9p.h>
 #include <net/9p/client.h>
+#include <net/9p/transport.h>
 #include <linux/scatterlist.h>
 #include "trans_common.h"
 
+/* User pages pinned for zero copy I/O, by transports and by v9fs */
+static atomic_t p9_pinned = ATOMIC_INIT(0);
+static unsigned long p9_max_pinned;
+static DECLARE_WAIT_QUEUE_HEAD(p9_pinned_wq);
+
 /**
  *  p9_release_req_pages - Release pages after the transaction.
  */
@@ -67,3 +75,43 @@ int p9_payload_gup(char *data, int *nr_pages, struct page **pages, int write)
 	return 0;
 }
 EXPORT_SYMBOL(p9_payload_gup);
+
+/**
+ * p9_pin_account - count user pages about to be pinned for zero copy I/O
+ * @nr_pages: number of pages
+ *
+ * Waits while the pages pinned so far have reached the ceiling.  Returns
+ * -ERESTARTSYS if killed while waiting.
+ */
+int p9_pin_account(int nr_pages)
+{
+	int err;
+
+	/* Ceiling limit to avoid denial of service attacks */
+	if (!p9_max_pinned)
+		p9_max_pinned = nr_free_buffer_pages() / 4;
+
+	if (atomic_read(&p9_pinned) >= p9_max_pinned) {
+		err = wait_event_killable(p9_pinned_wq,
+			(atomic_read(&p9_pinned) < p9_max_pinned));
+		if (err)
+			return err;
+	}
+	atomic_add(nr_pages, &p9_pinned);
+	return 0;
+}
+EXPORT_SYMBOL(p9_pin_account);
+
+/**
+ * p9_pin_release - uncount pages counted by p9_pin_account()
+ * @nr_pages: number of pages
+ */
+void p9_pin_release(int nr_pages)
+{
+	if (!nr_pages)
+		return;
+	atomic_sub(nr_pages, &p9_pinned);
+	/* wakeup anybody waiting for slots to pin pages */
+	wake_up(&p9_pinned_wq);
+}
+EXPORT_SYMBOL(p9_pin_release);
@@ -46,7 +46,6 @@
 #include <net/9p/client.h>
 #include <net/9p/transport.h>
 #include <linux/scatterlist.h>
-#include <linux/swap.h>
 #include <linux/virtio.h>
 #include <linux/virtio_9p.h>
 #include "trans_common.h"
@@ -55,8 +54,6 @@
 
 /* a single mutex to manage channel initialization and attachment */
 static DEFINE_MUTEX(virtio_9p_lock);
-static DECLARE_WAIT_QUEUE_HEAD(vp_wq);
-static atomic_t vp_pinned = ATOMIC_INIT(0);
 
 /**
  * struct virtio_chan - per-instance transport information
@@ -84,10 +81,6 @@ struct virtio_chan {
 	struct virtqueue *vq;
 	int ring_bufs_avail;
 	wait_queue_head_t *vc_wq;
-	/* This is global limit. Since we don't have a global structure,
-	 * will be placing it in each channel.
-	 */
-	unsigned long p9_max_pages;
 	/* Scatterlist: can be too big for stack. */
 	struct scatterlist sg[VIRTQUEUE_NUM];
 
@@ -320,20 +313,21 @@ static int p9_get_mapped_pages(struct virtio_chan *chan,
 {
 	int err;
 	if (!kern_buf) {
+		int count = nr_pages;
+
 		/*
-		 * We allow only p9_max_pages pinned. We wait for the
+		 * Only so many pages may be pinned. We wait for the
 		 * Other zc request to finish here
 		 */
-		if (atomic_read(&vp_pinned) >= chan->p9_max_pages) {
-			err = wait_event_killable(vp_wq,
-			      (atomic_read(&vp_pinned) < chan->p9_max_pages));
-			if (err == -ERESTARTSYS)
-				return err;
-		}
+		err = p9_pin_account(count);
+		if (err)
+			return err;
 		err = p9_payload_gup(data, &nr_pages, pages, write);
-		if (err < 0)
+		if (err < 0) {
+			p9_pin_release(count);
 			return err;
-		atomic_add(nr_pages, &vp_pinned);
+		}
+		p9_pin_release(count - nr_pages);
 	} else {
 		/* kernel buffer, no need to pin pages */
 		int s, index = 0;
@@ -481,14 +475,12 @@ err_out:
 	if (!kern_buf) {
 		if (in_pages) {
 			p9_release_pages(in_pages, in_nr_pages);
-			atomic_sub(in_nr_pages, &vp_pinned);
+			p9_pin_release(in_nr_pages);
 		}
 		if (out_pages) {
 			p9_release_pages(out_pages, out_nr_pages);
-			atomic_sub(out_nr_pages, &vp_pinned);
+			p9_pin_release(out_nr_pages);
 		}
-		/* wakeup anybody waiting for slots to pin pages */
-		wake_up(&vp_wq);
 	}
 	kfree(in_pages);
 	kfree(out_pages);
@@ -572,8 +564,6 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 	}
 	init_waitqueue_head(chan->vc_wq);
 	chan->ring_bufs_avail = 1;
-	/* Ceiling limit to avoid denial of service attacks */
-	chan->p9_max_pages = nr_free_buffer_pages()/4;
 
 	virtio_device_ready(vdev);
 
@@ -0,0 +1,174 @@
+/*
+ * fsync latency benchmark for jbd2 journalled filesystems
+ *
+ * Repeatedly writes a small amount of data to a file and fsyncs it, then
+ * reports the fsync latency distribution.  Given the journal's statistics
+ * directory it also reports how many transactions were committed and how
+ * many fsyncs were served by fast commits while the benchmark ran:
+ *
+ *	# fsync-bench -j /proc/fs/jbd2/sda2-8 /mnt/test/file
+ *	# fsync-bench -a -s 512 -n 10000 /mnt/test/file
+ *
+ * Licensed under GPL version 2 only.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_COUNT	1000
+#define DEFAULT_SIZE	4096
+
+struct jbd2_counters {
+	unsigned long transactions;
+	unsigned long fast_commits;
+	unsigned long fallbacks;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-a] [-n count] [-s bytes] [-j jbd2-dir] <file>\n"
+		"  -a        append instead of overwriting the start of the file\n"
+		"  -n count  number of write+fsync rounds (default %d)\n"
+		"  -s bytes  bytes written per round (default %d)\n"
+		"  -j dir    /proc/fs/jbd2/<dev> of the filesystem holding <file>\n",
+		prog, DEFAULT_COUNT, DEFAULT_SIZE);
+	exit(EXIT_FAILURE);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int read_counters(const char *dir, struct jbd2_counters *c)
+{
+	char path[4096], line[256];
+	FILE *f;
+
+	memset(c, 0, sizeof(*c));
+	snprintf(path, sizeof(path), "%s/info", dir);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lu transactions", &c->transactions) == 1)
+			continue;
+		sscanf(line, "%lu fast commits, %lu fsyncs", &c->fast_commits,
+		       &c->fallbacks);
+	}
+	fclose(f);
+	return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	struct jbd2_counters before, after;
+	const char *jbd2_dir = NULL;
+	size_t size = DEFAULT_SIZE;
+	int count = DEFAULT_COUNT;
+	int append = 0;
+	double *lat, start, total = 0;
+	char *buf;
+	int fd, opt, i;
+
+	while ((opt = getopt(argc, argv, "an:s:j:")) != -1) {
+		switch (opt) {
+		case 'a':
+			append = 1;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			jbd2_dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || count <= 0 || !size)
+		usage(argv[0]);
+
+	buf = malloc(size);
+	lat = calloc(count, sizeof(*lat));
+	if (!buf || !lat) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	memset(buf, 0x5a, size);
+
+	fd = open(argv[optind], O_WRONLY | O_CREAT | (append ? O_APPEND : 0),
+		  0644);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	/* Start from a stable file so the first round is not special */
+	if (fsync(fd) < 0) {
+		perror("fsync");
+		return EXIT_FAILURE;
+	}
+
+	if (jbd2_dir && read_counters(jbd2_dir, &before))
+		return EXIT_FAILURE;
+
+	for (i = 0; i < count; i++) {
+		ssize_t n = append ? write(fd, buf, size) :
+				     pwrite(fd, buf, size, 0);
+
+		if (n != (ssize_t)size) {
+			perror("write");
+			return EXIT_FAILURE;
+		}
+		start = now_us();
+		if (fsync(fd) < 0) {
+			perror("fsync");
+			return EXIT_FAILURE;
+		}
+		lat[i] = now_us() - start;
+		total += lat[i];
+	}
+	close(fd);
+
+	qsort(lat, count, sizeof(*lat), cmp_double);
+	printf("%d fsyncs of %zu byte %s: avg %.1f us, min %.1f, "
+	       "p50 %.1f, p99 %.1f, max %.1f\n",
+	       count, size, append ? "appends" : "overwrites", total / count,
+	       lat[0], lat[count / 2], lat[count * 99 / 100], lat[count - 1]);
+
+	if (jbd2_dir) {
+		if (read_counters(jbd2_dir, &after))
+			return EXIT_FAILURE;
+		printf("journal: %lu full commits, %lu fast commits, "
+		       "%lu fast commit fallbacks\n",
+		       after.transactions - before.transactions,
+		       after.fast_commits - before.fast_commits,
+		       after.fallbacks - before.fallbacks);
+	}
+
+	free(lat);
+	free(buf);
+	return EXIT_SUCCESS;
+}
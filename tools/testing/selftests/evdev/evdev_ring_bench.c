@@ -0,0 +1,420 @@
+/*
+ * evdev event delivery latency benchmark
+ *
+ * Creates a uinput device reporting ABS_X/ABS_Y packets at a touchscreen
+ * like rate and has several clients read its event device, first with
+ * read() and then through the mapped shared ring.  Every packet carries its
+ * sequence number, so each client checks that it saw all of them in order,
+ * and the time from the write() to uinput to the client having the packet
+ * is reported per mode.
+ *
+ * Needs /dev/uinput and permission to open the event devices.
+ */
+
+#define _GNU_SOURCE
+#define __EXPORTED_HEADERS__
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+enum { MODE_READ, MODE_MMAP };
+static const char * const mode_names[] = { "read", "mmap" };
+
+static unsigned int nr_readers = 4;
+static unsigned int nr_packets = 2400;
+static unsigned int period_us = 4166;		/* 240 Hz */
+
+static char event_path[300];
+static uint64_t *send_ns;
+static pthread_barrier_t start_barrier;
+
+struct reader {
+	pthread_t thread;
+	int mode;
+	uint64_t *lat;
+	unsigned int got;
+	unsigned int expected;
+	unsigned int lost;
+	unsigned int dropped;
+	int error;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* A packet with sequence number @seq (from 1) is complete */
+static void packet_done(struct reader *r, unsigned int seq)
+{
+	uint64_t now = now_ns();
+
+	if (!seq || seq > nr_packets)
+		return;
+	if (seq > r->expected)
+		r->lost += seq - r->expected;
+	if (seq >= r->expected)
+		r->expected = seq + 1;
+	r->lat[r->got++] = now - send_ns[seq - 1];
+}
+
+static int wait_input(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int ret;
+
+	ret = poll(&pfd, 1, 1000);
+	if (ret < 0)
+		return -errno;
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+static int read_events(struct reader *r, int fd)
+{
+	struct input_event ev[64];
+	unsigned int seq = 0;
+	ssize_t len;
+	int i, ret;
+
+	while (r->expected <= nr_packets) {
+		ret = wait_input(fd);
+		if (ret)
+			return ret;
+
+		len = read(fd, ev, sizeof(ev));
+		if (len < 0)
+			return -errno;
+
+		for (i = 0; i < len / sizeof(ev[0]); i++) {
+			if (ev[i].type == EV_ABS && ev[i].code == ABS_X)
+				seq = ev[i].value;
+			else if (ev[i].type == EV_SYN &&
+				 ev[i].code == SYN_DROPPED)
+				r->dropped++;
+			else if (ev[i].type == EV_SYN &&
+				 ev[i].code == SYN_REPORT)
+				packet_done(r, seq);
+		}
+	}
+	return 0;
+}
+
+static int mmap_events(struct reader *r, int fd)
+{
+	struct evdev_ring_info info;
+	struct evdev_ring_header *hdr;
+	struct evdev_ring_event *ring, *e, copy;
+	unsigned int tail, packet_head, seq = 0;
+	uint32_t s1, s2;
+	void *map;
+	int ret = 0;
+
+	if (ioctl(fd, EVIOCGRINGINFO, &info) < 0)
+		return -errno;
+	if (info.version != EVDEV_RING_VERSION)
+		return -EPROTO;
+
+	map = mmap(NULL, info.length, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+	hdr = map;
+	ring = map + info.offset;
+	tail = __atomic_load_n(&hdr->packet_head, __ATOMIC_ACQUIRE);
+
+	while (r->expected <= nr_packets) {
+		ret = wait_input(fd);
+		if (ret)
+			break;
+
+		packet_head = __atomic_load_n(&hdr->packet_head,
+					      __ATOMIC_ACQUIRE);
+		while (tail != packet_head) {
+			e = &ring[tail & (info.size - 1)];
+
+			s1 = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+			copy = *e;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			s2 = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+
+			if (s1 != (tail & ~EVDEV_RING_BUSY) || s2 != s1 ||
+			    __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) -
+			    tail > info.size) {
+				/* Lapped: resume at the last packet boundary */
+				r->dropped++;
+				tail = packet_head;
+				break;
+			}
+			tail++;
+
+			if (copy.grab && copy.grab != info.id)
+				continue;
+			if (copy.type == EV_ABS && copy.code == ABS_X)
+				seq = copy.value;
+			else if (copy.type == EV_SYN &&
+				 copy.code == SYN_REPORT)
+				packet_done(r, seq);
+		}
+
+		/* Lets poll() sleep until the next packet */
+		if (ioctl(fd, EVIOCSRINGTAIL, &tail) < 0) {
+			ret = -errno;
+			break;
+		}
+	}
+
+	munmap(map, info.length);
+	return ret;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader *r = arg;
+	int clkid = CLOCK_MONOTONIC;
+	int fd;
+
+	fd = open(event_path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0 || ioctl(fd, EVIOCSCLOCKID, &clkid) < 0)
+		r->error = -errno;
+	r->expected = 1;
+
+	pthread_barrier_wait(&start_barrier);
+	if (r->error)
+		goto out;
+
+	if (r->mode == MODE_READ)
+		r->error = read_events(r, fd);
+	else
+		r->error = mmap_events(r, fd);
+out:
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+static int create_device(void)
+{
+	struct uinput_user_dev udev;
+	char sysname[64], path[128];
+	struct dirent *de;
+	DIR *dir;
+	int fd, i;
+
+	fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror("/dev/uinput");
+		return -1;
+	}
+
+	memset(&udev, 0, sizeof(udev));
+	snprintf(udev.name, sizeof(udev.name), "evdev ring bench");
+	udev.id.bustype = BUS_VIRTUAL;
+	udev.absmax[ABS_X] = udev.absmax[ABS_Y] = 1 << 30;
+
+	if (ioctl(fd, UI_SET_EVBIT, EV_SYN) < 0 ||
+	    ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_X) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_Y) < 0 ||
+	    write(fd, &udev, sizeof(udev)) != sizeof(udev) ||
+	    ioctl(fd, UI_DEV_CREATE) < 0 ||
+	    ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+		perror("uinput setup");
+		close(fd);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "/sys/class/input/%s", sysname);
+	dir = opendir(path);
+	if (!dir) {
+		perror(path);
+		goto err;
+	}
+	while ((de = readdir(dir)) != NULL)
+		if (!strncmp(de->d_name, "event", 5))
+			snprintf(event_path, sizeof(event_path),
+				 "/dev/input/%s", de->d_name);
+	closedir(dir);
+	if (!event_path[0]) {
+		fprintf(stderr, "%s has no event device\n", path);
+		goto err;
+	}
+
+	/* Give udev a chance to create the node */
+	for (i = 0; i < 100 && access(event_path, R_OK); i++)
+		usleep(10000);
+	if (access(event_path, R_OK)) {
+		perror(event_path);
+		goto err;
+	}
+	return fd;
+err:
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	return -1;
+}
+
+static int send_packets(int fd)
+{
+	struct input_event ev[3];
+	struct timespec next;
+	unsigned int i;
+
+	memset(ev, 0, sizeof(ev));
+	ev[0].type = EV_ABS;
+	ev[0].code = ABS_X;
+	ev[1].type = EV_ABS;
+	ev[1].code = ABS_Y;
+	ev[2].type = EV_SYN;
+	ev[2].code = SYN_REPORT;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < nr_packets; i++) {
+		next.tv_nsec += period_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		/* Values must change, or the input core drops them */
+		ev[0].value = ev[1].value = i + 1;
+		send_ns[i] = now_ns();
+		if (write(fd, ev, sizeof(ev)) != sizeof(ev)) {
+			perror("uinput write");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int run_mode(int ufd, int mode)
+{
+	struct reader *readers;
+	uint64_t *all, sum = 0;
+	unsigned int i, n = 0, lost = 0, dropped = 0;
+	int ret = 0;
+
+	readers = calloc(nr_readers, sizeof(*readers));
+	all = calloc((size_t)nr_readers * nr_packets, sizeof(*all));
+	if (!readers || !all) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	pthread_barrier_init(&start_barrier, NULL, nr_readers + 1);
+	for (i = 0; i < nr_readers; i++) {
+		readers[i].mode = mode;
+		readers[i].lat = all + (size_t)i * nr_packets;
+		pthread_create(&readers[i].thread, NULL, reader_thread,
+			       &readers[i]);
+	}
+	pthread_barrier_wait(&start_barrier);
+
+	if (send_packets(ufd))
+		ret = -1;
+
+	for (i = 0; i < nr_readers; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].error) {
+			fprintf(stderr, "%s reader %u: %s\n", mode_names[mode],
+				i, strerror(-readers[i].error));
+			ret = -1;
+		}
+		/* Packets that never arrived */
+		lost += readers[i].lost + nr_packets + 1 - readers[i].expected;
+		dropped += readers[i].dropped;
+	}
+	pthread_barrier_destroy(&start_barrier);
+
+	/* Gather the latencies of all readers */
+	for (i = 0; i < nr_readers; i++) {
+		memmove(all + n, readers[i].lat,
+			readers[i].got * sizeof(*all));
+		n += readers[i].got;
+	}
+	for (i = 0; i < n; i++)
+		sum += all[i];
+	qsort(all, n, sizeof(*all), cmp_u64);
+
+	if (n)
+		printf("%-4s %u readers %u packets: avg %" PRIu64 " us, p50 %" PRIu64
+		       " us, p99 %" PRIu64 " us, max %" PRIu64
+		       " us, lost %u, dropped %u\n",
+		       mode_names[mode], nr_readers, n, sum / n / 1000,
+		       all[n / 2] / 1000, all[n * 99 / 100] / 1000,
+		       all[n - 1] / 1000, lost, dropped);
+	if (lost)
+		ret = -1;
+
+	free(all);
+	free(readers);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ufd, ret = 0;
+
+	while ((opt = getopt(argc, argv, "r:n:p:")) != -1) {
+		switch (opt) {
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 'n':
+			nr_packets = atoi(optarg);
+			break;
+		case 'p':
+			period_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r readers] [-n packets] [-p period_us]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!nr_readers || !nr_packets)
+		return 1;
+
+	send_ns = calloc(nr_packets, sizeof(*send_ns));
+	if (!send_ns)
+		return 1;
+
+	ufd = create_device();
+	if (ufd < 0)
+		return 1;
+
+	if (run_mode(ufd, MODE_READ))
+		ret = 1;
+	if (run_mode(ufd, MODE_MMAP))
+		ret = 1;
+
+	ioctl(ufd, UI_DEV_DESTROY);
+	close(ufd);
+	free(send_ns);
+
+	printf("evdev_ring_bench: %s\n", ret ? "[FAIL]" : "[PASS]");
+	return ret;
+}
@@ -0,0 +1,148 @@
+/*
+ * Metadata lookup benchmark for 9p mounts
+ *
+ * Creates a directory of files, then stats every file and a missing
+ * name next to each one for a number of rounds, and reports the rate of
+ * positive and negative lookups.  Comparing mounts with and without the
+ * actimeo= and negtimeo= options shows what the metadata cache saves:
+ *
+ *	# mount -t 9p -o trans=virtio,version=9p2000.L,actimeo=5,negtimeo=5 \
+ *	    share /mnt/9p
+ *	# stat-bench -n 10000 -i 10 /mnt/9p/stat-bench
+ *
+ * Licensed under GPL version 2 only.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_FILES	1000
+#define DEFAULT_ROUNDS	10
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-k] [-n files] [-i rounds] <dir>\n"
+		"  -k         keep the files afterwards\n"
+		"  -n files   number of files (default %d)\n"
+		"  -i rounds  times every name is looked up (default %d)\n",
+		prog, DEFAULT_FILES, DEFAULT_ROUNDS);
+	exit(EXIT_FAILURE);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_files(const char *dir, int files)
+{
+	char path[PATH_MAX];
+	int i, fd;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		perror(dir);
+		return -1;
+	}
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/f%d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+static void remove_files(const char *dir, int files)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/f%d", dir, i);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+/* Stat "<dir>/<prefix><i>" for every file; returns lookups per second */
+static double bench_stat(const char *dir, const char *prefix, int files,
+			 int rounds, int expect)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	double start;
+	int r, i, ret;
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < files; i++) {
+			snprintf(path, sizeof(path), "%s/%s%d", dir, prefix,
+				 i);
+			ret = stat(path, &st);
+			if ((ret == 0) != expect) {
+				fprintf(stderr, "%s: unexpected %s\n", path,
+					ret ? strerror(errno) : "success");
+				return -1;
+			}
+		}
+	}
+	return (double)files * rounds / (now() - start);
+}
+
+int main(int argc, char **argv)
+{
+	int files = DEFAULT_FILES, rounds = DEFAULT_ROUNDS;
+	double pos, neg;
+	const char *dir;
+	int keep = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "kn:i:")) != -1) {
+		switch (opt) {
+		case 'k':
+			keep = 1;
+			break;
+		case 'n':
+			files = atoi(optarg);
+			break;
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || files <= 0 || rounds <= 0)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create_files(dir, files))
+		return EXIT_FAILURE;
+
+	pos = bench_stat(dir, "f", files, rounds, 1);
+	neg = pos < 0 ? -1 : bench_stat(dir, "missing", files, rounds, 0);
+
+	if (!keep)
+		remove_files(dir, files);
+	if (pos < 0 || neg < 0)
+		return EXIT_FAILURE;
+
+	printf("%d files, %d rounds: %.0f stats/s, %.0f missing stats/s\n",
+	       files, rounds, pos, neg);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+ * Sequential throughput benchmark for 9p over virtio
+ *
+ * Writes a file in fixed size blocks, drops it from the page cache and
+ * reads it back, reporting the throughput of both phases.  With large
+ * blocks or the page cache enabled each call spans several 9p messages,
+ * which the client keeps in flight in parallel:
+ *
+ *	# mount -t 9p -o trans=virtio,version=9p2000.L,msize=524288 \
+ *	    share /mnt/9p
+ *	# virtfs-bench -b 4194304 -m 1024 /mnt/9p/bench
+ *	# virtfs-bench -r /mnt/9p/bench
+ *
+ * Licensed under GPL version 2 only.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MB	256
+#define DEFAULT_BUF	(1024 * 1024)
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-r] [-b bytes] [-m MiB] <file>\n"
+		"  -r        only read back an existing file\n"
+		"  -b bytes  bytes per read() or write() (default %d)\n"
+		"  -m MiB    file size (default %d)\n",
+		prog, DEFAULT_BUF, DEFAULT_MB);
+	exit(EXIT_FAILURE);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *phase, long long done, double secs)
+{
+	printf("%s: %lld bytes in %.3f s, %.1f MB/s\n", phase, done, secs,
+	       done / secs / 1e6);
+}
+
+static long long bench_write(int fd, char *buf, size_t bufsize,
+			     long long total)
+{
+	long long done = 0;
+	ssize_t n;
+
+	while (done < total) {
+		n = write(fd, buf, bufsize);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		done += n;
+	}
+	if (fsync(fd) < 0) {
+		perror("fsync");
+		return -1;
+	}
+	return done;
+}
+
+static long long bench_read(int fd, char *buf, size_t bufsize)
+{
+	long long done = 0;
+	ssize_t n;
+
+	for (;;) {
+		n = read(fd, buf, bufsize);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			return -1;
+		}
+		if (!n)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+int main(int argc, char **argv)
+{
+	size_t bufsize = DEFAULT_BUF;
+	long long total = (long long)DEFAULT_MB << 20;
+	long long done;
+	int read_only = 0;
+	double start;
+	char *buf;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "rb:m:")) != -1) {
+		switch (opt) {
+		case 'r':
+			read_only = 1;
+			break;
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			total = strtoll(optarg, NULL, 0) << 20;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !bufsize || total <= 0)
+		usage(argv[0]);
+
+	buf = malloc(bufsize);
+	if (!buf) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	memset(buf, 0x5a, bufsize);
+
+	fd = open(argv[optind], read_only ? O_RDONLY :
+		  O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	if (!read_only) {
+		start = now();
+		done = bench_write(fd, buf, bufsize, total);
+		if (done < 0)
+			return EXIT_FAILURE;
+		report("write", done, now() - start);
+		if (lseek(fd, 0, SEEK_SET) < 0) {
+			perror("lseek");
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Not fatal: without a page cache there is nothing to drop */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	start = now();
+	done = bench_read(fd, buf, bufsize);
+	if (done < 0)
+		return EXIT_FAILURE;
+	report("read", done, now() - start);
+
+	close(fd);
+	free(buf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/*
+ * Receive throughput benchmark for virtio serial ports
+ *
+ * Reads a fixed amount of data from a port with read(), or splices it
+ * through a pipe into /dev/null, and reports the throughput and the
+ * bytes moved per system call.
+ *
+ * The host has to keep the port busy, for instance:
+ *
+ *	# mkfifo /tmp/vport-bench.in /tmp/vport-bench.out
+ *	# qemu ... -device virtio-serial-pci,id=virtio-serial0 \
+ *	    -chardev pipe,id=bench,path=/tmp/vport-bench \
+ *	    -device virtserialport,bus=virtio-serial0.0,chardev=bench,\
+ *	    name=vport-bench
+ *	# cat /dev/zero > /tmp/vport-bench.in
+ *
+ * and in the guest:
+ *
+ *	# vport-bench /dev/virtio-ports/vport-bench
+ *	# vport-bench -s /dev/virtio-ports/vport-bench
+ *
+ * Licensed under GPL version 2 only.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MB	256
+#define DEFAULT_BUF	(64 * 1024)
+#define PIPE_SIZE	(1024 * 1024)
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s] [-b bytes] [-m MiB] <port>\n"
+		"  -s        splice through a pipe instead of read()\n"
+		"  -b bytes  bytes asked for per call (default %d)\n"
+		"  -m MiB    data to receive (default %d)\n",
+		prog, DEFAULT_BUF, DEFAULT_MB);
+	exit(EXIT_FAILURE);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long bench_read(int fd, size_t bufsize, long long total,
+			    long long *calls)
+{
+	long long done = 0;
+	char *buf;
+	ssize_t n;
+
+	buf = malloc(bufsize);
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+
+	while (done < total) {
+		n = read(fd, buf, bufsize);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			break;
+		}
+		if (!n) {
+			fprintf(stderr, "host disconnected\n");
+			break;
+		}
+		(*calls)++;
+		done += n;
+	}
+
+	free(buf);
+	return done;
+}
+
+static long long bench_splice(int fd, size_t bufsize, long long total,
+			      long long *calls)
+{
+	long long done = 0;
+	int p[2], null;
+	ssize_t n, out;
+
+	null = open("/dev/null", O_WRONLY);
+	if (null < 0) {
+		perror("/dev/null");
+		return -1;
+	}
+	if (pipe(p) < 0) {
+		perror("pipe");
+		close(null);
+		return -1;
+	}
+	/* Not fatal: the default pipe only holds less per call */
+	fcntl(p[1], F_SETPIPE_SZ, PIPE_SIZE);
+
+	while (done < total) {
+		n = splice(fd, NULL, p[1], NULL, bufsize, SPLICE_F_MOVE);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("splice from port");
+			break;
+		}
+		if (!n) {
+			fprintf(stderr, "host disconnected\n");
+			break;
+		}
+		(*calls)++;
+		done += n;
+
+		while (n > 0) {
+			out = splice(p[0], NULL, null, NULL, n, SPLICE_F_MOVE);
+			if (out < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("splice to /dev/null");
+				goto out;
+			}
+			n -= out;
+		}
+	}
+out:
+	close(p[0]);
+	close(p[1]);
+	close(null);
+	return done;
+}
+
+int main(int argc, char **argv)
+{
+	size_t bufsize = DEFAULT_BUF;
+	long long total = (long long)DEFAULT_MB << 20;
+	long long done, calls = 0;
+	int use_splice = 0;
+	double start, secs;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "sb:m:")) != -1) {
+		switch (opt) {
+		case 's':
+			use_splice = 1;
+			break;
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			total = strtoll(optarg, NULL, 0) << 20;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !bufsize || total <= 0)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	start = now();
+	if (use_splice)
+		done = bench_splice(fd, bufsize, total, &calls);
+	else
+		done = bench_read(fd, bufsize, total, &calls);
+	secs = now() - start;
+	close(fd);
+
+	if (done <= 0)
+		return EXIT_FAILURE;
+
+	printf("%s: %lld bytes in %.3f s, %.1f MB/s, %lld calls, %lld bytes per call\n",
+	       use_splice ? "splice" : "read", done, secs, done / secs / 1e6,
+	       calls, calls ? done / calls : 0);
+	return done < total ? EXIT_FAILURE : EXIT_SUCCESS;
+}